@@ -12,10 +12,23 @@
 #define PACKET_SIZE 256 // bytes
 #define BYTE_SIZE 8 // number of bits in a byte
 
+//Ground bytes received by the USART1 interrupt and not yet read, a power of two. Holds what the
+//ground sends while the main loop is busy with the payload.
+#define COMMS_RX_LEN 1024
+//A packet still not complete this long after poll_packet first saw its head was cut on the line;
+//its first byte is dropped to find the next head
+#define COMMS_RX_GAP_MS 100
+
+extern volatile uint32_t commsRxOverruns; // bytes lost, ring full or UART overrun
+extern uint32_t commsRxSkipped; // bytes dropped looking for a packet head
+
 /*FUNCTION PROTOTYPES-----------------------------------------------------------------------------*/
 void clearArray(uint8_t *buf);
 void print_buffer(uint8_t *buf, int size);
+void comms_rx_start(void);
 uint8_t receive_packet(uint8_t *buf);
+uint8_t poll_packet(uint8_t *buf, uint32_t timeout);
+void send_packet(uint8_t adr, uint8_t flg, uint8_t *data, uint8_t len);
 //uint8_t mram_packet(uint8_t *pointer, uint8_t *mram_pointer);
 uint8_t check_start_protocol(uint8_t *buf);
 void get_address(uint8_t *buf, uint8_t *adr);
@@ -0,0 +1,94 @@
+/*
+ * imgdl.h
+ *	Description: Chunked, resumable image downlink. The image on the TX2 is cut into
+ *				 IMGDL_CHUNK_LEN byte chunks, read from the TX2 by offset and sent to the
+ *				 ground numbered, in any order. The ground keeps a bitmap of the chunks it has
+ *				 (ground_station/imgdl.py) and asks only for the missing ranges, in the same
+ *				 pass or the next one. What is still to be sent is kept in flash, so a CDH
+ *				 reset resumes where it stopped instead of starting over. Chunks are only sent
+ *				 for IMGDL_PASS_MS after the START of the pass, so nothing goes out with no
+ *				 ground in view.
+ *
+ *	Ground commands (address 1, flag 0):
+ *	  IMGDL_CMD_START  [image][flags]		  open image "output/fire<image>.txt" and drop the
+ *	  										  ranges of the last pass, the ground asks again for
+ *	  										  what it still misses; IMGDL_RESTART also forgets the
+ *	  										  end and digest of the image, IMGDL_COMPRESS lets the
+ *	  										  chunks of this image go compressed
+ *	  IMGDL_CMD_RANGE  [first hi][first lo][count hi][count lo]
+ *	  										  send chunks first to first + count - 1,
+ *	  										  count IMGDL_TO_END for all up to the end
+ *
+ *	Downlink (address 1, flag 1), [type][...]:
+ *	  IMGDL_INFO   [image][chunks hi][chunks lo][chunk length][shasum, 32 bytes][flags]
+ *	  			   chunks is 0 while the end of the image is not known, flags the START
+ *	  			   flags the CDH took (IMGDL_COMPRESS)
+ *	  IMGDL_CHUNK  [index hi][index lo][IMGDL_CHUNK_LEN bytes]
+ *	  IMGDL_LAST   [index hi][index lo][0 to IMGDL_CHUNK_LEN bytes], the end of the image
+ *	  IMGDL_ZCHUNK, IMGDL_ZLAST
+ *	  			   as IMGDL_CHUNK and IMGDL_LAST with the bytes as one LZSS stream (lzss.h),
+ *	  			   only for an image started with IMGDL_COMPRESS and only where it is shorter
+ *
+ *	TX2: REQUEST_PACKET with data [offset, 4 bytes big endian][length hi][length lo][path]
+ *	reads the file from the offset; reply 7 means the offset is past its end.
+ */
+
+#ifndef IMGDL_H_
+#define IMGDL_H_
+
+#include "payload.h"
+
+#define IMGDL_CMD_START 0x02
+#define IMGDL_CMD_RANGE 0x03
+#define IMGDL_RESTART 0x01
+#define IMGDL_COMPRESS 0x02
+#define IMGDL_TO_END 0xFFFF
+
+#define IMGDL_INFO  'I'
+#define IMGDL_CHUNK 'C'
+#define IMGDL_LAST  'E'
+#define IMGDL_ZCHUNK 'c'
+#define IMGDL_ZLAST  'e'
+
+#define IMGDL_CHUNK_LEN 192 // with the 3 byte chunk header, fits one bridge packet
+#define IMGDL_RANGES 8 // range requests kept, more are dropped until these are sent
+#define IMGDL_SAVE_EVERY 16 // chunks sent between saves, at most these are sent again after a reset
+#define IMGDL_PASS_MS 600000 // chunks are sent this long after a START, the longest pass
+
+// The state is appended to one of two 128 KB flash banks, sectors 6 and 7, which the linker
+// script keeps free. When a bank is full the next record starts the other one, erased beforehand
+// by imgdl_idle() once the pass is over, so the newest record is never erased and no erase
+// stalls the CPU while chunks go out.
+#define IMGDL_FLASH_SECTOR FLASH_SECTOR_6 // of the first bank, the second is the next sector
+#define IMGDL_FLASH_ADDR 0x08040000
+#define IMGDL_FLASH_SIZE 0x20000 // per bank
+#define IMGDL_MAGIC 0x494D444C
+
+/* Structures -----------------------------------------------*/
+
+// Description: Transfer state as saved in flash, a multiple of 4 bytes. The newest record with a
+//				good check word is the state; a record cut by a reset is skipped.
+typedef struct {
+	uint32_t magic;
+	uint32_t seq; // counts saves
+	uint16_t chunks; // 0 while the end is not known
+	uint8_t image;
+	uint8_t opened; // shasum holds the digest the TX2 reported for the image
+	uint8_t numRanges;
+	uint8_t flags; // IMGDL_COMPRESS of the START
+	uint8_t pad[2];
+	uint8_t shasum[SHA256_DIGEST_LEN];
+	uint16_t first[IMGDL_RANGES]; // first chunk still to be sent of each range
+	uint16_t count[IMGDL_RANGES]; // chunks left, or IMGDL_TO_END
+	uint32_t check;
+} ImgdlState;
+
+/* Function Prototypes -----------------------------------------------*/
+void imgdl_init(Queue *que);
+void imgdl_command(uint8_t cmd, uint8_t *data, Queue *que);
+uint8_t imgdl_next(Queue *que);
+void imgdl_opened(uint8_t *sha);
+void imgdl_chunk(uint8_t *data, uint16_t len);
+void imgdl_idle(void);
+
+#endif
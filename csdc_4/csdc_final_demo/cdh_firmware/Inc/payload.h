@@ -11,6 +11,7 @@
 #include "stm32f4xx_hal.h"
 #include <stdlib.h>
 #include <string.h>
+#include "sha256.h"
 
 #define TRUE 1
 #define FALSE 0
@@ -0,0 +1,70 @@
+/*
+ * sha256.h
+ *	Description: Streaming SHA-256 and HMAC-SHA-256 (FIPS 180-4, RFC 2104).
+ *		     Data can be fed in arbitrary sized pieces as they arrive
+ *		     from the UART, so commands and downloads are verified
+ *		     without buffering them first.
+ */
+
+#ifndef INC_SHA256_H_
+#define INC_SHA256_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SHA256_BLOCK_LEN 64
+#define SHA256_DIGEST_LEN 32
+
+typedef struct
+{
+  uint32_t state[8];
+  uint32_t block[SHA256_BLOCK_LEN / 4];
+  uint64_t total_len;
+  size_t block_len;
+} sha256_ctx_t;
+
+/**
+ * Pre-processed HMAC key. Holds the SHA-256 state after absorbing the
+ * inner and outer padded key, so each new message only pays for its own
+ * blocks.
+ */
+typedef struct
+{
+  uint32_t istate[8];
+  uint32_t ostate[8];
+} hmac_sha256_key_t;
+
+typedef struct
+{
+  sha256_ctx_t ctx;
+  const hmac_sha256_key_t *key;
+} hmac_sha256_ctx_t;
+
+int32_t
+sha256_init (sha256_ctx_t *h);
+
+int32_t
+sha256_update (sha256_ctx_t *h, const uint8_t *in, size_t len);
+
+int32_t
+sha256_final (sha256_ctx_t *h, uint8_t *digest);
+
+int32_t
+sha256 (uint8_t *digest, const uint8_t *in, size_t len);
+
+int32_t
+hmac_sha256_set_key (hmac_sha256_key_t *k, const uint8_t *key, size_t key_len);
+
+int32_t
+hmac_sha256_init (hmac_sha256_ctx_t *h, const hmac_sha256_key_t *k);
+
+int32_t
+hmac_sha256_update (hmac_sha256_ctx_t *h, const uint8_t *in, size_t len);
+
+int32_t
+hmac_sha256_final (hmac_sha256_ctx_t *h, uint8_t *mac);
+
+uint8_t
+sha256_equal (const uint8_t *a, const uint8_t *b, size_t len);
+
+#endif /* INC_SHA256_H_ */
@@ -48,6 +48,7 @@
 void SysTick_Handler(void);
 void TIM2_IRQHandler(void);
 void TIM5_IRQHandler(void);
+void USART1_IRQHandler(void);
 
 #ifdef __cplusplus
 }
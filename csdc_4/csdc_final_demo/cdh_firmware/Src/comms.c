@@ -3,6 +3,17 @@
 UART_HandleTypeDef huart1;
 UART_HandleTypeDef huart2;
 
+// The receive ring of USART1. The interrupt writes the bytes and rxHead, the main loop reads them
+// and moves rxTail; the indices run freely and are masked on access.
+static uint8_t rxRing[COMMS_RX_LEN];
+static volatile uint16_t rxHead;
+static volatile uint16_t rxTail;
+static uint8_t rxByte;
+static uint8_t rxWaiting;
+static uint32_t rxWaitStart;
+volatile uint32_t commsRxOverruns;
+uint32_t commsRxSkipped;
+
 // Description: This function writes null bytes to the buffer array passed to it
 // Input: pointer to buffer that needs to be cleared
 void clear_array(uint8_t *buf) {
@@ -23,36 +34,140 @@ void clear_array(uint8_t *buf) {
 	}
 }*/
 
-// Description: Tries to receive a packet. If a packet is received, the function
-//				saves the packet at the input pointer. Additionally, it returns 1 once
-//        the packet has been saved. The function returns 0 if it is unable to
-//				receive.
-// Input: pointer to where the packet is to be saved
-// Returns: Confirmation on successful reception of packet.
-uint8_t receive_packet(uint8_t *buf) {
-	// Creates temporary buffer for receiving the packet.
-	uint8_t tempBuffer[PACKET_SIZE];
-	uint8_t packetSize = 0;
-	uint8_t commandLength[2][3] = {{0,0,0},
-								 {8,1,2}};
+// Data bytes after the header of each command, by address and command. The image downlink
+// commands are imgdl.h.
+static const uint8_t commandLength[2][4] = {{0,0,0,0},
+											{8,1,2,4}};
 
-	// Saves the packet in the temporary buffer.
-	while(HAL_UART_Receive(&huart1, tempBuffer, 2, 0x0FFF) != HAL_OK);
+// Description: Returns the number of bytes that follow the two header bytes of a packet: the
+//				length field for data, the command length for commands. A command that is not
+//				in commandLength has none.
+// Input: pointer to the header of the packet
+static uint8_t packet_size(uint8_t *buf) {
+	uint8_t adr = (buf[0] >> 1) & 0x07;
+
+	if((buf[0] & 0x01) == 1)
+		return buf[1];
+	if(adr < 2 && buf[1] < 4)
+		return commandLength[adr][buf[1]];
+	return 0;
+}
+
+// Description: Starts receiving from the ground in the background. From here on every byte goes
+//				into the receive ring as it arrives, also while the main loop waits on the payload.
+void comms_rx_start(void) {
+	rxHead = rxTail = 0;
+	rxWaiting = 0;
+	HAL_UART_Receive_IT(&huart1, &rxByte, 1);
+}
 
-	if((tempBuffer[0] & 0x01) == 1)
-		packetSize = tempBuffer[1];
+// Description: A byte of USART1 arrived. Stores it in the receive ring and waits for the next one.
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+	if(huart != &huart1)
+		return;
+	if((uint16_t)(rxHead - rxTail) < COMMS_RX_LEN) {
+		rxRing[rxHead & (COMMS_RX_LEN - 1)] = rxByte;
+		__DMB(); // the byte before the index that hands it over
+		rxHead++;
+	}
 	else
-		packetSize = commandLength[((tempBuffer[0]>>1) & 0x07)][tempBuffer[1]];
+		commsRxOverruns++;
+	HAL_UART_Receive_IT(&huart1, &rxByte, 1);
+}
+
+// Description: An overrun or framing error stopped the reception, start it again.
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart) {
+	if(huart != &huart1)
+		return;
+	commsRxOverruns++;
+	HAL_UART_Receive_IT(&huart1, &rxByte, 1);
+}
 
-	while (HAL_UART_Receive(&huart1, (tempBuffer + 2), packetSize, 0x0FFF) != HAL_OK);
+// Description: The byte i places after the oldest one in the receive ring
+static uint8_t rx_at(uint16_t i) {
+	return rxRing[(uint16_t)(rxTail + i) & (COMMS_RX_LEN - 1)];
+}
+
+// Description: Takes a whole packet out of the receive ring if there is one. Bytes that cannot
+//				start a packet are dropped, and so is the first byte of a packet that stays
+//				incomplete for COMMS_RX_GAP_MS, so a lost byte on the line costs one packet only.
+// Input: pointer to where the packet is to be saved
+// Returns: 1 if a packet was saved, 0 if there is none yet
+static uint8_t take_packet(uint8_t *buf) {
+	uint16_t used = rxHead - rxTail;
+	uint16_t size;
+	uint8_t head;
 
-	for (int i = 0; i < PACKET_SIZE; i += 1) {
-		*(buf + i) = tempBuffer[i];
+	while(used) {
+		head = rx_at(0);
+		if(check_start_protocol(&head))
+			break;
+		rxTail++;
+		used--;
+		commsRxSkipped++;
+		rxWaiting = 0;
 	}
+	if(used >= 2) {
+		buf[0] = rx_at(0);
+		buf[1] = rx_at(1);
+		size = 2 + packet_size(buf);
+		if(used >= size) {
+			for(uint16_t i = 2; i < size; i++)
+				buf[i] = rx_at(i);
+			__DMB(); // done with the bytes before the interrupt may reuse them
+			rxTail += size;
+			rxWaiting = 0;
+			return 1;
+		}
+	}
+	if(used) {
+		if(!rxWaiting) {
+			rxWaiting = 1;
+			rxWaitStart = HAL_GetTick();
+		}
+		else if(HAL_GetTick() - rxWaitStart > COMMS_RX_GAP_MS) {
+			rxTail++;
+			commsRxSkipped++;
+			rxWaiting = 0;
+		}
+	}
+	return 0;
+}
 
+// Description: Waits for a packet from the ground and saves it at the input pointer.
+// Input: pointer to where the packet is to be saved
+// Returns: Confirmation on successful reception of packet.
+uint8_t receive_packet(uint8_t *buf) {
+	while(!take_packet(buf));
 	return 1;
 }
 
+// Description: Like receive_packet, but returns 0 when no whole packet is there within the
+//				timeout, so the main loop can go on with the payload while the ground is quiet.
+//				What the ground sent in the meantime waits in the receive ring.
+// Input: pointer to where the packet is to be saved, time to wait in ms
+// Returns: 1 if a packet was saved, 0 if none arrived
+uint8_t poll_packet(uint8_t *buf, uint32_t timeout) {
+	uint32_t start = HAL_GetTick();
+
+	do {
+		if(take_packet(buf))
+			return 1;
+	} while(HAL_GetTick() - start < timeout);
+	return 0;
+}
+
+// Description: Sends a packet to the ground through the comms board, [head][length][data]
+// Input: address and flag of the head, the data and its length
+void send_packet(uint8_t adr, uint8_t flg, uint8_t *data, uint8_t len) {
+	uint8_t head[2];
+
+	head[0] = 0x60 | (adr << 1) | flg;
+	head[1] = len;
+	HAL_UART_Transmit(&huart1, head, 2, 0x0FFF);
+	HAL_UART_Transmit(&huart1, data, len, 0x0FFF);
+}
+
 // Description: Transmit a string over huart2. If solder bridges SB13 and SB14 are not removed,
 //				this will transmit a message to the STLink chip and can be printed on a serial monitor
 //				directly (such as the Arduino serial monitor). Otherwise, need to connect the huart2 pins to
@@ -131,8 +246,13 @@ void save_data(uint8_t *buf, uint8_t *data, uint8_t *len_command) {
 	}
 }
 
+// Description: Saves the data of a command, as many bytes as commandLength gives it, into the
+// data pointer.
 void save_command(uint8_t * buf, uint8_t *data, uint8_t *len_command) {
-
+	uint8_t size = packet_size(buf);
+	for (int x = 0; x < size; x++) {
+		*(data + x) = *(buf + 2 + x);
+	}
 }
 
 
@@ -0,0 +1,314 @@
+/*
+ * imgdl.c
+ *	Description: Chunked, resumable image downlink, see imgdl.h. The ground asks for chunk
+ *				 ranges, imgdl_next() queues the TX2 read of the next chunk still to be sent and
+ *				 imgdl_chunk() sends what the TX2 answered to the ground.
+ */
+#include "imgdl.h"
+#include "comms.h"
+#include "lzss.h"
+#include <stddef.h>
+
+static ImgdlState state;
+static uint32_t saveAddr; // where the next record goes
+static uint16_t sinceSave; // chunks sent since the last save
+static uint16_t requested; // chunk asked of the TX2
+static uint32_t passStart; // tick of the last START, when the ground came in view
+static uint8_t spareErased; // the bank the next record does not go to is known to be erased
+static char path[] = "output/fire0.txt";
+static uint8_t request[6 + sizeof(path)]; // REQUEST_PACKET data, kept until it is sent
+static lzss_enc_t enc; // compresses one chunk at a time
+
+/* Description: FNV-1a over the record up to its check word
+ */
+static uint32_t check_word(const ImgdlState *s){
+	const uint8_t *p = (const uint8_t*)s;
+	uint32_t h = 2166136261u;
+
+	for(int i = 0; i < offsetof(ImgdlState, check); i++)
+		h = (h ^ p[i]) * 16777619u;
+	return h;
+}
+
+/* Description: Start address of a bank
+ */
+static uint32_t bank_addr(int bank){
+	return IMGDL_FLASH_ADDR + bank * IMGDL_FLASH_SIZE;
+}
+
+/* Description: The bank the next record does not go to. A full first bank ends where the
+ * 				second one starts.
+ */
+static int spare_bank(){
+	return saveAddr <= bank_addr(1) ? 1 : 0;
+}
+
+/* Description: Checks that every word of a bank is erased; an erase cut by a reset can leave
+ * 				any of them programmed.
+ */
+static uint8_t bank_erased(int bank){
+	for(uint32_t addr = bank_addr(bank); addr < bank_addr(bank) + IMGDL_FLASH_SIZE; addr += 4)
+		if(*(const uint32_t*)addr != 0xFFFFFFFF)
+			return FALSE;
+	return TRUE;
+}
+
+/* Description: Erases a bank. Takes a second or two with the CPU stalled.
+ */
+static void erase_bank(int bank){
+	FLASH_EraseInitTypeDef erase;
+	uint32_t sectorError;
+
+	erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+	erase.Sector = IMGDL_FLASH_SECTOR + bank;
+	erase.NbSectors = 1;
+	erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+	HAL_FLASH_Unlock();
+	HAL_FLASHEx_Erase(&erase, &sectorError);
+	HAL_FLASH_Lock();
+}
+
+/* Description: Appends the state to the current bank, or starts the spare bank when it is full.
+ * 				The spare bank is only erased here if imgdl_idle() has not done it yet.
+ */
+static void save(){
+	uint32_t *word = (uint32_t*)&state;
+	int spare = spare_bank();
+
+	state.magic = IMGDL_MAGIC;
+	state.seq++;
+	state.check = check_word(&state);
+	sinceSave = 0;
+
+	if(saveAddr + sizeof(ImgdlState) > bank_addr(1 - spare) + IMGDL_FLASH_SIZE){
+		if(!spareErased && !bank_erased(spare))
+			erase_bank(spare);
+		saveAddr = bank_addr(spare);
+		spareErased = FALSE; // the bank just filled
+	}
+	HAL_FLASH_Unlock();
+	for(int i = 0; i < sizeof(ImgdlState) / 4; i++)
+		HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, saveAddr + 4 * i, word[i]);
+	HAL_FLASH_Lock();
+	saveAddr += sizeof(ImgdlState);
+}
+
+/* Description: Forgets the first range
+ */
+static void pop_range(){
+	for(int i = 1; i < state.numRanges; i++){
+		state.first[i - 1] = state.first[i];
+		state.count[i - 1] = state.count[i];
+	}
+	state.numRanges--;
+}
+
+/* Description: Queues the START_DOWNLOAD of the image, whose reply goes to imgdl_opened()
+ */
+static void open_image(Queue *que){
+	path[11] = '0' + state.image;
+	enqueue(createMessage(START_DOWNLOAD, strlen(path), (uint8_t*)path), que);
+}
+
+/* Description: Sends the ground what it needs to know of the transfer: the image, its length
+ * 				in chunks once known, and the digest to check it with.
+ */
+static void send_info(){
+	uint8_t info[6 + SHA256_DIGEST_LEN];
+
+	info[0] = IMGDL_INFO;
+	info[1] = state.image;
+	info[2] = state.chunks >> 8;
+	info[3] = state.chunks & 0xFF;
+	info[4] = IMGDL_CHUNK_LEN;
+	memcpy(info + 5, state.shasum, SHA256_DIGEST_LEN);
+	info[5 + SHA256_DIGEST_LEN] = state.flags;
+	send_packet(1, 1, info, sizeof(info));
+}
+
+/* Description: Compresses a chunk on its own, so that each one can be unpacked whichever others
+ * 				are lost
+ * Inputs: The chunk and its length, where the stream goes, at least as long as the chunk
+ * Output: The length of the stream, 0 if it is not shorter than the chunk
+ */
+static uint16_t pack(const uint8_t *data, uint16_t len, uint8_t *out){
+	size_t n;
+
+	if(len == 0 || lzss_enc_init(&enc) != 0 || lzss_enc_sink(&enc, data, len) != len)
+		return 0;
+	lzss_enc_finish(&enc);
+	if(lzss_enc_poll(&enc, out, len - 1, &n) != LZSS_DONE)
+		return 0; // did not fit in fewer bytes
+	return n;
+}
+
+/* Description: Loads the newest saved state of the two banks and, if chunks were still to be
+ * 				sent when the CDH stopped, opens the image again to go on with them.
+ * Input: Queue of the payload commands
+ */
+void imgdl_init(Queue *que){
+	const ImgdlState *rec;
+	uint32_t addr;
+
+	memset(&state, 0, sizeof(ImgdlState));
+	// With no records yet, start in the first bank if it is clean, else take it as full so that
+	// the first save goes to the second one
+	saveAddr = bank_erased(0) ? bank_addr(0) : bank_addr(1);
+	spareErased = FALSE;
+	for(int bank = 0; bank < 2; bank++){
+		for(addr = bank_addr(bank); addr + sizeof(ImgdlState) <= bank_addr(bank) + IMGDL_FLASH_SIZE;
+				addr += sizeof(ImgdlState)){
+			rec = (const ImgdlState*)addr;
+			if(rec->magic == 0xFFFFFFFF)
+				break; // erased, the end of the records
+			if(rec->magic == IMGDL_MAGIC && rec->check == check_word(rec) && rec->seq > state.seq){
+				memcpy(&state, rec, sizeof(ImgdlState));
+				saveAddr = 0; // the end of this bank, below
+			}
+		}
+		if(saveAddr == 0)
+			saveAddr = addr;
+	}
+	// The CDH keeps no time across a reset: what is left may go out for one more pass length
+	passStart = HAL_GetTick();
+	if(state.numRanges > 0)
+		open_image(que);
+}
+
+/* Description: Handles an image downlink command from the ground
+ * Inputs: Command number, its data as parse_packet saved it, queue of the payload commands
+ */
+void imgdl_command(uint8_t cmd, uint8_t *data, Queue *que){
+	uint16_t first, count;
+
+	switch(cmd){
+		case IMGDL_CMD_START:
+			if(data[0] > 9)
+				break;
+			passStart = HAL_GetTick();
+			if(data[0] != state.image || (data[1] & IMGDL_RESTART)){
+				state.image = data[0];
+				state.chunks = 0;
+				state.opened = FALSE;
+			}
+			state.flags = data[1] & IMGDL_COMPRESS;
+			// A new pass: the ground follows with the ranges it still misses
+			state.numRanges = 0;
+			save();
+			open_image(que);
+			break;
+
+		case IMGDL_CMD_RANGE:
+			first = ((uint16_t)data[0] << 8) | data[1];
+			count = ((uint16_t)data[2] << 8) | data[3];
+			if(count == 0 || state.numRanges == IMGDL_RANGES)
+				break;
+			for(int i = 0; i < state.numRanges; i++)
+				if(state.first[i] == first && state.count[i] == count)
+					return; // a repeat of a range not sent yet
+			state.first[state.numRanges] = first;
+			state.count[state.numRanges] = count;
+			state.numRanges++;
+			save();
+			break;
+	}
+}
+
+/* Description: Queues the TX2 read of the next chunk the ground asked for, while the pass lasts
+ * Input: Queue of the payload commands
+ * Output: True if a read was queued, False if nothing is left to send or the pass is over
+ */
+uint8_t imgdl_next(Queue *que){
+	uint32_t offset;
+
+	if(!state.opened || HAL_GetTick() - passStart > IMGDL_PASS_MS)
+		return FALSE;
+	while(state.numRanges > 0 && state.chunks && state.first[0] >= state.chunks)
+		pop_range(); // past the end of the image
+	if(state.numRanges == 0)
+		return FALSE;
+
+	requested = state.first[0];
+	offset = (uint32_t)requested * IMGDL_CHUNK_LEN;
+	request[0] = offset >> 24;
+	request[1] = (offset >> 16) & 0xFF;
+	request[2] = (offset >> 8) & 0xFF;
+	request[3] = offset & 0xFF;
+	request[4] = 0;
+	request[5] = IMGDL_CHUNK_LEN;
+	memcpy(request + 6, path, strlen(path));
+	enqueue(createMessage(REQUEST_PACKET, 6 + strlen(path), request), que);
+	return TRUE;
+}
+
+/* Description: Takes the digest the TX2 reported on START_DOWNLOAD. If it is not the one of
+ * 				the saved transfer, the image changed and what was still to be sent is dropped.
+ * Input: The 32 byte digest
+ */
+void imgdl_opened(uint8_t *sha){
+	if(state.opened && memcmp(sha, state.shasum, SHA256_DIGEST_LEN) != 0){
+		state.chunks = 0;
+		state.numRanges = 0;
+	}
+	memcpy(state.shasum, sha, SHA256_DIGEST_LEN);
+	state.opened = TRUE;
+	save();
+	send_info();
+}
+
+/* Description: Sends the chunk the TX2 answered to the ground and moves on. A short chunk, or
+ * 				none when the offset is past the end of the file, is the last one. It goes
+ * 				compressed if the START of the image asked for that and it comes out shorter.
+ * Input: The chunk, NULL when the TX2 replied that the offset is past the end, and its length
+ */
+void imgdl_chunk(uint8_t *data, uint16_t len){
+	uint8_t frame[3 + IMGDL_CHUNK_LEN];
+	uint8_t last;
+	uint16_t packed = 0;
+
+	if(data == NULL)
+		len = 0;
+	if(len > IMGDL_CHUNK_LEN)
+		len = IMGDL_CHUNK_LEN;
+	last = len < IMGDL_CHUNK_LEN;
+	if(state.flags & IMGDL_COMPRESS)
+		packed = pack(data, len, frame + 3);
+	if(packed > 0)
+		frame[0] = last ? IMGDL_ZLAST : IMGDL_ZCHUNK;
+	else{
+		frame[0] = last ? IMGDL_LAST : IMGDL_CHUNK;
+		if(len > 0)
+			memcpy(frame + 3, data, len);
+		packed = len;
+	}
+	frame[1] = requested >> 8;
+	frame[2] = requested & 0xFF;
+	send_packet(1, 1, frame, 3 + packed);
+
+	if(state.numRanges > 0 && state.first[0] == requested){
+		state.first[0]++;
+		if(state.count[0] != IMGDL_TO_END)
+			state.count[0]--;
+		if(state.count[0] == 0)
+			pop_range();
+	}
+	if(last){
+		state.chunks = requested + 1;
+		save();
+	}
+	else if(++sinceSave >= IMGDL_SAVE_EVERY)
+		save();
+}
+
+/* Description: Erases the spare bank once the pass is over, so that a full bank never waits for
+ * 				an erase while chunks are going out. Call when there is nothing else to do.
+ */
+void imgdl_idle(void){
+	int spare = spare_bank();
+
+	if(spareErased || HAL_GetTick() - passStart <= IMGDL_PASS_MS)
+		return;
+	if(!bank_erased(spare))
+		erase_bank(spare);
+	spareErased = TRUE;
+}
@@ -0,0 +1,387 @@
+/*
+ * lzss.c
+ *	Description: Streaming LZSS compressor and decompressor.
+ *
+ *	The encoder keeps the history and the not yet encoded input in one
+ *	buffer of twice the window. Earlier occurrences of each 3 byte prefix
+ *	are linked in hash chains, so finding a match checks a handful of
+ *	candidates instead of scanning the whole window. When the buffer fills
+ *	up its upper half slides down and the chains are rebased.
+ */
+
+#include "lzss.h"
+#include <string.h>
+
+#define LZSS_NIL (-1)
+
+static inline uint16_t
+lzss_hash (const uint8_t *p)
+{
+  return (uint16_t) (((p[0] << 6) ^ (p[1] << 3) ^ p[2])
+      & ((1 << LZSS_HASH_BITS) - 1));
+}
+
+static inline void
+lzss_put_bits (lzss_enc_t *h, uint32_t v, uint8_t n)
+{
+  h->bits = (h->bits << n) | v;
+  h->nbits += n;
+}
+
+/**
+ * Moves the complete bytes of the bit accumulator to the output
+ */
+static inline size_t
+lzss_flush_bits (lzss_enc_t *h, uint8_t *out)
+{
+  size_t n = 0;
+  while (h->nbits >= 8) {
+    h->nbits -= 8;
+    out[n++] = (uint8_t) (h->bits >> h->nbits);
+  }
+  return n;
+}
+
+/**
+ * Links into the hash chains every position before \p upto that has a
+ * complete 3 byte prefix
+ */
+static inline void
+lzss_enc_insert (lzss_enc_t *h, size_t upto)
+{
+  uint16_t k;
+  while (h->hashed < upto && h->hashed + LZSS_MIN_MATCH <= h->end) {
+    k = lzss_hash (h->buf + h->hashed);
+    h->prev[h->hashed] = h->head[k];
+    h->head[k] = (int16_t) h->hashed;
+    h->hashed++;
+  }
+}
+
+/**
+ * Slides the upper half of the buffer down once the encoder has moved past
+ * it, making room for new input. The hash chains are rebased and entries
+ * that fell out of the buffer are dropped.
+ */
+static void
+lzss_enc_slide (lzss_enc_t *h)
+{
+  size_t i;
+  int16_t v;
+
+  if (h->end < 2 * LZSS_WINDOW_LEN || h->pos < LZSS_WINDOW_LEN) {
+    return;
+  }
+
+  /* A long match may have jumped ahead of the chains, catch up first */
+  lzss_enc_insert (h, h->pos);
+
+  memcpy (h->buf, h->buf + LZSS_WINDOW_LEN, LZSS_WINDOW_LEN);
+  for (i = 0; i < (1 << LZSS_HASH_BITS); i++) {
+    v = h->head[i];
+    h->head[i] = v >= LZSS_WINDOW_LEN ? v - LZSS_WINDOW_LEN : LZSS_NIL;
+  }
+  for (i = 0; i < LZSS_WINDOW_LEN; i++) {
+    v = h->prev[i + LZSS_WINDOW_LEN];
+    h->prev[i] = v >= LZSS_WINDOW_LEN ? v - LZSS_WINDOW_LEN : LZSS_NIL;
+  }
+  h->pos -= LZSS_WINDOW_LEN;
+  h->end -= LZSS_WINDOW_LEN;
+  h->hashed = h->hashed > LZSS_WINDOW_LEN ? h->hashed - LZSS_WINDOW_LEN : 0;
+}
+
+/**
+ * Finds the longest earlier occurrence of the data at the current position
+ * @param h the encoder
+ * @param max_len the longest match allowed
+ * @param dist the distance of the match, if any
+ * @return the length of the match, 0 if none was found
+ */
+static size_t
+lzss_enc_match (lzss_enc_t *h, size_t max_len, size_t *dist)
+{
+  const uint8_t *cur = h->buf + h->pos;
+  int32_t cand;
+  size_t best = 0;
+  size_t len;
+  uint8_t chain = LZSS_MAX_CHAIN;
+
+  if (max_len < LZSS_MIN_MATCH) {
+    return 0;
+  }
+
+  cand = h->head[lzss_hash (cur)];
+  while (cand != LZSS_NIL && h->pos - cand <= LZSS_WINDOW_LEN && chain--) {
+    const uint8_t *p = h->buf + cand;
+    /* Cheap rejection on the byte that would make this match longer */
+    if (p[best] == cur[best] && p[0] == cur[0]) {
+      for (len = 1; len < max_len && p[len] == cur[len]; len++)
+	;
+      if (len > best) {
+	best = len;
+	*dist = h->pos - cand;
+	if (best == max_len) {
+	  break;
+	}
+      }
+    }
+    cand = h->prev[cand];
+  }
+  return best >= LZSS_MIN_MATCH ? best : 0;
+}
+
+/**
+ * Initializes the encoder
+ * @param h the encoder handle
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+lzss_enc_init (lzss_enc_t *h)
+{
+  if (!h) {
+    return -1;
+  }
+  memset (h->head, 0xFF, sizeof(h->head));
+  h->pos = LZSS_WINDOW_LEN;
+  h->end = LZSS_WINDOW_LEN;
+  h->hashed = LZSS_WINDOW_LEN;
+  h->bits = 0;
+  h->nbits = 0;
+  h->header_sent = 0;
+  h->finishing = 0;
+  return 0;
+}
+
+/**
+ * Copies input data into the encoder
+ * @param h the encoder handle
+ * @param in the input data
+ * @param len the size of the input data
+ * @return the number of bytes accepted. Can be less than \p len when the
+ * buffer is full; call lzss_enc_poll() and sink the rest afterwards.
+ */
+size_t
+lzss_enc_sink (lzss_enc_t *h, const uint8_t *in, size_t len)
+{
+  size_t n;
+
+  if (!h || !in || h->finishing) {
+    return 0;
+  }
+  lzss_enc_slide (h);
+  n = 2 * LZSS_WINDOW_LEN - h->end;
+  if (n > len) {
+    n = len;
+  }
+  memcpy (h->buf + h->end, in, n);
+  h->end += n;
+  return n;
+}
+
+/**
+ * Marks the end of the input. The following lzss_enc_poll() calls encode the
+ * remaining data and flush the last bits.
+ */
+int32_t
+lzss_enc_finish (lzss_enc_t *h)
+{
+  if (!h) {
+    return -1;
+  }
+  h->finishing = 1;
+  return 0;
+}
+
+/**
+ * Encodes the buffered input
+ * @param h the encoder handle
+ * @param out the output buffer
+ * @param out_cap the size of the output buffer
+ * @param out_len the number of bytes written to \p out
+ * @return LZSS_MORE_INPUT if the encoder needs more input to continue,
+ * LZSS_OK if the output buffer is full, LZSS_DONE when the input has been
+ * finished and everything has been written, or LZSS_ERROR.
+ */
+lzss_status_t
+lzss_enc_poll (lzss_enc_t *h, uint8_t *out, size_t out_cap, size_t *out_len)
+{
+  size_t n = 0;
+  size_t avail;
+  size_t len;
+  size_t dist;
+
+  if (!h || !out || !out_len) {
+    return LZSS_ERROR;
+  }
+
+  /* A symbol plus the pending bits never take more than 4 bytes */
+  while (out_cap - n >= 4) {
+    if (!h->header_sent) {
+      out[n++] = (LZSS_WINDOW_BITS << 4) | LZSS_LENGTH_BITS;
+      h->header_sent = 1;
+      continue;
+    }
+
+    avail = h->end - h->pos;
+    if (avail == 0 || (avail < LZSS_MAX_MATCH && !h->finishing)) {
+      lzss_enc_slide (h);
+      if (!h->finishing) {
+	*out_len = n;
+	return LZSS_MORE_INPUT;
+      }
+      /* Zero pad the last byte */
+      if (h->nbits) {
+	out[n++] = (uint8_t) (h->bits << (8 - h->nbits));
+	h->nbits = 0;
+      }
+      *out_len = n;
+      return LZSS_DONE;
+    }
+
+    lzss_enc_insert (h, h->pos);
+    len = lzss_enc_match (h, avail < LZSS_MAX_MATCH ? avail : LZSS_MAX_MATCH,
+			  &dist);
+    if (len) {
+      lzss_put_bits (h, 0, 1);
+      lzss_put_bits (h, dist - 1, LZSS_WINDOW_BITS);
+      lzss_put_bits (h, len - LZSS_MIN_MATCH, LZSS_LENGTH_BITS);
+      h->pos += len;
+    }
+    else {
+      lzss_put_bits (h, 0x100 | h->buf[h->pos], 9);
+      h->pos++;
+    }
+    n += lzss_flush_bits (h, out + n);
+  }
+  *out_len = n;
+  return LZSS_OK;
+}
+
+/**
+ * Initializes the decoder
+ * @param h the decoder handle
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+lzss_dec_init (lzss_dec_t *h)
+{
+  if (!h) {
+    return -1;
+  }
+  memset (h->window, 0, sizeof(h->window));
+  h->wpos = 0;
+  h->bits = 0;
+  h->nbits = 0;
+  h->state = LZSS_DEC_HEADER;
+  h->copy_dist = 0;
+  h->copy_left = 0;
+  return 0;
+}
+
+/**
+ * Decompresses a piece of an LZSS stream. Can be called repeatedly with
+ * consecutive pieces of the stream.
+ * @param h the decoder handle
+ * @param out the output buffer
+ * @param out_cap the size of the output buffer
+ * @param out_len the number of bytes written to \p out
+ * @param in the compressed data
+ * @param len the size of the compressed data
+ * @param consumed the number of input bytes used. When the output buffer
+ * fills up some input may be left for the next call.
+ * @return LZSS_MORE_INPUT if all input was used, LZSS_OK if the output
+ * buffer is full, or LZSS_ERROR for a stream the decoder cannot handle.
+ */
+lzss_status_t
+lzss_decode (lzss_dec_t *h, uint8_t *out, size_t out_cap, size_t *out_len,
+	     const uint8_t *in, size_t len, size_t *consumed)
+{
+  const size_t mask = LZSS_WINDOW_LEN - 1;
+  size_t i = 0;
+  size_t n = 0;
+  uint8_t need;
+  uint8_t b;
+
+  if (!h || !out || !out_len || (!in && len) || !consumed) {
+    return LZSS_ERROR;
+  }
+
+  for (;;) {
+    if (h->state == LZSS_DEC_COPY) {
+      while (h->copy_left && n < out_cap) {
+	b = h->window[(h->wpos - h->copy_dist) & mask];
+	h->window[h->wpos++ & mask] = b;
+	out[n++] = b;
+	h->copy_left--;
+      }
+      if (h->copy_left) {
+	break;
+      }
+      h->state = LZSS_DEC_TAG;
+    }
+
+    switch (h->state) {
+      case LZSS_DEC_HEADER:
+	need = 8;
+	break;
+      case LZSS_DEC_TAG:
+	need = 1;
+	break;
+      case LZSS_DEC_LITERAL:
+	need = 8;
+	break;
+      default:
+	need = h->window_bits + h->length_bits;
+	break;
+    }
+    while (h->nbits < need && i < len) {
+      h->bits = (h->bits << 8) | in[i++];
+      h->nbits += 8;
+    }
+    if (h->nbits < need) {
+      *out_len = n;
+      *consumed = i;
+      return LZSS_MORE_INPUT;
+    }
+    if (h->state == LZSS_DEC_LITERAL && n == out_cap) {
+      break;
+    }
+
+    h->nbits -= need;
+    switch (h->state) {
+      case LZSS_DEC_HEADER:
+	b = (uint8_t) (h->bits >> h->nbits);
+	h->window_bits = b >> 4;
+	h->length_bits = b & 0x0F;
+	if (h->window_bits > LZSS_WINDOW_BITS || h->window_bits == 0
+	    || h->length_bits == 0 || h->length_bits > 8) {
+	  *out_len = n;
+	  *consumed = i;
+	  return LZSS_ERROR;
+	}
+	h->state = LZSS_DEC_TAG;
+	break;
+      case LZSS_DEC_TAG:
+	h->state = ((h->bits >> h->nbits) & 0x1) ?
+	    LZSS_DEC_LITERAL : LZSS_DEC_REF;
+	break;
+      case LZSS_DEC_LITERAL:
+	b = (uint8_t) (h->bits >> h->nbits);
+	h->window[h->wpos++ & mask] = b;
+	out[n++] = b;
+	h->state = LZSS_DEC_TAG;
+	break;
+      default:
+	h->copy_left = ((h->bits >> h->nbits) & ((1 << h->length_bits) - 1))
+	    + LZSS_MIN_MATCH;
+	h->copy_dist = ((h->bits >> (h->nbits + h->length_bits))
+	    & ((1 << h->window_bits) - 1)) + 1;
+	h->state = LZSS_DEC_COPY;
+	break;
+    }
+    h->bits &= (1UL << h->nbits) - 1;
+  }
+  *out_len = n;
+  *consumed = i;
+  return LZSS_OK;
+}
@@ -41,6 +41,7 @@
 #include "a_comparison.h"
 #include "comms.h"
 #include "payload.h"
+#include "imgdl.h"
 #include "eps.h"
 #include <stdlib.h>
 
@@ -68,6 +69,7 @@ UART_HandleTypeDef huart6;
 #define PRESCALER 65534
 
 #define ONDELAY 500
+#define GROUND_POLL_MS 10 // wait for a ground packet when idle; the receive ring of comms.c keeps the rest
 
 struct tempBuffers {
 	uint8_t telemEPS;
@@ -152,6 +154,11 @@ int main(void)
 	uint8_t packetLenArr[2];
 	uint16_t packetLen = 0;
 	uint8_t *data;
+	uint8_t groundPacket[PACKET_SIZE];
+	uint8_t groundData[PACKET_SIZE];
+	uint8_t adr = 0;
+	uint8_t flg = 0;
+	uint8_t len_command = 0;
 
 
 /*	uint8_t lost_connection = 0;
@@ -243,16 +250,29 @@ int main(void)
 			break;
 	}*/
 
-	char *path = "output/fire0.txt";
-	enqueue(createMessage(START_DOWNLOAD, strlen(path), (uint8_t*)path), commandQue);
+	// Go on with an image downlink the CDH was in the middle of before a reset
+	imgdl_init(commandQue);
+
+	// Ground packets are received in the background from here on, poll_packet takes them
+	comms_rx_start();
 
 	 while (1) {
+		  /* Ground commands -------------*/
+		  if(poll_packet(groundPacket, GROUND_POLL_MS) && parse_packet(groundPacket, &adr, &flg, &len_command, groundData)){
+			  if(adr == 0x01 && flg == 0 && (len_command == IMGDL_CMD_START || len_command == IMGDL_CMD_RANGE)){
+				  printStringToConsole("Image downlink command received\n");
+				  imgdl_command(len_command, groundData, commandQue);
+			  }
+		  }
+
 		  /* Check if command queue is empty */
 		  if(commandQue->numMessages > 0)
 			  command = peekQueue(commandQue);
+		  else if(imgdl_next(commandQue)) // next chunk the ground is missing
+			  command = peekQueue(commandQue);
 		  else{
-			  HAL_Delay(1000); // Empty command queue - exit loop
-			  break;
+			  imgdl_idle(); // after the pass, ready the flash for the next saves
+			  continue; // nothing to do but listen to the ground
 		  }
 
 	  /* Save message details */
@@ -272,12 +292,13 @@ int main(void)
 	  uint8_t reply;
 	  switch(comcode){
 		  case START_DOWNLOAD:
-			  // To-do: Extract filename from filepath
-
 			  // Receive and parse success/error
 			  receiveData(&reply, 1);
 			  if(!handleError(errors, command, &reply)){
-				  // If no error, receive 32 byte shasum
+				  // If no error, receive 32 byte shasum, which goes down to the ground to check
+				  // the image against
+				  receiveData(shasum, SHA256_DIGEST_LEN);
+				  imgdl_opened(shasum);
 			  }
 			  break;
 
@@ -291,8 +312,10 @@ int main(void)
 
 		  case REQUEST_PACKET:
 			  receiveData(&reply, 1);
-			  if(reply == 7)
-				  printStringToConsole("Downloaded");
+			  if(reply == 7){
+				  // The offset is past the end of the file
+				  imgdl_chunk(NULL, 0);
+			  }
 			  else if(handleError(errors, command, &reply))
 				  break;
 			  else{
@@ -306,11 +329,9 @@ int main(void)
 				  packetLen = packetLen | ((uint16_t)packetLenArr[0] << 8);
 				  data = malloc(packetLen);
 
-				  // Use packet length to receive incoming data
+				  // Use packet length to receive incoming data, then send it down as a chunk
 				  receiveData(data, packetLen-5);
-
-				  // Save data
-				  saveData(data, packetLen); // To-do: Change saving function (currently a dummy)
+				  imgdl_chunk(data, packetLen-5);
 				  free(data);
 				  printStringToConsole("One Packet Downloaded\n");
 			  }
@@ -344,8 +365,6 @@ int main(void)
 			  break;
 	  }
 	  dequeue(commandQue);
-	  printStringToConsole("Enqueue one packet\n");
-	  enqueue(createMessage(REQUEST_PACKET, 0, (uint8_t*)path), commandQue);
 	  HAL_Delay(COMMAND_DELAY);
   	}
 
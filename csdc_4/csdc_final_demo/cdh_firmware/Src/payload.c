@@ -17,6 +17,7 @@ Message *command;
 /* File transfer variables */
 uint16_t packetLen;
 uint8_t *data;
+uint8_t shasum[SHA256_DIGEST_LEN]; // digest the TX2 reports for the file being downloaded
 
 uint8_t memory[64];
 uint32_t memIndex = 0;
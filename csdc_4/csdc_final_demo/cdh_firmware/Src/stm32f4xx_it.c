@@ -43,6 +43,7 @@
 /* External variables --------------------------------------------------------*/
 extern TIM_HandleTypeDef htim2;
 extern TIM_HandleTypeDef htim5;
+extern UART_HandleTypeDef huart1;
 extern int volatile payloadOn;
 /******************************************************************************/
 /*            Cortex-M4 Processor Interruption and Exception Handlers         */ 
@@ -123,6 +124,20 @@ void TIM5_IRQHandler(void)
 	/* USER CODE END TIM5_IRQn 1 */
 }
 
+/**
+* Bytes from the ground through the comms board, one at a time into the receive ring of comms.c
+*/
+void USART1_IRQHandler(void)
+{
+	/* USER CODE BEGIN USART1_IRQn 0 */
+
+	/* USER CODE END USART1_IRQn 0 */
+	HAL_UART_IRQHandler(&huart1);
+	/* USER CODE BEGIN USART1_IRQn 1 */
+
+	/* USER CODE END USART1_IRQn 1 */
+}
+
 /* USER CODE BEGIN 1 */
 
 /* USER CODE END 1 */
@@ -39,6 +39,16 @@
 #define AX25_PREAMBLE_LEN 16
 #define AX25_POSTAMBLE_LEN 16
 
+/**
+ * Worst case size of an encoded frame: a bit is stuffed after every five
+ * ones, so the frame can grow by a fifth
+ */
+#define AX25_MAX_UNSTUFFED_LEN (AX25_PREAMBLE_LEN + AX25_POSTAMBLE_LEN \
+    + AX25_MAX_FRAME_LEN + AX25_MAX_ADDR_LEN)
+#define AX25_MAX_STUFFED_BITS (AX25_MAX_UNSTUFFED_LEN * 8 \
+    + AX25_MAX_UNSTUFFED_LEN * 8 / 5 + 8)
+#define AX25_MAX_ENCODED_LEN ((AX25_MAX_STUFFED_BITS + 7) / 8)
+
 /**
  * AX.25 Frame types
  */
@@ -95,6 +105,8 @@ typedef struct
   uint8_t shift_reg;
   uint8_t dec_byte;
   uint8_t bit_cnt;
+  uint8_t rest;			/* bits after the flag that ended a frame */
+  uint8_t rest_bits;
   scrambler_handle_t descrambler;
 } ax25_handle_t;
 
@@ -123,6 +135,9 @@ ax25_decode_status_t
 ax25_decode (ax25_handle_t *h, uint8_t *out, size_t *out_len,
 	     const uint8_t *ax25_frame, size_t len);
 
+int32_t
+ax25_encode_frame(uint8_t *out, const uint8_t *in, size_t len, uint8_t is_wod);
+
 int32_t
 ax25_send(uint8_t *out, const uint8_t *in, size_t len, uint8_t is_wod);
 
@@ -0,0 +1,38 @@
+/*
+ * bench.h
+ *	Description: On-target benchmarks timed with the DWT cycle counter.
+ *		     Results are printed through the memory emulator serial
+ *		     monitor (ser_print).
+ */
+
+#ifndef INC_BENCH_H_
+#define INC_BENCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "stm32f4xx_hal.h"
+
+/**
+ * Size of the buffer the benchmarks process per run
+ */
+#define BENCH_BUF_LEN 1024
+
+void
+bench_init (void);
+
+static inline uint32_t
+bench_cycles (void)
+{
+  return DWT->CYCCNT;
+}
+
+void
+bench_report (const char *name, uint32_t cycles, size_t bytes);
+
+uint32_t
+bench_sha256 (void);
+
+uint32_t
+bench_lzss (void);
+
+#endif /* INC_BENCH_H_ */
@@ -0,0 +1,105 @@
+/*
+ * bridge.h
+ *	Description: Packet relay between the ground station and the CDH
+ *		     board. Both directions are handled independently, so
+ *		     uplink commands and downlink data flow at the same time.
+ *
+ *	Ground to CDH:	[size][seq][size - 1 bytes]
+ *		Assembled and queued by uplink_rx.h. The frame is echoed
+ *		back to the ground whole as the acknowledgment and the packet
+ *		after the sequence byte is passed to the router (router.h),
+ *		which sends it to the CDH, answers it on the comms MCU or
+ *		drops it. Local replies go to the ground framed as the
+ *		downlink. The ground numbers its packets in seq and sends a
+ *		repeat with the number of the first copy; a packet that
+ *		repeats one taken in the last DEDUP_WINDOW_MS (dedup.h),
+ *		sequence byte included, is still echoed but neither passed
+ *		to the CDH nor run on the comms MCU again.
+ *	CDH to ground:	[head][n][n bytes], n at most BRIDGE_MAX_DL_LEN
+ *		Sent to the ground as [n + 2][head][n][n bytes]. A size of 0
+ *		stands for 256. Dropped if the ground queue is full.
+ *
+ *	With a transmit scheduler (tx_sched.h) echoes and local replies go
+ *	to the ground ahead of the CDH data, and a CDH packet addressed to
+ *	ROUTER_ADDR_COMMS is taken as the WOD of the OBC for the beacon.
+ *
+ *	The bridge only knows the ports through read / write callbacks, so
+ *	it runs over the DMA UARTs on the board and over simulated lines on
+ *	the host. Its counters are COMMS_LINK_GND and COMMS_LINK_CDH of
+ *	comms_stats.h.
+ */
+
+#ifndef INC_BRIDGE_H_
+#define INC_BRIDGE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "router.h"
+#include "tx_sched.h"
+#include "dedup.h"
+#include "uplink_rx.h"
+
+/* The frame of the ground, the sequence byte and the packet */
+#define BRIDGE_MAX_UL_LEN UPLINK_RX_MAX_LEN
+#define BRIDGE_MAX_DL_LEN 254
+/**
+ * A CDH packet that stops arriving for this long is dropped and the parser
+ * waits for the next one. The ground side has UPLINK_RX_TIMEOUT_MS.
+ */
+#define BRIDGE_RESYNC_MS 100
+
+typedef struct
+{
+  /**
+   * Reads up to \p len received bytes, returns how many were read
+   */
+  size_t (*read) (void *priv, uint8_t *buf, size_t len);
+  /**
+   * Queues \p len bytes for sending, all or nothing. Returns 0 on success
+   * or -1 if there is no room.
+   */
+  int32_t (*write) (void *priv, const uint8_t *data, size_t len);
+  void *priv;
+} bridge_port_t;
+
+#define BRIDGE_TO_GND 0x1
+#define BRIDGE_TO_CDH 0x2
+#define BRIDGE_TO_REPLY 0x4
+
+typedef struct
+{
+  /* [size] followed by the packet, as sent to the ground */
+  uint8_t buf[BRIDGE_MAX_DL_LEN + 3];
+  size_t got;
+  size_t need;
+  uint32_t start_ms;
+  uint32_t last_ms;
+} bridge_rx_t;
+
+typedef struct
+{
+  bridge_port_t gnd;
+  bridge_port_t cdh;
+  uplink_rx_t ul;
+  uint8_t ul_pending;		/* outputs of the first queued packet still
+				   to write, BRIDGE_TO_* */
+  bridge_rx_t dl;
+  router_t *router;
+  tx_sched_t *sched;
+  dedup_t dedup;
+  /* [size] followed by the router reply */
+  uint8_t reply[ROUTER_MAX_REPLY_LEN + 3];
+  size_t reply_len;
+} bridge_t;
+
+int32_t
+bridge_init (bridge_t *b, const bridge_port_t *gnd, const bridge_port_t *cdh,
+	     router_t *router, tx_sched_t *sched);
+
+uint8_t
+bridge_poll (bridge_t *b, uint32_t now_ms);
+
+int32_t
+bridge_send (bridge_t *b, const uint8_t *pkt, size_t len);
+
+#endif /* INC_BRIDGE_H_ */
@@ -0,0 +1,120 @@
+/*
+ * cfgstore.h
+ *	Description: Key / value store of the comms parameters in flash,
+ *		     with every value cached in RAM.
+ *
+ *	The store alternates between two banks, each a whole flash sector
+ *	(fwupdate.h has the layout). The active bank is a log: a bank header
+ *	and then fixed size records appended one after the other, the last
+ *	record of a key holding its value. Nothing is ever rewritten in place,
+ *	so the writes spread over the whole bank before it needs an erase.
+ *
+ *	Bank header:	magic, sequence number, CRC
+ *	Record:		[key][len][CRC16][value, CFGSTORE_MAX_VALUE_LEN bytes]
+ *
+ *	Reads come from the RAM cache and never touch the flash. Writes only
+ *	update the cache; the changed keys are appended together by
+ *	cfgstore_flush(), which cfgstore_poll() calls CFGSTORE_FLUSH_MS after
+ *	the first unsaved change. Only when the active bank is full are the
+ *	current values compacted into the other bank, whose header is written
+ *	last, so a reset at any point leaves one complete bank.
+ *
+ *	A record cut short by a reset fails its CRC and is skipped; the key
+ *	keeps the value it had before. Flash programming stalls the MCU, and a
+ *	compaction erases a sector first, so flush when the links are idle.
+ */
+
+#ifndef INC_CFGSTORE_H_
+#define INC_CFGSTORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "flash_dev.h"
+
+#define CFGSTORE_MAGIC 0x53474643 /* "CFGS" */
+#define CFGSTORE_MAX_KEYS 16
+#define CFGSTORE_MAX_VALUE_LEN 16
+#define CFGSTORE_FLUSH_MS 1000
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t seq;
+  uint16_t crc;
+  uint16_t reserved;
+} cfgstore_bank_t;
+
+typedef struct
+{
+  uint8_t key;
+  uint8_t len;
+  uint16_t crc;
+  uint8_t value[CFGSTORE_MAX_VALUE_LEN];
+} cfgstore_rec_t;
+
+typedef struct
+{
+  uint8_t value[CFGSTORE_MAX_VALUE_LEN];
+  uint8_t len;
+  uint8_t valid;
+  uint8_t dirty;
+  uint32_t addr;		/* the record in flash, 0 if not saved yet */
+} cfgstore_entry_t;
+
+typedef struct
+{
+  const flash_dev_t *dev;
+  uint8_t sector[2];
+  uint8_t bank;			/* the active one, 0 or 1 */
+  uint32_t seq;
+  uint32_t append;		/* where the next record goes */
+  uint8_t dirty;
+  uint32_t dirty_ms;
+  cfgstore_entry_t entry[CFGSTORE_MAX_KEYS];
+  /* Counters for the telemetry and the benchmarks */
+  uint32_t torn;
+  uint32_t flushes;
+  uint32_t compactions;
+} cfgstore_t;
+
+int32_t
+cfgstore_init (cfgstore_t *s, const flash_dev_t *dev, uint8_t sector_a,
+	       uint8_t sector_b);
+
+/**
+ * Reads a value from the cache
+ * @param s the store
+ * @param key the key
+ * @param buf the output, room for \p len bytes
+ * @param len the size of \p buf
+ * @return the size of the value, or -1 if the key has none or it does not
+ * fit \p buf
+ */
+static inline int32_t
+cfgstore_get (const cfgstore_t *s, uint8_t key, void *buf, size_t len)
+{
+  const cfgstore_entry_t *e;
+
+  if (key >= CFGSTORE_MAX_KEYS || !s->entry[key].valid) {
+    return -1;
+  }
+  e = &s->entry[key];
+  if (e->len > len) {
+    return -1;
+  }
+  memcpy (buf, e->value, e->len);
+  return e->len;
+}
+
+int32_t
+cfgstore_set (cfgstore_t *s, uint8_t key, const void *value, size_t len,
+	      uint32_t now_ms);
+
+int32_t
+cfgstore_flush (cfgstore_t *s);
+
+uint8_t
+cfgstore_poll (cfgstore_t *s, uint32_t now_ms);
+
+#endif /* INC_CFGSTORE_H_ */
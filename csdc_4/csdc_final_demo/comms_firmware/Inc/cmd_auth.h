@@ -0,0 +1,43 @@
+/*
+ * cmd_auth.h
+ *	Description: Authentication of uplinked commands. Covers the RF switch
+ *		     command, whose key is checked against the SHA-256 digest in
+ *		     config.h, and HMAC-SHA-256 tags on ordinary commands.
+ *
+ *	A tagged packet ends with the leading tag_len bytes of the HMAC of
+ *	everything before it, [head][len/cmd] included, so a tag is only
+ *	good for the command it was made for. For a data packet the length
+ *	byte counts the tag. The tag does not stop a recorded packet from
+ *	being sent again.
+ */
+
+#ifndef INC_CMD_AUTH_H_
+#define INC_CMD_AUTH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sha256.h"
+#include "router.h"
+
+/**
+ * Shortest accepted HMAC tag. Tags may be truncated to save uplink bytes,
+ * but not below this.
+ */
+#define CMD_AUTH_MIN_TAG_LEN 8
+
+int32_t
+cmd_auth_init (const uint8_t *key, size_t key_len);
+
+uint8_t
+cmd_auth_rf_switch (const uint8_t *cmd, size_t len);
+
+int32_t
+cmd_auth_begin (hmac_sha256_ctx_t *h);
+
+uint8_t
+cmd_auth_end (hmac_sha256_ctx_t *h, const uint8_t *tag, size_t tag_len);
+
+uint8_t
+cmd_auth_verify (const router_pkt_t *pkt, size_t tag_len);
+
+#endif /* INC_CMD_AUTH_H_ */
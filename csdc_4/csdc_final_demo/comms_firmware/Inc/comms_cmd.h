@@ -0,0 +1,98 @@
+/*
+ * comms_cmd.h
+ *	Description: Packets handled by the comms MCU itself, without a round
+ *		     trip to the CDH, and the routing table that sends them
+ *		     here.
+ *
+ *	ROUTER_ADDR_COMMS
+ *	  commands	COMMS_CMD_STATUS, COMMS_CMD_SET_PROFILE,
+ *			COMMS_CMD_TELEMETRY, COMMS_CMD_RF_SWITCH
+ *	  data		firmware update packets (fwupdate.h), answered with
+ *			the number of patch bytes received so far. Flash
+ *			programming stalls the MCU, so the ground waits for
+ *			each reply before sending the next packet.
+ *
+ *	COMMS_CMD_SET_PROFILE and the firmware update packets change the
+ *	board and end with a COMMS_CMD_TAG_LEN bytes tag keyed with
+ *	__COMMS_CMD_KEY (cmd_auth.h); without a good tag they fail.
+ *	COMMS_CMD_RF_SWITCH carries the RF switch key instead.
+ *	ROUTER_ADDR_DIAG
+ *	  any		loopback, the data comes back unchanged
+ *
+ *	Every other address goes to the CDH. Numbers in replies are little
+ *	endian.
+ *
+ *	Every COMMS_STATS_PERIOD_MS the telemetry frame is also sent
+ *	unasked, as a reply to COMMS_CMD_TELEMETRY. While the WOD is stale
+ *	the beacon carries it as COMMS_CMD_BEACON instead. Neither is sent
+ *	while the RF switch is off.
+ */
+
+#ifndef INC_COMMS_CMD_H_
+#define INC_COMMS_CMD_H_
+
+#include <stdint.h>
+#include "router.h"
+#include "bridge.h"
+#include "fwupdate.h"
+#include "cfgstore.h"
+#include "link_profile.h"
+#include "comms_stats.h"
+
+#define COMMS_CMD_TAG_LEN 8
+
+typedef enum
+{
+  /**
+   * Reply: uint32 uptime in ms, bad packets, handler errors, ground and
+   * CDH UART errors, then the uint8 link profile, the uint32 address of
+   * the running image, the uint8 fwupdate_state_t and the uint32 patch
+   * bytes received
+   */
+  COMMS_CMD_STATUS = 0x00,
+  /**
+   * Argument: the uint8 link_profile_id_t for the next passes, kept across
+   * resets. Stored and reported only until the board has an RF transmit
+   * path, see link_profile.h.
+   */
+  COMMS_CMD_SET_PROFILE = 0x01,
+  /**
+   * Reply: the telemetry frame of comms_stats.h, counting since the last
+   * periodic one
+   */
+  COMMS_CMD_TELEMETRY = 0x02,
+  /**
+   * Never received. The beacon sent in place of a stale WOD, carrying the
+   * telemetry frame.
+   */
+  COMMS_CMD_BEACON = 0x03,
+  /**
+   * Argument: uint8 1 to turn the unasked transmissions on or 0 to turn
+   * them off, then __COMMS_RF_SWITCH_CMD and the RF switch key. Kept
+   * across resets.
+   */
+  COMMS_CMD_RF_SWITCH = 0x04
+} comms_cmd_id_t;
+
+typedef struct
+{
+  const router_t *router;
+  link_profile_id_t profile;
+  uint8_t rf_on;
+  fwupdate_t fw;
+  cfgstore_t cfg;
+} comms_cmd_t;
+
+extern comms_cmd_t comms_cmd;
+extern const router_route_t comms_routes[ROUTER_NUM_ADDR];
+
+void
+comms_cmd_init (const router_t *router);
+
+void
+comms_cmd_poll (bridge_t *b, uint32_t now_ms);
+
+size_t
+comms_cmd_beacon (void *priv, uint8_t *out, uint32_t now_ms);
+
+#endif /* INC_COMMS_CMD_H_ */
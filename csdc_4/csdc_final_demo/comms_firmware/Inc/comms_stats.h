@@ -0,0 +1,138 @@
+/*
+ * comms_stats.h
+ *	Description: Link statistics. The AX.25 codec and the UART bridge
+ *		     count what passes through them, and every
+ *		     COMMS_STATS_PERIOD_MS the counts of the last period go
+ *		     to the ground as a telemetry frame.
+ *
+ *	Telemetry frame, every number an unsigned LEB128 varint:
+ *	  [COMMS_STATS_VERSION][seq, one byte][period ms]
+ *	  per link, COMMS_LINK_RF to COMMS_LINK_CDH:
+ *	    frames in, frames out, bytes in, bytes out, CRC failures,
+ *	    sync losses, aborts, drops, duplicates, deepest TX queue
+ *	  per latency histogram, COMMS_LAT_UPLINK to COMMS_LAT_LOCAL:
+ *	    COMMS_STATS_HIST_BUCKETS counts
+ *	All but the queue depth count the period only and saturate at
+ *	0xFFFF. A gap in seq means frames were lost on the way; a frame that
+ *	could not be queued is not numbered and its counts go into the next.
+ */
+
+#ifndef INC_COMMS_STATS_H_
+#define INC_COMMS_STATS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define COMMS_STATS_VERSION 2
+
+typedef enum
+{
+  COMMS_LINK_RF = 0,
+  COMMS_LINK_GND,
+  COMMS_LINK_CDH,
+  COMMS_LINK_NUM
+} comms_link_t;
+
+/**
+ * Latencies through the comms MCU, from the first byte of a packet to its
+ * last copy written to the output UART. What goes to the ground counts
+ * its wait in the transmit scheduler (tx_sched.h) too; only the bytes
+ * the UART still holds ahead of it, at most TX_SCHED_LOW_WATER, are left
+ * out.
+ */
+typedef enum
+{
+  COMMS_LAT_UPLINK = 0,		/**< ground to CDH */
+  COMMS_LAT_DOWNLINK,		/**< CDH to ground */
+  COMMS_LAT_LOCAL,		/**< ground request to comms reply */
+  COMMS_LAT_NUM
+} comms_lat_t;
+
+/**
+ * Bucket 0 counts latencies below 1 ms, bucket k those from 2^(k-1) up to
+ * 2^k ms; the last bucket also takes everything longer
+ */
+#define COMMS_STATS_HIST_BUCKETS 16
+
+typedef struct
+{
+  uint32_t frames_in;
+  uint32_t frames_out;
+  uint32_t bytes_in;
+  uint32_t bytes_out;
+  uint32_t crc_fails;
+  uint32_t sync_losses;
+  uint32_t aborts;
+  uint32_t drops;
+  uint32_t duplicates;		/* repeated uplink packets not passed on */
+  uint32_t queue_max;		/* since the last telemetry frame */
+} comms_link_stats_t;
+
+#define COMMS_LINK_STATS_FIELDS (sizeof(comms_link_stats_t) / sizeof(uint32_t))
+
+typedef struct
+{
+  comms_link_stats_t link[COMMS_LINK_NUM];
+  uint32_t lat[COMMS_LAT_NUM][COMMS_STATS_HIST_BUCKETS];
+} comms_counters_t;
+
+typedef struct
+{
+  comms_counters_t now;
+  comms_counters_t sent;
+  uint32_t sent_ms;
+  uint8_t seq;
+} comms_stats_t;
+
+/**
+ * Longest telemetry frame, with every varint at its 3 byte maximum
+ */
+#define COMMS_STATS_MAX_FRAME_LEN (2 + 3 + 3 * COMMS_LINK_NUM \
+    * COMMS_LINK_STATS_FIELDS + 3 * COMMS_LAT_NUM * COMMS_STATS_HIST_BUCKETS)
+
+extern comms_stats_t comms_stats;
+
+static inline void
+comms_stats_frame_in (comms_link_t link, size_t len)
+{
+  comms_stats.now.link[link].frames_in++;
+  comms_stats.now.link[link].bytes_in += len;
+}
+
+static inline void
+comms_stats_frame_out (comms_link_t link, size_t len)
+{
+  comms_stats.now.link[link].frames_out++;
+  comms_stats.now.link[link].bytes_out += len;
+}
+
+static inline void
+comms_stats_queue (comms_link_t link, size_t depth)
+{
+  if (depth > comms_stats.now.link[link].queue_max) {
+    comms_stats.now.link[link].queue_max = depth;
+  }
+}
+
+static inline void
+comms_stats_latency (comms_lat_t lat, uint32_t ms)
+{
+  uint8_t b = 0;
+
+  while (ms && b < COMMS_STATS_HIST_BUCKETS - 1) {
+    ms >>= 1;
+    b++;
+  }
+  comms_stats.now.lat[lat][b]++;
+}
+
+void
+comms_stats_init (uint32_t now_ms);
+
+size_t
+comms_stats_encode (uint8_t *out, uint32_t now_ms);
+
+void
+comms_stats_commit (uint32_t now_ms);
+
+#endif /* INC_COMMS_STATS_H_ */
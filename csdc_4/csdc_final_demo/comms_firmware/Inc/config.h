@@ -62,16 +62,36 @@ static const uint32_t __COMMS_RF_ON_KEY = 0x16264e84;
 static const uint32_t __COMMS_RF_OFF_KEY = 0x669d93a3;
 
 /**
- * The offset from the beginning of the flash block in which
- * the RF key is stored
+ * The shared secret of the HMAC-SHA-256 tags on the commands that change
+ * the comms board (comms_cmd.h). This placeholder is replaced for flight.
  */
-static const uint32_t __COMMS_RF_KEY_FLASH_OFFSET = 0x0;
+static const uint8_t __COMMS_CMD_KEY[] =
+	{0x55, 0x42, 0x43, 0x4f, 0x72, 0x62, 0x69, 0x74, 0x20, 0x63,
+	0x6f, 0x6d, 0x6d, 0x73, 0x20, 0x63, 0x6f, 0x6d, 0x6d, 0x61,
+	0x6e, 0x64, 0x20, 0x6b, 0x65, 0x79, 0x20, 0x30, 0x30, 0x30,
+	0x30, 0x31};
 
 /**
- * The offset from the beginning of the flash block in which
- * the headless transmission pattern of the
+ * The flash sectors of the two banks of the configuration store
+ * (cfgstore.h)
  */
-static const uint32_t __COMMS_HEADLESS_TX_FLASH_OFFSET = 0x4;
+static const uint8_t __COMMS_CFG_SECTOR_A = 4;
+static const uint8_t __COMMS_CFG_SECTOR_B = 7;
+
+/**
+ * The configuration store key of the RF key
+ */
+static const uint8_t __COMMS_CFG_KEY_RF = 0;
+
+/**
+ * The configuration store key of the headless transmission pattern
+ */
+static const uint8_t __COMMS_CFG_KEY_HEADLESS_TX = 1;
+
+/**
+ * The configuration store key of the link profile (link_profile.h)
+ */
+static const uint8_t __COMMS_CFG_KEY_LINK_PROFILE = 2;
 
 static const uint32_t __COMMS_DEFAULT_HEADLESS_TX_PATTERN = 0x48;
 
@@ -153,6 +173,21 @@ static const uint32_t __MAX_WOD_RETRASMISSIONS = 6;
  */
 #define COMMS_STATS_PERIOD_MS 1000
 
+/**
+ * If set to 1, the on-target benchmarks run at startup and print their
+ * results through the memory emulator serial monitor
+ */
+#define COMMS_BENCH_EN 0
+
+/**
+ * If set to 1, the ground port (USART2) speaks KISS (kiss.h) instead of
+ * the size prefixed framing, so the board works as a TNC for standard
+ * ground software
+ */
+#ifndef COMMS_GND_KISS_EN
+#define COMMS_GND_KISS_EN 0
+#endif
+
 
 
 #endif /* CONFIG_H_ */
@@ -0,0 +1,45 @@
+/*
+ * dbg.h
+ *	Description: Debug channel to the memory emulator (PC.py) and the
+ *		     serial capture (SerialToFile.py) on USART2.
+ *
+ *	Records are queued whole in the TX ring of the ground port
+ *	(uart_dma.h), and its DMA sends them in the background, so a producer
+ *	never waits for the line. The ring takes one producer, so records are
+ *	queued from the main loop only, never from an interrupt. A record
+ *	that does not fit is dropped and counted.
+ *
+ *	Every record is sent as one COBS frame with a sequence number and a
+ *	CRC (dbg_frame.h).
+ */
+
+#ifndef INC_DBG_H_
+#define INC_DBG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "dbg_frame.h"
+
+typedef struct
+{
+  uint32_t records;
+  uint32_t bytes;		/* on the line */
+  uint32_t dropped;
+} dbg_stats_t;
+
+extern dbg_stats_t dbg_stats;
+
+int32_t
+dbg_init (void);
+
+int32_t
+dbg_write (uint8_t type, const uint8_t *head, size_t head_len,
+	   const uint8_t *data, size_t len);
+
+uint8_t
+dbg_room (size_t len);
+
+uint8_t
+dbg_idle (void);
+
+#endif /* INC_DBG_H_ */
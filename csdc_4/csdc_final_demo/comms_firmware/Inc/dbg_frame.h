@@ -0,0 +1,86 @@
+/*
+ * dbg_frame.h
+ *	Description: The frames of the debug channel (dbg.h), in both
+ *		     directions between the comms board and the PC.
+ *
+ *	Every record is one COBS frame followed by a 0x00 delimiter:
+ *
+ *	  COBS( type | seq (2) | len (2) | payload (len) | CRC (2) ) 0x00
+ *
+ *	with the numbers MS byte first and the CRC-16/CCITT (crc16_ccitt())
+ *	of everything before it. seq counts every record the sender tried to
+ *	send, the dropped ones too, so the receiver sees a drop as a gap. A
+ *	corrupted or cut frame fails its CRC and the receiver picks up again
+ *	at the next delimiter (ground_station/dbg_link.py on the PC).
+ *
+ *	Nothing here touches the hardware, so the host benchmarks build it.
+ */
+
+#ifndef INC_DBG_FRAME_H_
+#define INC_DBG_FRAME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ringbuf.h"
+
+/**
+ * Record types, the commands of the memory emulator and the serial capture,
+ * and the memory downlink
+ */
+typedef enum
+{
+  DBG_MEM_READ = 'r',		/* [tag][address (2)][size (2)] */
+  DBG_MEM_DATA = 'R',		/* from the PC: [tag][data], the answer */
+  DBG_MEM_WRITE = 'W',		/* [address (2)][data] */
+  DBG_PRINT = 'p',		/* text for the console */
+  DBG_LABEL = 'w',		/* names the next DBG_BINARY record */
+  DBG_BINARY = 'b',		/* data dumped as hex and binary */
+  DBG_MEMDL = 'm',		/* [txcnt][rxcnt][data], a memdl.h packet */
+  DBG_DONE = 'd'		/* closes the capture */
+} dbg_type_t;
+
+/**
+ * The longest record header, the arguments before the data
+ */
+#define DBG_MAX_HEAD_LEN 5
+/**
+ * type, seq, len and CRC
+ */
+#define DBG_OVERHEAD 7
+/**
+ * The size on the line of a record with \p n bytes of payload, at most:
+ * one COBS code byte every 254 bytes plus the delimiter
+ */
+#define DBG_FRAME_LEN(n) ((n) + DBG_OVERHEAD + ((n) + DBG_OVERHEAD) / 254 + 2)
+/**
+ * The longest payload received, a DBG_MEM_DATA answer of 1024 bytes
+ */
+#define DBG_RX_MAX_LEN (1 + 1024)
+
+typedef struct
+{
+  uint8_t buf[DBG_RX_MAX_LEN + DBG_OVERHEAD];
+  size_t len;
+  uint8_t left;			/* bytes left in the COBS run */
+  uint8_t zero;			/* a 0x00 goes before the next run */
+  uint8_t overflow;
+  /* The last record, valid after dbg_frame_feed() returned 1 */
+  uint8_t type;
+  uint16_t seq;
+  const uint8_t *payload;
+  size_t payload_len;
+  uint32_t records;
+  uint32_t bad;
+} dbg_frame_rx_t;
+
+size_t
+dbg_frame_put (ringbuf_t *r, uint8_t type, uint16_t seq, const uint8_t *head,
+	       size_t head_len, const uint8_t *data, size_t len);
+
+void
+dbg_frame_rx_init (dbg_frame_rx_t *d);
+
+uint8_t
+dbg_frame_feed (dbg_frame_rx_t *d, uint8_t b);
+
+#endif /* INC_DBG_FRAME_H_ */
@@ -0,0 +1,69 @@
+/*
+ * dedup.h
+ *	Description: Cache of the uplink packets recently taken by the
+ *		     bridge, so a copy the ground sends again is not executed
+ *		     twice, on the CDH or on the comms MCU.
+ *
+ *	The ground repeats a command when it misses the echo, and over a
+ *	noisy link the first copy often did arrive. Every packet of the ground
+ *	carries a sequence byte (bridge.h) that its repeats keep and a new
+ *	packet, even one with the same bytes, does not. A packet is keyed by
+ *	that byte, its CRC16, its length and its first two bytes, the header
+ *	and the command code; one matching a key seen in the last
+ *	DEDUP_WINDOW_MS is a duplicate. So a command the operator sends again
+ *	on purpose is a new packet and is executed again.
+ *
+ *	Each copy that arrives renews its entry, and a new packet replaces the
+ *	entry seen longest ago, one past the window if there is any. A packet
+ *	the ground is still repeating is then only lost from the cache when
+ *	more than DEDUP_ENTRIES other packets come in between two of its
+ *	copies.
+ *
+ *	The sequence byte wraps after 256 packets, far more than the ground
+ *	sends in one window. The CRC16 and the rest of the key only guard
+ *	against a ground station that restarted its numbering.
+ */
+
+#ifndef INC_DEDUP_H_
+#define INC_DEDUP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * WINDOW x (RETRIES + 1) of ground_station/uplink.py: a packet stays in
+ * while the window of the ground turns over once for every send it gets,
+ * all of them between two of its copies
+ */
+#define DEDUP_ENTRIES (4 * (5 + 1))
+/**
+ * Longer than RETRIES x TIMEOUT_S of ground_station/uplink.py, the most
+ * between the first and the last copy of a packet
+ */
+#define DEDUP_WINDOW_MS 12000
+
+typedef struct
+{
+  uint16_t crc;
+  uint8_t seq;
+  uint8_t len;
+  uint8_t head;
+  uint8_t cmd;
+  uint8_t used;
+  uint32_t seen_ms;
+} dedup_entry_t;
+
+typedef struct
+{
+  dedup_entry_t entry[DEDUP_ENTRIES];
+  uint32_t hits;
+} dedup_t;
+
+void
+dedup_init (dedup_t *d);
+
+uint8_t
+dedup_check (dedup_t *d, uint8_t seq, const uint8_t *pkt, size_t len,
+	     uint32_t now_ms);
+
+#endif /* INC_DEDUP_H_ */
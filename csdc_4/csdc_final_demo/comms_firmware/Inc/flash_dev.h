@@ -0,0 +1,72 @@
+/*
+ * flash_dev.h
+ *	Description: Flash device abstraction. The firmware update and the
+ *		     configuration store only talk to a flash_dev_t, so the same
+ *		     code runs on the internal STM32 flash and, on the host, on
+ *		     a file backed model of it.
+ *
+ *	Programming follows NOR rules: bits can only go from 1 to 0, and an
+ *	erase sets a whole sector back to 0xFF.
+ */
+
+#ifndef INC_FLASH_DEV_H_
+#define INC_FLASH_DEV_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * STM32F401RE internal flash: 4 x 16 KB, 1 x 64 KB and 3 x 128 KB sectors
+ */
+#define FLASH_DEV_BASE 0x08000000
+#define FLASH_DEV_LEN (512 * 1024)
+#define FLASH_DEV_SECTORS 8
+
+typedef struct flash_dev flash_dev_t;
+
+struct flash_dev
+{
+  int32_t
+  (*read) (const flash_dev_t *dev, uint32_t addr, uint8_t *buf, size_t len);
+  int32_t
+  (*program) (const flash_dev_t *dev, uint32_t addr, const uint8_t *buf,
+	      size_t len);
+  int32_t
+  (*erase_sector) (const flash_dev_t *dev, uint8_t sector);
+  void *priv;
+};
+
+typedef struct
+{
+  uint32_t addr;
+  uint32_t len;
+} flash_sector_t;
+
+extern const flash_sector_t flash_sectors[FLASH_DEV_SECTORS];
+
+int32_t
+flash_sector_of (uint32_t addr);
+
+int32_t
+flash_dev_erase (const flash_dev_t *dev, uint32_t addr, size_t len);
+
+static inline int32_t
+flash_dev_read (const flash_dev_t *dev, uint32_t addr, uint8_t *buf,
+		size_t len)
+{
+  return dev->read (dev, addr, buf, len);
+}
+
+static inline int32_t
+flash_dev_program (const flash_dev_t *dev, uint32_t addr, const uint8_t *buf,
+		   size_t len)
+{
+  return dev->program (dev, addr, buf, len);
+}
+
+/**
+ * The internal flash of the MCU (flash_stm32.c)
+ */
+extern const flash_dev_t flash_internal;
+
+#endif /* INC_FLASH_DEV_H_ */
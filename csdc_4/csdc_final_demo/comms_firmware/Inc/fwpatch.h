@@ -0,0 +1,93 @@
+/*
+ * fwpatch.h
+ *	Description: Streaming applier for binary delta firmware patches.
+ *		     Rebuilds the new image in flash from the old image and
+ *		     the patch as the patch arrives, without buffering either.
+ *
+ *	Patch format (integers little endian):
+ *	  header, FWPATCH_HDR_LEN bytes
+ *	    0	"FWDP"
+ *	    4	old image length
+ *	    8	new image length
+ *	    12	SHA-256 of the old image
+ *	    44	SHA-256 of the new image
+ *	  body, LZSS compressed (lzss.h), a sequence of records
+ *	    int32 seek, uint32 diff_len, uint32 extra_len
+ *	    diff_len bytes added (mod 256) to the old image bytes
+ *	    extra_len bytes copied as they are
+ *	The old image position moves by seek before each record and by
+ *	diff_len during it, as in bsdiff. The diff bytes are mostly zero
+ *	when code only moved, which is what the compression removes.
+ *	Patches are made on the ground by host/fwdiff.
+ */
+
+#ifndef INC_FWPATCH_H_
+#define INC_FWPATCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "flash_dev.h"
+#include "lzss.h"
+#include "sha256.h"
+
+#define FWPATCH_MAGIC "FWDP"
+#define FWPATCH_HDR_LEN (12 + 2 * SHA256_DIGEST_LEN)
+#define FWPATCH_REC_LEN 12
+
+/**
+ * The new image is programmed in pieces of this size
+ */
+#define FWPATCH_PAGE_LEN 256
+
+typedef enum
+{
+  FWPATCH_HEADER,
+  FWPATCH_BODY,
+  FWPATCH_DONE,
+  FWPATCH_FAILED
+} fwpatch_state_t;
+
+typedef struct
+{
+  const flash_dev_t *dev;
+  uint32_t old_addr;
+  uint32_t old_cap;
+  uint32_t new_addr;
+  uint32_t new_cap;
+
+  uint8_t hdr[FWPATCH_HDR_LEN];
+  size_t hdr_len;
+  uint32_t old_len;
+  uint32_t new_len;
+  uint8_t new_digest[SHA256_DIGEST_LEN];
+
+  lzss_dec_t dec;
+  sha256_ctx_t sha;
+
+  uint8_t rec[FWPATCH_REC_LEN];
+  uint8_t rec_len;
+  uint32_t diff_left;
+  uint32_t extra_left;
+  uint32_t old_pos;
+  uint32_t new_pos;
+
+  uint8_t page[FWPATCH_PAGE_LEN];
+  size_t page_len;
+  fwpatch_state_t state;
+} fwpatch_t;
+
+int32_t
+fwpatch_init (fwpatch_t *p, const flash_dev_t *dev, uint32_t old_addr,
+	      uint32_t old_cap, uint32_t new_addr, uint32_t new_cap);
+
+int32_t
+fwpatch_write (fwpatch_t *p, const uint8_t *in, size_t len);
+
+int32_t
+fwpatch_finish (fwpatch_t *p);
+
+int32_t
+fwpatch_hash_flash (const flash_dev_t *dev, uint32_t addr, uint32_t len,
+		    uint8_t *digest);
+
+#endif /* INC_FWPATCH_H_ */
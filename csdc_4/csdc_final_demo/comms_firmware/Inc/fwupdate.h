@@ -0,0 +1,125 @@
+/*
+ * fwupdate.h
+ *	Description: Dual slot firmware update over the uplink.
+ *
+ *	Flash layout:
+ *	  sectors 0 - 1	  0x08000000  32 KB	factory image: the boot selector
+ *	  sectors 2 - 3	  0x08008000  2 x 16 KB	boot control records, two banks
+ *	  sector 4	  0x08010000  64 KB	configuration store, bank A
+ *	  sector 5	  0x08020000 128 KB	slot A
+ *	  sector 6	  0x08040000 128 KB	slot B
+ *	  sector 7	  0x08060000 128 KB	configuration store, bank B
+ *	A new image is rebuilt from a delta patch (fwpatch.h) in the slot that
+ *	is not running, verified, and then activated by appending a boot
+ *	control record. The application only ever runs from a slot: the IDE
+ *	project links it with STM32F401RETx_SLOT_A.ld and VECT_TAB_OFFSET
+ *	0x20000 (STM32F401RETx_SLOT_B.ld and 0x40000 for slot B). The factory
+ *	image is the boot selector alone, built by boot/Makefile with
+ *	STM32F401RETx_FLASH.ld. Each linker script fails the build if the
+ *	image does not fit its area.
+ *
+ *	A freshly activated image gets FW_BOOT_TRIES boots to call
+ *	fwupdate_confirm(). If it never does, or its hash no longer matches,
+ *	the boot selector falls back to the last confirmed image, and without
+ *	any usable record to whichever slot holds an image, A first.
+ */
+
+#ifndef INC_FWUPDATE_H_
+#define INC_FWUPDATE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "flash_dev.h"
+#include "fwpatch.h"
+
+#define FW_FACTORY_ADDR 0x08000000
+#define FW_FACTORY_LEN (32 * 1024)
+#define FW_CTRL_ADDR 0x08008000
+#define FW_CTRL_LEN (16 * 1024) /* per bank */
+#define FW_SLOT_A_ADDR 0x08020000
+#define FW_SLOT_B_ADDR 0x08040000
+#define FW_SLOT_LEN (128 * 1024)
+
+#define FW_BOOT_MAGIC 0x43425746 /* "FWBC" */
+#define FW_BOOT_TRIES 2
+
+/**
+ * Boot control record. The words after the CRC start erased and are
+ * cleared one by one, so recording a boot attempt or a confirmation never
+ * needs an erase.
+ */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t addr;
+  uint32_t len;
+  uint8_t digest[SHA256_DIGEST_LEN];
+  uint16_t crc;
+  uint16_t reserved;
+  uint32_t tries[FW_BOOT_TRIES];
+  uint32_t confirmed;
+} fw_bootrec_t;
+
+/**
+ * Uplink commands, the first byte of a firmware update packet. The ground
+ * sends a packet again when its reply is lost, so each one can be
+ * repeated: BEGIN before any data, FINISH once verified and ACTIVATE once
+ * activated succeed again without doing anything.
+ */
+typedef enum
+{
+  FWUPDATE_CMD_BEGIN = 'B',  /**< start a session, no arguments */
+  FWUPDATE_CMD_DATA = 'D',   /**< uint32 offset, then patch bytes */
+  FWUPDATE_CMD_FINISH = 'F', /**< verify the new image */
+  FWUPDATE_CMD_ACTIVATE = 'A', /**< boot the new image from the next reset */
+  FWUPDATE_CMD_CONFIRM = 'C' /**< the running image works */
+} fwupdate_cmd_t;
+
+typedef enum
+{
+  FWUPDATE_IDLE,
+  FWUPDATE_RECEIVING,
+  FWUPDATE_VERIFIED,
+  FWUPDATE_FAILED,
+  FWUPDATE_ACTIVATED
+} fwupdate_state_t;
+
+typedef struct
+{
+  const flash_dev_t *dev;
+  uint32_t run_addr;
+  uint32_t slot_addr;
+  uint32_t received;
+  fwupdate_state_t state;
+  fwpatch_t patch;
+} fwupdate_t;
+
+int32_t
+fwupdate_begin (fwupdate_t *u, const flash_dev_t *dev, uint32_t run_addr);
+
+int32_t
+fwupdate_write (fwupdate_t *u, uint32_t offset, const uint8_t *data,
+		size_t len);
+
+int32_t
+fwupdate_finish (fwupdate_t *u);
+
+int32_t
+fwupdate_activate (fwupdate_t *u);
+
+int32_t
+fwupdate_confirm (const flash_dev_t *dev, uint32_t run_addr);
+
+int32_t
+fwupdate_uplink (fwupdate_t *u, const flash_dev_t *dev, uint32_t run_addr,
+		 const uint8_t *pkt, size_t len);
+
+int32_t
+fwboot_append (const flash_dev_t *dev, uint32_t addr, uint32_t len,
+	       const uint8_t *digest, uint8_t confirmed);
+
+uint32_t
+fwboot_select (const flash_dev_t *dev);
+
+#endif /* INC_FWUPDATE_H_ */
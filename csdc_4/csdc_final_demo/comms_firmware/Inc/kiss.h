@@ -0,0 +1,110 @@
+/*
+ * kiss.h
+ *	Description: KISS TNC framing of the ground port, so standard ground
+ *		     software talks to the comms board as it would to a TNC.
+ *
+ *	Serial line:	FEND [command] [AX.25 frame, escaped] FEND
+ *	  FEND and FESC inside the frame are sent as FESC TFEND and
+ *	  FESC TFESC. The AX.25 frame has no flags and no FCS.
+ *
+ *	The adapter sits between the bridge (bridge.h) and the UART and
+ *	translates to the [size][size bytes] framing the bridge uses towards
+ *	the ground:
+ *	  uplink	data frames of TNC port 0 sent to __UPSAT_CALLSIGN as UI
+ *			frames with no layer 3 are passed on as
+ *			[info length][info], so the info field is the
+ *			sequence byte and the packet (bridge.h); anything
+ *			else is counted and dropped. The other KISS commands
+ *			only set radio parameters and are ignored.
+ *	  downlink	every packet the bridge writes is sent as a UI frame
+ *			from __UPSAT_CALLSIGN to __UPSAT_DEST_CALLSIGN.
+ *
+ *	Escaping and unescaping scan a word at a time for the two special
+ *	bytes and copy the runs between them, so the common case costs no
+ *	branch per byte.
+ */
+
+#ifndef INC_KISS_H_
+#define INC_KISS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ax25.h"
+#include "bridge.h"
+#include "ringbuf.h"
+
+#define KISS_FEND 0xC0
+#define KISS_FESC 0xDB
+#define KISS_TFEND 0xDC
+#define KISS_TFESC 0xDD
+
+#define KISS_CMD_DATA 0x00
+
+/**
+ * Longest unescaped frame: the command byte, the addresses with two
+ * digipeaters, the control and PID bytes and the info field
+ */
+#define KISS_MAX_FRAME_LEN (1 + AX25_MAX_ADDR_LEN + 2 + 256)
+/**
+ * Worst case size of \p n bytes once escaped and framed
+ */
+#define KISS_MAX_ENCODED_LEN(n) (2 * (n) + 2)
+
+/**
+ * The uplink packets waiting for the bridge, a power of two
+ */
+#define KISS_UL_LEN 512
+/**
+ * Bytes taken from the UART at a time
+ */
+#define KISS_RX_CHUNK_LEN 64
+/**
+ * Normal bytes in a row after which escaping and decoding go back from one
+ * byte at a time to the word scan
+ */
+#define KISS_DENSE_RUN 8
+
+typedef struct
+{
+  uint8_t buf[KISS_MAX_FRAME_LEN];
+  size_t len;
+  uint8_t in_frame;
+  uint8_t esc;
+  uint8_t overflow;
+} kiss_dec_t;
+
+typedef struct
+{
+  bridge_port_t uart;
+  kiss_dec_t dec;
+  uint8_t in[KISS_RX_CHUNK_LEN];
+  size_t in_len;
+  size_t in_used;
+  ringbuf_t ul;
+  uint8_t ul_mem[KISS_UL_LEN];
+  uint8_t addr[AX25_MIN_ADDR_LEN];
+  uint8_t tx[KISS_MAX_ENCODED_LEN(1 + AX25_MIN_ADDR_LEN + 2 + 256)];
+  uint32_t frames_in;
+  uint32_t bad_frames;
+  uint32_t other_cmds;
+} kiss_t;
+
+size_t
+kiss_escape (uint8_t *out, const uint8_t *in, size_t len);
+
+void
+kiss_dec_init (kiss_dec_t *d);
+
+int32_t
+kiss_decode (kiss_dec_t *d, const uint8_t *in, size_t len, size_t *used);
+
+int32_t
+kiss_init (kiss_t *k, const bridge_port_t *uart);
+
+size_t
+kiss_read (void *priv, uint8_t *buf, size_t len);
+
+int32_t
+kiss_write (void *priv, const uint8_t *data, size_t len);
+
+#endif /* INC_KISS_H_ */
@@ -0,0 +1,23 @@
+/*
+ * link_profile.h
+ *	Description: Link profiles, the framing settings picked for the
+ *		     expected channel conditions of a pass. The ground station
+ *		     has to use the same profile as the satellite.
+ *
+ *	The comms MCU has no RF transmit path yet: COMMS_CMD_SET_PROFILE only
+ *	stores the profile and reports it in the status reply. The settings
+ *	of each profile come with that path.
+ */
+
+#ifndef INC_LINK_PROFILE_H_
+#define INC_LINK_PROFILE_H_
+
+typedef enum
+{
+  LINK_PROFILE_NOMINAL = 0,	/* clear line of sight, high elevation */
+  LINK_PROFILE_FADING,		/* low elevation passes, multipath */
+  LINK_PROFILE_DEEP_FADE,	/* tumbling or deep fades */
+  LINK_PROFILE_NUM
+} link_profile_id_t;
+
+#endif /* INC_LINK_PROFILE_H_ */
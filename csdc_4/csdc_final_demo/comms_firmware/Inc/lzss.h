@@ -0,0 +1,115 @@
+/*
+ * lzss.h
+ *	Description: Streaming LZSS compressor in the style of heatshrink, for
+ *		     shrinking data products before they are framed for the
+ *		     downlink. RAM use is fixed and small (about 7 KB for the
+ *		     encoder and 1 KB for the decoder with the defaults).
+ *
+ *	Stream format: one header byte holding the window bits in the high
+ *	nibble and the length bits in the low nibble, followed by MS bit first
+ *	packed symbols:
+ *	  1 + 8 bits			literal byte
+ *	  0 + W bits + L bits		back reference, (distance - 1) and
+ *					(length - LZSS_MIN_MATCH)
+ *	The last byte is zero padded. The padding is shorter than any symbol,
+ *	so the decoder simply runs out of input.
+ */
+
+#ifndef INC_LZSS_H_
+#define INC_LZSS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The window is 2^LZSS_WINDOW_BITS bytes. Must stay below 4 KB so the
+ * encoder (twice the window plus the hash chains) fits next to the rest of
+ * the comms buffers.
+ */
+#ifndef LZSS_WINDOW_BITS
+#define LZSS_WINDOW_BITS 10
+#endif
+#ifndef LZSS_LENGTH_BITS
+#define LZSS_LENGTH_BITS 6
+#endif
+#define LZSS_HASH_BITS 9
+/**
+ * How many earlier occurrences the encoder checks for each position.
+ * Trades speed for compression ratio.
+ */
+#define LZSS_MAX_CHAIN 16
+
+#define LZSS_WINDOW_LEN (1 << LZSS_WINDOW_BITS)
+#define LZSS_MIN_MATCH 3
+#define LZSS_MAX_MATCH (LZSS_MIN_MATCH + (1 << LZSS_LENGTH_BITS) - 1)
+
+/**
+ * The worst case output size: every byte a 9 bit literal, plus the header
+ * and the padding
+ */
+#define LZSS_MAX_OUTPUT(n) ((n) + ((n) + 7) / 8 + 2)
+
+typedef enum
+{
+  LZSS_OK = 0,
+  LZSS_MORE_INPUT = 1,
+  LZSS_DONE = 2,
+  LZSS_ERROR = -1
+} lzss_status_t;
+
+typedef struct
+{
+  uint8_t buf[2 * LZSS_WINDOW_LEN];
+  int16_t head[1 << LZSS_HASH_BITS];
+  int16_t prev[2 * LZSS_WINDOW_LEN];
+  size_t pos;
+  size_t end;
+  size_t hashed;
+  uint32_t bits;
+  uint8_t nbits;
+  uint8_t header_sent;
+  uint8_t finishing;
+} lzss_enc_t;
+
+typedef enum
+{
+  LZSS_DEC_HEADER,
+  LZSS_DEC_TAG,
+  LZSS_DEC_LITERAL,
+  LZSS_DEC_REF,
+  LZSS_DEC_COPY
+} lzss_dec_state_t;
+
+typedef struct
+{
+  uint8_t window[LZSS_WINDOW_LEN];
+  size_t wpos;
+  uint32_t bits;
+  uint8_t nbits;
+  uint8_t window_bits;
+  uint8_t length_bits;
+  lzss_dec_state_t state;
+  uint16_t copy_dist;
+  uint16_t copy_left;
+} lzss_dec_t;
+
+int32_t
+lzss_enc_init (lzss_enc_t *h);
+
+size_t
+lzss_enc_sink (lzss_enc_t *h, const uint8_t *in, size_t len);
+
+int32_t
+lzss_enc_finish (lzss_enc_t *h);
+
+lzss_status_t
+lzss_enc_poll (lzss_enc_t *h, uint8_t *out, size_t out_cap, size_t *out_len);
+
+int32_t
+lzss_dec_init (lzss_dec_t *h);
+
+lzss_status_t
+lzss_decode (lzss_dec_t *h, uint8_t *out, size_t out_cap, size_t *out_len,
+	     const uint8_t *in, size_t len, size_t *consumed);
+
+#endif /* INC_LZSS_H_ */
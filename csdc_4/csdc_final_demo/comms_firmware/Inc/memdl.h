@@ -0,0 +1,106 @@
+/*
+ * memdl.h
+ *	Description: Pipelined downlink of the emulated memory. Up to
+ *		     MEMDL_DEPTH chunks are requested ahead, so the memory
+ *		     emulator works on the next chunk while the current one
+ *		     is received, compressed and queued for sending. Nothing
+ *		     blocks: memdl_poll() does what the ports allow and
+ *		     returns.
+ *
+ *	Downlink packet: [txcnt][rxcnt][up to MEMDL_PAYLOAD_LEN bytes]
+ *	  txcnt counts packets modulo 8 and rxcnt is txcnt + 1 modulo 8.
+ *	  The payload is the memory from the start offset on, raw or as one
+ *	  LZSS stream (lzss.h).
+ *
+ *	A download can start at any offset. After an interruption the ground
+ *	station asks for the rest from the first byte it is missing; with
+ *	compression the resumed part is a new LZSS stream.
+ */
+
+#ifndef INC_MEMDL_H_
+#define INC_MEMDL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "lzss.h"
+
+/**
+ * Bytes per read request, at most MEMREQ_MAX_LEN
+ */
+#define MEMDL_CHUNK_LEN 512
+/**
+ * Requests kept in flight. 1 is the old request, wait, send cycle.
+ */
+#define MEMDL_DEPTH 3
+#define MEMDL_PAYLOAD_LEN 256
+/**
+ * Requests from the oldest unanswered one on are sent again when nothing
+ * arrives for this long: the emulator stopped answering or restarted, or
+ * an answer was damaged on the line.
+ */
+#define MEMDL_TIMEOUT_MS 1000
+
+typedef struct
+{
+  /**
+   * Queues a read request of \p len bytes at \p addr, all or nothing.
+   * Returns 0 on success or -1 if there is no room.
+   */
+  int32_t (*request) (void *priv, uint32_t addr, size_t len);
+  /**
+   * Reads up to \p len bytes of the memory at \p addr out of the answers,
+   * returns how many were read. Answers to other addresses are dropped.
+   */
+  size_t (*read) (void *priv, uint32_t addr, uint8_t *buf, size_t len);
+  /**
+   * Queues a downlink packet, all or nothing. Returns 0 on success or -1
+   * if there is no room.
+   */
+  int32_t (*send) (void *priv, const uint8_t *pkt, size_t len);
+  void *priv;
+} memdl_port_t;
+
+typedef enum
+{
+  MEMDL_IDLE = 0,
+  MEMDL_RUNNING,
+  MEMDL_DONE
+} memdl_state_t;
+
+typedef struct
+{
+  memdl_port_t port;
+  lzss_enc_t *enc;		/* NULL sends the memory raw */
+  memdl_state_t state;
+  uint8_t depth;
+  uint32_t start;
+  uint32_t end;
+  uint32_t req_off;		/* next address to request */
+  uint32_t rx_off;		/* next address to receive */
+  uint8_t in[MEMDL_CHUNK_LEN];	/* received, not yet compressed */
+  size_t in_len;
+  size_t in_used;
+  uint8_t finishing;
+  uint8_t pkt[2 + MEMDL_PAYLOAD_LEN];
+  size_t fill;
+  uint8_t pkt_ready;
+  uint8_t txcnt;
+  uint32_t last_rx_ms;
+  uint32_t start_ms;
+  uint32_t end_ms;
+  uint32_t packets;
+  uint32_t sent_bytes;
+  uint32_t retries;
+} memdl_t;
+
+int32_t
+memdl_start (memdl_t *m, const memdl_port_t *port, lzss_enc_t *enc,
+	     uint8_t depth, uint32_t start, uint32_t end, uint32_t now_ms);
+
+uint8_t
+memdl_poll (memdl_t *m, uint32_t now_ms);
+
+uint32_t
+memdl_rate (const memdl_t *m, uint32_t now_ms);
+
+#endif /* INC_MEMDL_H_ */
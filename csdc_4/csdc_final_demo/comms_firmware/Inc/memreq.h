@@ -0,0 +1,86 @@
+/*
+ * memreq.h
+ *	Description: Client of the memory emulator (ground_station/PC.py),
+ *		     with tagged read requests so that several can be in
+ *		     flight at once.
+ *
+ *	Read request (DBG_MEM_READ):  [tag][address (2)][size (2)]
+ *	Answer (DBG_MEM_DATA):        [tag][size bytes]
+ *	Write (DBG_MEM_WRITE):        [address (2)][data], not answered
+ *
+ *	All of them are records of the debug channel (dbg_frame.h), so an
+ *	answer that is damaged on the line is dropped whole instead of
+ *	shifting the ones after it. The tag of a request picks one of
+ *	MEMREQ_SLOTS slots, which keeps the address the answer is for; a new
+ *	request takes over the slot of the one MEMREQ_SLOTS requests older,
+ *	whose answer is then dropped when it comes. memreq_read() hands out
+ *	the answered data of the address it is asked for only, so answers to
+ *	requests that were given up and sent again cannot get mixed in.
+ */
+
+#ifndef INC_MEMREQ_H_
+#define INC_MEMREQ_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "dbg_frame.h"
+
+#define MEMREQ_SLOTS 8
+/**
+ * The largest read request, what the debug channel receives at most
+ */
+#define MEMREQ_MAX_LEN (DBG_RX_MAX_LEN - 1)
+
+typedef struct
+{
+  /**
+   * Queues a record of the debug channel, all or nothing. Returns 0 on
+   * success or -1 if there is no room.
+   */
+  int32_t (*send) (void *priv, uint8_t type, const uint8_t *head,
+		   size_t head_len, const uint8_t *data, size_t len);
+  /**
+   * Reads up to \p len received bytes, returns how many were read
+   */
+  size_t (*read) (void *priv, uint8_t *buf, size_t len);
+  void *priv;
+} memreq_port_t;
+
+typedef struct
+{
+  uint32_t addr;
+  uint16_t len;
+  uint8_t tag;
+  uint8_t used;
+} memreq_slot_t;
+
+typedef struct
+{
+  memreq_port_t port;
+  memreq_slot_t slot[MEMREQ_SLOTS];
+  uint8_t tag;			/* of the next request */
+  dbg_frame_rx_t rx;
+  uint8_t in[64];		/* read, not decoded yet */
+  size_t in_len;
+  size_t in_used;
+  /* The part of the current answer not read yet */
+  const uint8_t *data;
+  size_t left;
+  uint32_t addr;
+  uint32_t answers;
+  uint32_t dropped;		/* answers to nothing or to other addresses */
+} memreq_t;
+
+void
+memreq_init (memreq_t *m, const memreq_port_t *port);
+
+int32_t
+memreq_request (memreq_t *m, uint32_t addr, size_t len);
+
+size_t
+memreq_read (memreq_t *m, uint32_t addr, uint8_t *buf, size_t len);
+
+int32_t
+memreq_write (memreq_t *m, uint32_t addr, const uint8_t *data, size_t len);
+
+#endif /* INC_MEMREQ_H_ */
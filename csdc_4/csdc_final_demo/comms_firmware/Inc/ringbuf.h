@@ -0,0 +1,163 @@
+/*
+ * ringbuf.h
+ *	Description: Byte ring buffer for one producer and one consumer, for
+ *		     example the main loop and a DMA complete interrupt. The
+ *		     indices run freely and are only masked on access, so a
+ *		     full ring needs no extra flag.
+ */
+
+#ifndef INC_RINGBUF_H_
+#define INC_RINGBUF_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Orders the data accesses before the index store that hands them over,
+ * so the other side never sees an index ahead of its bytes. A DMB on the
+ * target, the same as CMSIS __DMB(), only a compiler barrier on the host
+ * benches. */
+#if defined(__arm__)
+#define RINGBUF_BARRIER() __asm volatile ("dmb 0xF" ::: "memory")
+#else
+#define RINGBUF_BARRIER() __asm volatile ("" ::: "memory")
+#endif
+
+typedef struct
+{
+  uint8_t *buf;
+  size_t size;
+  volatile size_t head;		/* written only by the producer */
+  volatile size_t tail;		/* written only by the consumer */
+} ringbuf_t;
+
+/**
+ * Initializes a ring on top of \p mem
+ * @param size the size of \p mem, a power of two
+ * @return 0 on success or -1 in case of error
+ */
+static inline int32_t
+ringbuf_init (ringbuf_t *r, uint8_t *mem, size_t size)
+{
+  if (!r || !mem || !size || (size & (size - 1))) {
+    return -1;
+  }
+  r->buf = mem;
+  r->size = size;
+  r->head = 0;
+  r->tail = 0;
+  return 0;
+}
+
+static inline size_t
+ringbuf_used (const ringbuf_t *r)
+{
+  return r->head - r->tail;
+}
+
+static inline size_t
+ringbuf_room (const ringbuf_t *r)
+{
+  return r->size - (r->head - r->tail);
+}
+
+/**
+ * Appends up to \p len bytes
+ * @return the number of bytes written
+ */
+static inline size_t
+ringbuf_write (ringbuf_t *r, const uint8_t *data, size_t len)
+{
+  size_t off = r->head & (r->size - 1);
+  size_t n;
+
+  if (len > ringbuf_room (r)) {
+    len = ringbuf_room (r);
+  }
+  n = r->size - off < len ? r->size - off : len;
+  memcpy (r->buf + off, data, n);
+  memcpy (r->buf, data + n, len - n);
+  RINGBUF_BARRIER ();
+  r->head += len;
+  return len;
+}
+
+/**
+ * Takes up to \p len bytes out of the ring
+ * @return the number of bytes read
+ */
+static inline size_t
+ringbuf_read (ringbuf_t *r, uint8_t *out, size_t len)
+{
+  size_t off = r->tail & (r->size - 1);
+  size_t n;
+
+  if (len > ringbuf_used (r)) {
+    len = ringbuf_used (r);
+  }
+  n = r->size - off < len ? r->size - off : len;
+  memcpy (out, r->buf + off, n);
+  memcpy (out + n, r->buf, len - n);
+  RINGBUF_BARRIER ();
+  r->tail += len;
+  return len;
+}
+
+/**
+ * Copies \p len bytes starting \p off bytes after the oldest one, without
+ * taking them out of the ring. The caller checks that they are there.
+ */
+static inline void
+ringbuf_peek (const ringbuf_t *r, size_t off, uint8_t *out, size_t len)
+{
+  size_t start = (r->tail + off) & (r->size - 1);
+  size_t n = r->size - start < len ? r->size - start : len;
+
+  memcpy (out, r->buf + start, n);
+  memcpy (out + n, r->buf, len - n);
+}
+
+/**
+ * The oldest bytes of the ring that are contiguous in memory, for handing
+ * to a DMA. Release them with ringbuf_skip() once they are sent.
+ * @param len the number of contiguous bytes
+ */
+static inline const uint8_t *
+ringbuf_linear (const ringbuf_t *r, size_t *len)
+{
+  size_t off = r->tail & (r->size - 1);
+  size_t used = ringbuf_used (r);
+
+  *len = r->size - off < used ? r->size - off : used;
+  return r->buf + off;
+}
+
+static inline void
+ringbuf_skip (ringbuf_t *r, size_t len)
+{
+  RINGBUF_BARRIER ();
+  r->tail += len;
+}
+
+/**
+ * Stores a byte \p off bytes after the newest one, for a producer that
+ * builds its data in place. The consumer sees nothing until
+ * ringbuf_commit(); the caller checks the room first.
+ */
+static inline void
+ringbuf_put_at (ringbuf_t *r, size_t off, uint8_t b)
+{
+  r->buf[(r->head + off) & (r->size - 1)] = b;
+}
+
+/**
+ * Hands the \p len bytes stored with ringbuf_put_at() to the consumer
+ */
+static inline void
+ringbuf_commit (ringbuf_t *r, size_t len)
+{
+  RINGBUF_BARRIER ();
+  r->head += len;
+}
+
+#endif /* INC_RINGBUF_H_ */
@@ -0,0 +1,123 @@
+/*
+ * router.h
+ *	Description: Address based routing of uplink packets. The header
+ *		     byte of every packet is parsed once and a table indexed
+ *		     by its address decides where the packet goes: on to the
+ *		     CDH, to a handler on the comms MCU, or nowhere.
+ *
+ *	Packet:	[head][len/cmd][data]
+ *	  head	0110 AAA F, A the address and F the flag, 1 for a data
+ *		packet whose second byte is the data length and 0 for a
+ *		command whose second byte is the command code.
+ *
+ *	Locally handled packets are answered with a data packet from the
+ *	same address:
+ *	  [head][n][len/cmd][status][handler data], status 0 on success.
+ */
+
+#ifndef INC_ROUTER_H_
+#define INC_ROUTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ROUTER_NUM_ADDR 8
+
+/**
+ * Addresses, the ones below ROUTER_ADDR_COMMS as parsed by the CDH
+ */
+#define ROUTER_ADDR_CDH 0
+#define ROUTER_ADDR_PAYLOAD 1
+#define ROUTER_ADDR_ADCS 2
+#define ROUTER_ADDR_EPS 3
+#define ROUTER_ADDR_COMMS 4
+#define ROUTER_ADDR_DIAG 7
+
+/**
+ * Longest reply payload, the n of [head][n][n bytes]. Handlers get what
+ * is left after the command and status bytes.
+ */
+#define ROUTER_MAX_REPLY_LEN 254
+#define ROUTER_MAX_HANDLER_LEN (ROUTER_MAX_REPLY_LEN - 2)
+
+#define ROUTER_STATUS_OK 0
+#define ROUTER_STATUS_ERROR 1
+
+static inline uint8_t
+router_head_valid (uint8_t head)
+{
+  return (head >> 4) == 0x6;
+}
+
+static inline uint8_t
+router_head_addr (uint8_t head)
+{
+  return (head >> 1) & 0x7;
+}
+
+static inline uint8_t
+router_head_flag (uint8_t head)
+{
+  return head & 0x1;
+}
+
+static inline uint8_t
+router_head (uint8_t addr, uint8_t flag)
+{
+  return 0x60 | ((addr & 0x7) << 1) | (flag & 0x1);
+}
+
+typedef enum
+{
+  ROUTER_DROP = 0,
+  ROUTER_TO_CDH,
+  ROUTER_LOCAL
+} router_dest_t;
+
+/**
+ * A parsed packet
+ */
+typedef struct
+{
+  uint8_t addr;
+  uint8_t flag;
+  uint8_t len_cmd;
+  const uint8_t *data;
+  size_t len;
+} router_pkt_t;
+
+/**
+ * Handles a packet on the comms MCU
+ * @param priv the handler state from the route
+ * @param pkt the packet
+ * @param out the reply data, room for ROUTER_MAX_HANDLER_LEN bytes
+ * @param out_len the size of the reply data, 0 when called
+ * @return 0 on success or -1 in case of error
+ */
+typedef int32_t
+(*router_handler_t) (void *priv, const router_pkt_t *pkt, uint8_t *out,
+		     size_t *out_len);
+
+typedef struct
+{
+  router_dest_t dest;
+  router_handler_t handler;	/* ROUTER_LOCAL only */
+  void *priv;
+} router_route_t;
+
+typedef struct
+{
+  const router_route_t *routes;	/* ROUTER_NUM_ADDR entries */
+  uint32_t packets[ROUTER_NUM_ADDR];
+  uint32_t bad_packets;
+  uint32_t errors;
+} router_t;
+
+int32_t
+router_init (router_t *r, const router_route_t *routes);
+
+router_dest_t
+router_dispatch (router_t *r, const uint8_t *buf, size_t len, uint8_t *reply,
+		 size_t *reply_len);
+
+#endif /* INC_ROUTER_H_ */
@@ -0,0 +1,103 @@
+/*
+ * tx_sched.h
+ *	Description: Transmit scheduler of the downlink. Packets are queued
+ *		     by class and handed to the output one at a time, only
+ *		     when it has almost drained, so a packet of a higher
+ *		     class waits behind at most one packet already sent.
+ *
+ *	Classes, highest first:
+ *	  TX_CLASS_REPLY  command acknowledgments and replies
+ *	  TX_CLASS_FILE	  file data and other bulk data, fills any airtime
+ *			  the other classes leave
+ *	  TX_CLASS_WOD	  the whole orbit data beacon, one every
+ *			  __TX_INTERVAL_MS. A due beacon yields to file data
+ *			  for up to TX_SCHED_WOD_SLACK_MS, then goes first.
+ *
+ *	The beacon repeats the last WOD received from the OBC. After
+ *	__WOD_VALID_REPEATS beacons with no new WOD it is considered stale
+ *	and the beacon carries what the fill callback provides instead, to
+ *	report that the OBC stopped sending.
+ */
+
+#ifndef INC_TX_SCHED_H_
+#define INC_TX_SCHED_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "ringbuf.h"
+#include "comms_stats.h"
+
+#define TX_SCHED_MAX_PKT_LEN 257
+#define TX_SCHED_REPLY_LEN 1024
+#define TX_SCHED_FILE_LEN 2048
+/**
+ * The output is given a new packet only when it holds no more than this.
+ * 64 bytes are 5.6 ms at 115200 baud.
+ */
+#define TX_SCHED_LOW_WATER 64
+#define TX_SCHED_WOD_SLACK_MS 1000
+/**
+ * Queue entry header: [length, 2 bytes][latency histogram][since ms, 4 bytes]
+ */
+#define TX_SCHED_HDR_LEN 7
+
+typedef enum
+{
+  TX_CLASS_REPLY = 0,
+  TX_CLASS_FILE,
+  TX_CLASS_WOD,
+  TX_CLASS_NUM
+} tx_class_t;
+
+typedef struct
+{
+  /**
+   * Queues \p len bytes for sending, all or nothing. Returns 0 on success
+   * or -1 if there is no room.
+   */
+  int32_t (*write) (void *priv, const uint8_t *data, size_t len);
+  /**
+   * Returns the number of bytes queued but not sent yet
+   */
+  size_t (*pending) (void *priv);
+  /**
+   * Builds the beacon sent while the WOD is stale, returns its size or 0
+   * to skip the beacon. \p out has room for TX_SCHED_MAX_PKT_LEN bytes.
+   */
+  size_t (*fill) (void *priv, uint8_t *out, uint32_t now_ms);
+  void *priv;
+} tx_sink_t;
+
+typedef struct
+{
+  tx_sink_t sink;
+  comms_link_t link;
+  ringbuf_t q[TX_CLASS_WOD];
+  uint8_t reply_mem[TX_SCHED_REPLY_LEN];
+  uint8_t file_mem[TX_SCHED_FILE_LEN];
+  uint8_t wod[TX_SCHED_MAX_PKT_LEN];
+  size_t wod_len;
+  uint32_t wod_repeats;
+  uint32_t beacon_due_ms;
+  uint32_t sent[TX_CLASS_NUM];
+  uint32_t stale_beacons;
+} tx_sched_t;
+
+int32_t
+tx_sched_init (tx_sched_t *s, const tx_sink_t *sink, comms_link_t link,
+	       uint32_t now_ms);
+
+int32_t
+tx_sched_put (tx_sched_t *s, tx_class_t cls, const uint8_t *pkt, size_t len);
+
+int32_t
+tx_sched_put_timed (tx_sched_t *s, tx_class_t cls, const uint8_t *pkt,
+		    size_t len, comms_lat_t lat, uint32_t since_ms);
+
+int32_t
+tx_sched_wod (tx_sched_t *s, const uint8_t *pkt, size_t len);
+
+uint8_t
+tx_sched_poll (tx_sched_t *s, uint32_t now_ms);
+
+#endif /* INC_TX_SCHED_H_ */
@@ -0,0 +1,73 @@
+/*
+ * uart_dma.h
+ *	Description: Non blocking UART driver. Reception runs continuously
+ *		     into a circular DMA buffer and the idle line interrupt
+ *		     marks the end of every burst, so data is picked up as
+ *		     soon as the line goes quiet instead of after a timeout.
+ *		     Transmission is queued in a ring that a DMA drains in
+ *		     the background.
+ *
+ *	The DMA streams are linked to the UART handles in
+ *	stm32f4xx_hal_msp.c and their interrupts are forwarded from
+ *	stm32f4xx_it.c.
+ */
+
+#ifndef INC_UART_DMA_H_
+#define INC_UART_DMA_H_
+
+#include "stm32f4xx_hal.h"
+#include "ringbuf.h"
+#include "comms_stats.h"
+
+/**
+ * The RX DMA buffer. Must be read at least once per buffer length of
+ * line time (44 ms at 115200 baud), else the DMA overwrites unread data.
+ */
+#define UART_DMA_RX_LEN 512
+/**
+ * The TX queue, a power of two
+ */
+#define UART_DMA_TX_LEN 1024
+#define UART_DMA_MAX_PORTS 2
+
+typedef struct
+{
+  UART_HandleTypeDef *huart;
+  comms_link_t link;
+  uint8_t rx_buf[UART_DMA_RX_LEN];
+  size_t rx_tail;
+  volatile uint8_t rx_event;
+  ringbuf_t tx;
+  uint8_t tx_mem[UART_DMA_TX_LEN];
+  volatile size_t tx_inflight;
+  uint32_t rx_errors;
+} uart_dma_t;
+
+extern uart_dma_t uart_cdh;
+extern uart_dma_t uart_gnd;
+
+int32_t
+uart_dma_init (uart_dma_t *u, UART_HandleTypeDef *huart, comms_link_t link);
+
+size_t
+uart_dma_read (uart_dma_t *u, uint8_t *buf, size_t len);
+
+size_t
+uart_dma_room (uart_dma_t *u);
+
+size_t
+uart_dma_pending (uart_dma_t *u);
+
+int32_t
+uart_dma_write (uart_dma_t *u, const uint8_t *data, size_t len);
+
+void
+uart_dma_commit (uart_dma_t *u, size_t len);
+
+uint8_t
+uart_dma_tx_idle (uart_dma_t *u);
+
+void
+uart_dma_irq (uart_dma_t *u);
+
+#endif /* INC_UART_DMA_H_ */
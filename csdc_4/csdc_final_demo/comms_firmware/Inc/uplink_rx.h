@@ -0,0 +1,79 @@
+/*
+ * uplink_rx.h
+ *	Description: Assembles the packets of the ground station, framed as
+ *		     [size][size bytes], from its serial port and queues them
+ *		     with their arrival times.
+ *
+ *	The port is the RX ring of the UART DMA (uart_dma.h), so nothing here
+ *	waits for the line: uplink_rx_poll() takes whatever has arrived and
+ *	returns. Up to UPLINK_RX_SLOTS complete packets wait in the queue
+ *	while the first one is being passed on; when the queue is full the
+ *	bytes stay in the port. A packet that stops arriving for
+ *	UPLINK_RX_TIMEOUT_MS is dropped and counted as a sync loss of
+ *	COMMS_LINK_GND, and the next byte is taken as a size.
+ */
+
+#ifndef INC_UPLINK_RX_H_
+#define INC_UPLINK_RX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UPLINK_RX_MAX_LEN 255
+#define UPLINK_RX_SLOTS 4
+#define UPLINK_RX_TIMEOUT_MS 100
+
+/**
+ * Reads up to \p len received bytes, returns how many were read
+ */
+typedef size_t (*uplink_read_t) (void *priv, uint8_t *buf, size_t len);
+
+typedef struct
+{
+  /* As received, [size][size bytes] */
+  uint8_t buf[1 + UPLINK_RX_MAX_LEN];
+  uint32_t first_ms;		/* the size byte */
+  uint32_t done_ms;		/* the last byte */
+} uplink_pkt_t;
+
+typedef struct
+{
+  uplink_pkt_t slot[UPLINK_RX_SLOTS];
+  uint8_t head;			/* the oldest complete packet */
+  uint8_t count;		/* complete packets */
+  size_t got;			/* bytes of the packet after them */
+  uint32_t last_ms;
+  uint32_t packets;
+  uint32_t timeouts;
+} uplink_rx_t;
+
+void
+uplink_rx_init (uplink_rx_t *u);
+
+uint8_t
+uplink_rx_poll (uplink_rx_t *u, uplink_read_t read, void *priv,
+		uint32_t now_ms);
+
+/**
+ * @return the oldest complete packet, NULL if there is none. It stays in
+ * the queue until uplink_rx_pop().
+ */
+static inline const uplink_pkt_t *
+uplink_rx_peek (const uplink_rx_t *u)
+{
+  return u->count ? &u->slot[u->head] : NULL;
+}
+
+/**
+ * @return the size of a queued packet with its size byte
+ */
+static inline size_t
+uplink_pkt_len (const uplink_pkt_t *p)
+{
+  return 1 + (size_t) p->buf[0];
+}
+
+void
+uplink_rx_pop (uplink_rx_t *u);
+
+#endif /* INC_UPLINK_RX_H_ */
@@ -23,6 +23,14 @@
 #include <stdint.h>
 #include <stddef.h>
 
+/**
+ * Checks a condition, evaluating to 1 if it holds. The UPSat logging
+ * service is not part of this build, so a failure is not reported.
+ */
+#ifndef C_ASSERT
+#define C_ASSERT(e) ((e) ? 1 : 0)
+#endif
+
 /**
  * Lookup table for the CCITT CRC16
  */
@@ -20,19 +20,20 @@
 #include "ax25.h"
 // #include "log.h"
 #include <string.h>
-#include "stm32f4xx_hal.h"
 // #include "services.h"
 #include "scrambler.h"
+#include "comms_stats.h"
+#if COMMS_UART_DBG_EN
+#include "stm32f4xx_hal.h"
 #include "pymem.h" // for debug purposes
+#endif
 
 #undef __FILE_ID__
 #define __FILE_ID__ 669
 
 static const uint8_t AX25_SYNC_FLAG_MAP_BIN[8] = {0, 1, 1, 1, 1, 1, 1, 0};
-uint8_t interm_send_buf[AX25_PREAMBLE_LEN + AX25_POSTAMBLE_LEN
-			+ AX25_MAX_FRAME_LEN + AX25_MAX_ADDR_LEN] = {0};
-uint8_t tmp_bit_buf[(AX25_PREAMBLE_LEN + AX25_POSTAMBLE_LEN
-    + AX25_MAX_FRAME_LEN + AX25_MAX_ADDR_LEN) * 8] = {0};
+uint8_t interm_send_buf[AX25_MAX_ENCODED_LEN] = {0};
+uint8_t tmp_bit_buf[AX25_MAX_STUFFED_BITS] = {0};
 uint8_t tmp_buf[AX25_MAX_FRAME_LEN * 2] = {0};
 
 scrambler_handle_t h_scrabler;
@@ -69,7 +70,7 @@ ax25_create_addr_field (uint8_t *out, const uint8_t  *dest_addr,
 {
   uint16_t i = 0;
 
-  for (i = 0; i < strnlen (dest_addr, AX25_CALLSIGN_MAX_LEN); i++) {
+  for (i = 0; i < strnlen ((const char *) dest_addr, AX25_CALLSIGN_MAX_LEN); i++) {
     *out++ = dest_addr[i] << 1;
   }
   /*
@@ -84,7 +85,7 @@ ax25_create_addr_field (uint8_t *out, const uint8_t  *dest_addr,
   *out++ = ((0x0F & dest_ssid) << 1) | 0x60;
   //*out++ = ((0b1111 & dest_ssid) << 1) | 0b01100000;
 
-  for (i = 0; i < strnlen (src_addr, AX25_CALLSIGN_MAX_LEN); i++) {
+  for (i = 0; i < strnlen ((const char *) src_addr, AX25_CALLSIGN_MAX_LEN); i++) {
     *out++ = src_addr[i] << 1;
   }
   for (; i < AX25_CALLSIGN_MAX_LEN; i++) {
@@ -243,9 +244,27 @@ ax25_decoder_enter_frame_end(ax25_handle_t *h)
   h->dec_byte = 0x0;
 }
 
+/**
+ * Keeps the bits of the current byte that follow the flag ending a frame.
+ * When frames share a flag they already belong to the next frame.
+ * @param cur the byte being decoded
+ * @param pos the position of the last bit of the flag in \p cur
+ * @param cur_bits the number of bits \p cur holds
+ */
+static inline void
+ax25_decoder_keep_rest(ax25_handle_t *h, uint8_t cur, uint8_t pos,
+		       uint8_t cur_bits)
+{
+  h->rest = pos + 1 < 8 ? cur >> (pos + 1) : 0;
+  h->rest_bits = cur_bits - pos - 1;
+}
+
 /**
  * This function tries to find a valid AX.25 frame. Consecutive calls of this
- * function will continue the decoding of a frame.
+ * function will continue the decoding of a frame. When a frame ends in the
+ * middle of a byte the rest of that byte is decoded first on the next call,
+ * so frames sharing a flag are all found; the bytes after it in
+ * \p ax25_frame are not, feed the stream a byte at a time.
  * @param h the AX.25 handle
  * @param out the output buffer
  * @param out_len the length of the decoded frame, if any
@@ -262,9 +281,22 @@ ax25_decode (ax25_handle_t *h, uint8_t *out, size_t *out_len,
   uint16_t fcs;
   uint16_t recv_fcs;
   uint16_t new_bit;
-
-  for(i = 0; i < len * 8; i++){
-    new_bit = (((ax25_frame[i/8] >> (i%8) ) & 0x1) << 7);
+  uint8_t rest = h->rest;
+  uint8_t rest_bits = h->rest_bits;
+  uint8_t cur;
+  uint8_t pos;
+
+  h->rest_bits = 0;
+  for(i = 0; i < rest_bits + len * 8; i++){
+    if(i < rest_bits){
+      cur = rest;
+      pos = i;
+    }
+    else{
+      cur = ax25_frame[(i - rest_bits) / 8];
+      pos = (i - rest_bits) % 8;
+    }
+    new_bit = ((cur >> pos) & 0x1) << 7;
     h->shift_reg = (h->shift_reg >> 1) | new_bit;
     h->dec_byte = (h->dec_byte >> 1) | new_bit;
 
@@ -289,20 +321,31 @@ ax25_decode (ax25_handle_t *h, uint8_t *out, size_t *out_len,
 	    ax25_decoder_enter_sync(h);
 	  }
 	  else{
-	    /* This was the end of frame. Check the CRC*/
+	    /*
+	     * This was the end of frame. Check the CRC. Either way the flag
+	     * may also open the next frame, so start over in sync; the
+	     * caller takes the frame out of \p out before the next call.
+	     */
 	    if(h->decoded_num > AX25_MIN_ADDR_LEN){
 	      fcs = ax25_fcs(out, h->decoded_num - sizeof(uint16_t));
 	      recv_fcs = ( ((uint16_t)out[h->decoded_num - 1]) << 8) |
 		  out[h->decoded_num - 2];
 	      if(recv_fcs == fcs){
 		*out_len = h->decoded_num - sizeof(uint16_t);
+		comms_stats_frame_in (COMMS_LINK_RF, *out_len);
+		ax25_decoder_enter_sync(h);
+		ax25_decoder_keep_rest(h, cur, pos, i < rest_bits ? rest_bits : 8);
 		return AX25_DEC_OK;
 	      }
 	      else{
+		comms_stats.now.link[COMMS_LINK_RF].crc_fails++;
+		ax25_decoder_enter_sync(h);
+		ax25_decoder_keep_rest(h, cur, pos, i < rest_bits ? rest_bits : 8);
 		return AX25_DEC_CRC_FAIL;
 	      }
 	    }
-	    ax25_decoder_enter_frame_end(h);
+	    /* Too short to be a frame, it was noise between flags */
+	    ax25_decoder_enter_sync(h);
 	  }
 	}
 	else if ((h->shift_reg & 0xfc) == 0x7c) {
@@ -311,6 +354,7 @@ ax25_decode (ax25_handle_t *h, uint8_t *out, size_t *out_len,
 	}
 	else if((h->shift_reg & 0xfe) == 0xfe){
 	  /* This is definitely an error */
+	  comms_stats.now.link[COMMS_LINK_RF].aborts++;
 	  ax25_decoder_reset(h);
 	}
 	else{
@@ -321,6 +365,7 @@ ax25_decode (ax25_handle_t *h, uint8_t *out, size_t *out_len,
 
 	    /* if the maximum allowed frame reached, restart */
 	    if(h->decoded_num > AX25_MAX_FRAME_LEN){
+	      comms_stats.now.link[COMMS_LINK_RF].sync_losses++;
 	      ax25_decoder_reset(h);
 	    }
 	  }
@@ -350,30 +395,15 @@ ax25_decode (ax25_handle_t *h, uint8_t *out, size_t *out_len,
 }
 
 /**
- * Prepared the AX.25 bit-stream that should be sent over the air.
- * The data are scrambled using the G3RUH self-synchronizing scrambler and
- * then are NRZI encoded. Also as AX.25 dictates that the LS bits should be
- * sent first, this function properly swap the bits in every bit. So the
- * transmitting routing should sent the bits MS bit first. This is performed
- * for user convenient due to the fact that most teleccomunication systems
- * send the MS first.
- *
- * @param out the output buffer that will hold the encoded data
- * @param in the input data containing the payload
- * @param len the length of the input data
- * @param is_wod set to true if this frame is a WOD
- * @return the length of the encoded data or -1 in case of error
+ * Builds the UI frame of a payload, with the AX.25 preamble and postamble,
+ * in interm_send_buf
+ * @return the length of the frame or 0 in case of error
  */
-int32_t
-ax25_send(uint8_t *out, const uint8_t *in, size_t len, uint8_t is_wod)
+static size_t
+ax25_prepare_ui (const uint8_t *in, size_t len, uint8_t is_wod)
 {
-  ax25_encode_status_t status;
   uint8_t addr_buf[AX25_MAX_ADDR_LEN] = {0};
   size_t addr_len = 0;
-  size_t interm_len;
-  size_t ret_len;
-  size_t i;
-  size_t pad_bits = 0;
   uint8_t dest_ssid = is_wod ? __UPSAT_DEST_SSID_WOD :__UPSAT_DEST_SSID;
 
   /* Create the address field */
@@ -383,66 +413,122 @@ ax25_send(uint8_t *out, const uint8_t *in, size_t len, uint8_t is_wod)
 				     (const uint8_t *) __UPSAT_CALLSIGN,
 				     __UPSAT_SSID);
 
+#if COMMS_UART_DBG_EN
   py_cmd('w', "addr_field", sizeof("addr_field"));
   py_cmd('b', addr_buf,addr_len);
-  HAL_Delay(100);
+#endif
 
   /*
    * Prepare address and payload into one frame placing the result in
    * an intermediate buffer
    */
-  interm_len = ax25_prepare_frame (interm_send_buf, in, len, AX25_UI_FRAME,
-				   addr_buf, addr_len, __UPSAT_AX25_CTRL, 1);
+  return ax25_prepare_frame (interm_send_buf, in, len, AX25_UI_FRAME,
+			     addr_buf, addr_len, __UPSAT_AX25_CTRL, 1);
+}
+
+/**
+ * Builds the bit stuffed AX.25 frame, packed LS bit first into bytes and
+ * padded to a whole byte, but not yet scrambled. ax25_send() completes it
+ * for the air.
+ *
+ * @param out the output buffer, at least AX25_MAX_ENCODED_LEN bytes. It
+ * may be interm_send_buf.
+ * @param in the input data containing the payload
+ * @param len the length of the input data
+ * @param is_wod set to true if this frame is a WOD
+ * @return the length of the encoded data or -1 in case of error
+ */
+int32_t
+ax25_encode_frame(uint8_t *out, const uint8_t *in, size_t len, uint8_t is_wod)
+{
+  ax25_encode_status_t status;
+  size_t interm_len;
+  size_t ret_len;
+  size_t i;
+
+  interm_len = ax25_prepare_ui (in, len, is_wod);
   if(interm_len == 0){
     return -1;
   }
 
+#if COMMS_UART_DBG_EN
   py_cmd('w', "frame", sizeof("frame"));
   py_cmd('b', interm_send_buf, interm_len);
-  HAL_Delay(100);
+#endif
 
   status = ax25_bit_stuffing(tmp_bit_buf, &ret_len, interm_send_buf, interm_len);
   if( status != AX25_ENC_OK){
     return -1;
   }
 
+#if COMMS_UART_DBG_EN
   py_cmd('w', "stuffed", sizeof("stuffed"));
   py_cmd('b', tmp_bit_buf, ret_len);
-  HAL_Delay(100);
+#endif
 
-  /* Pack now the bits into full bytes */
-  memset(interm_send_buf, 0, interm_len);
+  /*
+   * Pack now the bits into full bytes. Stuffing made the frame longer.
+   * Perhaps some padding is needed due to bit stuffing, the cleared bits
+   * take care of it.
+   */
+  memset(out, 0, (ret_len + 7) / 8);
   for (i = 0; i < ret_len; i++) {
-    interm_send_buf[i/8] |= tmp_bit_buf[i] << (i % 8);
+    out[i/8] |= tmp_bit_buf[i] << (i % 8);
   }
+  /* Counted as received: address, control, PID and info */
+  comms_stats_frame_out (COMMS_LINK_RF, AX25_MIN_ADDR_LEN + 2 + len);
 
+#if COMMS_UART_DBG_EN
   py_cmd('w', "packed", sizeof("packed"));
-  py_cmd('b', interm_send_buf, interm_len);
-  HAL_Delay(100);
+  py_cmd('b', out, (ret_len + 7) / 8);
+#endif
+
+  return (ret_len + 7) / 8;
+}
+
+/**
+ * Prepared the AX.25 bit-stream that should be sent over the air.
+ * The data are scrambled using the G3RUH self-synchronizing scrambler and
+ * then are NRZI encoded. Also as AX.25 dictates that the LS bits should be
+ * sent first, this function properly swap the bits in every bit. So the
+ * transmitting routing should sent the bits MS bit first. This is performed
+ * for user convenient due to the fact that most teleccomunication systems
+ * send the MS first.
+ *
+ * @param out the output buffer that will hold the encoded data
+ * @param in the input data containing the payload
+ * @param len the length of the input data
+ * @param is_wod set to true if this frame is a WOD
+ * @return the length of the encoded data or -1 in case of error
+ */
+int32_t
+ax25_send(uint8_t *out, const uint8_t *in, size_t len, uint8_t is_wod)
+{
+  int32_t ret_len;
+  int32_t i;
 
-  /*Perhaps some padding is needed due to bit stuffing */
-  if(ret_len % 8){
-    pad_bits = 8 - (ret_len % 8);
+  ret_len = ax25_encode_frame (interm_send_buf, in, len, is_wod);
+  if(ret_len < 0){
+    return -1;
   }
-  ret_len += pad_bits;
 
   /* Perform NRZI and scrambling based on the G3RUH polynomial */
   scrambler_init (&h_scrabler, __SCRAMBLER_POLY, __SCRAMBLER_SEED,
 		  __SCRAMBLER_ORDER);
   scrambler_reset(&h_scrabler);
-  scramble_data_nrzi(&h_scrabler, out, interm_send_buf,
-		     ret_len/8);
+  scramble_data_nrzi(&h_scrabler, out, interm_send_buf, ret_len);
 
-  py_cmd('w', "scramnled", sizeof("scramnled"));
-  py_cmd('b', interm_send_buf, interm_len);
-  HAL_Delay(100);
+#if COMMS_UART_DBG_EN
+  py_cmd('w', "scrambled", sizeof("scrambled"));
+  py_cmd('b', out, ret_len);
+#endif
 
   /* AX.25 sends LS bit first*/
-  for(i = 0; i < ret_len/8; i++){
+  for(i = 0; i < ret_len; i++){
     out[i] = reverse_byte(out[i]);
   }
 
-  return ret_len/8;
+  return ret_len;
 }
 
 /**
@@ -466,18 +552,32 @@ ax25_recv_nrzi (ax25_handle_t *h, uint8_t *out, size_t *out_len,
 		const uint8_t *in, size_t len)
 {
   size_t decode_len;
+  size_t i;
+  uint8_t b;
   ax25_decode_status_t status;
 
   if (len == 0) {
     return AX25_DEC_NOT_READY;
   }
+  if (len > sizeof(tmp_buf)) {
+    return AX25_DEC_SIZE_ERROR;
+  }
 
-  /* Now descramble the AX.25 frame and at the same time do the NRZI decoding */
-  descramble_data_nrzi (&h->descrambler, tmp_buf, in, len);
+  /*
+   * ax25_send() scrambles first and swaps the bit order last, so undo the
+   * swap before descrambling. At the same time do the NRZI decoding.
+   */
+  for (i = 0; i < len; i++) {
+    b = reverse_byte (in[i]);
+    descramble_data_nrzi (&h->descrambler, tmp_buf + i, &b, 1);
+  }
 
-  status  = ax25_recv(h, out, &decode_len, tmp_buf, len);
+  status = ax25_decode (h, out, &decode_len, tmp_buf, len);
+  if (status != AX25_DEC_OK) {
+    return status;
+  }
   *out_len = decode_len;
-  return status;
+  return AX25_DEC_OK;
 }
 
 /**
@@ -506,6 +606,9 @@ ax25_recv(ax25_handle_t *h, uint8_t *out, size_t *out_len, const uint8_t *in, si
   if(len == 0) {
     return AX25_DEC_NOT_READY;
   }
+  if(len > sizeof(tmp_buf)) {
+    return AX25_DEC_SIZE_ERROR;
+  }
 
   for(i = 0; i < len; i++){
     tmp_buf[i] = reverse_byte(in[i]);
@@ -612,5 +715,6 @@ ax25_rx_reset(ax25_handle_t *h)
   h->state = AX25_NO_SYNC;
   h->shift_reg = 0x0;
   h->bit_cnt = 0;
+  h->rest_bits = 0;
   return descrambler_reset(&h->descrambler);
 }
@@ -0,0 +1,115 @@
+/*
+ * bench.c
+ *	Description: On-target benchmarks timed with the DWT cycle counter.
+ */
+
+#include "bench.h"
+#include "pymem.h"
+#include "sha256.h"
+#include "lzss.h"
+#include <stdio.h>
+#include <string.h>
+
+static uint8_t bench_buf[BENCH_BUF_LEN];
+
+/**
+ * Enables the DWT cycle counter
+ */
+void
+bench_init (void)
+{
+  size_t i;
+
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  for (i = 0; i < BENCH_BUF_LEN; i++) {
+    bench_buf[i] = (uint8_t) (i * 31 + 7);
+  }
+}
+
+/**
+ * Prints the result of a benchmark as cycles per byte with two decimals
+ * @param name the name of the benchmark
+ * @param cycles the elapsed cycles
+ * @param bytes the number of bytes processed
+ */
+void
+bench_report (const char *name, uint32_t cycles, size_t bytes)
+{
+  char line[64];
+  uint32_t cpb_x100;
+  int len;
+
+  if (bytes == 0) {
+    return;
+  }
+  cpb_x100 = (uint32_t) (((uint64_t) cycles * 100) / bytes);
+  len = snprintf (line, sizeof(line), "%s: %lu.%02lu cycles/byte\n", name,
+		  (unsigned long) (cpb_x100 / 100),
+		  (unsigned long) (cpb_x100 % 100));
+  if (len <= 0) {
+    return;
+  }
+  if (len >= (int) sizeof(line)) {
+    len = sizeof(line) - 1;
+  }
+  ser_print ((uint8_t *) line, len);
+}
+
+/**
+ * Measures the SHA-256 throughput on BENCH_BUF_LEN bytes
+ * @return the elapsed cycles
+ */
+uint32_t
+bench_sha256 (void)
+{
+  uint8_t digest[SHA256_DIGEST_LEN];
+  uint32_t start;
+  uint32_t cycles;
+
+  start = bench_cycles ();
+  sha256 (digest, bench_buf, BENCH_BUF_LEN);
+  cycles = bench_cycles () - start;
+
+  bench_report ("sha256", cycles, BENCH_BUF_LEN);
+  return cycles;
+}
+
+/**
+ * Measures the LZSS compressor and decompressor on BENCH_BUF_LEN bytes of
+ * the bench pattern
+ * @return the elapsed cycles of the compressor
+ */
+uint32_t
+bench_lzss (void)
+{
+  static lzss_enc_t enc;
+  static lzss_dec_t dec;
+  static uint8_t comp[LZSS_MAX_OUTPUT(BENCH_BUF_LEN) + 4];
+  static uint8_t back[BENCH_BUF_LEN];
+  size_t clen;
+  size_t dlen;
+  size_t used;
+  uint32_t start;
+  uint32_t cycles;
+
+  start = bench_cycles ();
+  lzss_enc_init (&enc);
+  lzss_enc_sink (&enc, bench_buf, BENCH_BUF_LEN);
+  lzss_enc_finish (&enc);
+  lzss_enc_poll (&enc, comp, sizeof(comp), &clen);
+  cycles = bench_cycles () - start;
+  bench_report ("lzss compress", cycles, BENCH_BUF_LEN);
+
+  start = bench_cycles ();
+  lzss_dec_init (&dec);
+  lzss_decode (&dec, back, sizeof(back), &dlen, comp, clen, &used);
+  bench_report ("lzss decompress", bench_cycles () - start, BENCH_BUF_LEN);
+
+  if (dlen != BENCH_BUF_LEN || memcmp (back, bench_buf, dlen) != 0) {
+    ser_print ((uint8_t *) "lzss round trip FAIL\n", 21);
+  }
+  return cycles;
+}
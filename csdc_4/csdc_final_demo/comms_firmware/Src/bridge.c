@@ -0,0 +1,267 @@
+/*
+ * bridge.c
+ *	Description: Packet relay between the ground station and the CDH.
+ *
+ *	Each direction reads only the bytes its packets still need, so
+ *	whatever follows stays in the port until there is room for it.
+ *	Uplink packets wait in the queue of uplink_rx for room in the output
+ *	queues, commands are never dropped. The downlink cannot wait: the
+ *	ground line also carries the uplink echoes and one size byte more per
+ *	packet, so a CDH sending at line rate would overrun its receive buffer
+ *	and break the framing.
+ *	A downlink packet that finds the ground queue full is dropped whole.
+ */
+
+#include "bridge.h"
+#include "comms_stats.h"
+#include <string.h>
+
+/**
+ * Initializes the bridge
+ * @param b the bridge
+ * @param gnd the port of the ground station
+ * @param cdh the port of the CDH
+ * @param router routes the uplink packets, NULL sends all of them to the CDH
+ * @param sched schedules what goes to the ground, NULL writes it to the
+ * ground port in arrival order and the latencies leave out the wait in the
+ * port's send queue
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+bridge_init (bridge_t *b, const bridge_port_t *gnd, const bridge_port_t *cdh,
+	     router_t *router, tx_sched_t *sched)
+{
+  if (!b || !gnd || !cdh || !gnd->read || !gnd->write || !cdh->read
+      || !cdh->write) {
+    return -1;
+  }
+  memset (b, 0, sizeof(bridge_t));
+  b->gnd = *gnd;
+  b->cdh = *cdh;
+  b->router = router;
+  b->sched = sched;
+  dedup_init (&b->dedup);
+  uplink_rx_init (&b->ul);
+  b->dl.need = 3;
+  /* The downlink is stored as it goes to the ground, after a size byte */
+  b->dl.got = 1;
+  return 0;
+}
+
+/**
+ * Drops a CDH packet that stopped arriving
+ */
+static void
+bridge_resync (bridge_rx_t *rx, uint32_t now_ms)
+{
+  if (now_ms - rx->last_ms < BRIDGE_RESYNC_MS) {
+    return;
+  }
+  if (rx->got > 1) {
+    comms_stats.now.link[COMMS_LINK_CDH].sync_losses++;
+  }
+  rx->got = 1;
+  rx->need = 3;
+}
+
+/**
+ * Queues a packet for the ground. Its latency, if \p lat is not
+ * COMMS_LAT_NUM, counts from \p since_ms to when it is written to the
+ * ground port: after the wait in the scheduler queue when there is one.
+ * @return 0 on success or -1 if there is no room
+ */
+static int32_t
+bridge_to_gnd (bridge_t *b, tx_class_t cls, const uint8_t *data, size_t len,
+	       comms_lat_t lat, uint32_t since_ms, uint32_t now_ms)
+{
+  if (b->sched) {
+    return tx_sched_put_timed (b->sched, cls, data, len, lat, since_ms);
+  }
+  if (b->gnd.write (b->gnd.priv, data, len)) {
+    return -1;
+  }
+  comms_stats_frame_out (COMMS_LINK_GND, len);
+  if (lat < COMMS_LAT_NUM) {
+    comms_stats_latency (lat, now_ms - since_ms);
+  }
+  return 0;
+}
+
+/**
+ * Decides where a complete ground packet goes besides the echo. A repeat
+ * goes nowhere, whatever its address: a command run on the comms MCU must
+ * not run twice any more than one for the CDH. The echo still goes out, it
+ * is the acknowledgment the ground is waiting for.
+ */
+static void
+bridge_route (bridge_t *b, const uplink_pkt_t *p, uint32_t now_ms)
+{
+  size_t n;
+
+  if (p->buf[0] < 2) {
+    return;			/* a sequence byte alone, nothing to pass on */
+  }
+  if (dedup_check (&b->dedup, p->buf[1], p->buf + 2, p->buf[0] - 1, now_ms)) {
+    comms_stats.now.link[COMMS_LINK_GND].duplicates++;
+    return;
+  }
+  if (!b->router) {
+    b->ul_pending |= BRIDGE_TO_CDH;
+    return;
+  }
+  switch (router_dispatch (b->router, p->buf + 2, p->buf[0] - 1, b->reply + 1,
+			   &n)) {
+    case ROUTER_TO_CDH:
+      b->ul_pending |= BRIDGE_TO_CDH;
+      break;
+    case ROUTER_LOCAL:
+      if (n) {
+	b->reply[0] = (uint8_t) n;
+	b->reply_len = n + 1;
+	b->ul_pending |= BRIDGE_TO_REPLY;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Moves ground packets forward
+ * @return 1 if anything was read or written
+ */
+static uint8_t
+bridge_uplink (bridge_t *b, uint32_t now_ms)
+{
+  const uplink_pkt_t *p;
+  uint8_t progress;
+
+  progress = uplink_rx_poll (&b->ul, b->gnd.read, b->gnd.priv, now_ms);
+  p = uplink_rx_peek (&b->ul);
+  if (!p) {
+    return progress;
+  }
+  if (!b->ul_pending) {
+    comms_stats_frame_in (COMMS_LINK_GND, p->buf[0]);
+    b->ul_pending = BRIDGE_TO_GND;
+    bridge_route (b, p, now_ms);
+  }
+
+  if ((b->ul_pending & BRIDGE_TO_GND)
+      && bridge_to_gnd (b, TX_CLASS_REPLY, p->buf, uplink_pkt_len (p),
+			COMMS_LAT_NUM, 0, now_ms) == 0) {
+    b->ul_pending &= ~BRIDGE_TO_GND;
+    progress = 1;
+  }
+  if ((b->ul_pending & BRIDGE_TO_CDH)
+      && b->cdh.write (b->cdh.priv, p->buf + 2, p->buf[0] - 1) == 0) {
+    comms_stats_frame_out (COMMS_LINK_CDH, p->buf[0] - 1);
+    comms_stats_latency (COMMS_LAT_UPLINK, now_ms - p->first_ms);
+    b->ul_pending &= ~BRIDGE_TO_CDH;
+    progress = 1;
+  }
+  /* A local reply follows the echo of its request */
+  if ((b->ul_pending & BRIDGE_TO_REPLY) && !(b->ul_pending & BRIDGE_TO_GND)
+      && bridge_to_gnd (b, TX_CLASS_REPLY, b->reply, b->reply_len,
+			COMMS_LAT_LOCAL, p->first_ms, now_ms) == 0) {
+    b->ul_pending &= ~BRIDGE_TO_REPLY;
+    progress = 1;
+  }
+  if (!b->ul_pending) {
+    uplink_rx_pop (&b->ul);
+  }
+  return progress;
+}
+
+/**
+ * Moves a CDH packet forward
+ * @return 1 if anything was read or written
+ */
+static uint8_t
+bridge_downlink (bridge_t *b, uint32_t now_ms)
+{
+  bridge_rx_t *rx = &b->dl;
+  uint8_t progress = 0;
+  size_t n;
+
+  n = b->cdh.read (b->cdh.priv, rx->buf + rx->got, rx->need - rx->got);
+  if (n) {
+    if (rx->got == 1) {
+      rx->start_ms = now_ms;
+    }
+    rx->got += n;
+    rx->last_ms = now_ms;
+    progress = 1;
+  }
+  if (rx->got == 3 && rx->need == 3) {
+    if (rx->buf[2] > BRIDGE_MAX_DL_LEN) {
+      /* Not a header, try again from the next byte */
+      rx->buf[1] = rx->buf[2];
+      rx->got = 2;
+      comms_stats.now.link[COMMS_LINK_CDH].sync_losses++;
+      return progress;
+    }
+    rx->need = 3 + rx->buf[2];
+  }
+  if (rx->got < rx->need) {
+    bridge_resync (rx, now_ms);
+    return progress;
+  }
+
+  comms_stats_frame_in (COMMS_LINK_CDH, rx->got - 1);
+  rx->buf[0] = (uint8_t) (rx->got - 1);
+  if (b->sched && router_head_valid (rx->buf[1])
+      && router_head_addr (rx->buf[1]) == ROUTER_ADDR_COMMS) {
+    /* The WOD of the OBC, sent by the beacon */
+    tx_sched_wod (b->sched, rx->buf, rx->got);
+  }
+  else if (bridge_to_gnd (b, TX_CLASS_FILE, rx->buf, rx->got,
+			  COMMS_LAT_DOWNLINK, rx->start_ms, now_ms)) {
+    comms_stats.now.link[COMMS_LINK_GND].drops++;
+  }
+  rx->got = 1;
+  rx->need = 3;
+  return 1;
+}
+
+/**
+ * Moves data between the ports. Call it whenever a port may have received
+ * data or made room.
+ * @param b the bridge
+ * @param now_ms the current time in milliseconds
+ * @return 1 if anything happened, 0 if the bridge waits for the ports
+ */
+uint8_t
+bridge_poll (bridge_t *b, uint32_t now_ms)
+{
+  uint8_t progress;
+
+  progress = bridge_uplink (b, now_ms);
+  progress |= bridge_downlink (b, now_ms);
+  if (b->sched) {
+    progress |= tx_sched_poll (b->sched, now_ms);
+  }
+  return progress;
+}
+
+/**
+ * Sends a packet of the comms MCU to the ground, framed as the downlink,
+ * with the file data
+ * @param b the bridge
+ * @param pkt the packet, [head][n][n bytes]
+ * @param len the size of the packet
+ * @return 0 on success or -1 if the packet is malformed or the ground
+ * queue has no room for it
+ */
+int32_t
+bridge_send (bridge_t *b, const uint8_t *pkt, size_t len)
+{
+  uint8_t buf[BRIDGE_MAX_DL_LEN + 3];
+
+  if (len < 2 || len > BRIDGE_MAX_DL_LEN + 2 || pkt[1] != len - 2) {
+    return -1;
+  }
+  buf[0] = (uint8_t) len;
+  memcpy (buf + 1, pkt, len);
+  return bridge_to_gnd (b, TX_CLASS_FILE, buf, len + 1, COMMS_LAT_NUM, 0, 0);
+}
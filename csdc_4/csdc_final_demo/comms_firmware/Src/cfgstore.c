@@ -0,0 +1,334 @@
+/*
+ * cfgstore.c
+ *	Description: Key / value store of the comms parameters in flash.
+ */
+
+#include "cfgstore.h"
+#include "utils.h"
+
+#define CFGSTORE_BANK_CRC_LEN offsetof(cfgstore_bank_t, crc)
+#define CFGSTORE_ERASED 0xFFFFFFFF
+
+static inline uint32_t
+cfgstore_base (const cfgstore_t *s, uint8_t bank)
+{
+  return flash_sectors[s->sector[bank]].addr;
+}
+
+static inline uint32_t
+cfgstore_end (const cfgstore_t *s, uint8_t bank)
+{
+  return flash_sectors[s->sector[bank]].addr
+      + flash_sectors[s->sector[bank]].len;
+}
+
+static uint16_t
+cfgstore_rec_crc (const cfgstore_rec_t *r)
+{
+  uint16_t crc;
+
+  crc = crc16_ccitt (&r->key, 2);
+  return update_crc16_ccitt (crc, r->value, CFGSTORE_MAX_VALUE_LEN);
+}
+
+/**
+ * Reads the header of a bank
+ * @return the sequence number of the bank or 0 if it holds no valid one
+ */
+static uint32_t
+cfgstore_bank_seq (const cfgstore_t *s, uint8_t bank)
+{
+  cfgstore_bank_t h;
+
+  if (flash_dev_read (s->dev, cfgstore_base (s, bank), (uint8_t *) &h,
+		      sizeof(h))
+      || h.magic != CFGSTORE_MAGIC
+      || h.crc != crc16_ccitt ((const uint8_t *) &h, CFGSTORE_BANK_CRC_LEN)) {
+    return 0;
+  }
+  return h.seq;
+}
+
+static uint8_t
+cfgstore_blank (const cfgstore_t *s, uint8_t bank)
+{
+  uint32_t buf[16];
+  uint32_t addr;
+  size_t i;
+
+  for (addr = cfgstore_base (s, bank); addr < cfgstore_end (s, bank);
+      addr += sizeof(buf)) {
+    if (flash_dev_read (s->dev, addr, (uint8_t *) buf, sizeof(buf))) {
+      return 0;
+    }
+    for (i = 0; i < sizeof(buf) / sizeof(buf[0]); i++) {
+      if (buf[i] != CFGSTORE_ERASED) {
+	return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+/**
+ * Erases a bank unless it is already blank
+ */
+static int32_t
+cfgstore_wipe (cfgstore_t *s, uint8_t bank)
+{
+  if (cfgstore_blank (s, bank)) {
+    return 0;
+  }
+  return s->dev->erase_sector (s->dev, s->sector[bank]);
+}
+
+/**
+ * Writes the header that makes a bank valid
+ */
+static int32_t
+cfgstore_header (cfgstore_t *s, uint8_t bank, uint32_t seq)
+{
+  cfgstore_bank_t h;
+
+  h.magic = CFGSTORE_MAGIC;
+  h.seq = seq;
+  h.crc = crc16_ccitt ((const uint8_t *) &h, CFGSTORE_BANK_CRC_LEN);
+  h.reserved = 0xFFFF;
+  return flash_dev_program (s->dev, cfgstore_base (s, bank),
+			    (const uint8_t *) &h, sizeof(h));
+}
+
+/**
+ * Replays the log of the active bank into the cache
+ */
+static void
+cfgstore_load (cfgstore_t *s)
+{
+  cfgstore_rec_t r;
+  cfgstore_entry_t *e;
+  uint32_t addr = cfgstore_base (s, s->bank) + sizeof(cfgstore_bank_t);
+  uint32_t first;
+
+  for (; addr + sizeof(r) <= cfgstore_end (s, s->bank); addr += sizeof(r)) {
+    if (flash_dev_read (s->dev, addr, (uint8_t *) &r, sizeof(r))) {
+      break;
+    }
+    memcpy (&first, &r, sizeof(first));
+    if (first == CFGSTORE_ERASED) {
+      break;
+    }
+    /* Torn writes are skipped, the next record goes after them */
+    if (r.key >= CFGSTORE_MAX_KEYS || r.len > CFGSTORE_MAX_VALUE_LEN
+	|| r.crc != cfgstore_rec_crc (&r)) {
+      s->torn++;
+      continue;
+    }
+    e = &s->entry[r.key];
+    memcpy (e->value, r.value, r.len);
+    e->len = r.len;
+    e->valid = 1;
+    e->addr = addr;
+  }
+  s->append = addr;
+}
+
+/**
+ * Opens the store and loads every value into the cache. A flash with no
+ * valid bank is formatted.
+ * @param s the store
+ * @param dev the flash device
+ * @param sector_a the sector of the first bank
+ * @param sector_b the sector of the second bank
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+cfgstore_init (cfgstore_t *s, const flash_dev_t *dev, uint8_t sector_a,
+	       uint8_t sector_b)
+{
+  uint32_t seq[2];
+
+  if (!s || !dev || sector_a >= FLASH_DEV_SECTORS
+      || sector_b >= FLASH_DEV_SECTORS || sector_a == sector_b) {
+    return -1;
+  }
+  memset (s, 0, sizeof(cfgstore_t));
+  s->dev = dev;
+  s->sector[0] = sector_a;
+  s->sector[1] = sector_b;
+
+  seq[0] = cfgstore_bank_seq (s, 0);
+  seq[1] = cfgstore_bank_seq (s, 1);
+  if (!seq[0] && !seq[1]) {
+    if (cfgstore_wipe (s, 0) || cfgstore_header (s, 0, 1)) {
+      return -1;
+    }
+    seq[0] = 1;
+  }
+  /* The newer bank, sequence numbers compared across the wrap */
+  s->bank = !seq[0] || (seq[1] && (int32_t) (seq[1] - seq[0]) > 0);
+  s->seq = seq[s->bank];
+  cfgstore_load (s);
+  return 0;
+}
+
+/**
+ * Changes a value in the cache. The flash follows on the next flush.
+ * @param s the store
+ * @param key the key
+ * @param value the value
+ * @param len the size of the value, at most CFGSTORE_MAX_VALUE_LEN
+ * @param now_ms the current time in milliseconds
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+cfgstore_set (cfgstore_t *s, uint8_t key, const void *value, size_t len,
+	      uint32_t now_ms)
+{
+  cfgstore_entry_t *e;
+
+  if (key >= CFGSTORE_MAX_KEYS || len > CFGSTORE_MAX_VALUE_LEN) {
+    return -1;
+  }
+  e = &s->entry[key];
+  /* Rewriting the same value would only wear the flash */
+  if (e->valid && e->len == len && memcmp (e->value, value, len) == 0) {
+    return 0;
+  }
+  memcpy (e->value, value, len);
+  e->len = (uint8_t) len;
+  e->valid = 1;
+  e->dirty = 1;
+  if (!s->dirty) {
+    s->dirty = 1;
+    s->dirty_ms = now_ms;
+  }
+  return 0;
+}
+
+/**
+ * Builds the records of the keys that need saving
+ * @param out room for CFGSTORE_MAX_KEYS records
+ * @param all every valid key, else only the changed ones
+ * @return the number of records
+ */
+static size_t
+cfgstore_batch (const cfgstore_t *s, cfgstore_rec_t *out, uint8_t all)
+{
+  cfgstore_rec_t *r = out;
+  const cfgstore_entry_t *e;
+  uint8_t key;
+
+  for (key = 0; key < CFGSTORE_MAX_KEYS; key++) {
+    e = &s->entry[key];
+    if (!e->valid || !(all || e->dirty)) {
+      continue;
+    }
+    memset (r, 0xFF, sizeof(cfgstore_rec_t));
+    r->key = key;
+    r->len = e->len;
+    memcpy (r->value, e->value, e->len);
+    r->crc = cfgstore_rec_crc (r);
+    r++;
+  }
+  return r - out;
+}
+
+/**
+ * Points the index at the records just written
+ */
+static void
+cfgstore_committed (cfgstore_t *s, const cfgstore_rec_t *batch, size_t n,
+		    uint32_t addr)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    s->entry[batch[i].key].addr = addr + i * sizeof(cfgstore_rec_t);
+    s->entry[batch[i].key].dirty = 0;
+  }
+  s->dirty = 0;
+  s->flushes++;
+}
+
+/**
+ * Moves the current values into the other bank
+ */
+static int32_t
+cfgstore_compact (cfgstore_t *s, cfgstore_rec_t *batch)
+{
+  uint8_t other = !s->bank;
+  uint32_t addr = cfgstore_base (s, other) + sizeof(cfgstore_bank_t);
+  /* 0 marks a bank with no valid header */
+  uint32_t seq = s->seq + 1 ? s->seq + 1 : 1;
+  size_t n;
+
+  if (cfgstore_wipe (s, other)) {
+    return -1;
+  }
+  n = cfgstore_batch (s, batch, 1);
+  if (n && flash_dev_program (s->dev, addr, (const uint8_t *) batch,
+			      n * sizeof(cfgstore_rec_t))) {
+    return -1;
+  }
+  /* The header goes last, until then the current bank stays valid */
+  if (cfgstore_header (s, other, seq)) {
+    return -1;
+  }
+  s->bank = other;
+  s->seq = seq;
+  s->append = addr + n * sizeof(cfgstore_rec_t);
+  cfgstore_committed (s, batch, n, addr);
+  s->compactions++;
+  return 0;
+}
+
+/**
+ * Appends the changed values to the log, in one program operation
+ * @param s the store
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+cfgstore_flush (cfgstore_t *s)
+{
+  cfgstore_rec_t batch[CFGSTORE_MAX_KEYS];
+  size_t len;
+  size_t n;
+
+  if (!s->dirty) {
+    return 0;
+  }
+  n = cfgstore_batch (s, batch, 0);
+  len = n * sizeof(cfgstore_rec_t);
+  if (s->append + len > cfgstore_end (s, s->bank)) {
+    return cfgstore_compact (s, batch);
+  }
+  if (flash_dev_program (s->dev, s->append, (const uint8_t *) batch, len)) {
+    /* Whatever got written is skipped as torn on the next load */
+    s->append += len;
+    return -1;
+  }
+  cfgstore_committed (s, batch, n, s->append);
+  s->append += len;
+  return 0;
+}
+
+/**
+ * Flushes the changes once they have waited CFGSTORE_FLUSH_MS, so changes
+ * made close together share one append. Call it from the main loop.
+ * @param s the store
+ * @param now_ms the current time in milliseconds
+ * @return 1 if the flash was written
+ */
+uint8_t
+cfgstore_poll (cfgstore_t *s, uint32_t now_ms)
+{
+  if (!s->dirty || now_ms - s->dirty_ms < CFGSTORE_FLUSH_MS) {
+    return 0;
+  }
+  if (cfgstore_flush (s)) {
+    /* Try again one period later */
+    s->dirty_ms = now_ms;
+    return 0;
+  }
+  return 1;
+}
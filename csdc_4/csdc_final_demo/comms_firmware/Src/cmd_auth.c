@@ -0,0 +1,121 @@
+/*
+ * cmd_auth.c
+ *	Description: Authentication of uplinked commands.
+ */
+
+#include "cmd_auth.h"
+#include "config.h"
+#include <string.h>
+
+static hmac_sha256_key_t cmd_key;
+static uint8_t cmd_key_valid = 0;
+
+/**
+ * Loads the shared secret used for the command HMAC. The key is
+ * pre-processed once here, so verifying a command costs only the hashing
+ * of the command itself.
+ * @param key the shared secret
+ * @param key_len the size of the secret
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+cmd_auth_init (const uint8_t *key, size_t key_len)
+{
+  if (!key || key_len == 0) {
+    return -1;
+  }
+  cmd_key_valid = 0;
+  if (hmac_sha256_set_key (&cmd_key, key, key_len)) {
+    return -1;
+  }
+  cmd_key_valid = 1;
+  return 0;
+}
+
+/**
+ * Checks an RF switch command. The command is the __COMMS_RF_SWITCH_CMD
+ * string followed by a __COMMS_RF_SWITCH_KEY_LEN bytes key, whose SHA-256
+ * digest should match __COMMS_RF_SWITCH_HASH.
+ * @param cmd the received command
+ * @param len the size of the command
+ * @return 1 if the command is a valid RF switch command, 0 otherwise
+ */
+uint8_t
+cmd_auth_rf_switch (const uint8_t *cmd, size_t len)
+{
+  uint8_t digest[SHA256_DIGEST_LEN];
+  size_t cmd_len = strlen (__COMMS_RF_SWITCH_CMD);
+
+  if (!cmd || len != cmd_len + __COMMS_RF_SWITCH_KEY_LEN) {
+    return 0;
+  }
+  if (memcmp (cmd, __COMMS_RF_SWITCH_CMD, cmd_len) != 0) {
+    return 0;
+  }
+  sha256 (digest, cmd + cmd_len, __COMMS_RF_SWITCH_KEY_LEN);
+  return sha256_equal (digest, __COMMS_RF_SWITCH_HASH, SHA256_DIGEST_LEN);
+}
+
+/**
+ * Starts the verification of a command that arrives in pieces. Feed the
+ * command bytes, excluding the tag, with hmac_sha256_update() as they are
+ * received and finish with cmd_auth_end().
+ * @param h the HMAC context
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+cmd_auth_begin (hmac_sha256_ctx_t *h)
+{
+  if (!cmd_key_valid) {
+    return -1;
+  }
+  return hmac_sha256_init (h, &cmd_key);
+}
+
+/**
+ * Finishes a command verification started with cmd_auth_begin()
+ * @param h the HMAC context
+ * @param tag the received tag. It is the leading \p tag_len bytes of the
+ * HMAC-SHA-256 of the command.
+ * @param tag_len the size of the tag
+ * @return 1 if the tag is valid, 0 otherwise
+ */
+uint8_t
+cmd_auth_end (hmac_sha256_ctx_t *h, const uint8_t *tag, size_t tag_len)
+{
+  uint8_t mac[SHA256_DIGEST_LEN];
+
+  if (!tag || tag_len < CMD_AUTH_MIN_TAG_LEN || tag_len > SHA256_DIGEST_LEN) {
+    return 0;
+  }
+  if (hmac_sha256_final (h, mac)) {
+    return 0;
+  }
+  return sha256_equal (mac, tag, tag_len);
+}
+
+/**
+ * Verifies a routed packet with its tag at the end of the data
+ * @param pkt the packet as the router parsed it, the tag included in its
+ * data
+ * @param tag_len the size of the trailing tag
+ * @return 1 if the tag is valid, 0 otherwise
+ */
+uint8_t
+cmd_auth_verify (const router_pkt_t *pkt, size_t tag_len)
+{
+  hmac_sha256_ctx_t h;
+  uint8_t head[2];
+
+  if (!pkt || pkt->len < tag_len) {
+    return 0;
+  }
+  if (cmd_auth_begin (&h)) {
+    return 0;
+  }
+  head[0] = router_head (pkt->addr, pkt->flag);
+  head[1] = pkt->len_cmd;
+  hmac_sha256_update (&h, head, sizeof(head));
+  hmac_sha256_update (&h, pkt->data, pkt->len - tag_len);
+  return cmd_auth_end (&h, pkt->data + pkt->len - tag_len, tag_len);
+}
@@ -0,0 +1,215 @@
+/*
+ * comms_cmd.c
+ *	Description: Packets handled by the comms MCU itself.
+ */
+
+#include "comms_cmd.h"
+#include "cmd_auth.h"
+#include "uart_dma.h"
+#include "config.h"
+#include "stm32f4xx_hal.h"
+#include <string.h>
+
+comms_cmd_t comms_cmd;
+
+static int32_t
+comms_cmd_handle (void *priv, const router_pkt_t *pkt, uint8_t *out,
+		  size_t *out_len);
+static int32_t
+comms_diag_handle (void *priv, const router_pkt_t *pkt, uint8_t *out,
+		   size_t *out_len);
+
+const router_route_t comms_routes[ROUTER_NUM_ADDR] =
+  {
+    /* ROUTER_ADDR_CDH, ROUTER_ADDR_PAYLOAD, ROUTER_ADDR_ADCS, ROUTER_ADDR_EPS */
+    { ROUTER_TO_CDH, NULL, NULL },
+    { ROUTER_TO_CDH, NULL, NULL },
+    { ROUTER_TO_CDH, NULL, NULL },
+    { ROUTER_TO_CDH, NULL, NULL },
+    /* ROUTER_ADDR_COMMS */
+    { ROUTER_LOCAL, comms_cmd_handle, &comms_cmd },
+    /* Unassigned, left to the CDH */
+    { ROUTER_TO_CDH, NULL, NULL },
+    { ROUTER_TO_CDH, NULL, NULL },
+    /* ROUTER_ADDR_DIAG */
+    { ROUTER_LOCAL, comms_diag_handle, NULL }
+  };
+
+static inline uint8_t *
+put_le32 (uint8_t *p, uint32_t v)
+{
+  p[0] = (uint8_t) v;
+  p[1] = (uint8_t) (v >> 8);
+  p[2] = (uint8_t) (v >> 16);
+  p[3] = (uint8_t) (v >> 24);
+  return p + 4;
+}
+
+/**
+ * Prepares the local handlers and the command key, loads the saved
+ * parameters and clears the link statistics
+ * @param router the router whose statistics are reported
+ */
+void
+comms_cmd_init (const router_t *router)
+{
+  uint8_t profile;
+  uint32_t rf_key;
+
+  memset (&comms_cmd, 0, sizeof(comms_cmd_t));
+  comms_cmd.router = router;
+  comms_cmd.profile = LINK_PROFILE_NOMINAL;
+  comms_cmd.rf_on = 1;
+  cmd_auth_init (__COMMS_CMD_KEY, sizeof(__COMMS_CMD_KEY));
+  if (cfgstore_init (&comms_cmd.cfg, &flash_internal, __COMMS_CFG_SECTOR_A,
+		     __COMMS_CFG_SECTOR_B) == 0) {
+    if (cfgstore_get (&comms_cmd.cfg, __COMMS_CFG_KEY_LINK_PROFILE, &profile,
+		      sizeof(profile)) == sizeof(profile)
+	&& profile < LINK_PROFILE_NUM) {
+      comms_cmd.profile = (link_profile_id_t) profile;
+    }
+    /* Only the exact off key turns it off, a damaged one leaves it on */
+    if (cfgstore_get (&comms_cmd.cfg, __COMMS_CFG_KEY_RF, &rf_key,
+		      sizeof(rf_key)) == sizeof(rf_key)
+	&& rf_key == __COMMS_RF_OFF_KEY) {
+      comms_cmd.rf_on = 0;
+    }
+  }
+  comms_stats_init (HAL_GetTick ());
+}
+
+/**
+ * Sends the telemetry frame to the ground once per COMMS_STATS_PERIOD_MS.
+ * If the ground queue is full the counts wait for the next period. Also
+ * saves the changed parameters.
+ * @param b the bridge to the ground
+ * @param now_ms the current time in milliseconds
+ */
+void
+comms_cmd_poll (bridge_t *b, uint32_t now_ms)
+{
+  uint8_t pkt[4 + COMMS_STATS_MAX_FRAME_LEN];
+  size_t n;
+
+  cfgstore_poll (&comms_cmd.cfg, now_ms);
+  if (!comms_cmd.rf_on
+      || now_ms - comms_stats.sent_ms < COMMS_STATS_PERIOD_MS) {
+    return;
+  }
+  n = comms_stats_encode (pkt + 4, now_ms);
+  pkt[0] = router_head (ROUTER_ADDR_COMMS, 1);
+  pkt[1] = (uint8_t) (n + 2);
+  pkt[2] = COMMS_CMD_TELEMETRY;
+  pkt[3] = ROUTER_STATUS_OK;
+  if (bridge_send (b, pkt, n + 4) == 0) {
+    comms_stats_commit (now_ms);
+  }
+}
+
+/**
+ * Builds the beacon sent while the OBC sends no WOD, a tx_sink_t fill
+ * callback
+ * @param priv unused
+ * @param out the packet as sent to the ground, room for
+ * TX_SCHED_MAX_PKT_LEN bytes
+ * @param now_ms the current time in milliseconds
+ * @return the size of the packet, 0 while the RF switch is off
+ */
+size_t
+comms_cmd_beacon (void *priv, uint8_t *out, uint32_t now_ms)
+{
+  size_t n;
+
+  (void) priv;
+  if (!comms_cmd.rf_on) {
+    return 0;
+  }
+  n = comms_stats_encode (out + 5, now_ms);
+  out[0] = (uint8_t) (n + 4);
+  out[1] = router_head (ROUTER_ADDR_COMMS, 1);
+  out[2] = (uint8_t) (n + 2);
+  out[3] = COMMS_CMD_BEACON;
+  out[4] = ROUTER_STATUS_OK;
+  return n + 5;
+}
+
+static size_t
+comms_cmd_status (comms_cmd_t *c, uint8_t *out)
+{
+  uint8_t *p = out;
+
+  p = put_le32 (p, HAL_GetTick ());
+  p = put_le32 (p, c->router->bad_packets);
+  p = put_le32 (p, c->router->errors);
+  p = put_le32 (p, uart_gnd.rx_errors);
+  p = put_le32 (p, uart_cdh.rx_errors);
+  *p++ = (uint8_t) c->profile;
+  p = put_le32 (p, SCB->VTOR);
+  *p++ = (uint8_t) c->fw.state;
+  p = put_le32 (p, c->fw.received);
+  return p - out;
+}
+
+static int32_t
+comms_cmd_handle (void *priv, const router_pkt_t *pkt, uint8_t *out,
+		  size_t *out_len)
+{
+  comms_cmd_t *c = (comms_cmd_t *) priv;
+  const uint8_t *rf_cmd;
+  uint32_t rf_key;
+  int32_t ret;
+
+  if (pkt->flag) {
+    if (!cmd_auth_verify (pkt, COMMS_CMD_TAG_LEN)) {
+      return -1;
+    }
+    ret = fwupdate_uplink (&c->fw, &flash_internal, SCB->VTOR, pkt->data,
+			   pkt->len - COMMS_CMD_TAG_LEN);
+    put_le32 (out, c->fw.received);
+    *out_len = 4;
+    return ret ? -1 : 0;
+  }
+
+  switch (pkt->len_cmd) {
+    case COMMS_CMD_STATUS:
+      *out_len = comms_cmd_status (c, out);
+      return 0;
+    case COMMS_CMD_TELEMETRY:
+      *out_len = comms_stats_encode (out, HAL_GetTick ());
+      return 0;
+    case COMMS_CMD_SET_PROFILE:
+      if (pkt->len != 1 + COMMS_CMD_TAG_LEN
+	  || !cmd_auth_verify (pkt, COMMS_CMD_TAG_LEN)
+	  || pkt->data[0] >= LINK_PROFILE_NUM) {
+	return -1;
+      }
+      c->profile = (link_profile_id_t) pkt->data[0];
+      return cfgstore_set (&c->cfg, __COMMS_CFG_KEY_LINK_PROFILE,
+			   pkt->data, 1, HAL_GetTick ());
+    case COMMS_CMD_RF_SWITCH:
+      rf_cmd = pkt->data + 1;
+      if (pkt->len < 1 || pkt->data[0] > 1
+	  || !cmd_auth_rf_switch (rf_cmd, pkt->len - 1)) {
+	return -1;
+      }
+      c->rf_on = pkt->data[0];
+      rf_key = c->rf_on ? __COMMS_RF_ON_KEY : __COMMS_RF_OFF_KEY;
+      return cfgstore_set (&c->cfg, __COMMS_CFG_KEY_RF, &rf_key,
+			   sizeof(rf_key), HAL_GetTick ());
+    default:
+      return -1;
+  }
+}
+
+static int32_t
+comms_diag_handle (void *priv, const router_pkt_t *pkt, uint8_t *out,
+		   size_t *out_len)
+{
+  (void) priv;
+  if (pkt->len > ROUTER_MAX_HANDLER_LEN) {
+    return -1;
+  }
+  memcpy (out, pkt->data, pkt->len);
+  *out_len = pkt->len;
+  return 0;
+}
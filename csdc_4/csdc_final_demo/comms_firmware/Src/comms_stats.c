@@ -0,0 +1,93 @@
+/*
+ * comms_stats.c
+ *	Description: Link statistics and their telemetry frame.
+ */
+
+#include "comms_stats.h"
+#include <string.h>
+
+comms_stats_t comms_stats;
+
+static inline uint8_t *
+put_varint (uint8_t *p, uint32_t v)
+{
+  while (v >= 0x80) {
+    *p++ = (uint8_t) (v | 0x80);
+    v >>= 7;
+  }
+  *p++ = (uint8_t) v;
+  return p;
+}
+
+static inline uint8_t *
+put_delta (uint8_t *p, uint32_t now, uint32_t then)
+{
+  uint32_t d = now - then;
+  return put_varint (p, d > 0xFFFF ? 0xFFFF : d);
+}
+
+/**
+ * Clears all statistics
+ * @param now_ms the current time in milliseconds
+ */
+void
+comms_stats_init (uint32_t now_ms)
+{
+  memset (&comms_stats, 0, sizeof(comms_stats_t));
+  comms_stats.sent_ms = now_ms;
+}
+
+/**
+ * Builds the telemetry frame of the counts since the last
+ * comms_stats_commit(). Nothing is reset, so a frame that could not be
+ * sent can simply be built again later.
+ * @param out the frame, room for COMMS_STATS_MAX_FRAME_LEN bytes
+ * @param now_ms the current time in milliseconds
+ * @return the size of the frame
+ */
+size_t
+comms_stats_encode (uint8_t *out, uint32_t now_ms)
+{
+  const comms_counters_t *now = &comms_stats.now;
+  const comms_counters_t *then = &comms_stats.sent;
+  const uint32_t *n;
+  const uint32_t *t;
+  uint8_t *p = out;
+  size_t i;
+  size_t j;
+
+  *p++ = COMMS_STATS_VERSION;
+  *p++ = comms_stats.seq;
+  p = put_delta (p, now_ms, comms_stats.sent_ms);
+  for (i = 0; i < COMMS_LINK_NUM; i++) {
+    n = (const uint32_t *) &now->link[i];
+    t = (const uint32_t *) &then->link[i];
+    for (j = 0; j < COMMS_LINK_STATS_FIELDS - 1; j++) {
+      p = put_delta (p, n[j], t[j]);
+    }
+    p = put_delta (p, now->link[i].queue_max, 0);
+  }
+  for (i = 0; i < COMMS_LAT_NUM; i++) {
+    for (j = 0; j < COMMS_STATS_HIST_BUCKETS; j++) {
+      p = put_delta (p, now->lat[i][j], then->lat[i][j]);
+    }
+  }
+  return p - out;
+}
+
+/**
+ * Marks the last frame built as sent, the next one starts from here
+ * @param now_ms the time passed to comms_stats_encode()
+ */
+void
+comms_stats_commit (uint32_t now_ms)
+{
+  size_t i;
+
+  for (i = 0; i < COMMS_LINK_NUM; i++) {
+    comms_stats.now.link[i].queue_max = 0;
+  }
+  comms_stats.sent = comms_stats.now;
+  comms_stats.sent_ms = now_ms;
+  comms_stats.seq++;
+}
@@ -0,0 +1,75 @@
+/*
+ * dbg.c
+ *	Description: Non blocking debug channel on the TX ring of the ground
+ *		     port, in COBS frames built in place (dbg_frame.c).
+ */
+
+#include "dbg.h"
+#include "uart_dma.h"
+#include <string.h>
+
+extern UART_HandleTypeDef huart2;
+
+dbg_stats_t dbg_stats;
+
+static uint16_t dbg_seq;
+
+/**
+ * Takes over USART2 unless the ground port already runs on it
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+dbg_init (void)
+{
+  memset (&dbg_stats, 0, sizeof(dbg_stats_t));
+  dbg_seq = 0;
+  return uart_dma_init (&uart_gnd, &huart2, COMMS_LINK_GND);
+}
+
+/**
+ * Queues a record. Either all of it is queued or, if the ring has no room,
+ * none of it.
+ * @param type the record type, dbg_type_t
+ * @param head the arguments before the data, up to DBG_MAX_HEAD_LEN bytes
+ * @param head_len the size of the arguments
+ * @param data the data of the record
+ * @param len the size of the data
+ * @return 0 on success or -1 if the record was dropped
+ */
+int32_t
+dbg_write (uint8_t type, const uint8_t *head, size_t head_len,
+	   const uint8_t *data, size_t len)
+{
+  size_t n = head_len + len;
+
+  dbg_seq++;
+  if (head_len > DBG_MAX_HEAD_LEN || (head_len && !head) || (len && !data)
+      || n > 0xFFFF || uart_dma_room (&uart_gnd) < DBG_FRAME_LEN(n)) {
+    dbg_stats.dropped++;
+    return -1;
+  }
+  n = dbg_frame_put (&uart_gnd.tx, type, dbg_seq, head, head_len, data, len);
+  uart_dma_commit (&uart_gnd, n);
+
+  dbg_stats.records++;
+  dbg_stats.bytes += n;
+  return 0;
+}
+
+/**
+ * @return 1 if a record of \p len bytes, header and data, fits now
+ */
+uint8_t
+dbg_room (size_t len)
+{
+  return uart_dma_room (&uart_gnd) >= DBG_FRAME_LEN(len);
+}
+
+/**
+ * @return 1 when every queued record has been sent
+ */
+uint8_t
+dbg_idle (void)
+{
+  return uart_dma_tx_idle (&uart_gnd);
+}
@@ -0,0 +1,174 @@
+/*
+ * dbg_frame.c
+ *	Description: COBS framing of the debug channel records.
+ *
+ *	A frame is encoded in a single pass straight into the free part of a
+ *	ring: the place of each COBS code byte is kept and filled in once the
+ *	run it counts is over, and the ring hands the frame to its consumer
+ *	only when the caller commits it.
+ */
+
+#include "dbg_frame.h"
+#include "utils.h"
+#include <string.h>
+
+typedef struct
+{
+  ringbuf_t *r;
+  size_t pos;			/* the next byte */
+  size_t code_pos;		/* the code byte of the current run */
+  uint8_t code;
+  uint16_t crc;
+} cobs_enc_t;
+
+static inline void
+cobs_put (cobs_enc_t *e, uint8_t b)
+{
+  if (b) {
+    ringbuf_put_at (e->r, e->pos++, b);
+    e->code++;
+  }
+  if (!b || e->code == 0xFF) {
+    ringbuf_put_at (e->r, e->code_pos, e->code);
+    e->code_pos = e->pos++;
+    e->code = 1;
+  }
+}
+
+static void
+cobs_write (cobs_enc_t *e, const uint8_t *data, size_t len)
+{
+  size_t i;
+
+  e->crc = update_crc16_ccitt (e->crc, data, len);
+  for (i = 0; i < len; i++) {
+    cobs_put (e, data[i]);
+  }
+}
+
+/**
+ * Encodes a record after the newest byte of \p r, without committing it.
+ * The caller checks that the ring has DBG_FRAME_LEN(head_len + len) bytes
+ * of room, then hands the frame over with ringbuf_commit().
+ * @param r the ring
+ * @param type the record type, dbg_type_t
+ * @param seq the sequence number
+ * @param head the arguments before the data
+ * @param head_len the size of the arguments, up to DBG_MAX_HEAD_LEN
+ * @param data the data of the record
+ * @param len the size of the data
+ * @return the size of the frame with its delimiter
+ */
+size_t
+dbg_frame_put (ringbuf_t *r, uint8_t type, uint16_t seq, const uint8_t *head,
+	       size_t head_len, const uint8_t *data, size_t len)
+{
+  uint8_t fields[5];
+  size_t n = head_len + len;
+  cobs_enc_t e;
+
+  fields[0] = type;
+  fields[1] = (uint8_t) (seq >> 8);
+  fields[2] = (uint8_t) seq;
+  fields[3] = (uint8_t) (n >> 8);
+  fields[4] = (uint8_t) n;
+
+  e.r = r;
+  e.code_pos = 0;
+  e.pos = 1;
+  e.code = 1;
+  e.crc = 0;
+  cobs_write (&e, fields, sizeof(fields));
+  cobs_write (&e, head, head_len);
+  cobs_write (&e, data, len);
+
+  /* The CRC, then close the last run and the frame */
+  n = e.crc;
+  cobs_put (&e, (uint8_t) (n >> 8));
+  cobs_put (&e, (uint8_t) n);
+  ringbuf_put_at (r, e.code_pos, e.code);
+  ringbuf_put_at (r, e.pos++, 0);
+  return e.pos;
+}
+
+void
+dbg_frame_rx_init (dbg_frame_rx_t *d)
+{
+  memset (d, 0, sizeof(dbg_frame_rx_t));
+}
+
+static inline void
+dbg_frame_append (dbg_frame_rx_t *d, uint8_t b)
+{
+  if (d->len == sizeof(d->buf)) {
+    d->overflow = 1;
+    return;
+  }
+  d->buf[d->len++] = b;
+}
+
+/**
+ * Checks a complete frame
+ * @return 1 if it is a good record
+ */
+static uint8_t
+dbg_frame_check (dbg_frame_rx_t *d)
+{
+  size_t n;
+
+  if (d->overflow || d->left || d->len < DBG_OVERHEAD) {
+    return 0;
+  }
+  n = ((size_t) d->buf[3] << 8) | d->buf[4];
+  if (n != d->len - DBG_OVERHEAD
+      || crc16_ccitt (d->buf, d->len - 2)
+	  != (((uint16_t) d->buf[d->len - 2] << 8) | d->buf[d->len - 1])) {
+    return 0;
+  }
+  d->type = d->buf[0];
+  d->seq = ((uint16_t) d->buf[1] << 8) | d->buf[2];
+  d->payload = d->buf + 5;
+  d->payload_len = n;
+  return 1;
+}
+
+/**
+ * Decodes one received byte
+ * @param d the decoder
+ * @param b the byte
+ * @return 1 if \p b completed a good record, found in d->type, d->seq and
+ * d->payload until the next call
+ */
+uint8_t
+dbg_frame_feed (dbg_frame_rx_t *d, uint8_t b)
+{
+  uint8_t ok;
+
+  if (!b) {
+    /* Two delimiters in a row are no frame */
+    ok = d->len || d->left ? dbg_frame_check (d) : 0;
+    if (ok) {
+      d->records++;
+    }
+    else if (d->len || d->left || d->overflow) {
+      d->bad++;
+    }
+    d->len = 0;
+    d->left = 0;
+    d->zero = 0;
+    d->overflow = 0;
+    return ok;
+  }
+  if (!d->left) {
+    /* A code byte, after the zero that ended the last run if any */
+    if (d->zero) {
+      dbg_frame_append (d, 0);
+    }
+    d->left = b - 1;
+    d->zero = b < 0xFF;
+    return 0;
+  }
+  dbg_frame_append (d, b);
+  d->left--;
+  return 0;
+}
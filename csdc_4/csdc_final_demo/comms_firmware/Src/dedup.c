@@ -0,0 +1,65 @@
+/*
+ * dedup.c
+ *	Description: Cache of the uplink packets recently taken by the bridge.
+ */
+
+#include "dedup.h"
+#include "utils.h"
+#include <string.h>
+
+void
+dedup_init (dedup_t *d)
+{
+  memset (d, 0, sizeof(dedup_t));
+}
+
+/**
+ * Checks a packet against the ones seen in the last DEDUP_WINDOW_MS and
+ * remembers it if it is new, in place of the entry seen longest ago
+ * @param d the cache
+ * @param seq the sequence byte the packet came with
+ * @param pkt the packet
+ * @param len the size of the packet, 1 to 255
+ * @param now_ms the current time in milliseconds
+ * @return 1 if the packet is a duplicate, 0 otherwise
+ */
+uint8_t
+dedup_check (dedup_t *d, uint8_t seq, const uint8_t *pkt, size_t len,
+	     uint32_t now_ms)
+{
+  dedup_entry_t *e;
+  dedup_entry_t *old = &d->entry[0];
+  uint16_t crc;
+  uint8_t cmd = len > 1 ? pkt[1] : 0;
+  size_t i;
+
+  if (!len) {
+    return 0;
+  }
+  crc = crc16_ccitt (pkt, len);
+  for (i = 0; i < DEDUP_ENTRIES; i++) {
+    e = &d->entry[i];
+    if (e->used && e->seq == seq && e->crc == crc && e->len == (uint8_t) len
+	&& e->head == pkt[0] && e->cmd == cmd
+	&& now_ms - e->seen_ms < DEDUP_WINDOW_MS) {
+      e->seen_ms = now_ms;
+      d->hits++;
+      return 1;
+    }
+    if (!e->used) {
+      old = e;
+    }
+    else if (old->used && now_ms - e->seen_ms > now_ms - old->seen_ms) {
+      old = e;
+    }
+  }
+  e = old;
+  e->crc = crc;
+  e->seq = seq;
+  e->len = (uint8_t) len;
+  e->head = pkt[0];
+  e->cmd = cmd;
+  e->used = 1;
+  e->seen_ms = now_ms;
+  return 0;
+}
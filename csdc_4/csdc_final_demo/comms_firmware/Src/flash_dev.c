@@ -0,0 +1,66 @@
+/*
+ * flash_dev.c
+ *	Description: Sector map and helpers shared by all flash devices.
+ */
+
+#include "flash_dev.h"
+
+const flash_sector_t flash_sectors[FLASH_DEV_SECTORS] =
+  {
+    { 0x08000000, 16 * 1024 },
+    { 0x08004000, 16 * 1024 },
+    { 0x08008000, 16 * 1024 },
+    { 0x0800C000, 16 * 1024 },
+    { 0x08010000, 64 * 1024 },
+    { 0x08020000, 128 * 1024 },
+    { 0x08040000, 128 * 1024 },
+    { 0x08060000, 128 * 1024 } };
+
+/**
+ * Finds the sector an address belongs to
+ * @param addr the flash address
+ * @return the sector number or -1 if the address is not in the flash
+ */
+int32_t
+flash_sector_of (uint32_t addr)
+{
+  int32_t i;
+
+  for (i = 0; i < FLASH_DEV_SECTORS; i++) {
+    if (addr >= flash_sectors[i].addr
+	&& addr - flash_sectors[i].addr < flash_sectors[i].len) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Erases every sector that holds part of the given range
+ * @param dev the flash device
+ * @param addr the start of the range
+ * @param len the size of the range
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+flash_dev_erase (const flash_dev_t *dev, uint32_t addr, size_t len)
+{
+  int32_t first;
+  int32_t last;
+  int32_t i;
+
+  if (!dev || len == 0) {
+    return -1;
+  }
+  first = flash_sector_of (addr);
+  last = flash_sector_of (addr + len - 1);
+  if (first < 0 || last < 0) {
+    return -1;
+  }
+  for (i = first; i <= last; i++) {
+    if (dev->erase_sector (dev, (uint8_t) i)) {
+      return -1;
+    }
+  }
+  return 0;
+}
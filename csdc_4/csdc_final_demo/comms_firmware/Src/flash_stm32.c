@@ -0,0 +1,79 @@
+/*
+ * flash_stm32.c
+ *	Description: flash_dev_t backend for the internal flash, through the
+ *		     HAL flash driver. Programs whole words where the data is
+ *		     aligned, which needs the 2.7 - 3.6 V supply range.
+ */
+
+#include "flash_dev.h"
+#include "stm32f4xx_hal.h"
+#include <string.h>
+
+static int32_t
+flash_stm32_read (const flash_dev_t *dev, uint32_t addr, uint8_t *buf,
+		  size_t len)
+{
+  (void) dev;
+  if (addr < FLASH_DEV_BASE || addr - FLASH_DEV_BASE + len > FLASH_DEV_LEN) {
+    return -1;
+  }
+  memcpy (buf, (const void *) addr, len);
+  return 0;
+}
+
+static int32_t
+flash_stm32_program (const flash_dev_t *dev, uint32_t addr, const uint8_t *buf,
+		     size_t len)
+{
+  uint32_t word;
+  HAL_StatusTypeDef ret = HAL_OK;
+
+  (void) dev;
+  if (addr < FLASH_DEV_BASE || addr - FLASH_DEV_BASE + len > FLASH_DEV_LEN) {
+    return -1;
+  }
+
+  HAL_FLASH_Unlock ();
+  while (len && ret == HAL_OK) {
+    if ((addr & 0x3) == 0 && len >= 4) {
+      memcpy (&word, buf, 4);
+      ret = HAL_FLASH_Program (FLASH_TYPEPROGRAM_WORD, addr, word);
+      addr += 4;
+      buf += 4;
+      len -= 4;
+    }
+    else {
+      ret = HAL_FLASH_Program (FLASH_TYPEPROGRAM_BYTE, addr, *buf);
+      addr++;
+      buf++;
+      len--;
+    }
+  }
+  HAL_FLASH_Lock ();
+  return ret == HAL_OK ? 0 : -1;
+}
+
+static int32_t
+flash_stm32_erase_sector (const flash_dev_t *dev, uint8_t sector)
+{
+  FLASH_EraseInitTypeDef erase;
+  uint32_t err = 0;
+  HAL_StatusTypeDef ret;
+
+  (void) dev;
+  if (sector >= FLASH_DEV_SECTORS) {
+    return -1;
+  }
+  erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+  erase.Sector = sector;
+  erase.NbSectors = 1;
+  erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+  HAL_FLASH_Unlock ();
+  ret = HAL_FLASHEx_Erase (&erase, &err);
+  HAL_FLASH_Lock ();
+  return ret == HAL_OK ? 0 : -1;
+}
+
+const flash_dev_t flash_internal =
+  { flash_stm32_read, flash_stm32_program, flash_stm32_erase_sector, NULL };
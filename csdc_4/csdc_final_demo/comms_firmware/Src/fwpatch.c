@@ -0,0 +1,280 @@
+/*
+ * fwpatch.c
+ *	Description: Streaming applier for binary delta firmware patches.
+ *		     See fwpatch.h for the patch format.
+ */
+
+#include "fwpatch.h"
+#include <string.h>
+
+static inline uint32_t
+load_le32 (const uint8_t *p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16)
+      | ((uint32_t) p[3] << 24);
+}
+
+/**
+ * Computes the SHA-256 of a flash region
+ * @param dev the flash device
+ * @param addr the start of the region
+ * @param len the size of the region
+ * @param digest the output digest, SHA256_DIGEST_LEN bytes
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+fwpatch_hash_flash (const flash_dev_t *dev, uint32_t addr, uint32_t len,
+		    uint8_t *digest)
+{
+  sha256_ctx_t ctx;
+  uint8_t buf[FWPATCH_PAGE_LEN];
+  uint32_t n;
+
+  sha256_init (&ctx);
+  while (len) {
+    n = len < sizeof(buf) ? len : sizeof(buf);
+    if (flash_dev_read (dev, addr, buf, n)) {
+      return -1;
+    }
+    sha256_update (&ctx, buf, n);
+    addr += n;
+    len -= n;
+  }
+  return sha256_final (&ctx, digest);
+}
+
+static int32_t
+fwpatch_fail (fwpatch_t *p)
+{
+  p->state = FWPATCH_FAILED;
+  return -1;
+}
+
+/**
+ * Programs the buffered part of the new image
+ */
+static int32_t
+fwpatch_flush (fwpatch_t *p)
+{
+  uint32_t at = p->new_pos - p->page_len;
+
+  if (p->page_len == 0) {
+    return 0;
+  }
+  if (flash_dev_program (p->dev, p->new_addr + at, p->page, p->page_len)) {
+    return -1;
+  }
+  sha256_update (&p->sha, p->page, p->page_len);
+  p->page_len = 0;
+  return 0;
+}
+
+/**
+ * Checks the header once it is complete, verifies that the patch was made
+ * for the image we have and erases the destination
+ */
+static int32_t
+fwpatch_start (fwpatch_t *p)
+{
+  uint8_t digest[SHA256_DIGEST_LEN];
+
+  if (memcmp (p->hdr, FWPATCH_MAGIC, 4) != 0) {
+    return -1;
+  }
+  p->old_len = load_le32 (p->hdr + 4);
+  p->new_len = load_le32 (p->hdr + 8);
+  memcpy (p->new_digest, p->hdr + 12 + SHA256_DIGEST_LEN, SHA256_DIGEST_LEN);
+  if (p->old_len > p->old_cap || p->new_len > p->new_cap
+      || p->new_len == 0) {
+    return -1;
+  }
+
+  if (fwpatch_hash_flash (p->dev, p->old_addr, p->old_len, digest)
+      || !sha256_equal (digest, p->hdr + 12, SHA256_DIGEST_LEN)) {
+    return -1;
+  }
+  if (flash_dev_erase (p->dev, p->new_addr, p->new_len)) {
+    return -1;
+  }
+  sha256_init (&p->sha);
+  lzss_dec_init (&p->dec);
+  p->state = FWPATCH_BODY;
+  return 0;
+}
+
+/**
+ * Runs decompressed patch records
+ * @param p the patcher
+ * @param in the decompressed record stream
+ * @param len the size of \p in
+ * @return 0 on success or a negative number in case of error
+ */
+static int32_t
+fwpatch_records (fwpatch_t *p, const uint8_t *in, size_t len)
+{
+  uint8_t old[FWPATCH_PAGE_LEN];
+  size_t n;
+  size_t i;
+  int32_t seek;
+
+  while (len) {
+    if (p->diff_left == 0 && p->extra_left == 0) {
+      n = FWPATCH_REC_LEN - p->rec_len;
+      n = n < len ? n : len;
+      memcpy (p->rec + p->rec_len, in, n);
+      p->rec_len += n;
+      in += n;
+      len -= n;
+      if (p->rec_len < FWPATCH_REC_LEN) {
+	break;
+      }
+      p->rec_len = 0;
+      seek = (int32_t) load_le32 (p->rec);
+      p->diff_left = load_le32 (p->rec + 4);
+      p->extra_left = load_le32 (p->rec + 8);
+      p->old_pos += seek;
+      if (p->diff_left > p->new_len - p->new_pos
+	  || p->extra_left > p->new_len - p->new_pos - p->diff_left
+	  || (p->diff_left && (p->old_pos > p->old_len
+	      || p->diff_left > p->old_len - p->old_pos))) {
+	return -1;
+      }
+      continue;
+    }
+
+    /* Never cross a page, so each flush programs whole pieces */
+    n = FWPATCH_PAGE_LEN - p->page_len;
+    n = n < len ? n : len;
+    if (p->diff_left) {
+      n = n < p->diff_left ? n : p->diff_left;
+      if (flash_dev_read (p->dev, p->old_addr + p->old_pos, old, n)) {
+	return -1;
+      }
+      for (i = 0; i < n; i++) {
+	p->page[p->page_len + i] = (uint8_t) (old[i] + in[i]);
+      }
+      p->old_pos += n;
+      p->diff_left -= n;
+    }
+    else {
+      n = n < p->extra_left ? n : p->extra_left;
+      memcpy (p->page + p->page_len, in, n);
+      p->extra_left -= n;
+    }
+    p->page_len += n;
+    p->new_pos += n;
+    in += n;
+    len -= n;
+    if (p->page_len == FWPATCH_PAGE_LEN && fwpatch_flush (p)) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Prepares a patch session
+ * @param p the patcher
+ * @param dev the flash device holding both images
+ * @param old_addr the address of the running image
+ * @param old_cap the size of the running image slot
+ * @param new_addr the address of the slot the new image goes to
+ * @param new_cap the size of that slot
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+fwpatch_init (fwpatch_t *p, const flash_dev_t *dev, uint32_t old_addr,
+	      uint32_t old_cap, uint32_t new_addr, uint32_t new_cap)
+{
+  if (!p || !dev) {
+    return -1;
+  }
+  memset (p, 0, sizeof(fwpatch_t));
+  p->dev = dev;
+  p->old_addr = old_addr;
+  p->old_cap = old_cap;
+  p->new_addr = new_addr;
+  p->new_cap = new_cap;
+  p->state = FWPATCH_HEADER;
+  return 0;
+}
+
+/**
+ * Feeds the next piece of the patch. Pieces can have any size.
+ * @param p the patcher
+ * @param in the patch data
+ * @param len the size of the patch data
+ * @return 0 on success or a negative number if the patch does not apply.
+ * After an error the session has to start again with fwpatch_init().
+ */
+int32_t
+fwpatch_write (fwpatch_t *p, const uint8_t *in, size_t len)
+{
+  uint8_t out[64];
+  size_t out_len;
+  size_t used;
+  size_t n;
+  lzss_status_t st;
+
+  if (!p || (!in && len) || p->state == FWPATCH_FAILED
+      || p->state == FWPATCH_DONE) {
+    return -1;
+  }
+
+  if (p->state == FWPATCH_HEADER) {
+    n = FWPATCH_HDR_LEN - p->hdr_len;
+    n = n < len ? n : len;
+    memcpy (p->hdr + p->hdr_len, in, n);
+    p->hdr_len += n;
+    in += n;
+    len -= n;
+    if (p->hdr_len < FWPATCH_HDR_LEN) {
+      return 0;
+    }
+    if (fwpatch_start (p)) {
+      return fwpatch_fail (p);
+    }
+  }
+
+  do {
+    st = lzss_decode (&p->dec, out, sizeof(out), &out_len, in, len, &used);
+    if (st == LZSS_ERROR || fwpatch_records (p, out, out_len)) {
+      return fwpatch_fail (p);
+    }
+    in += used;
+    len -= used;
+  }
+  while (st == LZSS_OK);
+  return 0;
+}
+
+/**
+ * Completes the session: programs the last piece and checks the new image,
+ * both as it was produced and as it reads back from the flash
+ * @param p the patcher
+ * @return 0 if the new image is complete and matches the patch header,
+ * a negative number otherwise
+ */
+int32_t
+fwpatch_finish (fwpatch_t *p)
+{
+  uint8_t digest[SHA256_DIGEST_LEN];
+
+  if (!p || p->state != FWPATCH_BODY) {
+    return -1;
+  }
+  if (p->new_pos != p->new_len || p->diff_left || p->extra_left
+      || p->rec_len || fwpatch_flush (p)) {
+    return fwpatch_fail (p);
+  }
+  sha256_final (&p->sha, digest);
+  if (!sha256_equal (digest, p->new_digest, SHA256_DIGEST_LEN)) {
+    return fwpatch_fail (p);
+  }
+  if (fwpatch_hash_flash (p->dev, p->new_addr, p->new_len, digest)
+      || !sha256_equal (digest, p->new_digest, SHA256_DIGEST_LEN)) {
+    return fwpatch_fail (p);
+  }
+  p->state = FWPATCH_DONE;
+  return 0;
+}
@@ -0,0 +1,423 @@
+/*
+ * fwupdate.c
+ *	Description: Dual slot firmware update and boot selection.
+ *		     See fwupdate.h for the flash layout.
+ */
+
+#include "fwupdate.h"
+#include "utils.h"
+#include <string.h>
+
+#define FW_BOOTREC_COUNT (FW_CTRL_LEN / sizeof(fw_bootrec_t))
+#define FW_BOOTREC_CRC_LEN offsetof(fw_bootrec_t, crc)
+#define FW_ERASED 0xFFFFFFFF
+
+static inline uint32_t
+fwboot_rec_addr (uint32_t bank, size_t idx)
+{
+  return FW_CTRL_ADDR + bank * FW_CTRL_LEN + idx * sizeof(fw_bootrec_t);
+}
+
+static uint8_t
+fwboot_rec_valid (const fw_bootrec_t *r)
+{
+  return r->magic == FW_BOOT_MAGIC
+      && r->crc == crc16_ccitt ((const uint8_t *) r, FW_BOOTREC_CRC_LEN)
+      && (r->addr == FW_SLOT_A_ADDR || r->addr == FW_SLOT_B_ADDR)
+      && r->len <= FW_SLOT_LEN;
+}
+
+/**
+ * Walks the boot control log of one bank
+ * @param dev the flash device
+ * @param bank the bank, 0 or 1
+ * @param latest the latest valid record, if any
+ * @param latest_idx its position in the log, -1 if the log is empty
+ * @param confirmed the latest confirmed record before \p latest, if any
+ * @param confirmed_idx its position, -1 if there is none
+ * @return the first free position in the log, FW_BOOTREC_COUNT if full
+ */
+static size_t
+fwboot_scan_bank (const flash_dev_t *dev, uint32_t bank, fw_bootrec_t *latest,
+		  int32_t *latest_idx, fw_bootrec_t *confirmed,
+		  int32_t *confirmed_idx)
+{
+  fw_bootrec_t r;
+  size_t i;
+
+  *latest_idx = -1;
+  *confirmed_idx = -1;
+  for (i = 0; i < FW_BOOTREC_COUNT; i++) {
+    if (flash_dev_read (dev, fwboot_rec_addr (bank, i), (uint8_t *) &r,
+			sizeof(r))
+	|| r.magic == FW_ERASED) {
+      break;
+    }
+    /* Torn writes are skipped, the next record goes after them */
+    if (!fwboot_rec_valid (&r)) {
+      continue;
+    }
+    if (*latest_idx >= 0 && latest->confirmed == 0) {
+      *confirmed = *latest;
+      *confirmed_idx = *latest_idx;
+    }
+    *latest = r;
+    *latest_idx = (int32_t) i;
+  }
+  return i;
+}
+
+/**
+ * Walks the boot control log. The current bank is the one whose latest
+ * record is the newest; the other one holds older records only, or the
+ * start of a compaction that a reset cut short.
+ * @param dev the flash device
+ * @param bank set to the current bank
+ * @return as fwboot_scan_bank() for the current bank
+ */
+static size_t
+fwboot_scan (const flash_dev_t *dev, uint32_t *bank, fw_bootrec_t *latest,
+	     int32_t *latest_idx, fw_bootrec_t *confirmed,
+	     int32_t *confirmed_idx)
+{
+  fw_bootrec_t l;
+  fw_bootrec_t c;
+  int32_t li;
+  int32_t ci;
+  size_t next;
+  size_t n;
+
+  *bank = 0;
+  next = fwboot_scan_bank (dev, 0, latest, latest_idx, confirmed,
+			   confirmed_idx);
+  n = fwboot_scan_bank (dev, 1, &l, &li, &c, &ci);
+  if (li >= 0 && (*latest_idx < 0 || l.seq > latest->seq)) {
+    *bank = 1;
+    *latest = l;
+    *latest_idx = li;
+    *confirmed = c;
+    *confirmed_idx = ci;
+    next = n;
+  }
+  return next;
+}
+
+static uint8_t
+fwboot_image_ok (const flash_dev_t *dev, const fw_bootrec_t *r)
+{
+  uint8_t digest[SHA256_DIGEST_LEN];
+
+  if (fwpatch_hash_flash (dev, r->addr, r->len, digest)) {
+    return 0;
+  }
+  return sha256_equal (digest, r->digest, SHA256_DIGEST_LEN);
+}
+
+/**
+ * Clears one word of a record: a boot attempt or the confirmation
+ */
+static int32_t
+fwboot_clear_word (const flash_dev_t *dev, uint32_t bank, int32_t idx,
+		   size_t offset)
+{
+  const uint32_t zero = 0;
+  return flash_dev_program (dev, fwboot_rec_addr (bank, idx) + offset,
+			    (const uint8_t *) &zero, sizeof(zero));
+}
+
+/**
+ * Appends a boot control record. When the log is full it is compacted
+ * into the other bank: the latest confirmed record and the latest record
+ * are copied there and the new one follows them. The full bank is left as
+ * it is until the next compaction, so a reset at any point keeps the
+ * records.
+ * @param dev the flash device
+ * @param addr the slot address of the image
+ * @param len the size of the image
+ * @param digest the SHA-256 of the image
+ * @param confirmed 1 if the image is known to work, 0 for a trial
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+fwboot_append (const flash_dev_t *dev, uint32_t addr, uint32_t len,
+	       const uint8_t *digest, uint8_t confirmed)
+{
+  fw_bootrec_t latest;
+  fw_bootrec_t last_ok;
+  fw_bootrec_t r;
+  int32_t latest_idx;
+  int32_t last_ok_idx;
+  uint32_t bank;
+  size_t next;
+
+  if (!dev || !digest) {
+    return -1;
+  }
+  next = fwboot_scan (dev, &bank, &latest, &latest_idx, &last_ok,
+		      &last_ok_idx);
+
+  if (next == FW_BOOTREC_COUNT) {
+    bank ^= 1;
+    if (flash_dev_erase (dev, fwboot_rec_addr (bank, 0), FW_CTRL_LEN)) {
+      return -1;
+    }
+    next = 0;
+    if (last_ok_idx >= 0) {
+      if (flash_dev_program (dev, fwboot_rec_addr (bank, next++),
+			     (const uint8_t *) &last_ok, sizeof(last_ok))) {
+	return -1;
+      }
+    }
+    if (latest_idx >= 0) {
+      if (flash_dev_program (dev, fwboot_rec_addr (bank, next++),
+			     (const uint8_t *) &latest, sizeof(latest))) {
+	return -1;
+      }
+    }
+  }
+
+  memset (&r, 0xFF, sizeof(r));
+  r.magic = FW_BOOT_MAGIC;
+  r.seq = latest_idx >= 0 ? latest.seq + 1 : 0;
+  r.addr = addr;
+  r.len = len;
+  memcpy (r.digest, digest, SHA256_DIGEST_LEN);
+  r.crc = crc16_ccitt ((const uint8_t *) &r, FW_BOOTREC_CRC_LEN);
+  if (confirmed) {
+    r.confirmed = 0;
+  }
+  if (!fwboot_rec_valid (&r)) {
+    return -1;
+  }
+  return flash_dev_program (dev, fwboot_rec_addr (bank, next),
+			    (const uint8_t *) &r, sizeof(r));
+}
+
+/**
+ * Decides which image to boot. A trial image uses up one of its boot
+ * attempts each time it is selected.
+ * @param dev the flash device
+ * @return the address of the image to boot, FW_FACTORY_ADDR for the
+ * factory image
+ */
+uint32_t
+fwboot_select (const flash_dev_t *dev)
+{
+  fw_bootrec_t latest;
+  fw_bootrec_t last_ok;
+  int32_t latest_idx;
+  int32_t last_ok_idx;
+  uint32_t bank;
+  uint8_t ok;
+  size_t t;
+
+  if (!dev) {
+    return FW_FACTORY_ADDR;
+  }
+  fwboot_scan (dev, &bank, &latest, &latest_idx, &last_ok, &last_ok_idx);
+  if (latest_idx < 0) {
+    return FW_FACTORY_ADDR;
+  }
+
+  ok = latest.confirmed == 0;
+  for (t = 0; !ok && t < FW_BOOT_TRIES; t++) {
+    if (latest.tries[t] == FW_ERASED) {
+      ok = fwboot_clear_word (dev, bank, latest_idx,
+			      offsetof(fw_bootrec_t, tries) + 4 * t) == 0;
+      break;
+    }
+  }
+  if (ok && fwboot_image_ok (dev, &latest)) {
+    return latest.addr;
+  }
+  if (last_ok_idx >= 0 && fwboot_image_ok (dev, &last_ok)) {
+    return last_ok.addr;
+  }
+  return FW_FACTORY_ADDR;
+}
+
+/**
+ * Marks the running image as working, ending its trial
+ * @param dev the flash device
+ * @param run_addr the address of the running image
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+fwupdate_confirm (const flash_dev_t *dev, uint32_t run_addr)
+{
+  fw_bootrec_t latest;
+  fw_bootrec_t last_ok;
+  int32_t latest_idx;
+  int32_t last_ok_idx;
+  uint32_t bank;
+
+  if (!dev) {
+    return -1;
+  }
+  fwboot_scan (dev, &bank, &latest, &latest_idx, &last_ok, &last_ok_idx);
+  if (latest_idx < 0 || latest.addr != run_addr) {
+    return -1;
+  }
+  if (latest.confirmed == 0) {
+    return 0;
+  }
+  return fwboot_clear_word (dev, bank, latest_idx,
+			    offsetof(fw_bootrec_t, confirmed));
+}
+
+/**
+ * Starts an update session. The patch is applied against the running image
+ * and the result goes to the other slot. A session that has not received
+ * anything yet is kept as it is.
+ * @param u the session
+ * @param dev the flash device
+ * @param run_addr the address of the running image
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+fwupdate_begin (fwupdate_t *u, const flash_dev_t *dev, uint32_t run_addr)
+{
+  if (!u || !dev) {
+    return -1;
+  }
+  if (u->state == FWUPDATE_RECEIVING && u->received == 0 && u->dev == dev
+      && u->run_addr == run_addr) {
+    return 0;
+  }
+  switch (run_addr) {
+    case FW_SLOT_A_ADDR:
+      u->slot_addr = FW_SLOT_B_ADDR;
+      break;
+    case FW_SLOT_B_ADDR:
+      u->slot_addr = FW_SLOT_A_ADDR;
+      break;
+    default:
+      return -1;
+  }
+  u->dev = dev;
+  u->run_addr = run_addr;
+  u->received = 0;
+  if (fwpatch_init (&u->patch, dev, run_addr, FW_SLOT_LEN, u->slot_addr,
+		    FW_SLOT_LEN)) {
+    u->state = FWUPDATE_FAILED;
+    return -1;
+  }
+  u->state = FWUPDATE_RECEIVING;
+  return 0;
+}
+
+/**
+ * Feeds a piece of the patch. Pieces must arrive in order; a piece that
+ * was already received (a retransmission) is accepted and ignored.
+ * @param u the session
+ * @param offset the position of \p data in the patch
+ * @param data the patch data
+ * @param len the size of the patch data
+ * @return 0 on success, a negative number if a piece is missing or the
+ * patch does not apply. u->received tells where to continue from.
+ */
+int32_t
+fwupdate_write (fwupdate_t *u, uint32_t offset, const uint8_t *data,
+		size_t len)
+{
+  uint32_t skip;
+
+  if (!u || u->state != FWUPDATE_RECEIVING || offset > u->received) {
+    return -1;
+  }
+  skip = u->received - offset;
+  if (skip >= len) {
+    return 0;
+  }
+  if (fwpatch_write (&u->patch, data + skip, len - skip)) {
+    u->state = FWUPDATE_FAILED;
+    return -1;
+  }
+  u->received += len - skip;
+  return 0;
+}
+
+/**
+ * Checks that the new image is complete and intact. Succeeds again once
+ * the image is verified.
+ * @param u the session
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+fwupdate_finish (fwupdate_t *u)
+{
+  if (u && u->state == FWUPDATE_VERIFIED) {
+    return 0;
+  }
+  if (!u || u->state != FWUPDATE_RECEIVING) {
+    return -1;
+  }
+  if (fwpatch_finish (&u->patch)) {
+    u->state = FWUPDATE_FAILED;
+    return -1;
+  }
+  u->state = FWUPDATE_VERIFIED;
+  return 0;
+}
+
+/**
+ * Makes the verified image the one to boot, on trial. Succeeds again,
+ * without a second boot record, once the image is activated.
+ * @param u the session
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+fwupdate_activate (fwupdate_t *u)
+{
+  if (u && u->state == FWUPDATE_ACTIVATED) {
+    return 0;
+  }
+  if (!u || u->state != FWUPDATE_VERIFIED) {
+    return -1;
+  }
+  if (fwboot_append (u->dev, u->slot_addr, u->patch.new_len,
+		     u->patch.new_digest, 0)) {
+    return -1;
+  }
+  u->state = FWUPDATE_ACTIVATED;
+  return 0;
+}
+
+/**
+ * Handles a firmware update packet from the uplink
+ * @param u the session
+ * @param dev the flash device
+ * @param run_addr the address of the running image
+ * @param pkt the packet, a fwupdate_cmd_t followed by its arguments
+ * @param len the size of the packet
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+fwupdate_uplink (fwupdate_t *u, const flash_dev_t *dev, uint32_t run_addr,
+		 const uint8_t *pkt, size_t len)
+{
+  uint32_t offset;
+
+  if (!u || !pkt || len < 1) {
+    return -1;
+  }
+  switch (pkt[0]) {
+    case FWUPDATE_CMD_BEGIN:
+      return fwupdate_begin (u, dev, run_addr);
+    case FWUPDATE_CMD_DATA:
+      if (len < 5) {
+	return -1;
+      }
+      offset = (uint32_t) pkt[1] | ((uint32_t) pkt[2] << 8)
+	  | ((uint32_t) pkt[3] << 16) | ((uint32_t) pkt[4] << 24);
+      return fwupdate_write (u, offset, pkt + 5, len - 5);
+    case FWUPDATE_CMD_FINISH:
+      return fwupdate_finish (u);
+    case FWUPDATE_CMD_ACTIVATE:
+      return fwupdate_activate (u);
+    case FWUPDATE_CMD_CONFIRM:
+      return fwupdate_confirm (dev, run_addr);
+    default:
+      return -1;
+  }
+}
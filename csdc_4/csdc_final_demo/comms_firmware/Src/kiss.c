@@ -0,0 +1,311 @@
+/*
+ * kiss.c
+ *	Description: KISS TNC framing of the ground port.
+ */
+
+#include "kiss.h"
+#include "config.h"
+#include "comms_stats.h"
+#include <string.h>
+
+/**
+ * Nonzero if any byte of \p v equals the byte repeated in \p pattern
+ */
+static inline uint32_t
+kiss_has_byte (uint32_t v, uint32_t pattern)
+{
+  v ^= pattern;
+  return (v - 0x01010101U) & ~v & 0x80808080U;
+}
+
+/**
+ * @return the number of bytes before the first FEND or FESC, \p len if
+ * there is none
+ */
+static inline size_t
+kiss_span (const uint8_t *in, size_t len)
+{
+  size_t i = 0;
+  uint32_t w;
+
+  while (i + sizeof(w) <= len) {
+    memcpy (&w, in + i, sizeof(w));
+    if (kiss_has_byte (w, 0xC0C0C0C0U) | kiss_has_byte (w, 0xDBDBDBDBU)) {
+      break;
+    }
+    i += sizeof(w);
+  }
+  while (i < len && in[i] != KISS_FEND && in[i] != KISS_FESC) {
+    i++;
+  }
+  return i;
+}
+
+/**
+ * Escapes FEND and FESC. Runs of normal bytes are found a word at a time
+ * and copied; after a special byte the bytes are taken one by one until
+ * KISS_DENSE_RUN normal ones in a row, so data full of special bytes does
+ * not restart the word scan for each of them.
+ * @param out the output, room for 2 * \p len bytes
+ * @param in the data
+ * @param len the size of the data
+ * @return the number of bytes written
+ */
+size_t
+kiss_escape (uint8_t *out, const uint8_t *in, size_t len)
+{
+  size_t i = 0;
+  size_t o = 0;
+  size_t run;
+  size_t plain;
+
+  while (i < len) {
+    run = kiss_span (in + i, len - i);
+    memcpy (out + o, in + i, run);
+    o += run;
+    i += run;
+    for (plain = 0; i < len && plain < KISS_DENSE_RUN; i++) {
+      if (in[i] == KISS_FEND) {
+	out[o++] = KISS_FESC;
+	out[o++] = KISS_TFEND;
+	plain = 0;
+      }
+      else if (in[i] == KISS_FESC) {
+	out[o++] = KISS_FESC;
+	out[o++] = KISS_TFESC;
+	plain = 0;
+      }
+      else {
+	out[o++] = in[i];
+	plain++;
+      }
+    }
+  }
+  return o;
+}
+
+void
+kiss_dec_init (kiss_dec_t *d)
+{
+  memset (d, 0, sizeof(kiss_dec_t));
+}
+
+static inline void
+kiss_dec_put (kiss_dec_t *d, const uint8_t *in, size_t len)
+{
+  if (len > sizeof(d->buf) - d->len) {
+    len = sizeof(d->buf) - d->len;
+    d->overflow = 1;
+  }
+  memcpy (d->buf + d->len, in, len);
+  d->len += len;
+}
+
+/**
+ * Unescapes the serial stream until a frame ends. Bytes before the first
+ * FEND are dropped.
+ * @param d the decoder
+ * @param in the received bytes
+ * @param len the number of received bytes
+ * @param used the number of bytes consumed
+ * @return the size of the frame now in d->buf, valid until the next call,
+ * 0 if no frame ended or -1 if the frame that ended did not fit
+ */
+int32_t
+kiss_decode (kiss_dec_t *d, const uint8_t *in, size_t len, size_t *used)
+{
+  const uint8_t *p;
+  size_t i = 0;
+  size_t run;
+  size_t plain;
+  size_t n;
+  uint8_t esc;
+  uint8_t b;
+  int32_t ret;
+
+  while (i < len) {
+    if (!d->in_frame) {
+      p = memchr (in + i, KISS_FEND, len - i);
+      if (!p) {
+	i = len;
+	break;
+      }
+      i = p - in + 1;
+      d->in_frame = 1;
+      d->len = 0;
+      d->esc = 0;
+      d->overflow = 0;
+      continue;
+    }
+    if (!d->esc) {
+      run = kiss_span (in + i, len - i);
+      kiss_dec_put (d, in + i, run);
+      i += run;
+    }
+    /* As kiss_escape(), one by one while the special bytes are dense. The
+     * state is kept in locals, the byte stores would make the compiler
+     * reload it from d every time. */
+    esc = d->esc;
+    n = d->len;
+    for (plain = 0; i < len && plain < KISS_DENSE_RUN;) {
+      b = in[i++];
+      if (esc || b == KISS_FESC) {
+	/* The escaped byte, now or at the next call */
+	if (!esc) {
+	  if (i == len) {
+	    esc = 1;
+	    break;
+	  }
+	  b = in[i++];
+	}
+	esc = 0;
+	plain = 0;
+	if (b == KISS_TFEND) {
+	  b = KISS_FEND;
+	}
+	else if (b == KISS_TFESC) {
+	  b = KISS_FESC;
+	}
+      }
+      else if (b == KISS_FEND) {
+	/* Repeated ones are fill, the closing one opens the next frame */
+	plain = 0;
+	if (!n) {
+	  continue;
+	}
+	ret = d->overflow ? -1 : (int32_t) n;
+	d->len = 0;
+	d->esc = 0;
+	d->overflow = 0;
+	*used = i;
+	return ret;
+      }
+      else {
+	plain++;
+      }
+      if (n < sizeof(d->buf)) {
+	d->buf[n++] = b;
+      }
+      else {
+	d->overflow = 1;
+      }
+    }
+    d->esc = esc;
+    d->len = n;
+  }
+  *used = i;
+  return 0;
+}
+
+/**
+ * Initializes the adapter
+ * @param k the adapter
+ * @param uart the serial port of the ground station
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+kiss_init (kiss_t *k, const bridge_port_t *uart)
+{
+  if (!k || !uart || !uart->read || !uart->write) {
+    return -1;
+  }
+  memset (k, 0, sizeof(kiss_t));
+  k->uart = *uart;
+  ringbuf_init (&k->ul, k->ul_mem, sizeof(k->ul_mem));
+  ax25_create_addr_field (k->addr, (const uint8_t *) __UPSAT_DEST_CALLSIGN,
+			  __UPSAT_DEST_SSID,
+			  (const uint8_t *) __UPSAT_CALLSIGN, __UPSAT_SSID);
+  return 0;
+}
+
+/**
+ * Takes the info field out of a received frame and queues it for the
+ * bridge. The caller makes sure the queue has room for it.
+ */
+static void
+kiss_frame (kiss_t *k, const uint8_t *frame, size_t len)
+{
+  const uint8_t *ax = frame + 1;
+  size_t n = len - 1;
+  size_t addr_len;
+  uint8_t size;
+
+  if (frame[0] != KISS_CMD_DATA) {
+    k->other_cmds++;
+    return;
+  }
+  /* The address field ends with the extension bit set */
+  for (addr_len = AX25_MIN_ADDR_LEN;
+      addr_len < AX25_MAX_ADDR_LEN && addr_len <= n && !(ax[addr_len - 1] & 1);
+      addr_len += 7);
+  if (addr_len + 2 >= n || !(ax[addr_len - 1] & 1)
+      || (ax[addr_len] & ~0x10) != __UPSAT_AX25_CTRL
+      || ax[addr_len + 1] != 0xF0
+      || n - addr_len - 2 > BRIDGE_MAX_UL_LEN
+      || !ax25_check_dest_callsign (ax, n, __UPSAT_CALLSIGN)) {
+    k->bad_frames++;
+    return;
+  }
+  size = (uint8_t) (n - addr_len - 2);
+  ringbuf_write (&k->ul, &size, 1);
+  ringbuf_write (&k->ul, ax + addr_len + 2, size);
+  k->frames_in++;
+}
+
+/**
+ * bridge_port_t read callback: returns the uplink as [size][info]
+ * @param priv the adapter
+ */
+size_t
+kiss_read (void *priv, uint8_t *buf, size_t len)
+{
+  kiss_t *k = (kiss_t *) priv;
+  size_t used;
+  int32_t n;
+
+  while (ringbuf_room (&k->ul) >= 1 + BRIDGE_MAX_UL_LEN) {
+    if (k->in_used == k->in_len) {
+      k->in_len = k->uart.read (k->uart.priv, k->in, sizeof(k->in));
+      k->in_used = 0;
+      if (!k->in_len) {
+	break;
+      }
+    }
+    n = kiss_decode (&k->dec, k->in + k->in_used, k->in_len - k->in_used,
+		     &used);
+    k->in_used += used;
+    if (n > 0) {
+      kiss_frame (k, k->dec.buf, n);
+    }
+    else if (n < 0) {
+      k->bad_frames++;
+      comms_stats.now.link[COMMS_LINK_GND].sync_losses++;
+    }
+  }
+  return ringbuf_read (&k->ul, buf, len);
+}
+
+/**
+ * bridge_port_t and tx_sink_t write callback: sends a [size][data] packet
+ * of the bridge as a KISS framed UI frame carrying the data
+ * @param priv the adapter
+ * @return 0 on success or -1 if the UART has no room for the frame
+ */
+int32_t
+kiss_write (void *priv, const uint8_t *data, size_t len)
+{
+  kiss_t *k = (kiss_t *) priv;
+  uint8_t hdr[2] = { __UPSAT_AX25_CTRL, 0xF0 };
+  size_t o = 0;
+
+  if (len < 2 || len > 1 + 256) {
+    return -1;
+  }
+  k->tx[o++] = KISS_FEND;
+  k->tx[o++] = KISS_CMD_DATA;
+  o += kiss_escape (k->tx + o, k->addr, sizeof(k->addr));
+  o += kiss_escape (k->tx + o, hdr, sizeof(hdr));
+  o += kiss_escape (k->tx + o, data + 1, len - 1);
+  k->tx[o++] = KISS_FEND;
+  return k->uart.write (k->uart.priv, k->tx, o);
+}
@@ -43,6 +43,13 @@
 #include "ax25.h"
 
 /* USER CODE BEGIN Includes */
+#if COMMS_BENCH_EN
+#include "bench.h"
+#endif
+#include "memdl.h"
+#include "uart_dma.h"
+#include "dbg.h"
+#include <stdio.h>
 
 
 /* USER CODE END Includes */
@@ -50,26 +57,28 @@
 /* Private variables ---------------------------------------------------------*/
 UART_HandleTypeDef huart1;
 UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart1_rx;
+DMA_HandleTypeDef hdma_usart1_tx;
+DMA_HandleTypeDef hdma_usart2_rx;
+DMA_HandleTypeDef hdma_usart2_tx;
 
 /* USER CODE BEGIN PV */
 /* Private variables ---------------------------------------------------------*/
 #define MEM_SIZE 32000
 
-
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_USART2_UART_Init(void);
 static void MX_USART1_UART_Init(void);
 
 /* USER CODE BEGIN PFP */
 /* Private function prototypes -----------------------------------------------*/
 
-static void format_pkt(uint8_t *data, uint8_t *out, uint8_t txcnt);
-static void send_mem(void);
-static void send_pkt(uint8_t *data);
+static void send_mem(uint32_t offset);
 
 /* USER CODE END PFP */
 
@@ -106,6 +115,7 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_USART2_UART_Init();
   MX_USART1_UART_Init();
   /* USER CODE BEGIN 2 */
@@ -131,6 +141,12 @@ format packet and send it back to ground
   ser_print(recv_buffer,sizeof(recv_buffer));
 */
 // sertest();
+pymem_init();
+#if COMMS_BENCH_EN
+  bench_init();
+  bench_sha256();
+  bench_lzss();
+#endif
 csdcdemo();
 
 
@@ -249,6 +265,31 @@ static void MX_USART2_UART_Init(void)
 
 }
 
+/** 
+  * Enable DMA controller clock
+  */
+static void MX_DMA_Init(void) 
+{
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA1_Stream5_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Stream5_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream5_IRQn);
+  /* DMA1_Stream6_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Stream6_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+  /* DMA2_Stream2_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA2_Stream2_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream2_IRQn);
+  /* DMA2_Stream7_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA2_Stream7_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream7_IRQn);
+
+}
+
 /** Configure pins as
         * Analog
         * Input
@@ -290,64 +331,56 @@ static void MX_GPIO_Init(void)
 
 
 
-static void send_mem(void){
-
-  int n=0;
-  int size=256;
-  int txcnt=0;
-  uint8_t info[256];
-  uint8_t out_pkt[258];
-
-  while (n<MEM_SIZE){
-
-    if(n+256>MEM_SIZE) size=MEM_SIZE-n+256;
-
-    request_pkt(info,n,size);
-
-    format_pkt(info,out_pkt,txcnt);
-
-    send_pkt(out_pkt);
-
-    txcnt++;
-    if(txcnt>7)txcnt=0;
-    n=n+256;
-
-    HAL_Delay(100);
-
-  }
-
-  return;
-
+static int32_t mem_request(void *priv, uint32_t addr, size_t len){
+  return memreq_request((memreq_t *)priv, addr, len);
 }
 
-static void send_pkt(uint8_t *out){
-
-  HAL_UART_Transmit(&huart2, out,30, 100);
-
-  return;
+static size_t mem_read(void *priv, uint32_t addr, uint8_t *buf, size_t len){
+  return memreq_read((memreq_t *)priv, addr, buf, len);
 }
 
-static void format_pkt(uint8_t *data, uint8_t *out, uint8_t txcnt){
-
-  uint8_t rxcnt=txcnt+1;
-  uint8_t i;
-
-  memset((char*)data,'\n',sizeof(data));
+/* A downlink packet is a debug record of its own, so it shares the line
+ * with the read requests without breaking their frames. The room is checked
+ * first: a packet memdl.c sends again later is not a lost record. */
+static int32_t mem_send(void *priv, const uint8_t *pkt, size_t len){
+  (void)priv;
+  if(len<2 || !dbg_room(len)) return -1;
+  return dbg_write(DBG_MEMDL, pkt, 2, pkt+2, len-2);
+}
 
-  if (rxcnt>7) rxcnt=0;
-  
-  out[0]=txcnt;
-  out[1]=rxcnt;
-  for(i=0;i<sizeof(out);i++){
-    out[i+2]=data[i];
+/**
+ * Downlinks the emulated memory from \p offset on, see memdl.h. The next
+ * chunks are requested from the memory emulator while the current one is
+ * sent raw as DBG_MEMDL records, and the sustained rate is printed at the
+ * end. PC.py puts the packets back together and writes the memory to
+ * memdl.bin when the rate arrives.
+ */
+static void send_mem(uint32_t offset){
+
+  static memdl_t dl;
+  const memdl_port_t port = { mem_request, mem_read, mem_send, &pymem_emu };
+  char msg[32];
+  int len;
+
+  uart_dma_init(&uart_gnd, &huart2, COMMS_LINK_GND);
+  if(memdl_start(&dl, &port, NULL, MEMDL_DEPTH, offset, MEM_SIZE, HAL_GetTick())) return;
+
+  while(dl.state!=MEMDL_DONE){
+    if(!memdl_poll(&dl, HAL_GetTick())){
+      __WFI();
+    }
   }
 
+  len=snprintf(msg, sizeof(msg), "memdl %lu B/s",
+               (unsigned long)memdl_rate(&dl, HAL_GetTick()));
+  while(!dbg_room(len));
+  dbg_write(DBG_PRINT, NULL, 0, (uint8_t *)msg, len);
+  while(!dbg_idle());
+
   return;
 
 }
 
-
-
 /* USER CODE END 4 */
 
 /**
@@ -0,0 +1,220 @@
+/*
+ * memdl.c
+ *	Description: Pipelined downlink of the emulated memory.
+ */
+
+#include "memdl.h"
+#include <string.h>
+
+/**
+ * Starts a download
+ * @param m the download
+ * @param port the memory emulator and the downlink
+ * @param enc the LZSS encoder, NULL to send the memory raw
+ * @param depth the requests kept in flight, 1 to MEMDL_DEPTH
+ * @param start the first address to send, where a resumed download
+ * continues
+ * @param end the address after the last one to send
+ * @param now_ms the current time in milliseconds
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+memdl_start (memdl_t *m, const memdl_port_t *port, lzss_enc_t *enc,
+	     uint8_t depth, uint32_t start, uint32_t end, uint32_t now_ms)
+{
+  if (!m || !port || !port->request || !port->read || !port->send
+      || depth < 1 || depth > MEMDL_DEPTH || start > end) {
+    return -1;
+  }
+  memset (m, 0, sizeof(memdl_t));
+  m->port = *port;
+  m->enc = enc;
+  m->depth = depth;
+  m->start = start;
+  m->end = end;
+  m->req_off = start;
+  m->rx_off = start;
+  m->start_ms = now_ms;
+  m->last_rx_ms = now_ms;
+  if (enc) {
+    lzss_enc_init (enc);
+  }
+  m->state = MEMDL_RUNNING;
+  return 0;
+}
+
+/**
+ * Keeps up to depth chunks requested ahead of the reception
+ */
+static uint8_t
+memdl_request (memdl_t *m, uint32_t now_ms)
+{
+  uint8_t progress = 0;
+  size_t len;
+
+  while (m->req_off < m->end
+      && m->req_off - m->rx_off < (uint32_t) m->depth * MEMDL_CHUNK_LEN) {
+    len = m->end - m->req_off;
+    if (len > MEMDL_CHUNK_LEN) {
+      len = MEMDL_CHUNK_LEN;
+    }
+    if (m->port.request (m->port.priv, m->req_off, len)) {
+      break;
+    }
+    /* The timeout runs from the oldest unanswered request */
+    if (m->req_off == m->rx_off) {
+      m->last_rx_ms = now_ms;
+    }
+    m->req_off += len;
+    progress = 1;
+  }
+  return progress;
+}
+
+/**
+ * Reads what the memory emulator has answered, at most \p len bytes
+ */
+static size_t
+memdl_receive (memdl_t *m, uint8_t *buf, size_t len, uint32_t now_ms)
+{
+  size_t n;
+
+  if (len > m->req_off - m->rx_off) {
+    len = m->req_off - m->rx_off;
+  }
+  if (!len) {
+    return 0;
+  }
+  n = m->port.read (m->port.priv, m->rx_off, buf, len);
+  if (n) {
+    m->rx_off += n;
+    m->last_rx_ms = now_ms;
+  }
+  return n;
+}
+
+/**
+ * Moves received data into the packet, raw or compressed
+ * @return 1 if anything moved
+ */
+static uint8_t
+memdl_fill (memdl_t *m, uint32_t now_ms)
+{
+  lzss_status_t st;
+  size_t n;
+
+  if (!m->enc) {
+    n = memdl_receive (m, m->pkt + 2 + m->fill, MEMDL_PAYLOAD_LEN - m->fill,
+		       now_ms);
+    m->fill += n;
+    if (m->fill == MEMDL_PAYLOAD_LEN || (m->rx_off == m->end && m->fill)) {
+      m->pkt_ready = 1;
+    }
+    else if (m->rx_off == m->end) {
+      m->state = MEMDL_DONE;
+    }
+    return n > 0;
+  }
+
+  st = lzss_enc_poll (m->enc, m->pkt + 2 + m->fill,
+		      MEMDL_PAYLOAD_LEN - m->fill, &n);
+  m->fill += n;
+  switch (st) {
+    case LZSS_OK:
+      m->pkt_ready = 1;
+      return 1;
+    case LZSS_DONE:
+      if (m->fill) {
+	m->pkt_ready = 1;
+      }
+      else {
+	m->state = MEMDL_DONE;
+      }
+      return 1;
+    case LZSS_MORE_INPUT:
+      if (m->in_used == m->in_len) {
+	m->in_len = memdl_receive (m, m->in, sizeof(m->in), now_ms);
+	m->in_used = 0;
+	if (!m->in_len) {
+	  if (m->rx_off == m->end && !m->finishing) {
+	    lzss_enc_finish (m->enc);
+	    m->finishing = 1;
+	    return 1;
+	  }
+	  return n > 0;
+	}
+      }
+      m->in_used += lzss_enc_sink (m->enc, m->in + m->in_used,
+				   m->in_len - m->in_used);
+      return 1;
+    default:
+      m->state = MEMDL_DONE;
+      return 0;
+  }
+}
+
+/**
+ * Advances the download as far as the ports allow. Call it from the main
+ * loop until the state is MEMDL_DONE.
+ * @param m the download
+ * @param now_ms the current time in milliseconds
+ * @return 1 if anything happened
+ */
+uint8_t
+memdl_poll (memdl_t *m, uint32_t now_ms)
+{
+  uint8_t progress = 0;
+
+  while (m->state == MEMDL_RUNNING) {
+    if (m->pkt_ready) {
+      m->pkt[0] = m->txcnt;
+      m->pkt[1] = (m->txcnt + 1) & 0x07;
+      if (m->port.send (m->port.priv, m->pkt, m->fill + 2)) {
+	break;
+      }
+      m->txcnt = (m->txcnt + 1) & 0x07;
+      m->packets++;
+      m->sent_bytes += m->fill + 2;
+      m->fill = 0;
+      m->pkt_ready = 0;
+      progress = 1;
+      continue;
+    }
+    if (memdl_request (m, now_ms)) {
+      progress = 1;
+    }
+    if (!memdl_fill (m, now_ms)) {
+      break;
+    }
+    progress = 1;
+  }
+
+  if (m->state == MEMDL_DONE) {
+    if (!m->end_ms) {
+      m->end_ms = now_ms;
+    }
+    return progress;
+  }
+  /* A request or its answer got lost: ask again from the missing byte */
+  if (m->req_off != m->rx_off && now_ms - m->last_rx_ms > MEMDL_TIMEOUT_MS) {
+    m->req_off = m->rx_off;
+    m->retries++;
+    progress |= memdl_request (m, now_ms);
+  }
+  return progress;
+}
+
+/**
+ * @return the memory bytes sent per second so far, or over the whole
+ * download once it is done
+ */
+uint32_t
+memdl_rate (const memdl_t *m, uint32_t now_ms)
+{
+  uint32_t ms = (m->end_ms ? m->end_ms : now_ms) - m->start_ms;
+
+  if (!ms) {
+    return 0;
+  }
+  return (uint32_t) ((uint64_t) (m->rx_off - m->start) * 1000 / ms);
+}
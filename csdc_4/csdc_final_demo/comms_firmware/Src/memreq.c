@@ -0,0 +1,143 @@
+/*
+ * memreq.c
+ *	Description: Tagged requests to the memory emulator.
+ */
+
+#include "memreq.h"
+#include <string.h>
+
+void
+memreq_init (memreq_t *m, const memreq_port_t *port)
+{
+  memset (m, 0, sizeof(memreq_t));
+  m->port = *port;
+  dbg_frame_rx_init (&m->rx);
+}
+
+/**
+ * Queues a read request. It does not wait for the answer, which
+ * memreq_read() picks up.
+ * @param m the client
+ * @param addr the first address
+ * @param len the number of bytes, 1 to MEMREQ_MAX_LEN
+ * @return 0 on success or -1 if the request could not be queued
+ */
+int32_t
+memreq_request (memreq_t *m, uint32_t addr, size_t len)
+{
+  memreq_slot_t *s = &m->slot[m->tag % MEMREQ_SLOTS];
+  uint8_t head[5];
+
+  if (!len || len > MEMREQ_MAX_LEN || addr > 0xFFFF) {
+    return -1;
+  }
+  head[0] = m->tag;
+  head[1] = (uint8_t) (addr >> 8);
+  head[2] = (uint8_t) addr;
+  head[3] = (uint8_t) (len >> 8);
+  head[4] = (uint8_t) len;
+  if (m->port.send (m->port.priv, DBG_MEM_READ, head, sizeof(head), NULL,
+		    0)) {
+    return -1;
+  }
+  s->addr = addr;
+  s->len = (uint16_t) len;
+  s->tag = m->tag;
+  s->used = 1;
+  m->tag++;
+  return 0;
+}
+
+/**
+ * Decodes received bytes up to the next answer to a pending request
+ * @return 1 if there is a new answer
+ */
+static uint8_t
+memreq_next (memreq_t *m)
+{
+  memreq_slot_t *s;
+
+  for (;;) {
+    if (m->in_used == m->in_len) {
+      m->in_len = m->port.read (m->port.priv, m->in, sizeof(m->in));
+      m->in_used = 0;
+      if (!m->in_len) {
+	return 0;
+      }
+    }
+    if (!dbg_frame_feed (&m->rx, m->in[m->in_used++])) {
+      continue;
+    }
+    if (m->rx.type != DBG_MEM_DATA || !m->rx.payload_len) {
+      continue;
+    }
+    s = &m->slot[m->rx.payload[0] % MEMREQ_SLOTS];
+    if (!s->used || s->tag != m->rx.payload[0]
+	|| m->rx.payload_len - 1 != s->len) {
+      m->dropped++;
+      continue;
+    }
+    s->used = 0;
+    m->data = m->rx.payload + 1;
+    m->left = s->len;
+    m->addr = s->addr;
+    m->answers++;
+    return 1;
+  }
+}
+
+/**
+ * Reads answered memory
+ * @param m the client
+ * @param addr the address to read from, the answers to other addresses are
+ * dropped
+ * @param buf the output buffer
+ * @param len the size of the output buffer
+ * @return the number of bytes read
+ */
+size_t
+memreq_read (memreq_t *m, uint32_t addr, uint8_t *buf, size_t len)
+{
+  size_t n;
+
+  for (;;) {
+    if (m->left && m->addr != addr) {
+      m->left = 0;
+      m->dropped++;
+    }
+    if (m->left) {
+      break;
+    }
+    if (!memreq_next (m)) {
+      return 0;
+    }
+  }
+  n = len < m->left ? len : m->left;
+  memcpy (buf, m->data, n);
+  m->data += n;
+  m->left -= n;
+  m->addr += n;
+  return n;
+}
+
+/**
+ * Queues a write, up to MEMREQ_MAX_LEN bytes at once
+ * @param m the client
+ * @param addr the first address
+ * @param data the data to write
+ * @param len the size of the data
+ * @return 0 on success or -1 if the write could not be queued
+ */
+int32_t
+memreq_write (memreq_t *m, uint32_t addr, const uint8_t *data, size_t len)
+{
+  uint8_t head[2];
+
+  if (!len || len > MEMREQ_MAX_LEN || addr > 0xFFFF) {
+    return -1;
+  }
+  head[0] = (uint8_t) (addr >> 8);
+  head[1] = (uint8_t) addr;
+  return m->port.send (m->port.priv, DBG_MEM_WRITE, head, sizeof(head), data,
+		       len);
+}
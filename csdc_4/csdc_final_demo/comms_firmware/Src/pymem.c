@@ -3,210 +3,245 @@
 #include "string.h"
 #include "stm32f4xx_hal.h"
 #include "main.h"
+#include "uart_dma.h"
+#include "bridge.h"
+#include "comms_cmd.h"
+#include "config.h"
+#include "dbg.h"
+#include "memreq.h"
+#if COMMS_GND_KISS_EN
+#include "kiss.h"
+#endif
 
 
 extern UART_HandleTypeDef huart2;
 extern UART_HandleTypeDef huart1;
 
+memreq_t pymem_emu;
+
+static int32_t emu_send(void *priv, uint8_t type, const uint8_t *head,
+                        size_t head_len, const uint8_t *data, size_t len){
+  (void)priv;
+  return dbg_write(type, head, head_len, data, len);
+}
+
+static size_t emu_read(void *priv, uint8_t *buf, size_t len){
+  return uart_dma_read((uart_dma_t *)priv, buf, len);
+}
+
 /**
-  * @brief  Requests memory form python memory emulator
+  * @brief  Starts the debug channel and the memory emulator client on it
+  * @retval none
+  */
+void pymem_init(){
+  const memreq_port_t port = { emu_send, emu_read, &uart_gnd };
+
+  dbg_init();
+  memreq_init(&pymem_emu, &port);
+}
+
+/**
+  * @brief  Requests memory form python memory emulator, in requests of up
+  *         to MEMREQ_MAX_LEN bytes that are all sent before the answers
+  *         are read
   * @param  data the buffer where data will be stored
   * @param  address which section of the memory gets read
   * @param  Size Amount of data to be read
   * @retval none
   */
 void request_pkt(uint8_t *data,uint16_t address,int size){
-  uint8_t out[4];
-  memset((char*)data,'\n',size);
+  uint32_t start;
+  int req=0;
+  int got=0;
+  int n;
 
+  if(size<1 || address+size>0x10000){
+    return;
+  }
+  memset((char*)data,'\n',size);
 
-  out[0]='r';//settup request command
-  out[1]=(uint8_t)(address>>8);
-  out[2]=(uint8_t)(0xFF&address);
-  out[3]=(uint8_t)(0xFF&size);
-
-  HAL_UART_Transmit(&huart2, out,4, 100);
-
-  HAL_UART_Receive(&huart2, data,size, 1000);
+  start=HAL_GetTick();
+  while(got<size && HAL_GetTick()-start<1000){
+    /* keep up to MEMREQ_SLOTS requests in flight */
+    while(req<size && req-got<MEMREQ_SLOTS*MEMREQ_MAX_LEN){
+      n=size-req<MEMREQ_MAX_LEN ? size-req : MEMREQ_MAX_LEN;
+      if(memreq_request(&pymem_emu, address+req, n)){
+        break;
+      }
+      req+=n;
+    }
+    n=memreq_read(&pymem_emu, address+got, data+got, size-got);
+    if(n){
+      got+=n;
+      start=HAL_GetTick();
+    }
+  }
 
   return;
 }
 
 /**
-  * @brief  Sends memory to python memory emulator
+  * @brief  Sends memory to python memory emulator, queued on the debug
+  *         channel (dbg.h) in records of up to MEMREQ_MAX_LEN bytes
   * @param  data the buffer with the data that needs to be written
   * @param  address which section of the memory gets written to
   * @param  Size Amount of data to be sent
   * @retval none
   */
 void write_pkt(uint8_t *data, uint16_t address, int size){
-  uint8_t out[size+4];
-  int i;
-  
-  out[0]='w';
-  out[1]=(uint8_t)(address>>8);
-  out[2]=(uint8_t)(0xFF&address);
-  out[3]=(uint8_t)(size);
-
-  for (i=0;i<size;i++){
-    out[4+i]=data[i];
-  }
+  int sent=0;
+  int n;
 
-  HAL_UART_Transmit(&huart2, out,size+4, 100);
-  
-  HAL_Delay(100);// give the computer some time to write the data to a file
+  if(size<1 || address+size>0x10000){
+    return;
+  }
+  while(sent<size){
+    n=size-sent<MEMREQ_MAX_LEN ? size-sent : MEMREQ_MAX_LEN;
+    /* the channel drains at line rate, wait for room rather than drop */
+    while(!dbg_room(2+n));
+    memreq_write(&pymem_emu, address+sent, data+sent, n);
+    sent+=n;
+  }
 
   return;
 }
 
 
 /**
-  * @brief  Uses the memory emulator as a serial monitor
+  * @brief  Uses the memory emulator as a serial monitor. Returns at once,
+  *         the text is sent in the background.
   * @param  data the buffer with the data that needs to be printed
   * @param  Size Amount of data to be sent
   * @retval none
   */
 void ser_print(uint8_t *data, int size){
 
-  uint8_t out[size+2];
-  int i;
-
-  out[0]='p';//settup request command
-  out[1]=(uint8_t)(size);
-
-  for (i=0;i<size;i++){
-    out[2+i]=data[i];
+  if(size<1){
+    return;
   }
-
-  HAL_UART_Transmit(&huart2, out,sizeof(out), 100);
+  dbg_write(DBG_PRINT,NULL,0,data,size);
 
   return;
 
 }
 
 /**
-  * @brief  Generic python command interface
-  * @param  cmd the command to be sent to the python script
+  * @brief  Generic python command interface. Returns at once, the record
+  *         is sent in the background or dropped if the channel is full.
+  * @param  cmd the command to be sent to the python script, dbg_type_t
   * @param  data the buffer with the data that needs to be printed
   * @param  Size Amount of data to be sent
   * @retval none
   */
 void py_cmd(char cmd, uint8_t *data, int size){
 
-  uint8_t out[size+3];
-  int i;
-
-  out[0]=cmd;//settup request command
-  out[1]=(uint8_t)(size>>8);
-  out[2]=(uint8_t)(0xFF&size);
-
-  for (i=0;i<size;i++){
-    out[3+i]=data[i];
+  if(size<0){
+    return;
   }
-
-  HAL_UART_Transmit(&huart2, out,sizeof(out), 100);
-  
-  HAL_Delay(500);
+  dbg_write(cmd,NULL,0,data,size);
 
   return;
 
-
-
 }
 
-void wcsdc(uint8_t *head, uint8_t *data, uint8_t size){
-
-  uint8_t out[size+3];
-  int i;
-
-  HAL_Delay(3000);
-  out[0]=(size);//settup request command
-
-
-  for (i=0;i<2;i++){
-    out[1+i]=head[i];
-  }
-  for (i=0;i<size;i++){
-    out[3+i]=data[i];
-  }
+static size_t bridge_read(void *priv, uint8_t *buf, size_t len){
+  return uart_dma_read((uart_dma_t *)priv, buf, len);
+}
 
-  HAL_UART_Transmit(&huart2, out,sizeof(out), 100);
-  
+static int32_t bridge_write(void *priv, const uint8_t *data, size_t len){
+  return uart_dma_write((uart_dma_t *)priv, data, len);
+}
 
-  return;
+static size_t bridge_pending(void *priv){
+  return uart_dma_pending((uart_dma_t *)priv);
 }
+
 /**
-  * @brief  Receives packet from gnd
-  * @param  data the data grounds sends
-  * @retval size of data
+  * @brief  Echoes every packet of the ground back to it, assembled by
+  *         uplink_rx without waiting on the line. Never returns.
+  * @retval none
   */
-uint8_t rcsdc(uint8_t *data){
-
-  uint8_t size;
+void sertest(){
 
-  while(HAL_UART_Receive(&huart2, &size,1, 500)!=HAL_OK) 
-    HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
-  HAL_UART_Receive(&huart2, data,size, 100);
+  static uplink_rx_t rx;
+  const uplink_pkt_t *pkt;
+
+  uart_dma_init(&uart_gnd, &huart2, COMMS_LINK_GND);
+  uplink_rx_init(&rx);
+
+  while(1){
+    uplink_rx_poll(&rx, bridge_read, &uart_gnd, HAL_GetTick());
+    pkt = uplink_rx_peek(&rx);
+    if(pkt && uart_dma_write(&uart_gnd, pkt->buf, uplink_pkt_len(pkt)) == 0){
+      uplink_rx_pop(&rx);
+      HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
+      continue;
+    }
+    /* Nothing to do until the next DMA, idle line or SysTick interrupt */
+    __WFI();
+  }
 
-  return size;
 }
 
-
-void sertest(){
-
-  uint8_t in[256];
-  uint8_t size[1];
-  while(HAL_UART_Receive(&huart2, size,1, 500)!=HAL_OK) 
-   HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
-  HAL_UART_Transmit(&huart2,size,1,10000);
-  HAL_UART_Receive(&huart2, in,size[0], 10000);
-  HAL_Delay(500);
-  HAL_UART_Transmit(&huart2, in,size[0], 10000);
-
+#if COMMS_GND_KISS_EN
+static size_t kiss_pending(void *priv){
+  (void)priv;
+  return bridge_pending(&uart_gnd);
 }
+#endif
 
+/**
+  * @brief  Relays packets between the ground and the CDH, in both
+  *         directions at once, and answers the ones addressed to the
+  *         comms MCU. Never returns.
+  * @retval none
+  */
 void csdcdemo(){
 
-  uint8_t rbuff[256];
-  uint8_t cdhead[2];
-  uint8_t cdhbuff[254];
-  uint8_t rsize;
-
-  HAL_GPIO_WritePin(LD2_GPIO_Port, LD2_Pin, 1);
+  static bridge_t bridge;
+  static router_t router;
+  static tx_sched_t sched;
+#if COMMS_GND_KISS_EN
+  /* The bridge talks to the ground through the KISS adapter */
+  static kiss_t kiss;
+  const bridge_port_t uart = { bridge_read, bridge_write, &uart_gnd };
+  const tx_sink_t downlink = { kiss_write, kiss_pending, comms_cmd_beacon,
+                               &kiss };
+  const bridge_port_t gnd = { kiss_read, kiss_write, &kiss };
+#else
+  const tx_sink_t downlink = { bridge_write, bridge_pending, comms_cmd_beacon,
+                               &uart_gnd };
+  const bridge_port_t gnd = { bridge_read, bridge_write, &uart_gnd };
+#endif
+  const bridge_port_t cdh = { bridge_read, bridge_write, &uart_cdh };
+  uint32_t packets = 0;
+
+  uart_dma_init(&uart_gnd, &huart2, COMMS_LINK_GND);
+  uart_dma_init(&uart_cdh, &huart1, COMMS_LINK_CDH);
+#if COMMS_GND_KISS_EN
+  kiss_init(&kiss, &uart);
+#endif
+  router_init(&router, comms_routes);
+  comms_cmd_init(&router);
+  tx_sched_init(&sched, &downlink, COMMS_LINK_GND, HAL_GetTick());
+  bridge_init(&bridge, &gnd, &cdh, &router, &sched);
 
-  // sertest();
-
-  rsize=rcsdc(rbuff); //wait for packet from gnd
-  wcsdc(rbuff,rbuff+2,rsize);
-  HAL_UART_Transmit(&huart1, rbuff,rsize, 100);//send data from gnd to cdh
-  
-  memset((char*)rbuff,'\0',sizeof(rbuff));
-  rsize=rcsdc(rbuff); //wait for packet from gnd
-  wcsdc(rbuff,rbuff+2,rsize);
-  HAL_UART_Transmit(&huart1, rbuff,rsize, 100);//send data from gnd to cdh
-  
-
-  memset((char*)rbuff,'\0',sizeof(rbuff));
-  rsize=rcsdc(rbuff); //wait for packet from gnd
-  wcsdc(rbuff,rbuff+2,rsize);
-  HAL_UART_Transmit(&huart1, rbuff,rsize, 100);//send data from gnd to cdh
-  
   HAL_GPIO_WritePin(LD2_GPIO_Port, LD2_Pin, 1);
 
-  while(1){  
-
-
-    memset((char*)cdhbuff,'y',sizeof(cdhbuff));
-
-    while(HAL_UART_Receive(&huart1,cdhead,sizeof(cdhead),100)!=HAL_OK);//wait for cdh's reply
-    rsize=cdhead[1];  
-    // HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
-    HAL_GPIO_WritePin(LD2_GPIO_Port, LD2_Pin, 0);
-
-    if(HAL_UART_Receive(&huart1,cdhbuff,rsize,100)==HAL_OK)
-      HAL_GPIO_WritePin(LD2_GPIO_Port, LD2_Pin, 1);
-
-    wcsdc(cdhead,cdhbuff,rsize+2);//return cdh reply to ground
+  while(1){
+    if(bridge_poll(&bridge, HAL_GetTick())){
+      continue;
+    }
+    comms_cmd_poll(&bridge, HAL_GetTick());
+    /* blink on every relayed packet */
+    if(packets != comms_stats.now.link[COMMS_LINK_GND].frames_in
+       + comms_stats.now.link[COMMS_LINK_CDH].frames_in){
+      packets = comms_stats.now.link[COMMS_LINK_GND].frames_in
+	  + comms_stats.now.link[COMMS_LINK_CDH].frames_in;
+      HAL_GPIO_TogglePin(LD2_GPIO_Port, LD2_Pin);
+    }
+    /* Nothing to do until the next DMA, idle line or SysTick interrupt */
+    __WFI();
   }
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,92 @@
+/*
+ * router.c
+ *	Description: Address based routing of uplink packets.
+ */
+
+#include "router.h"
+#include <string.h>
+
+/**
+ * Sets up a router
+ * @param r the router
+ * @param routes the routing table, one entry per address
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+router_init (router_t *r, const router_route_t *routes)
+{
+  uint8_t i;
+
+  if (!r || !routes) {
+    return -1;
+  }
+  for (i = 0; i < ROUTER_NUM_ADDR; i++) {
+    if (routes[i].dest == ROUTER_LOCAL && !routes[i].handler) {
+      return -1;
+    }
+  }
+  memset (r, 0, sizeof(router_t));
+  r->routes = routes;
+  return 0;
+}
+
+/**
+ * Routes a packet, running its handler if it is for the comms MCU
+ * @param r the router
+ * @param buf the packet
+ * @param len the size of the packet
+ * @param reply the reply to send to the ground, room for
+ * ROUTER_MAX_REPLY_LEN + 2 bytes
+ * @param reply_len set to the size of the reply, 0 if there is none
+ * @return where the packet goes. Packets with a bad header are dropped.
+ */
+router_dest_t
+router_dispatch (router_t *r, const uint8_t *buf, size_t len, uint8_t *reply,
+		 size_t *reply_len)
+{
+  const router_route_t *route;
+  router_pkt_t pkt;
+  size_t out_len = 0;
+  int32_t ret;
+
+  *reply_len = 0;
+  if (len < 2 || !router_head_valid (buf[0])) {
+    r->bad_packets++;
+    return ROUTER_DROP;
+  }
+  pkt.addr = router_head_addr (buf[0]);
+  pkt.flag = router_head_flag (buf[0]);
+  pkt.len_cmd = buf[1];
+  pkt.data = buf + 2;
+  pkt.len = len - 2;
+
+  route = &r->routes[pkt.addr];
+  r->packets[pkt.addr]++;
+  if (route->dest != ROUTER_LOCAL) {
+    return route->dest;
+  }
+
+  /* The length field of a data packet has to agree with the packet */
+  if (pkt.flag && pkt.len_cmd > pkt.len) {
+    r->bad_packets++;
+    return ROUTER_DROP;
+  }
+  if (pkt.flag) {
+    pkt.len = pkt.len_cmd;
+  }
+
+  ret = route->handler (route->priv, &pkt, reply + 4, &out_len);
+  if (!ret && out_len > ROUTER_MAX_HANDLER_LEN) {
+    ret = -1;
+  }
+  if (ret) {
+    r->errors++;
+    out_len = 0;
+  }
+  reply[0] = router_head (pkt.addr, 1);
+  reply[1] = (uint8_t) (out_len + 2);
+  reply[2] = pkt.len_cmd;
+  reply[3] = ret ? ROUTER_STATUS_ERROR : ROUTER_STATUS_OK;
+  *reply_len = out_len + 4;
+  return ROUTER_LOCAL;
+}
@@ -0,0 +1,365 @@
+/*
+ * sha256.c
+ *	Description: Streaming SHA-256 and HMAC-SHA-256.
+ *
+ *	The compression function is written for the Cortex-M4: the 64 rounds
+ *	are fully unrolled with the working variables rotated by the macro
+ *	arguments instead of by register moves, the message schedule lives in
+ *	a 16 word circular window that is expanded in place, and input words
+ *	are fetched as whole words and byte swapped (LDR + REV) instead of
+ *	being assembled byte by byte.
+ */
+
+#include "sha256.h"
+#include <string.h>
+
+static const uint32_t K[64] =
+  { 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+      0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+      0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+      0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+      0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+      0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+      0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+      0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+      0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+static const uint32_t H0[8] =
+  { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c,
+      0x1f83d9ab, 0x5be0cd19 };
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z) ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z) (((x) & (y)) | ((z) & ((x) | (y))))
+#define BSIG0(x) (ROTR(x, 2) ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define BSIG1(x) (ROTR(x, 6) ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define SSIG0(x) (ROTR(x, 7) ^ ROTR(x, 18) ^ ((x) >> 3))
+#define SSIG1(x) (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+/* Expands the schedule in place: w[i & 15] becomes W[i] */
+#define SCHED(i)							\
+  (w[(i) & 15] += SSIG1(w[((i) - 2) & 15]) + w[((i) - 7) & 15]		\
+      + SSIG0(w[((i) - 15) & 15]))
+
+#define RND(a, b, c, d, e, f, g, h, k, wi)				\
+  do {									\
+    uint32_t t1 = (h) + BSIG1(e) + CH(e, f, g) + (k) + (wi);		\
+    (d) += t1;								\
+    (h) = t1 + BSIG0(a) + MAJ(a, b, c);					\
+  } while(0)
+
+#define RND8(i, W)							\
+  do {									\
+    RND(a, b, c, d, e, f, g, h, K[(i) + 0], W((i) + 0));		\
+    RND(h, a, b, c, d, e, f, g, K[(i) + 1], W((i) + 1));		\
+    RND(g, h, a, b, c, d, e, f, K[(i) + 2], W((i) + 2));		\
+    RND(f, g, h, a, b, c, d, e, K[(i) + 3], W((i) + 3));		\
+    RND(e, f, g, h, a, b, c, d, K[(i) + 4], W((i) + 4));		\
+    RND(d, e, f, g, h, a, b, c, K[(i) + 5], W((i) + 5));		\
+    RND(c, d, e, f, g, h, a, b, K[(i) + 6], W((i) + 6));		\
+    RND(b, c, d, e, f, g, h, a, K[(i) + 7], W((i) + 7));		\
+  } while(0)
+
+#define WLOAD(i) (w[(i)])
+
+static inline uint32_t
+load_be32 (const uint8_t *p)
+{
+  uint32_t x;
+  /* Compiles to a single (unaligned capable) LDR on the M4 */
+  memcpy (&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return x;
+#else
+  return __builtin_bswap32 (x);
+#endif
+}
+
+static inline void
+store_be32 (uint8_t *p, uint32_t x)
+{
+  p[0] = (uint8_t) (x >> 24);
+  p[1] = (uint8_t) (x >> 16);
+  p[2] = (uint8_t) (x >> 8);
+  p[3] = (uint8_t) x;
+}
+
+/**
+ * Processes one 64 byte block
+ * @param state the hash state
+ * @param p pointer to the block. No alignment is required.
+ */
+static void
+sha256_compress (uint32_t *state, const uint8_t *p)
+{
+  uint32_t w[16];
+  uint32_t a, b, c, d, e, f, g, h;
+  size_t i;
+
+  for (i = 0; i < 16; i++) {
+    w[i] = load_be32 (p + 4 * i);
+  }
+
+  a = state[0];
+  b = state[1];
+  c = state[2];
+  d = state[3];
+  e = state[4];
+  f = state[5];
+  g = state[6];
+  h = state[7];
+
+  RND8(0, WLOAD);
+  RND8(8, WLOAD);
+  RND8(16, SCHED);
+  RND8(24, SCHED);
+  RND8(32, SCHED);
+  RND8(40, SCHED);
+  RND8(48, SCHED);
+  RND8(56, SCHED);
+
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
+}
+
+/**
+ * Initializes a SHA-256 context
+ * @param h the SHA-256 context
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+sha256_init (sha256_ctx_t *h)
+{
+  if (!h) {
+    return -1;
+  }
+  memcpy (h->state, H0, sizeof(H0));
+  h->total_len = 0;
+  h->block_len = 0;
+  return 0;
+}
+
+/**
+ * Feeds data to the hash. Can be called repeatedly with pieces of any size.
+ * Whole blocks are hashed directly from \p in, only the leftover bytes are
+ * copied into the context.
+ * @param h the SHA-256 context
+ * @param in the input data
+ * @param len the size of the input data
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+sha256_update (sha256_ctx_t *h, const uint8_t *in, size_t len)
+{
+  uint8_t *block;
+  size_t n;
+
+  if (!h || (!in && len)) {
+    return -1;
+  }
+
+  block = (uint8_t *) h->block;
+  h->total_len += len;
+
+  if (h->block_len) {
+    n = SHA256_BLOCK_LEN - h->block_len;
+    if (n > len) {
+      n = len;
+    }
+    memcpy (block + h->block_len, in, n);
+    h->block_len += n;
+    in += n;
+    len -= n;
+    if (h->block_len < SHA256_BLOCK_LEN) {
+      return 0;
+    }
+    sha256_compress (h->state, block);
+    h->block_len = 0;
+  }
+
+  while (len >= SHA256_BLOCK_LEN) {
+    sha256_compress (h->state, in);
+    in += SHA256_BLOCK_LEN;
+    len -= SHA256_BLOCK_LEN;
+  }
+
+  memcpy (block, in, len);
+  h->block_len = len;
+  return 0;
+}
+
+/**
+ * Applies the padding and writes the digest
+ * @param h the SHA-256 context. It should be re-initialized before reuse.
+ * @param digest output buffer of SHA256_DIGEST_LEN bytes
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+sha256_final (sha256_ctx_t *h, uint8_t *digest)
+{
+  uint8_t *block;
+  uint64_t bits;
+  size_t i;
+
+  if (!h || !digest) {
+    return -1;
+  }
+
+  block = (uint8_t *) h->block;
+  bits = h->total_len * 8;
+
+  block[h->block_len++] = 0x80;
+  if (h->block_len > SHA256_BLOCK_LEN - 8) {
+    memset (block + h->block_len, 0, SHA256_BLOCK_LEN - h->block_len);
+    sha256_compress (h->state, block);
+    h->block_len = 0;
+  }
+  memset (block + h->block_len, 0, SHA256_BLOCK_LEN - 8 - h->block_len);
+  store_be32 (block + SHA256_BLOCK_LEN - 8, (uint32_t) (bits >> 32));
+  store_be32 (block + SHA256_BLOCK_LEN - 4, (uint32_t) bits);
+  sha256_compress (h->state, block);
+
+  for (i = 0; i < 8; i++) {
+    store_be32 (digest + 4 * i, h->state[i]);
+  }
+  return 0;
+}
+
+/**
+ * One-shot SHA-256
+ * @param digest output buffer of SHA256_DIGEST_LEN bytes
+ * @param in the input data
+ * @param len the size of the input data
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+sha256 (uint8_t *digest, const uint8_t *in, size_t len)
+{
+  sha256_ctx_t h;
+  sha256_init (&h);
+  if (sha256_update (&h, in, len)) {
+    return -1;
+  }
+  return sha256_final (&h, digest);
+}
+
+/**
+ * Pre-processes an HMAC key. Keys longer than a block are hashed first,
+ * as RFC 2104 dictates.
+ * @param k the key handle
+ * @param key the secret key
+ * @param key_len the size of the key
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+hmac_sha256_set_key (hmac_sha256_key_t *k, const uint8_t *key, size_t key_len)
+{
+  uint8_t pad[SHA256_BLOCK_LEN] = {0};
+  sha256_ctx_t h;
+  size_t i;
+
+  if (!k || (!key && key_len)) {
+    return -1;
+  }
+
+  if (key_len > SHA256_BLOCK_LEN) {
+    sha256 (pad, key, key_len);
+  }
+  else {
+    memcpy (pad, key, key_len);
+  }
+
+  for (i = 0; i < SHA256_BLOCK_LEN; i++) {
+    pad[i] ^= 0x36;
+  }
+  memcpy (h.state, H0, sizeof(H0));
+  sha256_compress (h.state, pad);
+  memcpy (k->istate, h.state, sizeof(k->istate));
+
+  /* 0x36 ^ 0x5c turns the inner pad into the outer one */
+  for (i = 0; i < SHA256_BLOCK_LEN; i++) {
+    pad[i] ^= 0x36 ^ 0x5c;
+  }
+  memcpy (h.state, H0, sizeof(H0));
+  sha256_compress (h.state, pad);
+  memcpy (k->ostate, h.state, sizeof(k->ostate));
+
+  memset (pad, 0, sizeof(pad));
+  return 0;
+}
+
+/**
+ * Starts a new HMAC computation
+ * @param h the HMAC context
+ * @param k a key prepared with hmac_sha256_set_key(). It should stay valid
+ * until hmac_sha256_final() is called.
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+hmac_sha256_init (hmac_sha256_ctx_t *h, const hmac_sha256_key_t *k)
+{
+  if (!h || !k) {
+    return -1;
+  }
+  h->key = k;
+  memcpy (h->ctx.state, k->istate, sizeof(k->istate));
+  h->ctx.total_len = SHA256_BLOCK_LEN;
+  h->ctx.block_len = 0;
+  return 0;
+}
+
+int32_t
+hmac_sha256_update (hmac_sha256_ctx_t *h, const uint8_t *in, size_t len)
+{
+  if (!h) {
+    return -1;
+  }
+  return sha256_update (&h->ctx, in, len);
+}
+
+/**
+ * Finishes the HMAC computation
+ * @param h the HMAC context
+ * @param mac output buffer of SHA256_DIGEST_LEN bytes
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+hmac_sha256_final (hmac_sha256_ctx_t *h, uint8_t *mac)
+{
+  uint8_t inner[SHA256_DIGEST_LEN];
+
+  if (!h || !mac) {
+    return -1;
+  }
+  sha256_final (&h->ctx, inner);
+
+  memcpy (h->ctx.state, h->key->ostate, sizeof(h->key->ostate));
+  h->ctx.total_len = SHA256_BLOCK_LEN;
+  h->ctx.block_len = 0;
+  sha256_update (&h->ctx, inner, sizeof(inner));
+  return sha256_final (&h->ctx, mac);
+}
+
+/**
+ * Compares two digests in constant time, so a forged MAC cannot be found
+ * byte by byte by timing the rejections.
+ * @return 1 if the buffers are equal, 0 otherwise
+ */
+uint8_t
+sha256_equal (const uint8_t *a, const uint8_t *b, size_t len)
+{
+  uint8_t diff = 0;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    diff |= a[i] ^ b[i];
+  }
+  return diff == 0;
+}
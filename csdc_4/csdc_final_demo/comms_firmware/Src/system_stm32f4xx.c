@@ -106,8 +106,12 @@
 /*!< Uncomment the following line if you need to relocate your vector Table in
      Internal SRAM. */
 /* #define VECT_TAB_SRAM */
+#ifndef VECT_TAB_OFFSET
 #define VECT_TAB_OFFSET  0x00 /*!< Vector Table base offset field. 
-                                   This value must be a multiple of 0x200. */
+                                   This value must be a multiple of 0x200.
+                                   Firmware slot builds set it to the slot
+                                   offset, see fwupdate.h */
+#endif
 /******************************************************************************/
 
 /**
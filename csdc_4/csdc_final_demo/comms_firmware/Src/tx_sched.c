@@ -0,0 +1,213 @@
+/*
+ * tx_sched.c
+ *	Description: Transmit scheduler of the downlink.
+ *
+ *	Queued packets are stored with a 16 bit length in front, so the
+ *	scheduler does not depend on how the packets frame themselves, then
+ *	the latency histogram of the packet and the time it counts from.
+ */
+
+#include "tx_sched.h"
+#include "config.h"
+#include <string.h>
+
+/**
+ * Sets up a scheduler
+ * @param s the scheduler
+ * @param sink the output
+ * @param link the statistics of the output
+ * @param now_ms the current time in milliseconds, the first beacon is due
+ * one interval later
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+tx_sched_init (tx_sched_t *s, const tx_sink_t *sink, comms_link_t link,
+	       uint32_t now_ms)
+{
+  if (!s || !sink || !sink->write || !sink->pending) {
+    return -1;
+  }
+  memset (s, 0, sizeof(tx_sched_t));
+  s->sink = *sink;
+  s->link = link;
+  ringbuf_init (&s->q[TX_CLASS_REPLY], s->reply_mem, TX_SCHED_REPLY_LEN);
+  ringbuf_init (&s->q[TX_CLASS_FILE], s->file_mem, TX_SCHED_FILE_LEN);
+  s->beacon_due_ms = now_ms + __TX_INTERVAL_MS;
+  return 0;
+}
+
+/**
+ * Queues a packet
+ * @param s the scheduler
+ * @param cls TX_CLASS_REPLY or TX_CLASS_FILE
+ * @param pkt the packet
+ * @param len the size of the packet
+ * @return 0 on success or -1 if the queue of the class has no room
+ */
+int32_t
+tx_sched_put (tx_sched_t *s, tx_class_t cls, const uint8_t *pkt, size_t len)
+{
+  return tx_sched_put_timed (s, cls, pkt, len, COMMS_LAT_NUM, 0);
+}
+
+/**
+ * Queues a packet whose latency is counted when it is handed to the
+ * output, so the time it waits behind other packets is part of it
+ * @param s the scheduler
+ * @param cls TX_CLASS_REPLY or TX_CLASS_FILE
+ * @param pkt the packet
+ * @param len the size of the packet
+ * @param lat the histogram of the latency, COMMS_LAT_NUM for none
+ * @param since_ms the time the latency counts from
+ * @return 0 on success or -1 if the queue of the class has no room
+ */
+int32_t
+tx_sched_put_timed (tx_sched_t *s, tx_class_t cls, const uint8_t *pkt,
+		    size_t len, comms_lat_t lat, uint32_t since_ms)
+{
+  ringbuf_t *q;
+  uint8_t hdr[TX_SCHED_HDR_LEN];
+
+  if (cls >= TX_CLASS_WOD || !len || len > TX_SCHED_MAX_PKT_LEN) {
+    return -1;
+  }
+  q = &s->q[cls];
+  if (ringbuf_room (q) < len + sizeof(hdr)) {
+    return -1;
+  }
+  hdr[0] = (uint8_t) len;
+  hdr[1] = (uint8_t) (len >> 8);
+  hdr[2] = (uint8_t) lat;
+  hdr[3] = (uint8_t) since_ms;
+  hdr[4] = (uint8_t) (since_ms >> 8);
+  hdr[5] = (uint8_t) (since_ms >> 16);
+  hdr[6] = (uint8_t) (since_ms >> 24);
+  ringbuf_write (q, hdr, sizeof(hdr));
+  ringbuf_write (q, pkt, len);
+  comms_stats_queue (s->link, ringbuf_used (&s->q[TX_CLASS_REPLY])
+		     + ringbuf_used (&s->q[TX_CLASS_FILE]));
+  return 0;
+}
+
+/**
+ * Replaces the WOD carried by the beacon
+ * @param s the scheduler
+ * @param pkt the WOD packet, as it is sent
+ * @param len the size of the packet
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+tx_sched_wod (tx_sched_t *s, const uint8_t *pkt, size_t len)
+{
+  if (!len || len > TX_SCHED_MAX_PKT_LEN) {
+    return -1;
+  }
+  memcpy (s->wod, pkt, len);
+  s->wod_len = len;
+  s->wod_repeats = 0;
+  return 0;
+}
+
+/**
+ * Sends the oldest packet of a queue
+ * @return 0 on success or -1 if the output refused it
+ */
+static int32_t
+tx_sched_send_queued (tx_sched_t *s, tx_class_t cls, uint32_t now_ms)
+{
+  ringbuf_t *q = &s->q[cls];
+  uint8_t pkt[TX_SCHED_MAX_PKT_LEN];
+  uint8_t hdr[TX_SCHED_HDR_LEN];
+  uint32_t since_ms;
+  size_t len;
+
+  ringbuf_peek (q, 0, hdr, sizeof(hdr));
+  len = hdr[0] | ((size_t) hdr[1] << 8);
+  ringbuf_peek (q, sizeof(hdr), pkt, len);
+  if (s->sink.write (s->sink.priv, pkt, len)) {
+    return -1;
+  }
+  ringbuf_skip (q, sizeof(hdr) + len);
+  comms_stats_frame_out (s->link, len);
+  if (hdr[2] < COMMS_LAT_NUM) {
+    since_ms = hdr[3] | ((uint32_t) hdr[4] << 8) | ((uint32_t) hdr[5] << 16)
+	| ((uint32_t) hdr[6] << 24);
+    comms_stats_latency ((comms_lat_t) hdr[2], now_ms - since_ms);
+  }
+  s->sent[cls]++;
+  return 0;
+}
+
+/**
+ * Sends the beacon, the WOD while it is valid
+ * @return 0 on success or -1 if the output refused it
+ */
+static int32_t
+tx_sched_send_beacon (tx_sched_t *s, uint32_t now_ms)
+{
+  uint8_t pkt[TX_SCHED_MAX_PKT_LEN];
+  size_t len = 0;
+
+  if (s->wod_len && s->wod_repeats < __WOD_VALID_REPEATS) {
+    if (s->sink.write (s->sink.priv, s->wod, s->wod_len)) {
+      return -1;
+    }
+    s->wod_repeats++;
+    len = s->wod_len;
+  }
+  else {
+    if (s->sink.fill) {
+      len = s->sink.fill (s->sink.priv, pkt, now_ms);
+    }
+    if (len && s->sink.write (s->sink.priv, pkt, len)) {
+      return -1;
+    }
+    s->stale_beacons++;
+  }
+  s->beacon_due_ms = now_ms + __TX_INTERVAL_MS;
+  if (len) {
+    comms_stats_frame_out (s->link, len);
+    s->sent[TX_CLASS_WOD]++;
+  }
+  return 0;
+}
+
+/**
+ * Feeds the output. Call it from the main loop.
+ * @param s the scheduler
+ * @param now_ms the current time in milliseconds
+ * @return 1 if a packet was sent
+ */
+uint8_t
+tx_sched_poll (tx_sched_t *s, uint32_t now_ms)
+{
+  uint8_t progress = 0;
+  uint8_t beacon_due;
+  uint8_t beacon_late;
+  int32_t ret;
+
+  while (s->sink.pending (s->sink.priv) <= TX_SCHED_LOW_WATER) {
+    beacon_due = (int32_t) (now_ms - s->beacon_due_ms) >= 0;
+    beacon_late = (int32_t) (now_ms - s->beacon_due_ms)
+	>= TX_SCHED_WOD_SLACK_MS;
+
+    if (ringbuf_used (&s->q[TX_CLASS_REPLY])) {
+      ret = tx_sched_send_queued (s, TX_CLASS_REPLY, now_ms);
+    }
+    else if (beacon_late
+	|| (beacon_due && !ringbuf_used (&s->q[TX_CLASS_FILE]))) {
+      ret = tx_sched_send_beacon (s, now_ms);
+    }
+    else if (ringbuf_used (&s->q[TX_CLASS_FILE])) {
+      ret = tx_sched_send_queued (s, TX_CLASS_FILE, now_ms);
+    }
+    else {
+      break;
+    }
+    if (ret) {
+      break;
+    }
+    progress = 1;
+  }
+  return progress;
+}
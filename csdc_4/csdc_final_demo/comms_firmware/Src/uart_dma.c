@@ -0,0 +1,260 @@
+/*
+ * uart_dma.c
+ *	Description: Non blocking UART driver on circular DMA reception and
+ *		     queued DMA transmission.
+ */
+
+#include "uart_dma.h"
+
+uart_dma_t uart_cdh;
+uart_dma_t uart_gnd;
+
+static uart_dma_t *ports[UART_DMA_MAX_PORTS];
+
+static uart_dma_t *
+uart_dma_find (UART_HandleTypeDef *huart)
+{
+  uint8_t i;
+  for (i = 0; i < UART_DMA_MAX_PORTS; i++) {
+    if (ports[i] && ports[i]->huart == huart) {
+      return ports[i];
+    }
+  }
+  return NULL;
+}
+
+/**
+ * Starts a DMA transfer of the queued data if none is running. Called both
+ * from the main loop and the TX complete interrupt, so interrupts must be
+ * masked around it.
+ */
+static void
+uart_dma_kick (uart_dma_t *u)
+{
+  const uint8_t *p;
+  size_t n;
+
+  if (u->tx_inflight) {
+    return;
+  }
+  p = ringbuf_linear (&u->tx, &n);
+  if (!n) {
+    return;
+  }
+  u->tx_inflight = n;
+  if (HAL_UART_Transmit_DMA (u->huart, (uint8_t *) p, n) != HAL_OK) {
+    u->tx_inflight = 0;
+  }
+}
+
+static void
+uart_dma_start_rx (uart_dma_t *u)
+{
+  u->rx_tail = 0;
+  HAL_UART_Receive_DMA (u->huart, u->rx_buf, UART_DMA_RX_LEN);
+  __HAL_UART_CLEAR_IDLEFLAG(u->huart);
+  __HAL_UART_ENABLE_IT(u->huart, UART_IT_IDLE);
+}
+
+/**
+ * Takes over a UART that has been set up with HAL_UART_Init() and starts
+ * the reception. Nothing happens if \p u already runs on \p huart, so
+ * the records queued by the debug channel (dbg.h) are not lost.
+ * @param u the driver handle
+ * @param huart the UART, with its RX DMA stream in circular mode
+ * @param link the statistics the TX queue depth is reported to
+ * @return 0 on success or -1 in case of error
+ */
+int32_t
+uart_dma_init (uart_dma_t *u, UART_HandleTypeDef *huart, comms_link_t link)
+{
+  uint8_t i;
+
+  if (!u || !huart || !huart->hdmarx || !huart->hdmatx) {
+    return -1;
+  }
+  for (i = 0; i < UART_DMA_MAX_PORTS && ports[i] && ports[i] != u; i++)
+    ;
+  if (i == UART_DMA_MAX_PORTS) {
+    return -1;
+  }
+  if (ports[i] == u && u->huart == huart) {
+    return 0;
+  }
+  ports[i] = u;
+
+  u->huart = huart;
+  u->link = link;
+  u->rx_event = 0;
+  u->rx_errors = 0;
+  u->tx_inflight = 0;
+  ringbuf_init (&u->tx, u->tx_mem, UART_DMA_TX_LEN);
+  uart_dma_start_rx (u);
+  return 0;
+}
+
+/**
+ * Copies out the bytes received since the last call
+ * @param u the driver handle
+ * @param buf the output buffer
+ * @param len the size of the output buffer
+ * @return the number of bytes copied
+ */
+size_t
+uart_dma_read (uart_dma_t *u, uint8_t *buf, size_t len)
+{
+  size_t head;
+  size_t n = 0;
+
+  u->rx_event = 0;
+  head = UART_DMA_RX_LEN - __HAL_DMA_GET_COUNTER(u->huart->hdmarx);
+  if (head == UART_DMA_RX_LEN) {
+    head = 0;
+  }
+  while (u->rx_tail != head && n < len) {
+    buf[n++] = u->rx_buf[u->rx_tail];
+    u->rx_tail = (u->rx_tail + 1) % UART_DMA_RX_LEN;
+  }
+  return n;
+}
+
+/**
+ * @return the free space of the TX queue
+ */
+size_t
+uart_dma_room (uart_dma_t *u)
+{
+  return ringbuf_room (&u->tx);
+}
+
+/**
+ * @return the number of queued bytes not sent yet
+ */
+size_t
+uart_dma_pending (uart_dma_t *u)
+{
+  return ringbuf_used (&u->tx);
+}
+
+/**
+ * Starts sending what has just been queued
+ */
+static void
+uart_dma_queued (uart_dma_t *u)
+{
+  uint32_t primask;
+
+  comms_stats_queue (u->link, ringbuf_used (&u->tx));
+
+  primask = __get_PRIMASK ();
+  __disable_irq ();
+  uart_dma_kick (u);
+  __set_PRIMASK (primask);
+}
+
+/**
+ * Queues data for transmission
+ * @param u the driver handle
+ * @param data the data to send
+ * @param len the size of the data
+ * @return 0 on success or -1 if the queue has no room for all of it, in
+ * which case nothing is queued
+ */
+int32_t
+uart_dma_write (uart_dma_t *u, const uint8_t *data, size_t len)
+{
+  if (ringbuf_room (&u->tx) < len) {
+    return -1;
+  }
+  ringbuf_write (&u->tx, data, len);
+  uart_dma_queued (u);
+  return 0;
+}
+
+/**
+ * Queues the \p len bytes that the caller has built in place in the TX
+ * ring with ringbuf_put_at(), after checking uart_dma_room()
+ */
+void
+uart_dma_commit (uart_dma_t *u, size_t len)
+{
+  ringbuf_commit (&u->tx, len);
+  uart_dma_queued (u);
+}
+
+/**
+ * @return 1 when everything queued has been sent
+ */
+uint8_t
+uart_dma_tx_idle (uart_dma_t *u)
+{
+  return !u->tx_inflight && !ringbuf_used (&u->tx);
+}
+
+/**
+ * Handles the idle line interrupt. Call it from the USART interrupt handler
+ * before HAL_UART_IRQHandler().
+ */
+void
+uart_dma_irq (uart_dma_t *u)
+{
+  if (__HAL_UART_GET_FLAG(u->huart, UART_FLAG_IDLE)
+      && __HAL_UART_GET_IT_SOURCE(u->huart, UART_IT_IDLE)) {
+    __HAL_UART_CLEAR_IDLEFLAG(u->huart);
+    u->rx_event = 1;
+  }
+}
+
+void
+HAL_UART_TxCpltCallback (UART_HandleTypeDef *huart)
+{
+  uart_dma_t *u = uart_dma_find (huart);
+  if (!u) {
+    return;
+  }
+  ringbuf_skip (&u->tx, u->tx_inflight);
+  u->tx_inflight = 0;
+  uart_dma_kick (u);
+}
+
+void
+HAL_UART_RxHalfCpltCallback (UART_HandleTypeDef *huart)
+{
+  uart_dma_t *u = uart_dma_find (huart);
+  if (u) {
+    u->rx_event = 1;
+  }
+}
+
+void
+HAL_UART_RxCpltCallback (UART_HandleTypeDef *huart)
+{
+  uart_dma_t *u = uart_dma_find (huart);
+  if (u) {
+    u->rx_event = 1;
+  }
+}
+
+/**
+ * The HAL stops the RX DMA on line errors (overrun, framing, noise).
+ * Reception restarts at the beginning of the buffer, dropping what was not
+ * read yet; the framing above has to resynchronize anyway.
+ */
+void
+HAL_UART_ErrorCallback (UART_HandleTypeDef *huart)
+{
+  uart_dma_t *u = uart_dma_find (huart);
+  if (!u) {
+    return;
+  }
+  u->rx_errors++;
+  if (huart->RxState == HAL_UART_STATE_READY) {
+    uart_dma_start_rx (u);
+  }
+  /* A failed transfer is dropped, the rest of the queue still goes out */
+  if (huart->gState == HAL_UART_STATE_READY && u->tx_inflight) {
+    ringbuf_skip (&u->tx, u->tx_inflight);
+    u->tx_inflight = 0;
+    uart_dma_kick (u);
+  }
+}
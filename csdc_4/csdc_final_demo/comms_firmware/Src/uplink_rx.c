@@ -0,0 +1,82 @@
+/*
+ * uplink_rx.c
+ *	Description: Assembles and queues the packets of the ground station.
+ *
+ *	Each packet is read straight into its queue slot, and only the bytes
+ *	it still needs are read, so the port keeps whatever follows once the
+ *	queue is full.
+ */
+
+#include "uplink_rx.h"
+#include "comms_stats.h"
+#include <string.h>
+
+void
+uplink_rx_init (uplink_rx_t *u)
+{
+  memset (u, 0, sizeof(uplink_rx_t));
+}
+
+/**
+ * Reads the received bytes into the queue, until the port is empty or the
+ * queue full
+ * @param u the receiver
+ * @param read reads the port
+ * @param priv passed to \p read
+ * @param now_ms the current time in milliseconds
+ * @return 1 if anything was read
+ */
+uint8_t
+uplink_rx_poll (uplink_rx_t *u, uplink_read_t read, void *priv,
+		uint32_t now_ms)
+{
+  uplink_pkt_t *p;
+  uint8_t progress = 0;
+  size_t need;
+  size_t n;
+
+  while (u->count < UPLINK_RX_SLOTS) {
+    p = &u->slot[(u->head + u->count) % UPLINK_RX_SLOTS];
+    need = u->got ? uplink_pkt_len (p) : 1;
+    n = read (priv, p->buf + u->got, need - u->got);
+    if (!n) {
+      break;
+    }
+    if (!u->got) {
+      p->first_ms = now_ms;
+    }
+    u->got += n;
+    u->last_ms = now_ms;
+    progress = 1;
+    /* An empty packet carries nothing, ignore it */
+    if (u->got == 1 && p->buf[0] == 0) {
+      u->got = 0;
+    }
+    else if (u->got > 1 && u->got == uplink_pkt_len (p)) {
+      p->done_ms = now_ms;
+      u->count++;
+      u->packets++;
+      u->got = 0;
+    }
+  }
+
+  if (u->got && now_ms - u->last_ms >= UPLINK_RX_TIMEOUT_MS) {
+    u->got = 0;
+    u->timeouts++;
+    comms_stats.now.link[COMMS_LINK_GND].sync_losses++;
+  }
+  return progress;
+}
+
+/**
+ * Frees the oldest complete packet
+ */
+void
+uplink_rx_pop (uplink_rx_t *u)
+{
+  if (!u->count) {
+    return;
+  }
+  u->head = (u->head + 1) % UPLINK_RX_SLOTS;
+  u->count--;
+}
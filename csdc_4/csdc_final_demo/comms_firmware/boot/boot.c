@@ -0,0 +1,60 @@
+/*
+ * boot.c
+ *	Description: Boot selector. This is the factory image, built on
+ *		     its own by boot/Makefile; it jumps to the firmware slot
+ *		     chosen by fwboot_select(). The application is always a
+ *		     slot image.
+ */
+
+#include "boot.h"
+#include "fwupdate.h"
+#include "stm32f4xx_hal.h"
+
+#define BOOT_SRAM_BASE 0x20000000
+#define BOOT_SRAM_LEN (96 * 1024)
+
+/**
+ * Hands the MCU over to the image at \p addr as if it came out of reset.
+ * Returns only if the image does not look valid.
+ */
+static void
+boot_jump (uint32_t addr)
+{
+  uint32_t sp = *(volatile const uint32_t *) addr;
+  uint32_t pc = *(volatile const uint32_t *) (addr + 4);
+  void
+  (*entry) (void) = (void (*) (void)) pc;
+
+  if (sp < BOOT_SRAM_BASE || sp > BOOT_SRAM_BASE + BOOT_SRAM_LEN
+      || pc < addr || pc >= addr + FW_SLOT_LEN) {
+    return;
+  }
+
+  HAL_DeInit ();
+  __disable_irq ();
+  SysTick->CTRL = 0;
+  SysTick->LOAD = 0;
+  SysTick->VAL = 0;
+  SCB->VTOR = addr;
+  __set_MSP (sp);
+  __enable_irq ();
+  entry ();
+}
+
+/**
+ * Boots the selected firmware slot. Without a usable boot record, as on a
+ * board that was just programmed, it tries slot A and then slot B.
+ * Returns only if no slot holds an image. Call right after HAL_Init().
+ */
+void
+boot_check (void)
+{
+  uint32_t addr;
+
+  addr = fwboot_select (&flash_internal);
+  if (addr != FW_FACTORY_ADDR) {
+    boot_jump (addr);
+  }
+  boot_jump (FW_SLOT_A_ADDR);
+  boot_jump (FW_SLOT_B_ADDR);
+}
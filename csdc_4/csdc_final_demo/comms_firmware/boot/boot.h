@@ -0,0 +1,14 @@
+/*
+ * boot.h
+ *	Description: Boot selector. This is the factory image, see
+ *		     boot/Makefile; it jumps to the firmware slot chosen by
+ *		     fwboot_select().
+ */
+
+#ifndef INC_BOOT_H_
+#define INC_BOOT_H_
+
+void
+boot_check (void);
+
+#endif /* INC_BOOT_H_ */
@@ -0,0 +1,26 @@
+/*
+ * main.c
+ *	Description: Entry point of the factory image. It only selects and
+ *		     starts a firmware slot; the application itself is always
+ *		     a slot image (STM32F401RETx_SLOT_A.ld or _SLOT_B.ld).
+ */
+
+#include "boot.h"
+#include "stm32f4xx_hal.h"
+
+void
+SysTick_Handler (void)
+{
+  HAL_IncTick ();
+}
+
+int
+main (void)
+{
+  HAL_Init ();
+  boot_check ();
+
+  /* No slot holds an image; wait for the debugger */
+  while (1) {
+  }
+}
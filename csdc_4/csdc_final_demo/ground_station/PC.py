@@ -1,62 +1,64 @@
+import sys
 import serial
+import dbg_link
+import memstore
 
-memfile="rwmem.txt" #change the file being used here
+# usage: python PC.py [journal.bin]   also keeps every write for replay
+memfile="rwmem.bin" #change the file being used here
+MEM_LEN=memstore.MEM_LEN #16 bit addresses
+dlfile="memdl.bin" #memory downlinks of send_mem() are written here
 st = serial.Serial('COM3',115200, timeout=None,parity=serial.PARITY_NONE, rtscts=0)
 print("preparing to read file")
-open(memfile, 'r').close()
-rom=open(memfile,"r")
-memory=list(rom.read())
-rom.close()
+#writes go to memory at once, the file follows in the background
+memory=memstore.MemStore(memfile,MEM_LEN,sys.argv[1] if len(sys.argv)>1 else None)
 print("file read")
 
+# records arrive COBS framed (dbg_link.py), a damaged one is skipped and
+# the next one is read normally
+dec=dbg_link.Decoder()
+seq=0
+dl=dbg_link.Downlink()
+
 while 1:
-    print("waiting for command")
-    cmd=None
-    st.reset_input_buffer()
-    cmd=st.read(1)#wait for command
-
-    if (cmd[0]=='r'):
-        print("read received")
-        cmd=st.read(3)
-        address=ord(cmd[0])*256+ord(cmd[1])
-        size=ord(cmd[2])
-        if (size==0): size = 256
-
-        #setup pkt to be sent    
-        pkt=memory[address]
-        for n in range(1,size):
-            pkt=pkt+memory[address+n]
-        
-        #send pkt
-        st.write(pkt)
-
-
-    elif(cmd[0]=='w'):
-        print("write received")
-        cmd=st.read(3)
-        address=ord(cmd[0])*256+ord(cmd[1])
-        size=ord(cmd[2])
-        if (size==0): size = 256
-        cmd=st.read(size)
-        
-        for n in range(0,len(cmd)-1):
-            memory[address+n]=cmd[n]#modify instantiated memory
-        
-
-        upstr=''.join(memory)
-        open(memfile, 'r+').close()#update physical memory
-        txtmem=open(memfile,"r+")
-        txtmem.write(upstr)
-        txtmem.close()
-
-    elif(cmd[0]=='p'):#use this command to print to console directly, for debud purposes
-        print("print received")
-        cmd=st.read(1)
-        size=ord(cmd[0])
-        if (size==0): size = 256
-        cmd=st.read(size)
-        print(cmd)
-        
-    else:
-        print("invalid command\n")
+    data=st.read(st.in_waiting or 1)#wait for commands
+
+    for rtype, rseq, payload in dec.feed(data):
+
+        if (rtype==dbg_link.MEM_READ):
+            #[tag][address][size], several can be waiting: answer them all
+            tag=payload[0]
+            address=payload[1]*256+payload[2]
+            size=min(payload[3]*256+payload[4],MEM_LEN-address)
+            print("read %d at %d"%(size,address))
+
+            seq=(seq+1)&0xFFFF
+            st.write(dbg_link.encode(dbg_link.MEM_DATA,seq,
+                                     bytes([tag])+memory.read(address,size)))
+
+
+        elif(rtype==dbg_link.MEM_WRITE):
+            address=payload[0]*256+payload[1]
+            data=payload[2:2+MEM_LEN-address]
+            print("write %d at %d"%(len(data),address))
+            memory.write(address,data)#in place, no wait for the disk
+
+        elif(rtype==dbg_link.MEMDL):#[txcnt][rxcnt][data], kept until the download ends
+            if not dl.feed(payload):
+                print("downlink: packets lost before packet %d"%payload[0])
+
+        elif(rtype==dbg_link.PRINT):#use this command to print to console directly, for debud purposes
+            text=payload.decode('ascii','replace')
+            print(text)
+            if text.startswith("memdl ") and dl.packets:#send_mem() prints its rate at the end
+                f=open(dlfile,'wb')
+                f.write(dl.memory())
+                f.close()
+                print("downlink: %d packets, %d lost, written to %s"%(dl.packets,dl.gaps,dlfile))
+                dl=dbg_link.Downlink()
+
+        else:
+            print("invalid command\n")
 
+    if dec.bad or dec.lost:
+        print("%d bad frames, %d records lost"%(dec.bad,dec.lost))
+        dec.bad=dec.lost=0
@@ -2,72 +2,47 @@
 # b=binary/hex (writes both)
 # d=done
 
+import time
 import serial
+import dbg_link
+import caplog
 
-memfile="serout.txt" #change the file being used here
+capfile="capture" #capture.log and capture.idx, change the file being used here
 #st = serial.Serial('COM3',115200, timeout=None,parity=serial.PARITY_NONE, rtscts=0)
 st = serial.Serial('COM3',115200, timeout=None,parity=serial.PARITY_NONE, rtscts=0)
-open(memfile, 'w').close()
-txtmem=open(memfile,"w")
-# print("preparing to read file")
-# open(memfile, 'r').close()
-# rom=open(memfile,"r")
-# memory=list(rom.read())
-# rom.close()
-# print("file read")
+#every record is kept with its time, query them or get the old serout.txt with
+#  python caplog.py query capture [from [to]] [types]
+#  python caplog.py text capture serout.txt
+log=caplog.CapLog(capfile)
 
-hexout=[]
-binout=[]
+# records arrive COBS framed (dbg_link.py), a damaged one is skipped and
+# the next one is read normally
+dec=dbg_link.Decoder()
 
 
 while 1:
-    print("waiting for command")
-    st.reset_input_buffer()
-    cmd=st.read(1)
-
-    if(cmd=='w'):
-        print("write received")
-        size=st.read(2)
-        size=ord(size[0])*256+ord(size[1])
-        print(size)
-        cmd=st.read(size)
-        print(cmd)
-        
-        txtmem.write(cmd)
-        txtmem.write('\n')
-
-    elif(cmd=='b'):
-        print("binary received")
-        size=st.read(2)#wait for command
-        size=ord(size[0])*256+ord(size[1])
-        print(size)
-        ser=st.read(size)
-        ser=list(ser)
-        for n in range(0,size):
-            hexout.append('')
-            binout.append('')
-
-        for n in range(0,size):
-            ser[n]=ord(ser[n])
-            hexout[n]=hex(ser[n])
-            binout[n]='{0:08b}'.format(ser[n])
-        
-        hexoutf=' '.join(hexout)
-        binoutf=' '.join(binout)
-        txtmem.write(hexoutf)
-        txtmem.write('\n')
-        txtmem.write(binoutf)
-        txtmem.write('\n')
-        hexoutf=None
-        binoutf=None
-        hexout=[]
-        binout=[]
-
-
-    elif(cmd=='d'):
-        print("exiting")
-        txtmem.close()
-        exit()
+    data=st.read(max(st.in_waiting,1))#all that is waiting, one block at a time
+    now=time.time()
+
+    for rtype, seq, payload in dec.feed(data):
+        log.append(now,rtype,seq,payload)
+
+        if(rtype==dbg_link.LABEL):
+            print("write received: "+payload.decode('ascii','replace'))
+
+        elif(rtype==dbg_link.BINARY):
+            print("binary received: %d bytes"%len(payload))
+
+        elif(rtype==dbg_link.PRINT):#serial monitor
+            print(payload.decode('ascii','replace'))
+
+        elif(rtype==dbg_link.DONE):
+            print("exiting")
+            print("%d records, %d bad frames, %d lost"%(dec.records,dec.bad,dec.lost))
+            log.close()
+            exit()
+
+    log.flush()
 
     # if (cmd[0]=='r'):
     #     print("read received")
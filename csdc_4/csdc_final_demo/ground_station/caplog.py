@@ -0,0 +1,255 @@
+# Binary log of debug channel records (dbg_link.py) with a sidecar index,
+# written by SerialToFile.py during a pass.
+#
+# capture.log holds the records one after the other:
+#   time (8, float, seconds) | type (1) | seq (2) | size (2) | payload
+# capture.idx holds one entry per record, in the same order:
+#   time (8, float, seconds) | offset in capture.log (8) | type (1)
+# numbers little endian. The index entries have a fixed size and their
+# times never go down, so a time range is found by a binary search of the
+# index, and the records of some types only by reading index entries; the
+# log itself is read only for the records asked for.
+#
+# usage: python caplog.py query capture [from [to]] [types]
+#            times in seconds from the start of the capture, types as the
+#            record characters, e.g. "pw"
+#        python caplog.py text capture serout.txt   the old text dump
+#        python caplog.py selftest
+
+import mmap
+import os
+import struct
+import sys
+import time
+
+import dbg_link
+
+REC_HEAD = struct.Struct('<dBHH')
+IDX_ENTRY = struct.Struct('<dQB')
+
+
+class CapLog:
+    """Appends records to capture.log and capture.idx. A capture cut by a
+    crash is repaired when it is opened again: the half written record or
+    index entry at the end is dropped and missing index entries are
+    rebuilt from the log."""
+
+    def __init__(self, name):
+        self.log_path = name + '.log'
+        self.idx_path = name + '.idx'
+        self._log = open(self.log_path, 'ab+')
+        self._idx = open(self.idx_path, 'ab+')
+        self.last_time = 0.0
+        self.records = self._repair()
+
+    def _repair(self):
+        log_len = os.path.getsize(self.log_path)
+        n = os.path.getsize(self.idx_path) // IDX_ENTRY.size
+        pos = 0
+        # drop the entries of records that did not reach the log
+        while n:
+            self._idx.seek((n - 1) * IDX_ENTRY.size)
+            _, pos, _ = IDX_ENTRY.unpack(self._idx.read(IDX_ENTRY.size))
+            if pos + REC_HEAD.size <= log_len:
+                self._log.seek(pos)
+                size = REC_HEAD.unpack(self._log.read(REC_HEAD.size))[3]
+                if pos + REC_HEAD.size + size <= log_len:
+                    break
+            n -= 1
+            pos = 0
+        self._idx.truncate(n * IDX_ENTRY.size)
+        # index the records after the last indexed one
+        self._log.seek(pos)
+        tail = self._log.read()
+        skip = n > 0
+        off = 0
+        while off + REC_HEAD.size <= len(tail):
+            t, rtype, _, size = REC_HEAD.unpack_from(tail, off)
+            if off + REC_HEAD.size + size > len(tail):
+                break
+            if not skip:
+                self._idx.write(IDX_ENTRY.pack(t, pos + off, rtype))
+                n += 1
+            skip = False
+            self.last_time = t
+            off += REC_HEAD.size + size
+        if pos + off < log_len:
+            self._log.truncate(pos + off)
+        self._log.seek(0, 2)
+        self._idx.flush()
+        return n
+
+    def append(self, t, rtype, seq, payload):
+        t = max(t, self.last_time)     # the index needs times in order
+        self.last_time = t
+        self._idx.write(IDX_ENTRY.pack(t, self._log.tell(), rtype))
+        self._log.write(REC_HEAD.pack(t, rtype, seq, len(payload)))
+        self._log.write(payload)
+        self.records += 1
+
+    def flush(self):
+        # the log first, so an index entry never points past it
+        self._log.flush()
+        self._idx.flush()
+
+    def close(self):
+        self.flush()
+        self._log.close()
+        self._idx.close()
+
+
+class CapReader:
+
+    def __init__(self, name):
+        self._log = open(name + '.log', 'rb')
+        self._idx_file = open(name + '.idx', 'rb')
+        size = os.path.getsize(name + '.idx')
+        self.entries = size // IDX_ENTRY.size
+        self._idx = mmap.mmap(self._idx_file.fileno(), 0,
+                              access=mmap.ACCESS_READ) if size else b''
+
+    def _entry(self, i):
+        return IDX_ENTRY.unpack_from(self._idx, i * IDX_ENTRY.size)
+
+    def _first_at(self, t):
+        """The first entry at or after time t"""
+        lo, hi = 0, self.entries
+        while lo < hi:
+            mid = (lo + hi) // 2
+            if self._entry(mid)[0] < t:
+                lo = mid + 1
+            else:
+                hi = mid
+        return lo
+
+    def start(self):
+        return self._entry(0)[0] if self.entries else 0.0
+
+    def query(self, t0=None, t1=None, types=None):
+        """The records from t0 up to t1 (absolute times, None for no limit)
+        of the given types as (time, type, seq, payload)."""
+        i = self._first_at(t0) if t0 is not None else 0
+        while i < self.entries:
+            t, off, rtype = self._entry(i)
+            i += 1
+            if t1 is not None and t > t1:
+                break
+            if types is not None and rtype not in types:
+                continue
+            self._log.seek(off)
+            t, rtype, seq, size = REC_HEAD.unpack(self._log.read(REC_HEAD.size))
+            yield t, rtype, seq, self._log.read(size)
+
+    def close(self):
+        if self.entries:
+            self._idx.close()
+        self._idx_file.close()
+        self._log.close()
+
+
+def write_text(rtype, payload, out):
+    """A record as SerialToFile.py used to write it to serout.txt"""
+    if rtype == dbg_link.LABEL:
+        out.write(payload.decode('ascii', 'replace') + '\n')
+    elif rtype == dbg_link.BINARY:
+        out.write(' '.join(hex(b) for b in payload) + '\n')
+        out.write(' '.join('{0:08b}'.format(b) for b in payload) + '\n')
+    elif rtype == dbg_link.PRINT:
+        out.write(payload.decode('ascii', 'replace'))
+
+
+def _selftest():
+    import random
+    import tempfile
+    rnd = random.Random(1)
+    tmp = tempfile.mkdtemp()
+    name = os.path.join(tmp, 'capture')
+    types = [dbg_link.PRINT, dbg_link.LABEL, dbg_link.BINARY]
+    # a 3 hour pass, 20 records a second
+    t = 1e9
+    model = []
+    log = CapLog(name)
+    t_write = time.perf_counter()
+    for seq in range(216000):
+        t += rnd.expovariate(20)
+        rtype = rnd.choice(types) if rnd.random() < 0.99 else dbg_link.DONE
+        payload = bytes(rnd.randrange(256) for _ in range(rnd.randrange(40)))
+        log.append(t, rtype, seq & 0xFFFF, payload)
+        model.append((t, rtype, seq & 0xFFFF, payload))
+        if seq % 100 == 0:
+            log.flush()
+    log.close()
+    t_write = time.perf_counter() - t_write
+    size = os.path.getsize(name + '.log') + os.path.getsize(name + '.idx')
+    print("%d records, %.1f MB, %.0f records/s written" % (
+          len(model), size / 1e6, len(model) / t_write))
+
+    ok = True
+    cap = CapReader(name)
+    start = cap.start()
+    for t0, t1, want in ((3600, 3660, None), (0, 10, None), (10000, 20000, None),
+                         (0, 11000, {dbg_link.DONE})):
+        t_query = time.perf_counter()
+        got = list(cap.query(start + t0, start + t1, want))
+        t_query = time.perf_counter() - t_query
+        exp = [r for r in model if start + t0 <= r[0] <= start + t1
+               and (want is None or r[1] in want)]
+        ok = ok and got == exp
+        print("%5d..%5d s %s: %6d records in %.1f ms, %s" % (
+              t0, t1, ''.join(chr(c) for c in want) if want else 'all',
+              len(got), t_query * 1e3, "OK" if got == exp else "MISMATCH"))
+    cap.close()
+
+    # cut in the middle of a record and of an index entry, as a crash would
+    for cut_log, cut_idx in ((5, 0), (0, 7), (5, 3 * IDX_ENTRY.size + 7)):
+        log_len = os.path.getsize(name + '.log')
+        idx_len = os.path.getsize(name + '.idx')
+        os.truncate(name + '.log', log_len - cut_log)
+        os.truncate(name + '.idx', idx_len - cut_idx)
+        log = CapLog(name)
+        kept = log.records
+        log.append(model[-1][0] + 1, dbg_link.PRINT, 0, b'again')
+        log.close()
+        cap = CapReader(name)
+        got = list(cap.query())
+        cap.close()
+        model = model[:kept] + [(model[-1][0] + 1, dbg_link.PRINT, 0,
+                                 b'again')]
+        good = got == model
+        ok = ok and good
+        print("repaired after a cut of %d/%d bytes: %d records, %s" % (
+              cut_log, cut_idx, len(got), "OK" if good else "MISMATCH"))
+    os.remove(name + '.log')
+    os.remove(name + '.idx')
+    os.rmdir(tmp)
+    return ok
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    if args and args[0] == 'query' and 2 <= len(args) <= 5:
+        cap = CapReader(args[1])
+        rest = args[2:]
+        want = None
+        if rest and not rest[-1].replace('.', '').isdigit():
+            want = set(rest.pop().encode())
+        start = cap.start()
+        t0 = start + float(rest[0]) if len(rest) > 0 else None
+        t1 = start + float(rest[1]) if len(rest) > 1 else None
+        for t, rtype, seq, payload in cap.query(t0, t1, want):
+            print("%10.3f %s" % (t - start,
+                                 dbg_link.describe(rtype, seq, payload)))
+        cap.close()
+    elif args and args[0] == 'text' and len(args) == 3:
+        cap = CapReader(args[1])
+        out = open(args[2], 'w')
+        for _, rtype, _, payload in cap.query():
+            write_text(rtype, payload, out)
+        out.close()
+        cap.close()
+    elif args == ['selftest']:
+        sys.exit(0 if _selftest() else 1)
+    else:
+        print("usage: python caplog.py query capture [from [to]] [types] | "
+              "text capture out.txt | selftest")
+        sys.exit(1)
@@ -0,0 +1,144 @@
+# Python binding of the comms firmware AX.25 / G3RUH codec.
+# Uses host/libcomms_codec.so, which is the firmware source built for Linux
+# (run make in ../host first), so frames are bit for bit the ones the
+# satellite sends and receives.
+#
+# usage: python comms_codec.py decode capture.bin     print the frames in a
+#                                                      captured stream
+#        python comms_codec.py encode payload.bin out.bin
+#        python comms_codec.py selftest
+#
+# Set COMMS_CODEC_LIB to use a library somewhere else.
+
+import ctypes
+import os
+import sys
+
+AX25_MAX_FRAME_LEN = 256
+AX25_MAX_ENCODED_LEN = 381  # as in ax25.h
+
+_here = os.path.dirname(os.path.abspath(__file__))
+_lib = ctypes.CDLL(os.environ.get(
+    'COMMS_CODEC_LIB', os.path.join(_here, '..', 'host', 'libcomms_codec.so')))
+
+_u8p = ctypes.c_char_p
+_lib.codec_rx_size.restype = ctypes.c_size_t
+_lib.codec_rx_init.argtypes = [ctypes.c_void_p]
+_lib.codec_rx_feed.argtypes = [ctypes.c_void_p, _u8p, ctypes.c_size_t,
+                               ctypes.POINTER(ctypes.c_size_t),
+                               ctypes.c_void_p]
+_lib.codec_rx_feed.restype = ctypes.c_int32
+_lib.codec_encode.argtypes = [ctypes.c_void_p, ctypes.c_size_t, _u8p,
+                              ctypes.c_size_t, ctypes.c_uint8]
+_lib.codec_encode.restype = ctypes.c_int32
+_lib.codec_payload.argtypes = [ctypes.c_void_p, _u8p, ctypes.c_size_t]
+_lib.codec_payload.restype = ctypes.c_int32
+for _f in (_lib.codec_scramble, _lib.codec_descramble):
+    _f.argtypes = [ctypes.c_void_p, _u8p, ctypes.c_size_t]
+    _f.restype = ctypes.c_int32
+
+
+def encode(payload, wod=False):
+    """AX.25 UI frame, bit stuffed, G3RUH scrambled and NRZI coded."""
+    out = ctypes.create_string_buffer(AX25_MAX_ENCODED_LEN)
+    n = _lib.codec_encode(out, len(out), bytes(payload), len(payload),
+                          1 if wod else 0)
+    if n < 0:
+        raise ValueError("payload too long")
+    return out.raw[:n]
+
+
+def payload(frame):
+    """The information field of a decoded frame."""
+    out = ctypes.create_string_buffer(max(len(frame), 1))
+    n = _lib.codec_payload(out, bytes(frame), len(frame))
+    if n < 0:
+        raise ValueError("not a UI frame")
+    return out.raw[:n]
+
+
+def scramble(data):
+    out = ctypes.create_string_buffer(max(len(data), 1))
+    _lib.codec_scramble(out, bytes(data), len(data))
+    return out.raw[:len(data)]
+
+
+def descramble(data):
+    out = ctypes.create_string_buffer(max(len(data), 1))
+    _lib.codec_descramble(out, bytes(data), len(data))
+    return out.raw[:len(data)]
+
+
+class Decoder:
+    """Finds frames in a received stream fed in pieces of any size."""
+
+    def __init__(self):
+        self._rx = ctypes.create_string_buffer(_lib.codec_rx_size())
+        self._frame = ctypes.create_string_buffer(AX25_MAX_FRAME_LEN)
+        self._used = ctypes.c_size_t()
+        _lib.codec_rx_init(self._rx)
+
+    def feed(self, data):
+        """Returns the frames completed by data (address field included,
+        FCS removed)."""
+        frames = []
+        data = bytes(data)
+        while data:
+            n = _lib.codec_rx_feed(self._rx, data, len(data),
+                                   ctypes.byref(self._used), self._frame)
+            if n < 0:
+                raise ValueError("decoder error")
+            if n > 0:
+                frames.append(self._frame.raw[:n])
+            data = data[self._used.value:]
+        return frames
+
+    @property
+    def crc_errors(self):
+        # uint32 counters at the end of codec_rx_t
+        return int.from_bytes(self._rx.raw[-4:], sys.byteorder)
+
+
+def _selftest():
+    import random
+    rnd = random.Random(1)
+    dec = Decoder()
+    stream = b''
+    sent = []
+    for i in range(200):
+        p = bytes(rnd.randrange(256) for _ in range(rnd.randrange(1, 230)))
+        sent.append(p)
+        stream += encode(p, wod=(i % 2 == 1))
+    got = []
+    pos = 0
+    while pos < len(stream):
+        step = rnd.randrange(1, 700)
+        got += dec.feed(stream[pos:pos + step])
+        pos += step
+    got = [payload(f) for f in got]
+    print("%d frames sent, %d decoded, %s" % (len(sent), len(got),
+          "OK" if got == sent else "MISMATCH"))
+    return got == sent
+
+
+if __name__ == '__main__':
+    if len(sys.argv) == 3 and sys.argv[1] == 'decode':
+        dec = Decoder()
+        f = open(sys.argv[2], 'rb')
+        for frame in dec.feed(f.read()):
+            print(payload(frame).hex())
+        f.close()
+        print("%d CRC errors" % dec.crc_errors)
+    elif len(sys.argv) == 4 and sys.argv[1] == 'encode':
+        f = open(sys.argv[2], 'rb')
+        data = f.read()
+        f.close()
+        f = open(sys.argv[3], 'wb')
+        f.write(encode(data))
+        f.close()
+    elif len(sys.argv) == 2 and sys.argv[1] == 'selftest':
+        sys.exit(0 if _selftest() else 1)
+    else:
+        print("usage: python comms_codec.py decode capture.bin | "
+              "encode payload.bin out.bin | selftest")
+        sys.exit(1)
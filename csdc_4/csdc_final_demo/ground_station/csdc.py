@@ -1,90 +1,88 @@
-#from serial import serial
+# usage: python csdc.py [fake] [commands.txt]
+#   fake          talk to uplink.FakeSat instead of the radio
+#   commands.txt  more packets for the pass, one per line in hex, sent
+#                 through the window (uplink.py) after the payload commands;
+#                 python planner.py plan writes one for the pass
+import sys
 import time
 import serial
-memfile="payload.jpeg"
-open(memfile, 'w').close()#update physical memory
-st = serial.serial('COM15',115200)
-#st = serial.Serial('/dev/ttyACM0',115200, timeout=None,parity=serial.PARITY_NONE, rtscts=0)
+import uplink
+import telemdb
+import imgdl
+args=sys.argv[1:]
+if args and args[0]=='fake':
+    st=uplink.FakeSat(cdh=imgdl.FakeCDH(bytes(range(256))*20,loss=0.1))
+    args=args[1:]
+else:
+    st = serial.Serial('COM15',115200,timeout=0.01)#short timeout, the client polls
+#st = serial.Serial('/dev/ttyACM0',115200, timeout=0.01,parity=serial.PARITY_NONE, rtscts=0)
+
+db=telemdb.TelemDB("telemetry")#every frame decoded into its channels
+images=imgdl.Images()#the chunks kept from earlier passes
+dl=images.get(0)#payload.jpeg, written once every chunk is in
+last_chunk=time.monotonic()
+def downlink(cmd):
+    #[head][n][n bytes] from the CDH, nothing is thrown away while commands
+    #are waiting for their echoes
+    global last_chunk
+    db.add_frame(cmd)
+    if images.frame(cmd):
+        last_chunk=time.monotonic()
+        if images.current.done:
+            print(images.current.status())
+        return
+    print(cmd)
+
+up=uplink.Uplink(st,on_data=downlink,record="uplink.cap")#for host/replay
 
 # payload=chr(0b01100001)+chr(len(message))+message
 ################################################################
+# the payload commands depend on each other, so each one is echoed before
+# the next goes out
 timep=10
-payload=chr(0b01100010)+chr(0)*8+chr(timep)+"000fire0"
-size=len(payload)
-print(size)
-
-out=chr(size)+payload
-print(out)
-st.write(out.encode())
-# time.sleep(3)
-
-size=st.read(1)
-size=ord(size)
-if (size==0): size = 256
-print(size)
-cmd=st.read(size)
-print(cmd)
-time.sleep(3)
-
-################################################################
-payload=chr(0b01100010)+chr(1)+"000fire0"
-size=len(payload)
-print(size)
-
-out=chr(size)+payload
-print(out)
-st.write(out.encode())
-# time.sleep(3)
-
-st.reset_input_buffer()
-size=st.read(1)
-size=ord(size)
-print(size)
-if (size==0): size = 256
-cmd=st.read(size)
-print(cmd)
-time.sleep(3)
+for payload in (bytes([0b01100010])+bytes(8)+bytes([timep])+b"000fire0",
+                bytes([0b01100010,1])+b"000fire0",
+                dl.start_packet()):
+    print(payload)
+    seq=up.queue(payload)
+    up.run()
+    print("command %d %s"%(seq,"echoed" if up.result[seq] else "FAILED"))
 ################################################################
-payload=chr(0b01100010)+chr(2)+"000fire0"+chr(1)
-size=len(payload)
-print(size)
-
-out=chr(size)+payload
-print(out)
-st.write(out.encode())
-# time.sleep(3)
-
-st.reset_input_buffer()
-size=st.read(1)
-size=ord(size)
-print(size)
-if (size==0): size = 256
-cmd=st.read(size)
-print(cmd)
+# the image: the digest comes back first, then only the chunks still missing
+# are asked for, the rest of them in the next pass. A commands file from
+# planner.py asks for the chunks that fit in the pass itself.
+end=time.monotonic()+5
+while not dl.info and time.monotonic()<end:
+    up.poll()
+if not args:
+    for pkt in dl.range_packets():
+        up.queue(pkt)
+print(dl.status())
 ################################################################
-# st.write(chr(1).encode('utf-8'))
-# back=st.read(1)
-# print(back)
+# the rest of the pass: independent packets, up to uplink.WINDOW in flight
+if args:
+    for line in open(args[0]):
+        if line.strip() and not line.startswith('#'):
+            pkt=bytes.fromhex(line.strip())
+            up.queue(pkt)
+            if pkt[:2]==bytes([0x60|imgdl.ADDR<<1,imgdl.CMD_START]):
+                up.run()#START drops the ranges queued on the CDH, so it goes before them
+    up.run()
+    print("%d of %d echoed, %d sends"%(sum(up.result.values()),len(up.result),up.sent))
 print("commands done\n")
-while(1):
-
-    st.reset_input_buffer()
-    size=st.read(1)
-    size=ord(size)
-    print(size)
-    if (size==0): size = 256
-    cmd=st.read(size)
-    print(cmd)
-
-    # for n in range(0,len(cmd)-1):
-    #     memory[address+n]=cmd[n]#modify instantiated memory
-
-    # upstr=''.join(memory)
-    open(memfile, 'ab').close()#update physical memory
-    txtmem=open(memfile,"ab")
-    txtmem.write(cmd[2:])
-    txtmem.close()
-
+try:
+    flushed=time.monotonic()
+    while(1):
+        up.poll()
+        if not args and not dl.done and not up.busy() and time.monotonic()-last_chunk>20:
+            for pkt in dl.range_packets():#the CDH stopped short, ask again
+                up.queue(pkt)
+            last_chunk=time.monotonic()
+        if time.monotonic()-flushed>60:#whole blocks of the telemetry db
+            db.flush()
+            flushed=time.monotonic()
+finally:
+    db.close()
 
 # while 1:
 #     print("waiting for command")
@@ -0,0 +1,263 @@
+# Records of the comms firmware debug channel (comms_firmware/Inc/dbg.h).
+#
+# Every record is one COBS frame ended by a 0x00 byte:
+#
+#   COBS( type | seq (2) | len (2) | payload (len) | CRC (2) ) 0x00
+#
+# numbers MS byte first, CRC-16/CCITT (XMODEM) of everything before it.
+# seq counts every record the firmware tried to send, so a gap is the
+# number of records lost, dropped on board or corrupted on the line. After
+# a bad frame the decoder starts again at the next 0x00.
+#
+# A memory downlink (comms_firmware/Inc/memdl.h) comes as MEMDL records,
+# [txcnt][rxcnt][data] with txcnt counting packets modulo 8; Downlink puts
+# the data back together and unpacks it with lzss.py when it is compressed.
+#
+# usage: python dbg_link.py decode capture.bin    print the records of a
+#                                                  captured stream
+#        python dbg_link.py selftest
+
+import sys
+
+MEM_READ = ord('r')
+MEM_DATA = ord('R')
+MEM_WRITE = ord('W')
+PRINT = ord('p')
+LABEL = ord('w')
+BINARY = ord('b')
+DONE = ord('d')
+MEMDL = ord('m')
+
+OVERHEAD = 7
+
+
+def crc16(data, crc=0):
+    """CRC-16/CCITT as crc16_ccitt() in utils.h: polynomial 0x1021, no
+    reflection, initial value 0."""
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_pos = 0
+    code = 1
+    for b in data:
+        if b:
+            out.append(b)
+            code += 1
+        if not b or code == 0xFF:
+            out[code_pos] = code
+            code_pos = len(out)
+            out.append(0)
+            code = 1
+    out[code_pos] = code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    """The bytes of a frame without its delimiter, None if it is not
+    valid COBS."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode(rtype, seq, payload):
+    """A complete frame, delimiter included, as dbg_write() sends it."""
+    n = len(payload)
+    raw = bytes([rtype, seq >> 8 & 0xFF, seq & 0xFF, n >> 8 & 0xFF,
+                 n & 0xFF]) + bytes(payload)
+    c = crc16(raw)
+    return cobs_encode(raw + bytes([c >> 8, c & 0xFF])) + b'\x00'
+
+
+class Decoder:
+    """Finds the records in a stream fed in pieces of any size."""
+
+    def __init__(self):
+        self._buf = bytearray()
+        self._seq = None
+        self.records = 0
+        self.bad = 0        # frames that failed COBS, length or CRC
+        self.lost = 0       # records missing from the sequence
+
+    def feed(self, data):
+        """Returns the records completed by data as (type, seq, payload)."""
+        records = []
+        self._buf += data
+        while True:
+            end = self._buf.find(b'\x00')
+            if end < 0:
+                break
+            frame = bytes(self._buf[:end])
+            del self._buf[:end + 1]
+            if not frame:
+                continue
+            rec = self._parse(frame)
+            if rec is None:
+                self.bad += 1
+                continue
+            if self._seq is not None:
+                self.lost += (rec[1] - self._seq - 1) & 0xFFFF
+            self._seq = rec[1]
+            self.records += 1
+            records.append(rec)
+        return records
+
+    @staticmethod
+    def _parse(frame):
+        raw = cobs_decode(frame)
+        if raw is None or len(raw) < OVERHEAD:
+            return None
+        n = raw[3] << 8 | raw[4]
+        if n != len(raw) - OVERHEAD:
+            return None
+        if crc16(raw[:-2]) != (raw[-2] << 8 | raw[-1]):
+            return None
+        return raw[0], raw[1] << 8 | raw[2], raw[5:-2]
+
+
+class Downlink:
+    """The memory downlink of send_mem(), from its MEMDL records."""
+
+    def __init__(self):
+        self.data = bytearray()
+        self.packets = 0
+        self.gaps = 0       # packets missing, from the counters
+
+    def feed(self, payload):
+        """Adds a MEMDL record, returns False if packets were lost before
+        it or its counters are damaged."""
+        if len(payload) < 2 or payload[1] != (payload[0] + 1) & 0x07:
+            self.gaps += 1
+            return False
+        gap = (payload[0] - self.packets) & 0x07
+        self.gaps += gap
+        self.packets += 1 + gap
+        self.data += payload[2:]
+        return not gap
+
+    def memory(self, compressed=False):
+        """The memory sent, from the start offset of the download."""
+        if not compressed:
+            return bytes(self.data)
+        import lzss
+        return lzss.decompress(bytes(self.data))
+
+
+def describe(rtype, seq, payload):
+    if rtype in (PRINT, LABEL):
+        text = payload.decode('ascii', 'replace').rstrip('\n')
+    elif rtype == MEM_READ and len(payload) == 5:
+        text = "read %d at 0x%04x, tag %d" % (payload[3] << 8 | payload[4],
+                                              payload[1] << 8 | payload[2],
+                                              payload[0])
+    elif rtype == MEM_DATA and len(payload) >= 1:
+        text = "%d bytes, tag %d" % (len(payload) - 1, payload[0])
+    elif rtype == MEM_WRITE and len(payload) >= 2:
+        text = "write %d at 0x%04x" % (len(payload) - 2,
+                                       payload[0] << 8 | payload[1])
+    elif rtype == MEMDL and len(payload) >= 2:
+        text = "downlink packet %d, %d bytes" % (payload[0], len(payload) - 2)
+    else:
+        text = payload.hex()
+    return "%5d %c %s" % (seq, rtype, text)
+
+
+def _selftest():
+    import random
+    rnd = random.Random(1)
+    # COBS corner cases: zero runs and 254 byte blocks
+    for data in (b'', b'\x00', b'\x00\x00', bytes(range(1, 255)),
+                 bytes(range(1, 256)), b'\x01' * 600, b'\x00' * 300):
+        enc = cobs_encode(data)
+        if 0 in enc or cobs_decode(enc) != data:
+            print("COBS round trip FAIL, %d bytes" % len(data))
+            return False
+    sent = []
+    stream = bytearray()
+    for seq in range(1, 501):
+        p = bytes(rnd.randrange(4) and rnd.randrange(256) or 0
+                  for _ in range(rnd.randrange(0, 600)))
+        sent.append((rnd.choice((PRINT, BINARY, MEM_WRITE)), seq, p))
+        stream += encode(*sent[-1])
+    dec = Decoder()
+    got = []
+    pos = 0
+    while pos < len(stream):
+        step = rnd.randrange(1, 700)
+        got += dec.feed(stream[pos:pos + step])
+        pos += step
+    ok = got == sent and dec.bad == 0 and dec.lost == 0
+    print("%d records, %d decoded, %s" % (len(sent), len(got),
+          "OK" if ok else "MISMATCH"))
+    # Flip and lose bytes: the damaged records are lost, at most two for
+    # each error when a delimiter is hit, and the others come through
+    dec = Decoder()
+    damaged = bytearray(stream)
+    hit = set()
+    for _ in range(50):
+        i = rnd.randrange(len(damaged))
+        if rnd.randrange(2):
+            damaged[i] ^= 1 << rnd.randrange(8)
+        else:
+            del damaged[i]
+    got = dec.feed(bytes(damaged))
+    for rec in got:
+        if rec != sent[rec[1] - 1]:
+            hit.add(rec[1])
+    resync = (not hit and len(got) >= len(sent) - 2 * 50
+              and len(got) + dec.lost == got[-1][1] - got[0][1] + 1)
+    print("50 byte errors: %d decoded, %d bad frames, %d lost, %s" % (
+          len(got), dec.bad, dec.lost, "OK" if resync else "MISMATCH"))
+    # A downlink among read requests, as send_mem() sends it: the packets
+    # come back in order, and a lost one shows in the counters
+    mem = bytes(rnd.randrange(256) for _ in range(3000))
+    stream = bytearray()
+    seq = 0
+    for n, off in enumerate(range(0, len(mem), 256)):
+        seq += 1
+        stream += encode(MEM_READ, seq, bytes([n, 0, n, 2, 0]))
+        seq += 1
+        stream += encode(MEMDL, seq, bytes([n & 7, (n + 1) & 7])
+                         + mem[off:off + 256])
+    dl = Downlink()
+    lossy = Downlink()
+    for rtype, rseq, payload in Decoder().feed(bytes(stream)):
+        if rtype == MEMDL:
+            dl.feed(payload)
+            if rseq != 10:
+                lossy.feed(payload)
+    dl_ok = dl.memory() == mem and not dl.gaps and lossy.gaps == 1
+    print("downlink of %d bytes in %d packets, %s" % (
+          len(dl.data), dl.packets, "OK" if dl_ok else "MISMATCH"))
+    return ok and resync and dl_ok
+
+
+if __name__ == '__main__':
+    if len(sys.argv) == 3 and sys.argv[1] == 'decode':
+        dec = Decoder()
+        f = open(sys.argv[2], 'rb')
+        for rec in dec.feed(f.read()):
+            print(describe(*rec))
+        f.close()
+        print("%d records, %d bad frames, %d lost" % (dec.records, dec.bad,
+                                                      dec.lost))
+    elif len(sys.argv) == 2 and sys.argv[1] == 'selftest':
+        sys.exit(0 if _selftest() else 1)
+    else:
+        print("usage: python dbg_link.py decode capture.bin | selftest")
+        sys.exit(1)
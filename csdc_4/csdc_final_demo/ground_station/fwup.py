@@ -0,0 +1,169 @@
+# Ground end of the firmware update (comms_firmware/Inc/fwupdate.h).
+#
+# Sends a patch made by host/fwdiff to the comms MCU as signed firmware
+# update packets through the uplink client:
+#   BEGIN, DATA [offset][patch bytes] ..., FINISH, then ACTIVATE
+# each [head][n][command][arguments][tag], head the data packet head of
+# ROUTER_ADDR_COMMS. Flash programming stalls the comms MCU, so one packet
+# is out at a time and the next goes once the reply
+#   [head][n][len][status][patch bytes received, uint32]
+# is in. A packet whose reply does not come within REPLY_S is sent again,
+# up to TRIES times; the board takes every command twice without harm,
+# and DATA goes on from the received count of the last reply.
+#
+# The new image boots on trial from the next reset; CONFIRM from the new
+# image (comms_cmd.h) keeps it.
+#
+# usage: python fwup.py send PORT patch.bin [noactivate]
+#        python fwup.py selftest
+
+import random
+import struct
+import sys
+import time
+
+import uplink
+
+HEAD = 0x69         # router_head(ROUTER_ADDR_COMMS, 1)
+BEGIN, DATA, FINISH, ACTIVATE = b'BDFA'
+CHUNK = 254 - 2 - 5 - uplink.TAG_LEN     # patch bytes per DATA packet
+REPLY_S = 3.0
+TRIES = 5
+
+
+class Upload:
+
+    def __init__(self, patch, activate=True, chunk=CHUNK, reply_s=REPLY_S):
+        self.patch = patch
+        self.activate = activate
+        self.chunk = chunk
+        self.reply_s = reply_s
+        self.reply = None       # (status, received) of the last reply
+        self.sent = 0
+        self.error = None
+
+    def frame(self, data):
+        """Takes a packet from the satellite, returns True if it was a
+        firmware update reply"""
+        if len(data) < 8 or data[0] != HEAD or data[1] < 6:
+            return False
+        self.reply = (data[3], struct.unpack_from('<I', data, 4)[0])
+        return True
+
+    def _ask(self, up, cmd, args, until):
+        pkt = uplink.sign(bytes([HEAD, 1 + len(args), cmd]) + args)
+        for _ in range(TRIES):
+            self.reply = None
+            up.queue(pkt)
+            self.sent += 1
+            end = min(time.monotonic() + self.reply_s, until)
+            while self.reply is None and time.monotonic() < end:
+                up.poll()
+            if self.reply is not None or time.monotonic() >= until:
+                break
+        if self.reply is None:
+            self.error = "no reply to %c" % cmd
+        elif self.reply[0]:
+            self.error = "%c failed, %d bytes in" % (cmd, self.reply[1])
+        return self.error is None
+
+    def run(self, up, until=None):
+        """Sends the whole update, returns True once the board has taken
+        it"""
+        until = until or float('inf')
+        self.error = None
+        if not self._ask(up, BEGIN, b'', until):
+            return False
+        offset = 0
+        while offset < len(self.patch):
+            data = self.patch[offset:offset + self.chunk]
+            if not self._ask(up, DATA, struct.pack('<I', offset) + data,
+                             until):
+                return False
+            offset = self.reply[1]
+        if not self._ask(up, FINISH, b'', until):
+            return False
+        return not self.activate or self._ask(up, ACTIVATE, b'', until)
+
+
+class FakeComms:
+    """The fwupdate_uplink() session of the comms MCU as a FakeSat cdh
+    callback: checks the tag, keeps the patch and answers like the board,
+    losing a reply with the given chance"""
+
+    def __init__(self, loss=0.0, seed=1):
+        self.rnd = random.Random(seed)
+        self.loss = loss
+        self.state = 'idle'
+        self.patch = b''
+        self.activations = 0
+
+    def _handle(self, cmd, args):
+        if cmd == BEGIN:
+            if self.state != 'receiving' or self.patch:
+                self.state, self.patch = 'receiving', b''
+            return True
+        if cmd == DATA and self.state == 'receiving' and len(args) >= 4:
+            offset = struct.unpack_from('<I', args)[0]
+            if offset > len(self.patch):
+                return False
+            self.patch += args[4 + len(self.patch) - offset:]
+            return True
+        if cmd == FINISH and self.state in ('receiving', 'verified'):
+            self.state = 'verified'
+            return True
+        if cmd == ACTIVATE and self.state in ('verified', 'activated'):
+            if self.state == 'verified':
+                self.activations += 1
+            self.state = 'activated'
+            return True
+        return False
+
+    def __call__(self, pkt):
+        body = bytes([pkt[0], pkt[1] - uplink.TAG_LEN]) + \
+            pkt[2:-uplink.TAG_LEN]
+        if pkt[0] != HEAD or uplink.sign(body) != pkt:
+            return []
+        ok = self._handle(pkt[2], pkt[3:-uplink.TAG_LEN])
+        if self.rnd.random() < self.loss:
+            return []
+        out = bytes([pkt[1], 0 if ok else 1]) + \
+            struct.pack('<I', len(self.patch))
+        return [bytes([HEAD, len(out)]) + out]
+
+
+def _selftest():
+    ok = True
+    patch = bytes(random.Random(2).getrandbits(8) for _ in range(3000))
+    for loss in (0.0, 0.2):
+        comms = FakeComms(loss=loss, seed=4)
+        sat = uplink.FakeSat(baud=115200, latency=0.05, loss=loss / 2,
+                             cdh=comms)
+        fw = Upload(patch, reply_s=0.5)
+        up = uplink.Uplink(sat, on_data=fw.frame, timeout=0.5)
+        t0 = time.monotonic()
+        done = fw.run(up, t0 + 60)
+        good = (done and comms.patch == patch and comms.activations == 1
+                and comms.state == 'activated')
+        ok = ok and good
+        print("loss %3.0f%%: %d B patch in %.1f s, %d packets for %d, %s" % (
+            loss * 100, len(patch), time.monotonic() - t0, fw.sent,
+            3 + (len(patch) + CHUNK - 1) // CHUNK,
+            "OK" if good else "FAILED %s" % fw.error))
+    return ok
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    if args == ['selftest']:
+        sys.exit(0 if _selftest() else 1)
+    if len(args) in (3, 4) and args[0] == 'send' and args[3:] in (
+            [], ['noactivate']):
+        import serial
+        port = serial.Serial(args[1], 115200, timeout=0.01)
+        fw = Upload(open(args[2], 'rb').read(), activate=not args[3:])
+        done = fw.run(uplink.Uplink(port, on_data=fw.frame))
+        print("update sent in %d packets" % fw.sent if done else fw.error)
+        sys.exit(0 if done else 1)
+    print("usage: python fwup.py send PORT patch.bin [noactivate] | selftest")
+    sys.exit(1)
@@ -0,0 +1,395 @@
+# Ground end of the chunked image downlink (cdh_firmware/Inc/imgdl.h).
+#
+# The CDH sends an image as numbered chunks, in any order, and this keeps
+# what has arrived across passes and ground station restarts:
+#   <file>.part   the chunks at their offsets
+#   <file>.map    magic, image, chunk length, chunks (0 while the end is
+#                 not known), length of the last chunk, SHA-256 of the
+#                 image from the TX2, then one bit per chunk that arrived
+# numbers little endian. The chunk is written before the map, so a crash
+# at worst loses the bit of a chunk that is on disk.
+#
+# The chunks carry no image number: they belong to the image of the last
+# INFO, which Images keeps track of.
+#
+# Each pass starts with START for the image, which the CDH answers with
+# the digest; another digest than the one in the map is another image, and
+# the map starts over. START also drops the ranges the CDH still had from
+# the last pass. Then only the missing ranges are asked for, up to RANGES
+# of them, the tail as one range to the end while the end is not known.
+# The CDH sends for as long as a pass lasts after the START. Once every chunk is in and the digest matches, the image is
+# written to <file>.
+#
+# Compression is asked for per image with COMPRESS in START, and INFO says
+# whether the CDH took it. Each chunk that comes out shorter then goes as an
+# LZSS stream of its own (ZCHUNK, ZLAST), unpacked here with lzss.py; the
+# .part and .map keep the chunks as they are in the image either way.
+#
+# usage: python imgdl.py status payload.jpeg
+#        python imgdl.py selftest
+
+import hashlib
+import os
+import random
+import struct
+import sys
+import time
+
+import lzss
+
+ADDR = 1            # payload, router.h
+CMD_START = 0x02
+CMD_RANGE = 0x03
+RESTART = 0x01
+COMPRESS = 0x02
+TO_END = 0xFFFF
+RANGES = 8          # IMGDL_RANGES
+CHUNK_LEN = 192     # IMGDL_CHUNK_LEN
+INFO, CHUNK, LAST = b'I'[0], b'C'[0], b'E'[0]
+ZCHUNK, ZLAST = b'c'[0], b'e'[0]
+INFO_LEN = 6 + 32
+MAGIC = b'IMDL'
+MAP_HEAD = struct.Struct('<4sBBHH32s')
+
+
+def image_path(image):
+    """Where image n is written, and its .part and .map next to it"""
+    return 'payload.jpeg' if image == 0 else 'payload%d.jpeg' % image
+
+
+class Download:
+
+    def __init__(self, path, image=0, compress=True):
+        self.path = path
+        self.image = image
+        self.compress = compress    # asked for in START
+        self.packed = 0         # chunks that arrived compressed
+        self.chunk_len = 0      # 0 until the first INFO
+        self.chunks = 0
+        self.last_len = 0
+        self.sha = bytes(32)
+        self.have = bytearray()
+        self.info = False       # INFO arrived since this was made
+        self.took = 0           # the START flags the CDH took, of INFO
+        self.done = False
+        self.received = 0       # chunks that arrived, repeats included
+        if os.path.exists(path + '.map'):
+            with open(path + '.map', 'rb') as f:
+                m = f.read()
+            magic, img, clen, chunks, last, sha = MAP_HEAD.unpack_from(m)
+            if magic == MAGIC and img == image:
+                self.chunk_len, self.chunks = clen, chunks
+                self.last_len, self.sha = last, sha
+                self.have = bytearray(m[MAP_HEAD.size:])
+                self._check()
+
+    def start_packet(self, restart=False):
+        return bytes([0x60 | ADDR << 1, CMD_START, self.image,
+                      (RESTART if restart else 0) |
+                      (COMPRESS if self.compress else 0)])
+
+    def _got(self, i):
+        return i // 8 < len(self.have) and self.have[i // 8] >> (i % 8) & 1
+
+    def missing(self):
+        """The missing chunks as (first, count) runs, the last one TO_END
+        while the end is not known"""
+        if not self.chunk_len:
+            return [(0, TO_END)]
+        end = self.chunks or len(self.have) * 8
+        while not self.chunks and end and not self._got(end - 1):
+            end -= 1
+        runs = []
+        i = 0
+        while i < end:
+            if self._got(i):
+                i += 1
+                continue
+            j = i
+            while j < end and not self._got(j) and j - i < TO_END - 1:
+                j += 1
+            runs.append((i, j - i))
+            i = j
+        if not self.chunks:
+            runs.append((end, TO_END))
+        return runs
+
+    def range_packets(self, ranges=RANGES):
+        return [bytes([0x60 | ADDR << 1, CMD_RANGE]) +
+                struct.pack('>HH', first, count)
+                for first, count in self.missing()[:ranges]]
+
+    def _save(self):
+        with open(self.path + '.map.new', 'wb') as f:
+            f.write(MAP_HEAD.pack(MAGIC, self.image, self.chunk_len,
+                                  self.chunks, self.last_len, self.sha) +
+                    bytes(self.have))
+        os.replace(self.path + '.map.new', self.path + '.map')
+
+    def _restart(self, chunk_len, sha):
+        self.chunk_len, self.sha = chunk_len, sha
+        self.chunks = self.last_len = 0
+        self.have = bytearray()
+        self.done = False
+        open(self.path + '.part', 'wb').close()
+
+    def frame(self, data):
+        """Takes a frame from the satellite, [head][n][n bytes]; returns
+        False if it is not of the image downlink"""
+        head, p = data[0], data[2:2 + data[1]]
+        if (head >> 1) & 7 != ADDR or not head & 1 or len(p) < 3:
+            return False
+        if p[0] == INFO and len(p) == INFO_LEN:
+            if p[1] != self.image:
+                return True
+            chunks, clen, sha = struct.unpack('>H', p[2:4])[0], p[4], p[5:37]
+            if sha != self.sha or clen != self.chunk_len:
+                self._restart(clen, sha)
+            self.chunks = self.chunks or chunks
+            self.info = True
+            self.took = p[37]
+            self._save()
+        elif p[0] in (CHUNK, LAST, ZCHUNK, ZLAST) and self.chunk_len:
+            i = struct.unpack('>H', p[1:3])[0]
+            c = p[3:]
+            if p[0] in (ZCHUNK, ZLAST):
+                try:
+                    c = lzss.decompress(c)
+                except ValueError:
+                    return True     # damaged, asked for again
+                self.packed += 1
+            last = p[0] in (LAST, ZLAST)
+            if len(c) > self.chunk_len or \
+               (len(c) < self.chunk_len) != last:
+                return True
+            self.received += 1
+            mode = 'r+b' if os.path.exists(self.path + '.part') else 'wb'
+            with open(self.path + '.part', mode) as f:
+                f.seek(i * self.chunk_len)
+                f.write(c)
+            if last:
+                self.chunks, self.last_len = i + 1, len(c)
+            while len(self.have) <= i // 8:
+                self.have.append(0)
+            self.have[i // 8] |= 1 << (i % 8)
+            self._save()
+            self._check()
+        else:
+            return False
+        return True
+
+    def _check(self):
+        if self.done or not self.chunks or \
+           any(not self._got(i) for i in range(self.chunks)):
+            return
+        with open(self.path + '.part', 'rb') as f:
+            img = f.read((self.chunks - 1) * self.chunk_len + self.last_len)
+        if hashlib.sha256(img).digest() != self.sha:
+            # a chunk went wrong on the way; all of it again
+            self._restart(self.chunk_len, self.sha)
+            self._save()
+            return
+        with open(self.path, 'wb') as f:
+            f.write(img)
+        self.done = True
+
+    def status(self):
+        got = sum(bin(b).count('1') for b in self.have)
+        return "image %d: %d of %s chunks of %d bytes%s%s" % (
+            self.image, got, self.chunks or '?', self.chunk_len,
+            ", %d compressed" % self.packed if self.took & COMPRESS else "",
+            ", complete" if self.done else "")
+
+
+class Images:
+    """The downloads of all images, the chunks to the one the CDH opened
+    last"""
+
+    def __init__(self, directory='.'):
+        self.directory = directory
+        self.downloads = {}
+        self.current = None
+
+    def get(self, image):
+        if image not in self.downloads:
+            self.downloads[image] = Download(
+                os.path.join(self.directory, image_path(image)), image)
+        return self.downloads[image]
+
+    def frame(self, data):
+        p = data[2:2 + data[1]]
+        if (data[0] >> 1) & 7 == ADDR and data[0] & 1 and len(p) == INFO_LEN \
+           and p[0] == INFO:
+            self.current = self.get(p[1])
+        return bool(self.current) and self.current.frame(data)
+
+
+class FakeCDH:
+    """The CDH end of imgdl.h on an image in memory, for uplink.FakeSat.
+    START is answered with INFO and drops the ranges still queued, RANGE
+    queues one, up to RANGES, and the chunks of the queue go out one after
+    the other on a line of the given speed, each lost with the given chance
+    on the way down. As on the CDH, sending stops pass_s after the START
+    (IMGDL_PASS_MS), and what is left stays queued, as in its flash, until
+    the next START. A START with COMPRESS has the chunks compressed where
+    they come out shorter."""
+
+    def __init__(self, data, loss=0.0, seed=1, baud=115200, pass_s=600.0):
+        self.data = data
+        self.loss = loss
+        self.rnd = random.Random(seed)
+        self.pass_s = pass_s
+        self.ranges = []        # [first, count] still to be sent
+        self.sent = 0
+        self.lost = 0           # of those sent, on the way down
+        self.line = 0           # bytes of the chunk frames sent
+        self.end_known = False  # as the CDH, once the last chunk was read
+        self._byte_s = 10.0 / baud
+        self._free = 0.0        # when the line is free for the next chunk
+        self._until = 0.0       # the end of the pass, as the CDH sees it
+        self.flags = 0          # of the last START
+
+    def _frame(self, p):
+        return bytes([0x60 | ADDR << 1 | 1, len(p)]) + p
+
+    def __call__(self, pkt):
+        if pkt[0] != 0x60 | ADDR << 1 or len(pkt) < 2:
+            return []
+        now = time.monotonic()
+        n = len(self.data) // CHUNK_LEN + 1     # the last one can be empty
+        out = []
+        if pkt[1] == CMD_START and len(pkt) == 4:
+            self.ranges = []
+            self._until = now + self.pass_s
+            self.flags = pkt[3] & COMPRESS
+            out.append(self._frame(bytes([INFO, pkt[2]]) +
+                                   struct.pack('>H', n if self.end_known
+                                               else 0) +
+                                   bytes([CHUNK_LEN]) +
+                                   hashlib.sha256(self.data).digest() +
+                                   bytes([self.flags])))
+        elif pkt[1] == CMD_RANGE and len(pkt) == 6:
+            r = list(struct.unpack('>HH', pkt[2:6]))
+            if r[1] and len(self.ranges) < RANGES and r not in self.ranges:
+                self.ranges.append(r)
+        else:
+            return []
+        self._free = max(self._free, now)
+        while self.ranges and self._free < self._until:
+            r = self.ranges[0]
+            if self.end_known and r[0] >= n:
+                self.ranges.pop(0)      # past the end of the image
+                continue
+            i = r[0]
+            c = self.data[i * CHUNK_LEN:(i + 1) * CHUNK_LEN]
+            kind = LAST if i == n - 1 else CHUNK
+            self.end_known |= kind == LAST
+            z = lzss.compress(c) if self.flags and c else c
+            if len(z) < len(c):
+                kind, c = ZLAST if kind == LAST else ZCHUNK, z
+            frame = self._frame(bytes([kind]) + struct.pack('>H', i) + c)
+            self._free += (1 + len(frame)) * self._byte_s
+            self.sent += 1
+            self.line += len(frame)
+            r[0] += 1
+            if r[1] != TO_END:
+                r[1] -= 1
+            if not r[1]:
+                self.ranges.pop(0)
+            if self.rnd.random() >= self.loss:
+                out.append(frame)
+            else:
+                self.lost += 1
+        return out
+
+
+def run_pass(sat, dl, seconds):
+    """One pass of csdc.py: START, wait for INFO, ask for what is missing"""
+    import uplink
+    up = uplink.Uplink(sat, on_data=dl.frame, timeout=0.5)
+    end = time.monotonic() + seconds
+    up.queue(dl.start_packet())
+    up.run(end)
+    while not dl.info and time.monotonic() < end:
+        up.poll()
+    for pkt in dl.range_packets():
+        up.queue(pkt)
+    while time.monotonic() < end and not dl.done:
+        up.poll()
+
+
+def _selftest():
+    import tempfile
+    import uplink
+    ok = True
+    rnd = random.Random(5)
+    d = tempfile.mkdtemp()
+    path = os.path.join(d, 'payload.jpeg')
+    for size, loss in ((40 * CHUNK_LEN + 77, 0.1), (30 * CHUNK_LEN, 0.2)):
+        img = bytes(rnd.randrange(256) for _ in range(size))
+        # the CDH stops sending as long after the START as the pass lasts
+        cdh = FakeCDH(img, loss=loss, seed=size, pass_s=0.4)
+        n = size // CHUNK_LEN + 1
+        passes = received = 0
+        dl = None
+        while (not dl or not dl.done) and passes < 20:
+            passes += 1
+            # a new ground station run each pass, the same CDH; the pass
+            # is too short for the whole image
+            dl = Download(path)
+            sat = uplink.FakeSat(baud=115200, latency=0.05, cdh_s=0.001,
+                                 cdh=cdh, seed=passes)
+            run_pass(sat, dl, 0.4)
+            received += dl.received
+        good = dl.done and open(path, 'rb').read() == img and received == n
+        ok = ok and good
+        print("%d bytes, %d chunks, %2.0f%% lost: %d passes, %d chunks "
+              "received, %d sent, %d lost and %d after the end of a pass; "
+              "sequential needs a pass long enough with none lost, %.1f%% "
+              "of passes, %s" % (
+                  size, n, loss * 100, passes, received, cdh.sent, cdh.lost,
+                  cdh.sent - cdh.lost - received, 100 * (1 - loss) ** n,
+                  "OK" if good else "FAILED"))
+    # a new image on the TX2 starts the map over
+    img = bytes(rnd.randrange(256) for _ in range(5 * CHUNK_LEN + 3))
+    cdh = FakeCDH(img)
+    dl = Download(path)
+    run_pass(uplink.FakeSat(baud=115200, latency=0.05, cdh=cdh), dl, 0.5)
+    good = dl.done and open(path, 'rb').read() == img
+    ok = ok and good
+    print("new image: %s, %s" % (dl.status(), "OK" if good else "FAILED"))
+    # a text product as the TX2 writes them, asked for with and without
+    # compression; random bytes above never come out shorter
+    img = ''.join('%d,%.2f,%d\n' % (t, 20 + rnd.random(), rnd.randrange(2))
+                  for t in range(300)).encode()
+    for compress in (False, True):
+        cdh = FakeCDH(img, loss=0.1, seed=3)
+        text = os.path.join(d, 'fire%d.txt' % compress)
+        dl = Download(text, compress=compress)
+        for seed in range(5):
+            run_pass(uplink.FakeSat(baud=115200, latency=0.05, cdh=cdh,
+                                    seed=seed), dl, 0.5)
+        good = dl.done and open(text, 'rb').read() == img and \
+            (dl.packed > 0) == compress
+        ok = ok and good
+        print("text %scompressed: %s, %d bytes on the line, %s" % (
+            "" if compress else "not ", dl.status(), cdh.line,
+            "OK" if good else "FAILED"))
+    for f in os.listdir(d):
+        os.remove(os.path.join(d, f))
+    os.rmdir(d)
+    return ok
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    if len(args) == 2 and args[0] == 'status':
+        dl = Download(args[1])
+        print(dl.status())
+        print("missing:", ' '.join("%d+%s" % (f, 'end' if c == TO_END else c)
+                                   for f, c in dl.missing()) or 'none')
+    elif args == ['selftest']:
+        sys.exit(0 if _selftest() else 1)
+    else:
+        print("usage: python imgdl.py status payload.jpeg | selftest")
+        sys.exit(1)
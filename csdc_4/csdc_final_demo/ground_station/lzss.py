@@ -0,0 +1,113 @@
+# Decompressor for the LZSS streams produced by comms_firmware/Src/lzss.c,
+# and a plain compressor of the same format for the fakes of the selftests
+#
+# usage: python lzss.py compressed.bin output.bin
+#
+# Stream format: one header byte (window bits << 4 | length bits), then MS bit
+# first packed symbols:
+#   1 + 8 bits          literal byte
+#   0 + W bits + L bits back reference, (distance - 1) and (length - 3)
+# The last byte is zero padded.
+
+import sys
+
+MIN_MATCH = 3
+WINDOW_BITS = 10    # LZSS_WINDOW_BITS
+LENGTH_BITS = 6     # LZSS_LENGTH_BITS
+
+
+def compress(data, wbits=WINDOW_BITS, lbits=LENGTH_BITS):
+    """The longest match in the window at each position, else a literal;
+    slower than lzss.c but decoded the same"""
+    max_len = MIN_MATCH + (1 << lbits) - 1
+    acc, nbits = 0, 0
+    out = bytearray([wbits << 4 | lbits])
+    i = 0
+    while i < len(data):
+        best, dist = 0, 0
+        for j in range(max(0, i - (1 << wbits) + 1), i):
+            n = 0
+            while n < max_len and i + n < len(data) and \
+                    data[j + n] == data[i + n]:
+                n += 1
+            if n >= best:
+                best, dist = n, i - j
+        if best >= MIN_MATCH:
+            acc = acc << (1 + wbits + lbits) | \
+                (dist - 1) << lbits | (best - MIN_MATCH)
+            nbits += 1 + wbits + lbits
+            i += best
+        else:
+            acc = acc << 9 | 0x100 | data[i]
+            nbits += 9
+            i += 1
+        while nbits >= 8:
+            nbits -= 8
+            out.append(acc >> nbits & 0xFF)
+        acc &= (1 << nbits) - 1
+    if nbits:
+        out.append(acc << (8 - nbits) & 0xFF)
+    return bytes(out)
+
+
+def decompress(data):
+    if not data:
+        return b''
+    wbits = data[0] >> 4
+    lbits = data[0] & 0x0F
+    if wbits == 0 or lbits == 0 or lbits > 8:
+        raise ValueError("bad LZSS header 0x%02x" % data[0])
+    ref_bits = wbits + lbits
+    len_mask = (1 << lbits) - 1
+    out = bytearray()
+
+    body = data[1:]
+    end = len(body)
+    i = 0       # next input byte
+    acc = 0     # bit accumulator, MS bit first
+    nbits = 0
+
+    while True:
+        # Top up to at least one whole symbol (at most 1 + 8 + 8 bits)
+        while nbits < 24 and i < end:
+            acc = (acc << 8) | body[i]
+            i += 1
+            nbits += 8
+        if nbits < 1:
+            break
+        nbits -= 1
+        if (acc >> nbits) & 1:
+            if nbits < 8:
+                break
+            nbits -= 8
+            out.append((acc >> nbits) & 0xFF)
+        else:
+            if nbits < ref_bits:
+                break
+            nbits -= ref_bits
+            ref = (acc >> nbits) & ((1 << ref_bits) - 1)
+            dist = (ref >> lbits) + 1
+            length = (ref & len_mask) + MIN_MATCH
+            start = len(out) - dist
+            if start < 0:
+                raise ValueError("LZSS reference before start of stream")
+            if dist >= length:
+                out += out[start:start + length]
+            else:
+                # overlapping copy, e.g. a run of one repeated byte
+                for k in range(length):
+                    out.append(out[start + k])
+        acc &= (1 << nbits) - 1
+    return bytes(out)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 3:
+        print("usage: python lzss.py compressed.bin output.bin")
+        sys.exit(1)
+    src = open(sys.argv[1], 'rb')
+    comp = src.read()
+    src.close()
+    dst = open(sys.argv[2], 'wb')
+    dst.write(decompress(comp))
+    dst.close()
@@ -0,0 +1,187 @@
+# Backing store of the memory emulator (PC.py): a fixed size binary file
+# mapped into memory.
+#
+# Writes change the mapped pages in place and return at once, so their cost
+# does not depend on the size of the memory. A background thread writes the
+# changed pages back to the file every FLUSH_S seconds, and close() writes
+# the rest. An optional journal keeps every write with its time, so a
+# session can be replayed on a fresh store.
+#
+# Journal record: time (8, float, seconds) | address (2) | size (2) | data,
+# numbers little endian.
+#
+# usage: python memstore.py reset [rwmem.bin]        fill with '\n'
+#        python memstore.py replay journal.bin [rwmem.bin]
+#        python memstore.py dump address size [rwmem.bin]
+#        python memstore.py selftest
+
+import mmap
+import os
+import struct
+import sys
+import threading
+import time
+
+MEM_LEN = 65536     # 16 bit addresses
+FILL = b'\n'        # what a reset memory reads as
+FLUSH_S = 0.5
+DEFAULT_FILE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                            'rwmem.bin')
+
+_JOURNAL_HEAD = struct.Struct('<dHH')
+
+
+def reset(path=DEFAULT_FILE, size=MEM_LEN):
+    f = open(path, 'wb')
+    f.write(FILL * size)
+    f.close()
+
+
+class MemStore:
+
+    def __init__(self, path=DEFAULT_FILE, size=MEM_LEN, journal=None):
+        if not os.path.exists(path) or os.path.getsize(path) != size:
+            reset(path, size)
+        self.size = size
+        self._file = open(path, 'r+b')
+        self._mem = mmap.mmap(self._file.fileno(), size)
+        self._journal = open(journal, 'ab') if journal else None
+        self._lock = threading.Lock()
+        self._dirty_lo = size
+        self._dirty_hi = 0
+        self._wake = threading.Event()
+        self._stop = False
+        self.writes = 0
+        self.flushes = 0
+        self._flusher = threading.Thread(target=self._flush_loop, daemon=True)
+        self._flusher.start()
+
+    def read(self, addr, n):
+        """Up to n bytes from addr on, fewer at the end of the memory."""
+        return self._mem[addr:min(addr + n, self.size)]
+
+    def write(self, addr, data):
+        """Changes the memory in place, the file follows within FLUSH_S.
+        Returns the number of bytes written, fewer at the end."""
+        data = bytes(data[:max(self.size - addr, 0)])
+        if not data:
+            return 0
+        with self._lock:
+            self._mem[addr:addr + len(data)] = data
+            self._dirty_lo = min(self._dirty_lo, addr)
+            self._dirty_hi = max(self._dirty_hi, addr + len(data))
+            self.writes += 1
+        if self._journal:
+            self._journal.write(_JOURNAL_HEAD.pack(time.time(), addr,
+                                                   len(data)) + data)
+        return len(data)
+
+    def flush(self):
+        """Writes the changed pages back to the file now."""
+        with self._lock:
+            lo, hi = self._dirty_lo, self._dirty_hi
+            self._dirty_lo, self._dirty_hi = self.size, 0
+        if lo >= hi:
+            return
+        # mmap.flush() wants a page aligned offset
+        lo -= lo % mmap.ALLOCATIONGRANULARITY
+        self._mem.flush(lo, hi - lo)
+        if self._journal:
+            self._journal.flush()
+        self.flushes += 1
+
+    def _flush_loop(self):
+        while not self._stop:
+            self._wake.wait(FLUSH_S)
+            self.flush()
+
+    def close(self):
+        self._stop = True
+        self._wake.set()
+        self._flusher.join()
+        self.flush()
+        self._mem.close()
+        self._file.close()
+        if self._journal:
+            self._journal.close()
+
+
+def journal_records(path):
+    """The writes of a journal as (time, address, data)."""
+    f = open(path, 'rb')
+    buf = f.read()
+    f.close()
+    pos = 0
+    while pos + _JOURNAL_HEAD.size <= len(buf):
+        t, addr, n = _JOURNAL_HEAD.unpack_from(buf, pos)
+        pos += _JOURNAL_HEAD.size
+        if pos + n > len(buf):
+            break       # cut by a crash
+        yield t, addr, buf[pos:pos + n]
+        pos += n
+
+
+def replay(journal, path=DEFAULT_FILE):
+    """Applies a journal to the store at path, returns the writes applied."""
+    store = MemStore(path)
+    n = 0
+    for _, addr, data in journal_records(journal):
+        store.write(addr, data)
+        n += 1
+    store.close()
+    return n
+
+
+def _selftest():
+    import random
+    import tempfile
+    rnd = random.Random(1)
+    tmp = tempfile.mkdtemp()
+    path = os.path.join(tmp, 'mem.bin')
+    jpath = os.path.join(tmp, 'journal.bin')
+    model = bytearray(FILL * MEM_LEN)
+    store = MemStore(path, journal=jpath)
+    t0 = time.perf_counter()
+    for _ in range(2000):
+        addr = rnd.randrange(MEM_LEN)
+        data = bytes(rnd.randrange(256) for _ in range(rnd.randrange(1, 300)))
+        n = store.write(addr, data)
+        model[addr:addr + n] = data[:n]
+    us = (time.perf_counter() - t0) / 2000 * 1e6
+    ok = store.read(0, MEM_LEN) == model
+    store.close()
+    f = open(path, 'rb')
+    ok = ok and f.read() == model
+    f.close()
+    print("2000 writes, %.1f us each, store and file %s" % (
+          us, "OK" if ok else "MISMATCH"))
+    # The journal on a fresh store gives the same memory
+    fresh = os.path.join(tmp, 'fresh.bin')
+    n = replay(jpath, fresh)
+    f = open(fresh, 'rb')
+    ok_replay = n == 2000 and f.read() == model
+    f.close()
+    print("journal replay: %d writes, %s" % (n, "OK" if ok_replay
+                                              else "MISMATCH"))
+    for p in (path, jpath, fresh):
+        os.remove(p)
+    os.rmdir(tmp)
+    return ok and ok_replay
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    if args and args[0] == 'reset' and len(args) <= 2:
+        reset(*args[1:])
+    elif args and args[0] == 'replay' and len(args) in (2, 3):
+        print("%d writes applied" % replay(*args[1:]))
+    elif args and args[0] == 'dump' and len(args) in (3, 4):
+        store = MemStore(*args[3:])
+        print(store.read(int(args[1], 0), int(args[2], 0)).hex())
+        store.close()
+    elif args == ['selftest']:
+        sys.exit(0 if _selftest() else 1)
+    else:
+        print("usage: python memstore.py reset [file] | replay journal "
+              "[file] | dump address size [file] | selftest")
+        sys.exit(1)
@@ -0,0 +1,307 @@
+# Pass planner: picks what to pull down in a pass out of the catalog of
+# products waiting on board, so that the most valuable fit in the time the
+# link has, and writes the requests for csdc.py to send.
+#
+# Catalog, one product a line, # starts a comment:
+#   name  kind  size  priority  [request]
+#   kind      data     sent whole by the request, hex of one uplink packet
+#                      without its size byte (a comms or CDH command)
+#             image<n> image n of the TX2, in imgdl.py chunks; what the
+#                      map next to imgdl.image_path(n) has is not asked
+#                      for again, and size is only used while the map
+#                      does not know the end
+#   size      bytes
+#   priority  the value of the whole product
+#
+# A product costs its bytes plus the frame headers, plus SETUP_S of link
+# time for the request to go up and the answer to start. Data products are
+# taken whole or not at all, images by the chunk, their value in
+# proportion; the CDH sends one image at a time (imgdl.h), so a pass takes
+# chunks of one image at most, from as many missing ranges as the CDH keeps.
+# The plan is a knapsack over the bytes of the pass: exact, by dynamic
+# programming in UNIT byte steps, for the whole products, and the image
+# chunks on the rest of the pass; every split of the pass between the two
+# is tried. The requests are then ordered by value per byte, so a pass cut
+# short loses the least.
+#
+# usage: python planner.py plan catalog.txt pass_s [rate [setup_s]]
+#        python planner.py selftest
+#   plan prints the schedule as comments and the requests one a line in
+#   hex, the commands file of csdc.py
+
+import os
+import struct
+import sys
+
+import imgdl
+
+RATE = 800          # effective downlink bytes/s at 9600 baud
+SETUP_S = 1.0
+UNIT = 64
+FRAME_DATA = 253    # data bytes in one bridge frame, [size][head][n] around
+FRAME_HEAD = 3
+CHUNK_HEAD = FRAME_HEAD + 3     # [type][index hi][index lo] too
+
+
+class Product:
+
+    def __init__(self, name, kind, size, priority, request=b''):
+        self.name = name
+        self.kind = kind
+        self.size = size
+        self.priority = priority
+        self.request = request
+        self.chunks = []        # image: the missing chunks
+        self.dl = None
+
+    def cost(self):
+        """Bytes on the link for all of it"""
+        if self.dl:
+            return len(self.chunks) * (self.dl_chunk_len() + CHUNK_HEAD)
+        return self.size + -(-self.size // FRAME_DATA) * FRAME_HEAD
+
+    def dl_chunk_len(self):
+        return self.dl.chunk_len or imgdl.CHUNK_LEN
+
+    def value(self):
+        if self.dl:
+            total = self.dl.chunks or -(-self.size // self.dl_chunk_len()) or 1
+            return self.priority * len(self.chunks) / total
+        return self.priority
+
+
+def load(path, image_dir='.'):
+    products = []
+    for n, line in enumerate(open(path), 1):
+        f = line.split('#')[0].split()
+        if not f:
+            continue
+        if len(f) not in (4, 5):
+            raise ValueError("%s:%d: name kind size priority [request]" % (
+                path, n))
+        p = Product(f[0], f[1], int(f[2]), float(f[3]),
+                    bytes.fromhex(f[4]) if len(f) > 4 else b'')
+        if p.kind.startswith('image'):
+            image = int(p.kind[5:])
+            p.dl = imgdl.Download(os.path.join(image_dir,
+                                               imgdl.image_path(image)), image)
+            p.chunks = _missing_chunks(p)
+        elif p.kind != 'data' or not p.request:
+            raise ValueError("%s:%d: kind data needs a request" % (path, n))
+        products.append(p)
+    return products
+
+
+def _missing_chunks(p):
+    """The chunks of the image not on the ground, from the map, and up to
+    the catalog size where the map does not know the end"""
+    end = p.dl.chunks or max(-(-p.size // p.dl_chunk_len()),
+                             len(p.dl.have) * 8)
+    return [i for i in range(end) if not p.dl._got(i)]
+
+
+def _runs(chunks):
+    runs = []
+    for i in chunks:
+        if runs and runs[-1][0] + runs[-1][1] == i:
+            runs[-1][1] += 1
+        else:
+            runs.append([i, 1])
+    return runs
+
+
+def _fit(whole, units, setup):
+    """Best value of the whole products for every capacity 0 .. units, the
+    bytes they really take, and which to take"""
+    best = [0.0] * (units + 1)
+    real = [0] * (units + 1)
+    keep = []
+    for p, u in whole:
+        k = bytearray(units + 1)
+        v = p.value()
+        b = p.cost() + setup
+        for c in range(units, u - 1, -1):
+            if best[c - u] + v > best[c]:
+                best[c] = best[c - u] + v
+                real[c] = real[c - u] + b
+                k[c] = 1
+        keep.append(k)
+    return best, real, keep
+
+
+def plan(products, pass_s, rate=RATE, setup_s=SETUP_S):
+    """Returns [(product, chunks or None, bytes)] in sending order and the
+    total value"""
+    budget = int(pass_s * rate)
+    units = budget // UNIT
+    setup = int(setup_s * rate)
+    whole = [(p, -(-(p.cost() + setup) // UNIT))
+             for p in products if not p.dl and p.cost() + setup <= budget]
+    # per image the chunks it can ask for in one pass
+    parts = [(p, p.chunks[:sum(n for _, n in _runs(p.chunks)[:imgdl.RANGES])])
+             for p in products if p.dl and p.chunks]
+    best, real, keep = _fit(whole, units, setup)
+
+    def fill(room):
+        out, top = [], 0.0
+        for p, chunks in parts:
+            per = p.dl_chunk_len() + CHUNK_HEAD
+            n = min(len(chunks), max(0, room - setup) // per)
+            v = p.value() * n / len(p.chunks)
+            if n and v > top:
+                out, top = [(p, chunks[:n], n * per)], v
+        return out, top
+
+    # the image chunks go on the bytes the whole products leave, not on the
+    # UNIT steps
+    top = (-1.0, 0, [])
+    for c in range(units + 1):
+        chunks, v = fill(budget - real[c])
+        if best[c] + v > top[0]:
+            top = (best[c] + v, c, chunks)
+    total, c, chunks = top
+    taken = []
+    for i in range(len(whole) - 1, -1, -1):
+        p, u = whole[i]
+        if keep[i][c]:
+            taken.append((p, None, p.cost()))
+            c -= u
+    # what the rounding to UNIT left out and still fits
+    room = budget - sum(b + setup for _, _, b in taken + chunks)
+    for p, u in sorted(whole, key=lambda w: -w[0].value() / w[0].cost()):
+        if p.cost() + setup <= room and all(p is not t[0] for t in taken):
+            taken.append((p, None, p.cost()))
+            total += p.value()
+            room -= p.cost() + setup
+    out = taken + chunks
+    out.sort(key=lambda t: -(t[0].value() * (len(t[1]) / len(t[0].chunks)
+                                             if t[1] else 1)) / (t[2] + setup))
+    return out, total
+
+
+def requests(p, chunks):
+    """The uplink packets for a product, or for the chunks of an image: as
+    many ranges as the CDH keeps, imgdl.RANGES"""
+    if chunks is None:
+        return [p.request]
+    return [p.dl.start_packet()] + [
+        bytes([0x60 | imgdl.ADDR << 1, imgdl.CMD_RANGE]) +
+        struct.pack('>HH', first, count)
+        for first, count in _runs(chunks)[:imgdl.RANGES]]
+
+
+def greedy(products, pass_s, rate=RATE, setup_s=SETUP_S, key=None):
+    """Products in order of key until the pass is full, for comparison:
+    whole, and one image with what it can ask for in a pass"""
+    room = int(pass_s * rate)
+    v = 0.0
+    image = False
+    for p in sorted(products, key=key):
+        if p.dl:
+            n = sum(c for _, c in _runs(p.chunks)[:imgdl.RANGES])
+            cost = n * (p.dl_chunk_len() + CHUNK_HEAD)
+            if image or not n or cost + setup_s * rate > room:
+                continue
+            image = True
+            room -= cost + setup_s * rate
+            v += p.value() * n / len(p.chunks)
+        elif p.cost() + setup_s * rate <= room:
+            room -= p.cost() + setup_s * rate
+            v += p.value()
+    return v
+
+
+def _selftest():
+    import itertools
+    import random
+    import shutil
+    import tempfile
+    ok = True
+    rnd = random.Random(3)
+    d = tempfile.mkdtemp()
+
+    def catalog(n, images):
+        ps = []
+        for i in range(n):
+            size = int(rnd.choice((200, 2000, 20000, 60000)) * rnd.uniform(0.5, 1.5))
+            ps.append(Product('p%d' % i, 'data', size, rnd.randint(1, 10),
+                              bytes([0x62, 0x00])))
+        for i in range(images):
+            p = Product('img%d' % i, 'image%d' % i, rnd.randint(5000, 40000),
+                        rnd.randint(5, 20))
+            p.dl = imgdl.Download(os.path.join(d, 'image%d.jpeg' % i), i)
+            # half the chunks came down in an earlier pass
+            p.dl.chunk_len = imgdl.CHUNK_LEN
+            p.dl.have = bytearray(rnd.getrandbits(8) for _ in range(
+                -(-p.size // imgdl.CHUNK_LEN) // 8))
+            p.chunks = _missing_chunks(p)
+            ps.append(p)
+        return ps
+
+    # against every subset on small catalogs of whole products
+    worst = 1.0
+    for trial in range(20):
+        ps = catalog(10, 0)
+        pass_s = rnd.choice((30, 60, 120))
+        sched, v = plan(ps, pass_s)
+        exact = 0
+        for r in range(len(ps) + 1):
+            for sub in itertools.combinations(ps, r):
+                if sum(p.cost() + SETUP_S * RATE for p in sub) <= pass_s * RATE:
+                    exact = max(exact, sum(p.priority for p in sub))
+        used = sum(b + SETUP_S * RATE for _, _, b in sched)
+        ok = ok and used <= pass_s * RATE and abs(v - sum(
+            p.priority for p, _, _ in sched)) < 1e-9
+        worst = min(worst, v / exact if exact else 1)
+    ok = ok and worst >= 0.9
+    print("10 products, 20 catalogs: plan within %.1f%% of the best subset "
+          "(%s)" % (100 * (1 - worst), "OK" if worst >= 0.9 else "FAILED"))
+
+    # large catalogs with images against the greedy orders
+    for n, images, pass_s in ((40, 3, 300), (100, 5, 600), (200, 10, 900)):
+        ps = catalog(n, images)
+        sched, v = plan(ps, pass_s)
+        used = sum(b + SETUP_S * RATE for _, _, b in sched)
+        by_prio = greedy(ps, pass_s, key=lambda p: -p.priority)
+        by_density = greedy(ps, pass_s, key=lambda p: -p.value() / p.cost())
+        fifo = greedy(ps, pass_s, key=lambda p: 0)
+        pkts = [pk for p, c, _ in sched for pk in requests(p, c)]
+        # image requests cover only missing chunks
+        good = used <= pass_s * RATE and \
+            v >= max(by_prio, by_density, fifo) - 1e-6
+        for p, c, _ in sched:
+            good = good and (c is None or all(not p.dl._got(i) for i in c))
+        ok = ok and good
+        print("%3d products, %2d images, %3d s pass: value %.1f, by priority "
+              "%.1f, by value per byte %.1f, in order %.1f; %d requests, "
+              "%.0f%% of the pass, %s" % (
+                  n, images, pass_s, v, by_prio, by_density, fifo, len(pkts),
+                  100 * used / (pass_s * RATE), "OK" if good else "FAILED"))
+    shutil.rmtree(d)
+    return ok
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    if args and args[0] == 'plan' and 3 <= len(args) <= 5:
+        rate = float(args[3]) if len(args) > 3 else RATE
+        setup_s = float(args[4]) if len(args) > 4 else SETUP_S
+        products = load(args[1], os.path.dirname(args[1]) or '.')
+        sched, v = plan(products, float(args[2]), rate, setup_s)
+        t = 0.0
+        print("# %s s pass at %d bytes/s, %d products, value %.1f of %.1f" % (
+            args[2], rate, len(products), v,
+            sum(p.value() for p in products)))
+        for p, chunks, b in sched:
+            t += setup_s + b / rate
+            print("# %7.1f s  %-12s %7d bytes %s" % (
+                t, p.name, b, "%d chunks" % len(chunks) if chunks else ""))
+        for p, chunks, b in sched:
+            for pkt in requests(p, chunks):
+                print(pkt.hex())
+    elif args == ['selftest']:
+        sys.exit(0 if _selftest() else 1)
+    else:
+        print("usage: python planner.py plan catalog.txt pass_s "
+              "[rate [setup_s]] | selftest")
+        sys.exit(1)
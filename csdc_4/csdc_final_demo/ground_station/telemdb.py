@@ -0,0 +1,498 @@
+# Local telemetry store of the ground station: the frames the satellite
+# sends are decoded into numbered channels ("gnd.crc_fails",
+# "lat.uplink.3", "status.uptime_ms", ...) and kept by column, so a query
+# reads only the channel it asks for and the times.
+#
+# The channels decoded from one kind of frame form a table, which shares
+# one time column:
+# <db>/<table>/columns      the channel names, one a line
+# <db>/<table>/time.col     per block the times after the first as the
+#                           delta of delta
+# <db>/<table>/<name>.col   per block the values after the first as the
+#                           delta
+#                           both as zigzag LEB128 varints, a 0 followed by
+#                           the number of 0s after it
+# <db>/<table>/index        one entry per block of up to BLOCK rows:
+#                           first and last time (ms), rows, offset and size
+#                           in time.col, then per channel offset and size
+#                           in its .col, first value, min, max and sum
+# numbers little endian. The index is small enough to read whole, a time
+# range decodes only the blocks it overlaps, and a downsampled view over
+# weeks takes the min / max / sum of the blocks that fall inside a bucket
+# without decoding them. Blocks are written whole, columns before the
+# index, so a crash loses at most the rows not flushed yet.
+#
+# Tables (comms_cmd.h, comms_stats.h): "telem", the comms telemetry and
+# beacon frames; "status", the comms status replies; "dl<address>", the
+# size of every downlinked frame from that address.
+#
+# usage: python telemdb.py channels db
+#        python telemdb.py query db channel [from [to]]     times in unix s
+#        python telemdb.py plot db channel from to [columns]
+#        python telemdb.py selftest
+
+import os
+import struct
+import sys
+import time
+
+BLOCK = 256
+IDX_HEAD = struct.Struct('<qqIQI')
+IDX_COL = struct.Struct('<QIqqqq')
+
+ROUTER_ADDR_COMMS = 4
+COMMS_CMD_STATUS = 0x00
+COMMS_CMD_TELEMETRY = 0x02
+COMMS_CMD_BEACON = 0x03
+COMMS_STATS_VERSION = 2
+LINKS = ('rf', 'gnd', 'cdh')
+LINK_FIELDS = ('frames_in', 'frames_out', 'bytes_in', 'bytes_out',
+               'crc_fails', 'sync_losses', 'aborts', 'drops', 'duplicates',
+               'queue_max')
+LATS = ('uplink', 'downlink', 'local')
+HIST_BUCKETS = 16
+STATUS_FIELDS = (('uptime_ms', 4), ('bad_packets', 4), ('errors', 4),
+                 ('gnd_rx_errors', 4), ('cdh_rx_errors', 4), ('profile', 1),
+                 ('image', 4), ('fw_state', 1), ('fw_received', 4))
+TELEM_CHANNELS = (('telem.seq', 'telem.period_ms')
+                  + tuple('%s.%s' % (l, f) for l in LINKS for f in LINK_FIELDS)
+                  + tuple('lat.%s.%d' % (l, b) for l in LATS
+                          for b in range(HIST_BUCKETS)))
+STATUS_CHANNELS = tuple('status.' + name for name, _ in STATUS_FIELDS)
+
+
+def _put_varint(out, v):
+    v = (v << 1) ^ (v >> 63)    # zigzag
+    while v >= 0x80:
+        out.append(v & 0x7F | 0x80)
+        v >>= 7
+    out.append(v)
+
+
+def _varints(buf):
+    v = shift = 0
+    for b in buf:
+        v |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            yield (v >> 1) ^ -(v & 1)
+            v = shift = 0
+
+
+def _put_deltas(out, deltas):
+    """Zigzag varints, a 0 followed by the number of further 0s"""
+    i = 0
+    while i < len(deltas):
+        _put_varint(out, deltas[i])
+        if deltas[i]:
+            i += 1
+            continue
+        run = 1
+        while i + run < len(deltas) and not deltas[i + run]:
+            run += 1
+        _put_varint(out, run - 1)
+        i += run
+
+
+def _deltas(buf):
+    it = _varints(buf)
+    for d in it:
+        yield d
+        if not d:
+            for _ in range(next(it)):
+                yield 0
+
+
+def encode_times(times):
+    out = bytearray()
+    _put_deltas(out, [times[i] - 2 * times[i - 1] + times[i - 2] if i > 1
+                      else times[1] - times[0]
+                      for i in range(1, len(times))])
+    return bytes(out)
+
+
+def decode_times(t, data):
+    out = [t]
+    dt = 0
+    for dod in _deltas(data):
+        dt += dod
+        t += dt
+        out.append(t)
+    return out
+
+
+def encode_values(vals):
+    out = bytearray()
+    _put_deltas(out, [vals[i] - vals[i - 1] for i in range(1, len(vals))])
+    return bytes(out)
+
+
+def decode_values(v, data):
+    out = [v]
+    for d in _deltas(data):
+        v += d
+        out.append(v)
+    return out
+
+
+def decode_frame(frame):
+    """The rows in a downlinked frame, [head][n][n bytes], as
+    [(table, channel names, values)]"""
+    if len(frame) < 2:
+        return []
+    head = frame[0]
+    addr = (head >> 1) & 0x7
+    rows = [('dl%d' % addr, ('dl.%d.bytes' % addr,), (len(frame),))]
+    if addr != ROUTER_ADDR_COMMS or not head & 1 or len(frame) < 4 \
+       or frame[3] != 0:
+        return rows
+    cmd, data = frame[2], frame[4:2 + frame[1]]
+    if cmd in (COMMS_CMD_TELEMETRY, COMMS_CMD_BEACON):
+        # the version and seq are single bytes, the rest varints
+        if len(data) < 2 or data[0] != COMMS_STATS_VERSION:
+            return rows
+        vals = list(_unsigned(data[2:]))
+        if len(vals) == len(TELEM_CHANNELS) - 1:
+            rows.append(('telem', TELEM_CHANNELS, (data[1],) + tuple(vals)))
+    elif cmd == COMMS_CMD_STATUS:
+        vals = []
+        pos = 0
+        for _, size in STATUS_FIELDS:
+            vals.append(int.from_bytes(data[pos:pos + size], 'little'))
+            pos += size
+        if pos <= len(data):
+            rows.append(('status', STATUS_CHANNELS, tuple(vals)))
+    return rows
+
+
+def _unsigned(buf):
+    v = shift = 0
+    for b in buf:
+        v |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            yield v
+            v = shift = 0
+
+
+class _Table:
+
+    def __init__(self, path, channels=None):
+        self.path = path
+        names = os.path.join(path, 'columns')
+        if channels is not None and not os.path.exists(names):
+            os.makedirs(path, exist_ok=True)
+            f = open(names, 'w')
+            f.write(''.join(c + '\n' for c in channels))
+            f.close()
+        f = open(names)
+        self.channels = tuple(f.read().split())
+        f.close()
+        self.col = {c: i for i, c in enumerate(self.channels)}
+        self.entry = struct.Struct(IDX_HEAD.format + IDX_COL.format[1:]
+                                   * len(self.channels))
+        self.blocks = []
+        self.times = []
+        self.rows = []
+        self._load()
+
+    def _file(self, name):
+        return os.path.join(self.path, name + '.col')
+
+    def _load(self):
+        idx = os.path.join(self.path, 'index')
+        if not os.path.exists(idx):
+            return
+        sizes = [os.path.getsize(self._file(c)) if os.path.exists(
+            self._file(c)) else 0 for c in ('time',) + self.channels]
+        f = open(idx, 'rb')
+        buf = f.read()
+        f.close()
+        for i in range(len(buf) // self.entry.size):
+            e = self.entry.unpack_from(buf, i * self.entry.size)
+            ends = [e[3] + e[4]] + [e[5 + 6 * c] + e[6 + 6 * c]
+                                    for c in range(len(self.channels))]
+            if any(end > size for end, size in zip(ends, sizes)):
+                break           # its columns were not all written
+            self.blocks.append(e)
+
+    def last_time(self):
+        if self.times:
+            return self.times[-1]
+        return self.blocks[-1][1] if self.blocks else None
+
+    def append(self, t_ms, vals):
+        last = self.last_time()
+        if last is not None and t_ms < last:
+            t_ms = last         # times in order, as the index needs
+        self.times.append(t_ms)
+        self.rows.append(vals)
+        if len(self.times) >= BLOCK:
+            self.flush()
+
+    def _put(self, name, data):
+        f = open(self._file(name), 'ab')
+        off = f.tell()
+        f.write(data)
+        f.close()
+        return off, len(data)
+
+    def flush(self):
+        if not self.times:
+            return
+        e = [self.times[0], self.times[-1], len(self.times)]
+        e += self._put('time', encode_times(self.times))
+        for c, name in enumerate(self.channels):
+            vals = [r[c] for r in self.rows]
+            e += self._put(name, encode_values(vals))
+            e += [vals[0], min(vals), max(vals), sum(vals)]
+        f = open(os.path.join(self.path, 'index'), 'ab')
+        f.write(self.entry.pack(*e))
+        f.close()
+        self.blocks.append(tuple(e))
+        self.times = []
+        self.rows = []
+
+    def _first_block(self, t0):
+        lo, hi = 0, len(self.blocks)
+        while lo < hi:
+            mid = (lo + hi) // 2
+            if self.blocks[mid][1] < t0:
+                lo = mid + 1
+            else:
+                hi = mid
+        return lo
+
+    def _read(self, f, off, size):
+        f.seek(off)
+        return f.read(size)
+
+    def _scan(self, name, t0, t1, whole=None):
+        """(block, times, values) of the blocks from t0 to t1, the flushed
+        ones that whole() accepts only as their index entries"""
+        c = self.col[name]
+        k = 5 + 6 * c
+        ft = open(self._file('time'), 'rb') if self.blocks else None
+        fv = open(self._file(name), 'rb') if self.blocks else None
+        for e in self.blocks[self._first_block(t0):]:
+            if e[0] > t1:
+                break
+            if whole and whole(e):
+                yield e, None, None
+                continue
+            yield (e, decode_times(e[0], self._read(ft, e[3], e[4])),
+                   decode_values(e[k + 2], self._read(fv, e[k], e[k + 1])))
+        if ft:
+            ft.close()
+            fv.close()
+        if self.times:
+            yield None, self.times, [r[c] for r in self.rows]
+
+    def query(self, name, t0, t1):
+        out = []
+        for _, times, vals in self._scan(name, t0, t1):
+            out.extend((t, v) for t, v in zip(times, vals) if t0 <= t <= t1)
+        return out
+
+    def downsample(self, name, t0, t1, n):
+        """n buckets from t0 to t1 as (count, min, max, sum)"""
+        width = (t1 - t0) / n
+        out = [[0, None, None, 0] for _ in range(n)]
+        k = 5 + 6 * self.col[name]
+
+        def bucket(t):
+            return min(int((t - t0) / width), n - 1)
+
+        def add(b, cnt, lo, hi, total):
+            o = out[b]
+            o[0] += cnt
+            o[1] = lo if o[1] is None else min(o[1], lo)
+            o[2] = hi if o[2] is None else max(o[2], hi)
+            o[3] += total
+
+        def whole(e):
+            return e[0] >= t0 and e[1] <= t1 and bucket(e[0]) == bucket(e[1])
+
+        self.decoded = 0
+        for e, times, vals in self._scan(name, t0, t1, whole):
+            if times is None:
+                add(bucket(e[0]), e[2], e[k + 3], e[k + 4], e[k + 5])
+                continue
+            self.decoded += e is not None
+            for t, v in zip(times, vals):
+                if t0 <= t <= t1:
+                    add(bucket(t), 1, v, v, v)
+        return [tuple(o) for o in out]
+
+
+class TelemDB:
+
+    def __init__(self, path):
+        self.path = path
+        if not os.path.isdir(path):
+            os.makedirs(path)
+        self.tables = {}
+        self.where = {}         # channel: table
+        for name in os.listdir(path):
+            if os.path.exists(os.path.join(path, name, 'columns')):
+                self._table(name)
+
+    def _table(self, name, channels=None):
+        if name not in self.tables:
+            t = _Table(os.path.join(self.path, name), channels)
+            self.tables[name] = t
+            for c in t.channels:
+                self.where[c] = t
+        return self.tables[name]
+
+    def channels(self):
+        return sorted(self.where)
+
+    def add_frame(self, frame, t=None):
+        """Decodes a downlinked frame, [head][n][n bytes], into its
+        channels; t in seconds, now if None. Returns the rows added."""
+        t_ms = int((time.time() if t is None else t) * 1000)
+        rows = decode_frame(frame)
+        for table, channels, vals in rows:
+            self._table(table, channels).append(t_ms, vals)
+        return len(rows)
+
+    def query(self, name, t0=None, t1=None):
+        """The samples from t0 to t1 (unix seconds) as (ms, value)"""
+        return self.where[name].query(
+            name, int(t0 * 1000) if t0 is not None else -(1 << 62),
+            int(t1 * 1000) if t1 is not None else 1 << 62)
+
+    def downsample(self, name, t0, t1, n):
+        return self.where[name].downsample(name, int(t0 * 1000),
+                                           int(t1 * 1000), n)
+
+    def flush(self):
+        for t in self.tables.values():
+            t.flush()
+
+    def close(self):
+        self.flush()
+
+
+def telemetry_frame(seq, vals):
+    """A comms telemetry frame as the comms MCU sends it, for tests"""
+    body = bytearray([COMMS_STATS_VERSION, seq & 0xFF])
+    for v in vals:
+        while v >= 0x80:
+            body.append(v & 0x7F | 0x80)
+            v >>= 7
+        body.append(v)
+    return bytes([0x60 | ROUTER_ADDR_COMMS << 1 | 1, len(body) + 2,
+                  COMMS_CMD_TELEMETRY, 0]) + bytes(body)
+
+
+def _selftest():
+    import random
+    import shutil
+    import tempfile
+    rnd = random.Random(1)
+    path = tempfile.mkdtemp()
+    db = TelemDB(path)
+    nvals = 1 + len(LINKS) * len(LINK_FIELDS) + len(LATS) * HIST_BUCKETS
+    # four weeks, four 10 minute passes a day, a frame every 10 s; counters
+    # about level, most of the error counters and histogram buckets 0
+    levels = [rnd.choice((0, 0, 5, 40, 1500)) for _ in range(nvals - 1)]
+    t = 1.7e9
+    model = []
+    t_in = time.perf_counter()
+    frames = 0
+    for day in range(28):
+        for p in range(4):
+            start = t + day * 86400 + p * 6 * 3600 + rnd.randrange(3600)
+            for k in range(60):
+                vals = [10000] + [max(0, lvl + rnd.randrange(-3, 4))
+                                  if lvl or rnd.random() < 0.05 else 0
+                                  for lvl in levels]
+                ft = start + k * 10 + rnd.random() * 0.2
+                db.add_frame(telemetry_frame(frames, vals), ft)
+                model.append((int(ft * 1000), vals[1 + 1 * 10 + 4]))
+                frames += 1
+    db.close()
+    t_in = time.perf_counter() - t_in
+    size = sum(os.path.getsize(os.path.join(d, f))
+               for d, _, files in os.walk(path) for f in files)
+    raw = frames * len(telemetry_frame(0, [0] * nvals))
+    print("%d frames, %d channels: %.0f frames/s in, %d KB on disk, "
+          "%.0f%% of the frames as sent" % (
+              frames, len(db.channels()), frames / t_in, size / 1024,
+              100.0 * size / raw))
+
+    ok = True
+    db = TelemDB(path)
+    chan = 'gnd.crc_fails'
+    t0, t1 = t + 10 * 86400, t + 11 * 86400
+    q = time.perf_counter()
+    got = db.query(chan, t0, t1)
+    q = time.perf_counter() - q
+    exp = [s for s in model if t0 * 1000 <= s[0] <= t1 * 1000]
+    ok = ok and got == exp
+    print("one day of %s: %d samples in %.2f ms, %s" % (
+          chan, len(got), q * 1e3, "OK" if got == exp else "MISMATCH"))
+
+    for days in (1, 7):
+        n = 28 // days
+        q = time.perf_counter()
+        buckets = db.downsample(chan, t, t + 28 * 86400, n)
+        q = time.perf_counter() - q
+        exp = [0] * n
+        for ms, v in model:
+            exp[min(int((ms - t * 1000) / (days * 86400000)), n - 1)] += v
+        good = [b[3] for b in buckets] == exp
+        ok = ok and good
+        print("four weeks in %d buckets: %.2f ms, %d of %d blocks decoded, "
+              "%s" % (n, q * 1e3, db.where[chan].decoded,
+                      len(db.where[chan].blocks), "OK" if good else "MISMATCH"))
+
+    # the index written, a column not: that block is dropped
+    db.close()
+    col = os.path.join(path, 'telem', chan + '.col')
+    os.truncate(col, os.path.getsize(col) - 3)
+    db = TelemDB(path)
+    got = db.query(chan)
+    good = got == model[:len(got)] and len(got) >= len(model) - BLOCK
+    ok = ok and good
+    print("data cut: %d of %d samples kept, %s" % (
+          len(got), len(model), "OK" if good else "MISMATCH"))
+    shutil.rmtree(path)
+    return ok
+
+
+if __name__ == '__main__':
+    args = sys.argv[1:]
+    if len(args) >= 3 and args[0] in ('query', 'plot') and \
+       args[2] not in TelemDB(args[1]).where:
+        print("no channel %s, see: python telemdb.py channels %s" % (
+            args[2], args[1]))
+        sys.exit(1)
+    if args and args[0] == 'channels' and len(args) == 2:
+        for name in TelemDB(args[1]).channels():
+            print(name)
+    elif args and args[0] == 'query' and 3 <= len(args) <= 5:
+        db = TelemDB(args[1])
+        rng = [float(a) for a in args[3:]] + [None] * (5 - len(args))
+        for ms, v in db.query(args[2], *rng):
+            print("%s.%03d %d" % (time.strftime(
+                '%Y-%m-%d %H:%M:%S', time.gmtime(ms // 1000)), ms % 1000, v))
+    elif args and args[0] == 'plot' and 5 <= len(args) <= 6:
+        db = TelemDB(args[1])
+        t0, t1 = float(args[3]), float(args[4])
+        n = int(args[5]) if len(args) > 5 else 60
+        buckets = db.downsample(args[2], t0, t1, n)
+        top = max([b[2] for b in buckets if b[0]] or [0]) or 1
+        for i, (cnt, lo, hi, total) in enumerate(buckets):
+            bt = t0 + (t1 - t0) * i / n
+            bar = '#' * int(40 * hi / top) if cnt else ''
+            print("%s %6s %s" % (time.strftime('%m-%d %H:%M', time.gmtime(bt)),
+                                 hi if cnt else '-', bar))
+    elif args == ['selftest']:
+        sys.exit(0 if _selftest() else 1)
+    else:
+        print("usage: python telemdb.py channels db | query db channel "
+              "[from [to]] | plot db channel from to [columns] | selftest")
+        sys.exit(1)
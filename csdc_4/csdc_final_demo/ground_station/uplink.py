@@ -0,0 +1,293 @@
+# Windowed uplink client for the comms bridge (comms_firmware/Inc/bridge.h).
+#
+# Every packet is sent to the satellite as [size][seq][packet], seq the
+# low byte of its number here, and the frame is echoed back unchanged once
+# the comms MCU has taken it; that echo is the acknowledgment, matched to
+# the outstanding frame with the same bytes. The bridge echoes in the
+# order it receives, so an echo that skips an older outstanding frame
+# means that one was lost and it is sent again at once. Up to WINDOW
+# packets are outstanding, enough to keep the UPLINK_RX_SLOTS queue of the
+# bridge full, and one that is not echoed within TIMEOUT_S is sent again,
+# with the same seq, up to RETRIES times. A repeat that does reach the
+# satellite twice is echoed twice but passed on once (dedup.h); a packet
+# queued again is numbered anew and executed again.
+#
+# Everything else from the satellite (CDH data, local replies) goes to the
+# on_data callback as the bytes after the size.
+#
+# A packet sent again can reach the CDH after ones queued behind it. When
+# the order matters, run() the window empty before queuing what depends
+# on it.
+#
+# With record set, everything written to and read from the port is kept in
+# a capture file for the replay harness (host/replay.c), one record per
+# write or read:
+#   time (8, float, seconds) | direction (1) | size (2) | bytes
+# numbers little endian, direction 'U' for sent and 'G' for received.
+#
+# The comms commands that change the board (comms_cmd.h) end with a tag,
+# see sign().
+#
+# usage: python uplink.py selftest      against the fake satellite below
+#        python uplink.py sign packet   the packet in hex with its tag
+
+import collections
+import hashlib
+import hmac
+import random
+import struct
+import sys
+import time
+
+WINDOW = 4
+TIMEOUT_S = 2.0
+RETRIES = 5
+RESYNC_S = 0.1      # as UPLINK_RX_TIMEOUT_MS and BRIDGE_RESYNC_MS
+CAPTURE_HEAD = struct.Struct('<dBH')
+CMD_KEY = b'UBCOrbit comms command key 00001'   # __COMMS_CMD_KEY
+TAG_LEN = 8         # COMMS_CMD_TAG_LEN
+
+
+def sign(pkt, key=CMD_KEY, tag_len=TAG_LEN):
+    """[head][len/cmd][data] with the tag of cmd_auth.h at the end, the
+    length of a data packet counting it"""
+    if pkt[0] & 1:
+        pkt = bytes([pkt[0], pkt[1] + tag_len]) + pkt[2:]
+    return pkt + hmac.new(key, pkt, hashlib.sha256).digest()[:tag_len]
+
+
+class Uplink:
+
+    def __init__(self, port, on_data=None, window=WINDOW, timeout=TIMEOUT_S,
+                 retries=RETRIES, record=None):
+        """port: a pyserial port with a short timeout, or a FakeSat;
+        record: the capture file to write, if any"""
+        self.port = port
+        self.on_data = on_data
+        self.window = window
+        self.timeout = timeout
+        self.retries = retries
+        self.next_seq = 0
+        self.queued = []        # [seq, frame] not sent yet
+        self.out = []           # [seq, frame, sent at, tries] in send order
+        self.result = {}        # seq: True when echoed, False when given up
+        self.acked = collections.deque(maxlen=32)  # to know late echoes
+        self.rx = b''
+        self.rx_time = 0.0
+        self.sent = 0
+        self.repeats = 0
+        self.stray_echoes = 0
+        self.record = open(record, 'wb') if record else None
+
+    def queue(self, pkt):
+        """Queues a packet without its size and sequence bytes, returns its
+        sequence number"""
+        if not 1 <= len(pkt) <= 254:
+            raise ValueError("uplink packets are 1 to 254 bytes")
+        seq = self.next_seq
+        self.next_seq += 1
+        self.queued.append([seq, bytes([len(pkt) + 1, seq & 0xFF]) +
+                            bytes(pkt)])
+        return seq
+
+    def busy(self):
+        return bool(self.queued or self.out)
+
+    def _send(self, entry, now):
+        self.port.write(entry[1])
+        self._record(ord('U'), entry[1])
+        entry[2] = now
+        entry[3] += 1
+        self.sent += 1
+        # keep self.out in the order of the last send, the echo order
+        if entry in self.out:
+            self.out.remove(entry)
+            self.repeats += 1
+        self.out.append(entry)
+
+    def _record(self, direction, data):
+        if self.record:
+            self.record.write(CAPTURE_HEAD.pack(time.time(), direction,
+                                                len(data)) + data)
+            self.record.flush()
+
+    def _frame(self, frame, now):
+        for i, entry in enumerate(self.out):
+            if entry[1] == frame:
+                self.result[entry[0]] = True
+                self.acked.append(frame)
+                del self.out[i]
+                # the ones sent before it were lost on the way up
+                for lost in self.out[:i]:
+                    self._retry(lost, now)
+                return
+        if frame in self.acked:
+            self.stray_echoes += 1      # both copies of a repeat arrived
+        elif self.on_data:
+            self.on_data(frame[1:])
+
+    def _retry(self, entry, now):
+        if entry[3] > self.retries:
+            self.out.remove(entry)
+            self.result[entry[0]] = False
+        else:
+            self._send(entry, now)
+
+    def poll(self):
+        """Reads what has arrived, sends again what timed out and sends
+        queued packets while the window has room"""
+        now = time.monotonic()
+        data = self.port.read(max(self.port.in_waiting, 1))
+        if data:
+            self._record(ord('G'), data)
+            if self.rx and now - self.rx_time > RESYNC_S:
+                self.rx = b''
+            self.rx += data
+            self.rx_time = now
+        while self.rx:
+            size = self.rx[0] or 256
+            if len(self.rx) < 1 + size:
+                break
+            frame, self.rx = self.rx[:1 + size], self.rx[1 + size:]
+            self._frame(frame, now)
+        for entry in [e for e in self.out if now - e[2] > self.timeout]:
+            self._retry(entry, now)
+        while self.queued and len(self.out) < self.window:
+            self._send([*self.queued.pop(0), 0.0, 0], now)
+
+    def run(self, until=None):
+        """Polls until everything queued is echoed or given up, or until
+        the monotonic time until"""
+        while self.busy() and (until is None or time.monotonic() < until):
+            self.poll()
+
+
+class FakeSat:
+    """The comms bridge and the CDH behind it, in place of a serial port:
+    packets and bytes take the time of the line and the latency of the
+    link, a packet or its echo is lost with the given chance, repeats
+    within DEDUP_S, same sequence byte and bytes, are echoed but not
+    executed again, and every executed packet is answered by a CDH data
+    packet [head | 1][n][packet after the head], or by the packets
+    cdh(packet) returns, [head][n][data] each."""
+
+    DEDUP_S = 12.0              # DEDUP_WINDOW_MS
+
+    def __init__(self, baud=9600, latency=0.1, loss=0.0, cdh_s=0.02,
+                 seed=1, cdh=None):
+        self.byte_s = 10.0 / baud
+        self.latency = latency
+        self.loss = loss
+        self.cdh_s = cdh_s
+        self.cdh = cdh or (lambda pkt: [bytes([pkt[0] | 1, len(pkt) - 1])
+                                        + pkt[1:]])
+        self.rnd = random.Random(seed)
+        self.timeout = 0.01
+        self.executed = []
+        self._rx = b''
+        self._up_free = 0.0     # when the uplink line is free
+        self._down_free = 0.0
+        self._cdh_free = 0.0
+        self._seen = {}         # packet: time it was executed
+        self._down = []         # (time it is read, bytes), in time order
+
+    def _downlink(self, t, data):
+        t = max(t, self._down_free) + len(data) * self.byte_s
+        self._down_free = t
+        self._down.append((t + self.latency, data))
+        self._down.sort(key=lambda d: d[0])
+
+    def write(self, data):
+        now = time.monotonic()
+        self._up_free = max(now, self._up_free)
+        for b in data:
+            self._up_free += self.byte_s
+            self._rx += bytes([b])
+            if len(self._rx) < 1 + self._rx[0]:
+                continue
+            pkt, self._rx = self._rx, b''
+            t = self._up_free + self.latency
+            if self.rnd.random() < self.loss:
+                continue        # damaged, dropped by the uplink timeout
+            if self.rnd.random() >= self.loss:
+                self._downlink(t, pkt)
+            if len(pkt) < 3 or \
+               t - self._seen.get(pkt, -self.DEDUP_S) < self.DEDUP_S:
+                continue
+            self._seen[pkt] = t
+            self.executed.append(pkt[2:])
+            self._cdh_free = max(t, self._cdh_free)
+            for reply in self.cdh(pkt[2:]):
+                self._cdh_free += self.cdh_s
+                self._downlink(self._cdh_free, bytes([len(reply)]) + reply)
+        return len(data)
+
+    @property
+    def in_waiting(self):
+        now = time.monotonic()
+        return sum(len(d) for t, d in self._down if t <= now)
+
+    def read(self, n=1):
+        end = time.monotonic() + self.timeout
+        while not self.in_waiting and time.monotonic() < end:
+            time.sleep(0.001)
+        out = b''
+        now = time.monotonic()
+        while self._down and self._down[0][0] <= now and len(out) < n:
+            t, d = self._down.pop(0)
+            take = n - len(out)
+            out += d[:take]
+            if d[take:]:
+                self._down.insert(0, (t, d[take:]))
+        return out
+
+
+def _selftest():
+    ok = True
+    n = 40
+    base = None
+    for window, loss in ((1, 0.0), (WINDOW, 0.0), (WINDOW, 0.1)):
+        sat = FakeSat(loss=loss)
+        data = []
+        up = Uplink(sat, on_data=data.append, window=window, timeout=0.5)
+        cmds = [bytes([0x62, i]) + b'000fire0' for i in range(n)]
+        for c in cmds:
+            up.queue(c)
+        t0 = time.monotonic()
+        up.run(t0 + 30)
+        took = time.monotonic() - t0
+        base = base or took
+        end = time.monotonic() + 0.5    # the last CDH answers
+        while time.monotonic() < end:
+            up.poll()
+        good = (all(up.result.get(i) for i in range(n))
+                and sorted(sat.executed) == sorted(cmds)
+                and sorted(d[2:] for d in data) == sorted(c[1:] for c in cmds))
+        ok = ok and good
+        print("window %d, loss %3.0f%%: %d commands in %.2f s (x%.1f), "
+              "%d sends, %d repeats, %d stray echoes, %s" % (
+                  window, loss * 100, n, took, base / took, up.sent,
+                  up.repeats, up.stray_echoes, "OK" if good else "FAILED"))
+    # a command sent again on purpose is executed again, its lost echoes
+    # still are not
+    sat = FakeSat(loss=0.2, seed=3)
+    up = Uplink(sat, window=1, timeout=0.5)
+    cmd = bytes([0x62, 0x05]) + b'000fire0'
+    for _ in range(3):
+        up.queue(cmd)
+        up.run(time.monotonic() + 10)
+    good = sat.executed == [cmd] * 3 and all(up.result.get(i) for i in range(3))
+    ok = ok and good
+    print("same command 3 times: executed %d times, %d sends, %s" % (
+        len(sat.executed), up.sent, "OK" if good else "FAILED"))
+    return ok
+
+
+if __name__ == '__main__':
+    if sys.argv[1:] == ['selftest']:
+        sys.exit(0 if _selftest() else 1)
+    if len(sys.argv) == 3 and sys.argv[1] == 'sign':
+        print(sign(bytes.fromhex(sys.argv[2])).hex())
+        sys.exit(0)
+    print("usage: python uplink.py selftest | sign packet")
+    sys.exit(1)
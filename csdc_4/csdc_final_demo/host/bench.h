@@ -0,0 +1,67 @@
+/*
+ * bench.h
+ *	Description: Timing helpers for the host benchmarks. Cycles are read
+ *		     from the time stamp counter on x86, elsewhere only the
+ *		     wall clock is reported.
+ */
+
+#ifndef HOST_BENCH_H_
+#define HOST_BENCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_CYCLES 1
+static inline uint64_t
+bench_cycles (void)
+{
+  return __rdtsc ();
+}
+#else
+#define BENCH_HAVE_CYCLES 0
+static inline uint64_t
+bench_cycles (void)
+{
+  return 0;
+}
+#endif
+
+typedef struct
+{
+  struct timespec t0;
+  uint64_t c0;
+} bench_timer_t;
+
+static inline void
+bench_start (bench_timer_t *t)
+{
+  clock_gettime (CLOCK_MONOTONIC, &t->t0);
+  t->c0 = bench_cycles ();
+}
+
+/**
+ * Prints throughput and cost per byte since bench_start()
+ * @return the elapsed time in seconds
+ */
+static inline double
+bench_stop (bench_timer_t *t, const char *name, uint64_t bytes)
+{
+  struct timespec t1;
+  uint64_t c1 = bench_cycles ();
+  double secs;
+
+  clock_gettime (CLOCK_MONOTONIC, &t1);
+  secs = (t1.tv_sec - t->t0.tv_sec) + (t1.tv_nsec - t->t0.tv_nsec) * 1e-9;
+  printf ("%-28s %9.2f MB/s %8.2f ns/byte", name, bytes / secs / 1e6,
+	  secs * 1e9 / bytes);
+  if (BENCH_HAVE_CYCLES) {
+    printf (" %8.2f cycles/byte", (double) (c1 - t->c0) / bytes);
+  }
+  printf ("\n");
+  return secs;
+}
+
+#endif /* HOST_BENCH_H_ */
@@ -0,0 +1,489 @@
+/*
+ * bench_bridge.c
+ *	Description: Compares the ground <-> CDH relay of the comms board
+ *		     before and after the DMA bridge, on simulated 115200
+ *		     baud lines in virtual time.
+ *
+ *	The new relay is the firmware bridge.c itself, over ports that behave
+ *	like the DMA UARTs: a 512 byte receive buffer and a 1024 byte send
+ *	queue per line. The old relay is a model of the blocking csdcdemo()
+ *	loop: it only receives while it sits in HAL_UART_Receive(), sleeps
+ *	3 s before every packet it returns to the ground, relays three uplink
+ *	packets and then only downlink. The model leaves out its trailing junk
+ *	bytes, which the ground script flushed.
+ *
+ *	The bridge also runs with the transmit scheduler (tx_sched.c) in
+ *	front of the ground line, which sends the echoes ahead of the CDH
+ *	data.
+ *
+ *	The ground sends a 12 byte command every second while the CDH sends
+ *	254 byte packets, first back to back, then one every 5 s.
+ *
+ *	The firmware downlink histogram (COMMS_LAT_DOWNLINK) ends where the
+ *	packet is written to the ground port. With the scheduler that is after
+ *	its wait in the scheduler queue and it should agree with the measured
+ *	latency within the line time of TX_SCHED_LOW_WATER plus one packet;
+ *	without it the wait in the 1024 byte send queue is not in it.
+ *
+ *	usage: bench_bridge [seconds]
+ */
+
+#include "bridge.h"
+#include "comms_stats.h"
+#include "ringbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* 10 bits per byte on the line */
+#define BYTE_US (10 * 1e6 / 115200)
+#define MS_TO_TICKS(ms) ((uint64_t) ((ms) * 1000 / BYTE_US))
+
+#define UL_HEAD 0x61
+#define DL_HEAD 0x60
+#define UL_LEN 10
+#define DL_LEN 254
+#define UL_PERIOD_MS 1000
+#define MAX_PKTS 8192
+
+/* One direction of a serial line: a send queue and the far end buffer */
+typedef struct
+{
+  ringbuf_t tx;
+  uint8_t tx_mem[1024];
+  ringbuf_t rx;
+  uint8_t rx_mem[512];
+  uint64_t lost;
+} line_t;
+
+/* Reassembles the packets arriving at an end point and times them */
+typedef struct
+{
+  uint8_t buf[260];
+  size_t got;
+  size_t need;
+  uint8_t sized;		/* [size][data] framing, else [head][n][data] */
+  uint32_t next_seq;
+  uint32_t packets;
+  uint32_t missing;
+  uint64_t bytes;
+  double lat_sum;
+  double lat_max;
+  uint64_t sent_at[MAX_PKTS];	/* tick of the last byte of each packet */
+} sink_t;
+
+static line_t gnd_up, gnd_down, cdh_up, cdh_down;
+/* The ground frames carry the sequence byte of bridge.h, not for the old
+ * loop */
+static uint8_t ul_seq_byte;
+static sink_t at_gnd_echo, at_gnd_dl, at_cdh;
+static uint64_t now;
+
+static void
+line_init (line_t *l)
+{
+  ringbuf_init (&l->tx, l->tx_mem, sizeof(l->tx_mem));
+  ringbuf_init (&l->rx, l->rx_mem, sizeof(l->rx_mem));
+  l->lost = 0;
+}
+
+/**
+ * Moves one byte along the wire
+ * @param listening 0 if the receiver is not taking bytes right now
+ * @return the byte plus 1, or 0 if the line was idle
+ */
+static int
+line_tick (line_t *l, uint8_t listening)
+{
+  uint8_t b;
+
+  if (!ringbuf_read (&l->tx, &b, 1)) {
+    return 0;
+  }
+  if (!listening || !ringbuf_write (&l->rx, &b, 1)) {
+    l->lost++;
+  }
+  return b + 1;
+}
+
+/* A bridge port: receives from one line, sends on another */
+typedef struct
+{
+  line_t *from;
+  line_t *to;
+} port_t;
+
+static size_t
+port_read (void *priv, uint8_t *buf, size_t len)
+{
+  return ringbuf_read (&((port_t *) priv)->from->rx, buf, len);
+}
+
+static int32_t
+port_write (void *priv, const uint8_t *data, size_t len)
+{
+  ringbuf_t *tx = &((port_t *) priv)->to->tx;
+  if (ringbuf_room (tx) < len) {
+    return -1;
+  }
+  ringbuf_write (tx, data, len);
+  return 0;
+}
+
+static void
+sink_init (sink_t *s, uint8_t sized)
+{
+  memset (s, 0, sizeof(sink_t));
+  s->sized = sized;
+  s->need = sized ? 1 : 2;
+}
+
+static void
+sink_done (sink_t *s, const uint8_t *pkt, size_t n)
+{
+  uint32_t seq = pkt[2] | (pkt[3] << 8);
+  double lat;
+
+  if (seq < s->next_seq || seq >= MAX_PKTS) {
+    return;
+  }
+  s->missing += seq - s->next_seq;
+  s->next_seq = seq + 1;
+  s->packets++;
+  s->bytes += n;
+  lat = (now - s->sent_at[seq]) * BYTE_US / 1000;
+  s->lat_sum += lat;
+  if (lat > s->lat_max) {
+    s->lat_max = lat;
+  }
+}
+
+/**
+ * Feeds one received byte to the end points on a ground line, which sees
+ * both the echoed uplink and the downlink
+ */
+static void
+gnd_byte (uint8_t b)
+{
+  sink_t *s = &at_gnd_echo;
+  s->buf[s->got++] = b;
+  if (s->got == 1) {
+    s->need = 1 + (b ? b : 256);
+  }
+  if (s->got < s->need) {
+    return;
+  }
+  if (s->buf[1] == DL_HEAD) {
+    sink_done (&at_gnd_dl, s->buf + 1, s->got - 1);
+  }
+  else if (s->buf[1 + ul_seq_byte] == UL_HEAD) {
+    sink_done (&at_gnd_echo, s->buf + 1 + ul_seq_byte,
+	       s->got - 1 - ul_seq_byte);
+  }
+  s->got = 0;
+}
+
+static void
+cdh_byte (uint8_t b)
+{
+  sink_t *s = &at_cdh;
+  s->buf[s->got++] = b;
+  if (s->got == 2) {
+    s->need = 2 + b;
+  }
+  if (s->got < s->need) {
+    return;
+  }
+  if (s->buf[0] == UL_HEAD) {
+    sink_done (s, s->buf, s->got);
+  }
+  s->got = 0;
+}
+
+/**
+ * Builds packet \p seq of the ground or the CDH: head, length, sequence
+ * number and filler
+ */
+static size_t
+make_pkt (uint8_t *out, uint8_t head, size_t len, uint32_t seq)
+{
+  size_t i;
+  out[0] = head;
+  out[1] = (uint8_t) len;
+  out[2] = (uint8_t) seq;
+  out[3] = (uint8_t) (seq >> 8);
+  for (i = 4; i < len + 2; i++) {
+    out[i] = (uint8_t) (seq + i);
+  }
+  return len + 2;
+}
+
+/* The end points: the ground paces its commands, the CDH streams or paces */
+static uint32_t ul_seq, dl_seq;
+static uint32_t dl_period_ms;
+
+static void
+endpoints_tick (void)
+{
+  uint8_t pkt[DL_LEN + 3];
+  size_t n;
+
+  if (now >= ul_seq * MS_TO_TICKS (UL_PERIOD_MS) && ul_seq < MAX_PKTS
+      && ringbuf_room (&gnd_up.tx) > UL_LEN + 3) {
+    n = make_pkt (pkt + 1 + ul_seq_byte, UL_HEAD, UL_LEN, ul_seq);
+    pkt[0] = (uint8_t) (n + ul_seq_byte);
+    if (ul_seq_byte) {
+      pkt[1] = (uint8_t) ul_seq;
+    }
+    ringbuf_write (&gnd_up.tx, pkt, n + 1 + ul_seq_byte);
+    /* The last byte leaves after everything queued before it */
+    at_gnd_echo.sent_at[ul_seq] = now + ringbuf_used (&gnd_up.tx);
+    at_cdh.sent_at[ul_seq] = at_gnd_echo.sent_at[ul_seq];
+    ul_seq++;
+  }
+  if (ringbuf_used (&cdh_up.tx) == 0 && dl_seq < MAX_PKTS
+      && now >= dl_seq * MS_TO_TICKS (dl_period_ms)) {
+    n = make_pkt (pkt, DL_HEAD, DL_LEN, dl_seq);
+    ringbuf_write (&cdh_up.tx, pkt, n);
+    at_gnd_dl.sent_at[dl_seq] = now + n;
+    dl_seq++;
+  }
+}
+
+/* --- The old blocking loop ------------------------------------------- */
+
+typedef enum
+{
+  OLD_UL_SIZE, OLD_UL_DATA, OLD_DL_HEAD, OLD_DL_DATA, OLD_DELAY, OLD_TX
+} old_state_t;
+
+typedef struct
+{
+  old_state_t state;
+  old_state_t after_tx;
+  uint8_t buf[260];		/* [size][head][n][data], as sent to ground */
+  size_t got;
+  size_t need;
+  uint64_t deadline;
+  uint8_t uplinks;
+  size_t to_cdh_len;
+} old_loop_t;
+
+static old_loop_t old;
+
+static void
+old_receive (old_state_t st, size_t need, uint32_t timeout_ms)
+{
+  old.state = st;
+  old.got = 0;
+  old.need = need;
+  old.deadline = now + MS_TO_TICKS (timeout_ms);
+}
+
+static void
+old_send (old_state_t next, size_t to_cdh_len)
+{
+  old.state = OLD_DELAY;
+  old.deadline = now + MS_TO_TICKS (3000);
+  old.after_tx = next;
+  old.to_cdh_len = to_cdh_len;
+}
+
+/**
+ * Advances the blocking loop by one byte time
+ * @param listen_gnd set if it sits in HAL_UART_Receive() on the ground line
+ * @param listen_cdh the same for the CDH line
+ */
+static void
+old_tick (uint8_t *listen_gnd, uint8_t *listen_cdh)
+{
+  uint8_t *dst;
+  line_t *src;
+
+  *listen_gnd = old.state == OLD_UL_SIZE || old.state == OLD_UL_DATA;
+  *listen_cdh = old.state == OLD_DL_HEAD || old.state == OLD_DL_DATA;
+
+  switch (old.state) {
+    case OLD_UL_SIZE:
+    case OLD_UL_DATA:
+    case OLD_DL_HEAD:
+    case OLD_DL_DATA:
+      src = *listen_gnd ? &gnd_up : &cdh_up;
+      dst = old.buf + (old.state == OLD_UL_SIZE ? 0 :
+		       old.state == OLD_DL_DATA ? 3 : 1);
+      old.got += ringbuf_read (&src->rx, dst + old.got, old.need - old.got);
+      break;
+    default:
+      break;
+  }
+
+  switch (old.state) {
+    case OLD_UL_SIZE:
+      /* rcsdc() */
+      if (old.got == 1 && old.buf[0]) {
+	old_receive (OLD_UL_DATA, old.buf[0], 100);
+      }
+      else if (now >= old.deadline) {
+	old_receive (OLD_UL_SIZE, 1, 500);
+      }
+      break;
+    case OLD_UL_DATA:
+      /* The result of HAL_UART_Receive() is not checked */
+      if (old.got == old.need || now >= old.deadline) {
+	old_send (++old.uplinks < 3 ? OLD_UL_SIZE : OLD_DL_HEAD, old.need);
+      }
+      break;
+    case OLD_DL_HEAD:
+      if (old.got == 2) {
+	old_receive (OLD_DL_DATA, old.buf[2], 100);
+      }
+      else if (now >= old.deadline) {
+	old_receive (OLD_DL_HEAD, 2, 100);
+      }
+      break;
+    case OLD_DL_DATA:
+      if (old.got == old.need || now >= old.deadline) {
+	old.buf[0] = (uint8_t) (old.need + 2);
+	old_send (OLD_DL_HEAD, 0);
+      }
+      break;
+    case OLD_DELAY:
+      /* wcsdc() sleeps, then the packet goes to the ground and the CDH */
+      if (now >= old.deadline) {
+	ringbuf_write (&gnd_down.tx, old.buf,
+		       1 + (old.buf[0] ? old.buf[0] : 256));
+	ringbuf_write (&cdh_down.tx, old.buf + 1, old.to_cdh_len);
+	old.state = OLD_TX;
+      }
+      break;
+    case OLD_TX:
+      /* HAL_UART_Transmit() blocks until the bytes are out */
+      if (!ringbuf_used (&gnd_down.tx) && !ringbuf_used (&cdh_down.tx)) {
+	if (old.after_tx == OLD_DL_HEAD) {
+	  old_receive (OLD_DL_HEAD, 2, 100);
+	}
+	else {
+	  old_receive (OLD_UL_SIZE, 1, 500);
+	}
+      }
+      break;
+  }
+}
+
+/* --------------------------------------------------------------------- */
+
+static size_t
+port_pending (void *priv)
+{
+  return ringbuf_used (&((port_t *) priv)->to->tx);
+}
+
+enum
+{
+  RELAY_OLD, RELAY_BRIDGE, RELAY_SCHED
+};
+
+static void
+run (int relay, double seconds)
+{
+  static bridge_t b;
+  static tx_sched_t sched;
+  static port_t gnd_port = { &gnd_up, &gnd_down };
+  static port_t cdh_port = { &cdh_up, &cdh_down };
+  const bridge_port_t gnd = { port_read, port_write, &gnd_port };
+  const bridge_port_t cdh = { port_read, port_write, &cdh_port };
+  const tx_sink_t sink = { port_write, port_pending, NULL, &gnd_port };
+  const uint64_t end = MS_TO_TICKS (seconds * 1000);
+  uint8_t listen_gnd = 1;
+  uint8_t listen_cdh = 1;
+  uint8_t frame[COMMS_STATS_MAX_FRAME_LEN];
+  int v;
+
+  line_init (&gnd_up);
+  line_init (&gnd_down);
+  line_init (&cdh_up);
+  line_init (&cdh_down);
+  sink_init (&at_gnd_echo, 1);
+  sink_init (&at_gnd_dl, 1);
+  sink_init (&at_cdh, 0);
+  ul_seq = 0;
+  ul_seq_byte = relay != RELAY_OLD;
+  dl_seq = 0;
+  now = 0;
+  tx_sched_init (&sched, &sink, COMMS_LINK_GND, 0);
+  bridge_init (&b, &gnd, &cdh, NULL, relay == RELAY_SCHED ? &sched : NULL);
+  comms_stats_init (0);
+  memset (&old, 0, sizeof(old));
+  old_receive (OLD_UL_SIZE, 1, 500);
+
+  for (now = 0; now < end; now++) {
+    endpoints_tick ();
+    if (relay != RELAY_OLD) {
+      bridge_poll (&b, (uint32_t) (now * BYTE_US / 1000));
+    }
+    else {
+      old_tick (&listen_gnd, &listen_cdh);
+    }
+    line_tick (&gnd_up, listen_gnd);
+    line_tick (&cdh_up, listen_cdh);
+    if ((v = line_tick (&gnd_down, 1))) {
+      gnd_byte (v - 1);
+      ringbuf_skip (&gnd_down.rx, 1);
+    }
+    if ((v = line_tick (&cdh_down, 1))) {
+      cdh_byte (v - 1);
+      ringbuf_skip (&cdh_down.rx, 1);
+    }
+  }
+
+  printf ("%s\n", relay == RELAY_OLD ? "blocking loop (old)" :
+	  relay == RELAY_BRIDGE ? "DMA bridge" : "DMA bridge, tx scheduler");
+  printf ("  downlink   %6u packets %8.1f B/s  latency avg %8.1f ms max "
+	  "%8.1f ms  lost %u\n", at_gnd_dl.packets,
+	  at_gnd_dl.bytes / seconds,
+	  at_gnd_dl.packets ? at_gnd_dl.lat_sum / at_gnd_dl.packets : 0,
+	  at_gnd_dl.lat_max, dl_seq - at_gnd_dl.packets);
+  printf ("  uplink     %6u packets %8.1f B/s  latency avg %8.1f ms max "
+	  "%8.1f ms  lost %u\n", at_cdh.packets, at_cdh.bytes / seconds,
+	  at_cdh.packets ? at_cdh.lat_sum / at_cdh.packets : 0,
+	  at_cdh.lat_max, ul_seq - at_cdh.packets);
+  printf ("  ground ack %6u packets               latency avg %8.1f ms max "
+	  "%8.1f ms\n", at_gnd_echo.packets,
+	  at_gnd_echo.packets ? at_gnd_echo.lat_sum / at_gnd_echo.packets : 0,
+	  at_gnd_echo.lat_max);
+  if (relay != RELAY_OLD) {
+    printf ("  dropped %u, resyncs %u, telemetry frame %zu bytes\n",
+	    comms_stats.now.link[COMMS_LINK_GND].drops,
+	    comms_stats.now.link[COMMS_LINK_GND].sync_losses
+		+ comms_stats.now.link[COMMS_LINK_CDH].sync_losses,
+	    comms_stats_encode (frame, (uint32_t) (now * BYTE_US / 1000)));
+    printf ("  downlink latency histogram:");
+    for (v = 0; v < COMMS_STATS_HIST_BUCKETS; v++) {
+      if (comms_stats.now.lat[COMMS_LAT_DOWNLINK][v]) {
+	printf (" <%ums %u", 1u << v,
+		comms_stats.now.lat[COMMS_LAT_DOWNLINK][v]);
+      }
+    }
+    printf ("\n");
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  double seconds = argc > 1 ? atof (argv[1]) : 60;
+
+  printf ("%.0f s at 115200 baud, line capacity %.0f B/s per direction\n",
+	  seconds, 1e6 / BYTE_US);
+  printf ("\nCDH streaming\n");
+  dl_period_ms = 0;
+  run (RELAY_OLD, seconds);
+  run (RELAY_BRIDGE, seconds);
+  run (RELAY_SCHED, seconds);
+  printf ("\nCDH sending every 5 s\n");
+  dl_period_ms = 5000;
+  run (RELAY_OLD, seconds);
+  run (RELAY_BRIDGE, seconds);
+  run (RELAY_SCHED, seconds);
+  return 0;
+}
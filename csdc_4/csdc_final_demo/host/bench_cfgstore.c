@@ -0,0 +1,282 @@
+/*
+ * bench_cfgstore.c
+ *	Description: Runs the comms configuration store on the file backed
+ *		     flash model.
+ *
+ *	1. Values survive closing and reopening the flash.
+ *	2. Wear: a long run of parameter changes, flushed in small batches,
+ *	   against rewriting a sector for every change.
+ *	3. Resets: the flash stops in the middle of random program and erase
+ *	   operations. After every reopen each key must hold either the value
+ *	   it had before the interrupted flush or the one being written.
+ *	4. Cached reads.
+ *
+ *	usage: bench_cfgstore [flash.img]
+ *	The image is recreated on every run.
+ */
+
+#include "bench.h"
+#include "cfgstore.h"
+#include "flash_file.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SECTOR_A 4
+#define SECTOR_B 7
+#define KEYS 8
+#define CHANGES 200000
+#define BATCH 4
+#define RESETS 2000
+#define READS 10000000
+
+/* A flash that loses power after a budget of programmed bytes */
+typedef struct
+{
+  flash_dev_t dev;
+  flash_file_t *file;
+  long budget;			/* bytes left, negative for no limit */
+  uint8_t dead;
+} cut_t;
+
+static int32_t
+cut_read (const flash_dev_t *dev, uint32_t addr, uint8_t *buf, size_t len)
+{
+  cut_t *c = dev->priv;
+
+  return c->file->dev.read (&c->file->dev, addr, buf, len);
+}
+
+static int32_t
+cut_program (const flash_dev_t *dev, uint32_t addr, const uint8_t *buf,
+	     size_t len)
+{
+  cut_t *c = dev->priv;
+  size_t n = len;
+
+  if (c->dead) {
+    return -1;
+  }
+  if (c->budget >= 0 && (size_t) c->budget < len) {
+    n = (size_t) c->budget;
+    c->dead = 1;
+  }
+  if (n && c->file->dev.program (&c->file->dev, addr, buf, n)) {
+    return -1;
+  }
+  if (c->budget >= 0) {
+    c->budget -= n;
+  }
+  return c->dead ? -1 : 0;
+}
+
+static int32_t
+cut_erase_sector (const flash_dev_t *dev, uint8_t sector)
+{
+  cut_t *c = dev->priv;
+  uint8_t ff[256];
+  uint32_t addr;
+  uint32_t end = flash_sectors[sector].addr + flash_sectors[sector].len;
+
+  if (c->dead) {
+    return -1;
+  }
+  /* An erase counts as 1 KB. Cut short, only its second half is erased. */
+  if (c->budget >= 0 && c->budget < 1024) {
+    c->dead = 1;
+    memset (ff, 0xFF, sizeof(ff));
+    for (addr = end - flash_sectors[sector].len / 2; addr < end;
+	addr += sizeof(ff)) {
+      memcpy (c->file->mem + (addr - FLASH_DEV_BASE), ff, sizeof(ff));
+    }
+    return -1;
+  }
+  if (c->budget >= 0) {
+    c->budget -= 1024;
+  }
+  return c->file->dev.erase_sector (&c->file->dev, sector);
+}
+
+static void
+cut_init (cut_t *c, flash_file_t *f, long budget)
+{
+  c->dev.read = cut_read;
+  c->dev.program = cut_program;
+  c->dev.erase_sector = cut_erase_sector;
+  c->dev.priv = c;
+  c->file = f;
+  c->budget = budget;
+  c->dead = 0;
+}
+
+static int
+persist (flash_file_t *f, const char *path)
+{
+  static cfgstore_t s;
+  uint32_t v;
+  uint32_t got = 0;
+  uint8_t k;
+
+  if (cfgstore_init (&s, &f->dev, SECTOR_A, SECTOR_B)) {
+    return 1;
+  }
+  for (k = 0; k < KEYS; k++) {
+    v = 0x1000 + k;
+    cfgstore_set (&s, k, &v, sizeof(v), 0);
+  }
+  if (cfgstore_flush (&s)) {
+    return 1;
+  }
+  flash_file_close (f);
+  if (flash_file_open (f, path)
+      || cfgstore_init (&s, &f->dev, SECTOR_A, SECTOR_B)) {
+    return 1;
+  }
+  for (k = 0; k < KEYS; k++) {
+    if (cfgstore_get (&s, k, &got, sizeof(got)) != sizeof(got)
+	|| got != 0x1000u + k) {
+      printf ("persistence FAIL\n");
+      return 1;
+    }
+  }
+  printf ("persistence: ok\n");
+  return 0;
+}
+
+static int
+wear (flash_file_t *f)
+{
+  static cfgstore_t s;
+  uint32_t erases = f->erases;
+  uint32_t programmed = f->programmed;
+  uint32_t v;
+  long i;
+
+  if (cfgstore_init (&s, &f->dev, SECTOR_A, SECTOR_B)) {
+    return 1;
+  }
+  srand (2);
+  for (i = 0; i < CHANGES; i++) {
+    v = (uint32_t) rand ();
+    cfgstore_set (&s, (uint8_t) (rand () % KEYS), &v, sizeof(v), 0);
+    if ((i + 1) % BATCH == 0 && cfgstore_flush (&s)) {
+      printf ("flush FAIL\n");
+      return 1;
+    }
+  }
+  erases = f->erases - erases;
+  printf ("wear: %d changes in batches of %d\n", CHANGES, BATCH);
+  printf ("  %u flushes, %u compactions, %u sector erases, %.1f KB "
+	  "programmed\n", s.flushes, s.compactions, erases,
+	  (f->programmed - programmed) / 1024.0);
+  printf ("  %.0f changes per erase, against 1 rewriting in place\n",
+	  erases ? (double) CHANGES / erases : 0.0);
+  /* 10k cycles per sector, spread over two sectors */
+  printf ("  at one change a minute, 10k erase cycles last %.0f years\n",
+	  erases ? 2 * 10000.0 * CHANGES / erases / (60 * 24 * 365) : 0.0);
+  return 0;
+}
+
+static int
+resets (flash_file_t *f)
+{
+  static cfgstore_t s;
+  cut_t cut;
+  uint32_t committed[KEYS];
+  uint32_t pending[KEYS];
+  uint32_t got;
+  uint32_t v;
+  uint32_t torn = 0;
+  uint8_t k;
+  int r;
+
+  cut_init (&cut, f, -1);
+  if (cfgstore_init (&s, &cut.dev, SECTOR_A, SECTOR_B)) {
+    return 1;
+  }
+  for (k = 0; k < KEYS; k++) {
+    cfgstore_get (&s, k, &committed[k], sizeof(got));
+  }
+  srand (3);
+  for (r = 0; r < RESETS; r++) {
+    cut_init (&cut, f, rand () % (64 * 1024));
+    if (cfgstore_init (&s, &cut.dev, SECTOR_A, SECTOR_B)) {
+      printf ("reset %d: init FAIL\n", r);
+      return 1;
+    }
+    torn += s.torn;
+    memcpy (pending, committed, sizeof(pending));
+    while (!cut.dead) {
+      v = (uint32_t) rand ();
+      k = (uint8_t) (rand () % KEYS);
+      cfgstore_set (&s, k, &v, sizeof(v), 0);
+      pending[k] = v;
+      if (rand () % BATCH == 0) {
+	if (cfgstore_flush (&s) == 0) {
+	  memcpy (committed, pending, sizeof(committed));
+	}
+      }
+    }
+    /* The reset */
+    cut_init (&cut, f, -1);
+    if (cfgstore_init (&s, &cut.dev, SECTOR_A, SECTOR_B)) {
+      printf ("reset %d: reopen FAIL\n", r);
+      return 1;
+    }
+    for (k = 0; k < KEYS; k++) {
+      if (cfgstore_get (&s, k, &got, sizeof(got)) != sizeof(got)
+	  || (got != committed[k] && got != pending[k])) {
+	printf ("reset %d: key %u lost FAIL\n", r, k);
+	return 1;
+      }
+      committed[k] = got;
+    }
+  }
+  printf ("resets: %d, %u torn records skipped, ok\n", RESETS, torn);
+  return 0;
+}
+
+static int
+reads (flash_file_t *f)
+{
+  static cfgstore_t s;
+  bench_timer_t t;
+  uint32_t v;
+  uint32_t sum = 0;
+  long i;
+
+  if (cfgstore_init (&s, &f->dev, SECTOR_A, SECTOR_B)) {
+    return 1;
+  }
+  bench_start (&t);
+  for (i = 0; i < READS; i++) {
+    cfgstore_get (&s, (uint8_t) (i % KEYS), &v, sizeof(v));
+    sum += v;
+  }
+  /* Per byte reads as per get */
+  bench_stop (&t, "cached reads, per get", READS);
+  return sum == 0x12345678;
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *path = argc > 1 ? argv[1] : "cfgstore.img";
+  flash_file_t f;
+  int err = 0;
+
+  unlink (path);
+  if (flash_file_open (&f, path)) {
+    perror (path);
+    return 1;
+  }
+  printf ("banks: sector %d (%u KB), sector %d (%u KB), %zu B records\n",
+	  SECTOR_A, flash_sectors[SECTOR_A].len / 1024, SECTOR_B,
+	  flash_sectors[SECTOR_B].len / 1024, sizeof(cfgstore_rec_t));
+  err |= persist (&f, path);
+  err |= wear (&f);
+  err |= resets (&f);
+  err |= reads (&f);
+  flash_file_close (&f);
+  return err;
+}
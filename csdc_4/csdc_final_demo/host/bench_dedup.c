@@ -0,0 +1,212 @@
+/*
+ * bench_dedup.c
+ *	Description: Runs the uplink duplicate cache of the bridge (dedup.c)
+ *		     behind a ground station that repeats every command until
+ *		     it sees the echo, over a link losing packets both ways.
+ *		     Counts how often the CDH would execute each command with
+ *		     and without the cache, then times the check.
+ *
+ *	Every OPERATOR_REPEAT-th command is the one before it sent again on
+ *	purpose, a new packet with the same bytes: the cache must let it
+ *	through, it only tells copies apart by their sequence byte.
+ *
+ *	Then the ground is ground_station/uplink.py, UPLINK_WINDOW packets
+ *	out at once back to back on the line, each sent again after
+ *	UPLINK_TIMEOUT_MS, or at once when the echo of one sent after it
+ *	arrives, up to UPLINK_TRIES times: the cache has to keep a packet
+ *	while the others go on around it.
+ *
+ *	usage: bench_dedup [commands]
+ */
+
+#include "bench.h"
+#include "dedup.h"
+#include <stdlib.h>
+
+#define CMD_LEN 12
+#define CMD_PERIOD_MS 2000
+#define RETRY_MS 1500
+#define TRIES 4
+#define OPERATOR_REPEAT 5
+#define UPLINK_WINDOW 4		/* WINDOW, TIMEOUT_S and RETRIES + 1 of uplink.py */
+#define UPLINK_TIMEOUT_MS 2000
+#define UPLINK_TRIES 6
+#define PKT_MS 5		/* line time of a packet */
+#define CHECKS 10000000
+
+static double
+uniform (void)
+{
+  return rand () / (RAND_MAX + 1.0);
+}
+
+/* Command \p seq of the ground: head, code, then arguments */
+static void
+make_cmd (uint8_t *out, uint32_t seq)
+{
+  size_t i;
+
+  out[0] = 0x60 | (seq % 5) << 1;
+  out[1] = (uint8_t) (seq % 7);
+  for (i = 2; i < CMD_LEN; i++) {
+    out[i] = (uint8_t) (seq * 31 + i);
+  }
+}
+
+static void
+run (long cmds, double loss)
+{
+  static dedup_t d;
+  uint8_t cmd[CMD_LEN];
+  uint32_t now;
+  long plain = 0;
+  long cached = 0;
+  long missed = 0;
+  long extra = 0;
+  long i;
+  int t;
+  int got;
+
+  dedup_init (&d);
+  srand (1);
+  for (i = 0; i < cmds; i++) {
+    make_cmd (cmd, (uint32_t) (i % OPERATOR_REPEAT ? i : i - 1));
+    now = (uint32_t) i * CMD_PERIOD_MS;
+    got = 0;
+    for (t = 0; t < TRIES; t++, now += RETRY_MS) {
+      if (uniform () < loss) {
+	continue;
+      }
+      plain++;
+      if (!dedup_check (&d, (uint8_t) i, cmd, sizeof(cmd), now)) {
+	cached++;
+	got++;
+      }
+      /* Stop once the echo makes it down */
+      if (uniform () >= loss) {
+	break;
+      }
+    }
+    missed += !got;
+    extra += got > 1;
+  }
+  printf ("loss %4.0f %%: CDH executions per command %.3f without the "
+	  "cache, %.3f with it (%ld lost, %ld run twice)\n", loss * 100,
+	  (double) plain / cmds, (double) cached / cmds, missed, extra);
+}
+
+typedef struct
+{
+  long id;
+  int tries;
+  int got;
+  uint32_t next_ms;
+} slot_t;
+
+static void
+run_window (long cmds, double loss)
+{
+  static dedup_t d;
+  slot_t slot[UPLINK_WINDOW];
+  slot_t *s;
+  uint8_t cmd[CMD_LEN];
+  uint32_t now = 0;
+  long started = 0;
+  long done = 0;
+  long plain = 0;
+  long cached = 0;
+  long missed = 0;
+  long extra = 0;
+  int k;
+
+  dedup_init (&d);
+  srand (2);
+  for (k = 0; k < UPLINK_WINDOW; k++) {
+    slot[k].id = -1;
+  }
+  while (done < cmds) {
+    /* The next send, the earliest due, the oldest packet of those; a free
+       slot takes a new packet */
+    s = NULL;
+    for (k = 0; k < UPLINK_WINDOW; k++) {
+      if (slot[k].id < 0 && started < cmds) {
+	slot[k].id = started++;
+	slot[k].tries = 0;
+	slot[k].got = 0;
+	slot[k].next_ms = now;
+      }
+      if (slot[k].id >= 0 && (!s || slot[k].next_ms < s->next_ms
+			       || (slot[k].next_ms == s->next_ms
+				   && slot[k].id < s->id))) {
+	s = &slot[k];
+      }
+    }
+    now = s->next_ms > now + PKT_MS ? s->next_ms : now + PKT_MS;
+    make_cmd (cmd, (uint32_t) (s->id % OPERATOR_REPEAT ? s->id : s->id - 1));
+    s->tries++;
+    if (uniform () >= loss) {
+      plain++;
+      if (!dedup_check (&d, (uint8_t) s->id, cmd, sizeof(cmd), now)) {
+	cached++;
+	s->got++;
+      }
+      if (uniform () >= loss) {
+	s->tries = UPLINK_TRIES;	/* echoed */
+	/* The ones sent before it were lost on the way up */
+	for (k = 0; k < UPLINK_WINDOW; k++) {
+	  if (slot[k].id >= 0 && &slot[k] != s) {
+	    slot[k].next_ms = now;
+	  }
+	}
+      }
+    }
+    s->next_ms = now + UPLINK_TIMEOUT_MS;
+    if (s->tries == UPLINK_TRIES) {
+      missed += !s->got;
+      extra += s->got > 1;
+      s->id = -1;
+      done++;
+    }
+  }
+  printf ("window %d, loss %4.0f %%: CDH executions per command %.3f "
+	  "without the cache, %.3f with it (%ld lost, %ld run twice)\n",
+	  UPLINK_WINDOW, loss * 100, (double) plain / cmds,
+	  (double) cached / cmds, missed, extra);
+}
+
+int
+main (int argc, char **argv)
+{
+  static const double loss[] = { 0.0, 0.05, 0.2, 0.4 };
+  static dedup_t d;
+  uint8_t cmd[CMD_LEN];
+  bench_timer_t t;
+  long cmds = argc > 1 ? atol (argv[1]) : 100000;
+  uint32_t dups = 0;
+  long i;
+  size_t l;
+
+  printf ("%ld commands, %d ms apart, retried every %d ms up to %d "
+	  "times\n", cmds, CMD_PERIOD_MS, RETRY_MS, TRIES);
+  for (l = 0; l < sizeof(loss) / sizeof(loss[0]); l++) {
+    run (cmds, loss[l]);
+  }
+  for (l = 0; l < sizeof(loss) / sizeof(loss[0]); l++) {
+    run_window (cmds, loss[l]);
+  }
+
+  /* Per byte reads as per packet */
+  dedup_init (&d);
+  bench_start (&t);
+  for (i = 0; i < CHECKS; i++) {
+    make_cmd (cmd, (uint32_t) i >> 1);
+    dups += dedup_check (&d, (uint8_t) (i >> 1), cmd, sizeof(cmd),
+			 (uint32_t) i);
+  }
+  bench_stop (&t, "dedup_check, per packet", CHECKS);
+  if (dups != CHECKS / 2) {
+    printf ("check FAIL, %u duplicates\n", dups);
+    return 1;
+  }
+  return 0;
+}
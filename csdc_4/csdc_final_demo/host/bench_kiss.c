@@ -0,0 +1,321 @@
+/*
+ * bench_kiss.c
+ *	Description: Host benchmark of the KISS framing of the ground port.
+ *		     The scan and copy escaping and unescaping of kiss.c are
+ *		     checked against a byte by byte reference and timed
+ *		     against it, then the adapter is run over a loopback
+ *		     port as a ground TNC client would use it.
+ *
+ *	usage: bench_kiss [file ...]
+ *	Without arguments random data and the ground station sample data are
+ *	used.
+ */
+
+#include "bench.h"
+#include "kiss.h"
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define RUNS 256
+#define RANDOM_LEN 65536
+
+/* The escaping of a classic TNC: one branch per byte */
+static size_t
+ref_escape (uint8_t *out, const uint8_t *in, size_t len)
+{
+  size_t o = 0;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    switch (in[i]) {
+      case KISS_FEND:
+	out[o++] = KISS_FESC;
+	out[o++] = KISS_TFEND;
+	break;
+      case KISS_FESC:
+	out[o++] = KISS_FESC;
+	out[o++] = KISS_TFESC;
+	break;
+      default:
+	out[o++] = in[i];
+	break;
+    }
+  }
+  return o;
+}
+
+static size_t
+ref_unescape (uint8_t *out, const uint8_t *in, size_t len)
+{
+  size_t o = 0;
+  size_t i;
+  uint8_t esc = 0;
+
+  for (i = 0; i < len; i++) {
+    if (esc) {
+      out[o++] = in[i] == KISS_TFEND ? KISS_FEND
+	  : in[i] == KISS_TFESC ? KISS_FESC : in[i];
+      esc = 0;
+    }
+    else if (in[i] == KISS_FESC) {
+      esc = 1;
+    }
+    else {
+      out[o++] = in[i];
+    }
+  }
+  return o;
+}
+
+/* Cuts \p in into KISS_MAX_FRAME_LEN frames */
+static size_t
+kiss_frames (uint8_t *wire, const uint8_t *in, size_t len)
+{
+  size_t o = 0;
+  size_t off;
+  size_t n;
+
+  for (off = 0; off < len; off += n) {
+    n = len - off < KISS_MAX_FRAME_LEN ? len - off : KISS_MAX_FRAME_LEN;
+    wire[o++] = KISS_FEND;
+    o += kiss_escape (wire + o, in + off, n);
+    wire[o++] = KISS_FEND;
+  }
+  return o;
+}
+
+/* Takes the frames apart with kiss_decode(), \p chunk bytes at a time */
+static size_t
+kiss_unframe (uint8_t *out, const uint8_t *wire, size_t len, size_t chunk)
+{
+  static kiss_dec_t d;
+  size_t o = 0;
+  size_t off = 0;
+  size_t piece;
+  size_t used;
+  int32_t n;
+
+  kiss_dec_init (&d);
+  while (off < len) {
+    piece = len - off < chunk ? len - off : chunk;
+    n = kiss_decode (&d, wire + off, piece, &used);
+    off += used;
+    if (n < 0) {
+      return 0;
+    }
+    if (n > 0) {
+      memcpy (out + o, d.buf, n);
+      o += n;
+    }
+  }
+  return o;
+}
+
+static int
+run (const char *name, const uint8_t *in, size_t len)
+{
+  uint8_t *a = malloc (KISS_MAX_ENCODED_LEN(len) * 2);
+  uint8_t *b = malloc (KISS_MAX_ENCODED_LEN(len) * 2);
+  uint8_t *framed = malloc (KISS_MAX_ENCODED_LEN(len) * 2);
+  uint8_t *back = malloc (len + KISS_MAX_FRAME_LEN);
+  size_t la, lb, wire;
+  bench_timer_t t;
+  int r;
+  int err = 0;
+
+  if (!a || !b || !framed || !back) {
+    return 1;
+  }
+  la = ref_escape (a, in, len);
+  lb = kiss_escape (b, in, len);
+  if (la != lb || memcmp (a, b, la)
+      || ref_unescape (back, b, lb) != len || memcmp (back, in, len)) {
+    printf ("%s: escape FAIL\n", name);
+    err = 1;
+  }
+  wire = kiss_frames (framed, in, len);
+  if (kiss_unframe (back, framed, wire, 1) != len || memcmp (back, in, len)
+      || kiss_unframe (back, framed, wire, 61) != len
+      || memcmp (back, in, len)) {
+    printf ("%s: decode FAIL\n", name);
+    err = 1;
+  }
+  printf ("%s: %zu bytes, %zu escaped\n", name, len, lb);
+
+  bench_start (&t);
+  for (r = 0; r < RUNS; r++) {
+    ref_escape (a, in, len);
+  }
+  bench_stop (&t, "  escape, byte loop", (uint64_t) RUNS * len);
+  bench_start (&t);
+  for (r = 0; r < RUNS; r++) {
+    kiss_escape (b, in, len);
+  }
+  bench_stop (&t, "  escape, scan and copy", (uint64_t) RUNS * len);
+  bench_start (&t);
+  for (r = 0; r < RUNS; r++) {
+    ref_unescape (back, b, lb);
+  }
+  bench_stop (&t, "  unescape, byte loop", (uint64_t) RUNS * len);
+  bench_start (&t);
+  for (r = 0; r < RUNS; r++) {
+    kiss_unframe (back, framed, wire, 512);
+  }
+  bench_stop (&t, "  decode, scan and copy", (uint64_t) RUNS * len);
+
+  free (a);
+  free (b);
+  free (framed);
+  free (back);
+  return err;
+}
+
+/* A byte pipe standing in for USART2 */
+static uint8_t pipe_mem[4096];
+static size_t pipe_len;
+static size_t pipe_off;
+
+static size_t
+pipe_read (void *priv, uint8_t *buf, size_t len)
+{
+  (void) priv;
+  if (len > pipe_len - pipe_off) {
+    len = pipe_len - pipe_off;
+  }
+  memcpy (buf, pipe_mem + pipe_off, len);
+  pipe_off += len;
+  return len;
+}
+
+static int32_t
+pipe_write (void *priv, const uint8_t *data, size_t len)
+{
+  (void) priv;
+  if (len > sizeof(pipe_mem) - pipe_len) {
+    return -1;
+  }
+  memcpy (pipe_mem + pipe_len, data, len);
+  pipe_len += len;
+  return 0;
+}
+
+/* What a ground client sends: a UI frame to the satellite */
+static void
+ground_send (const char *dest, const uint8_t *info, size_t len)
+{
+  uint8_t frame[KISS_MAX_FRAME_LEN];
+  uint8_t wire[KISS_MAX_ENCODED_LEN(KISS_MAX_FRAME_LEN)];
+  size_t n = 0;
+  size_t o = 0;
+
+  frame[n++] = KISS_CMD_DATA;
+  n += ax25_create_addr_field (frame + n, (const uint8_t *) dest, 0,
+			       (const uint8_t *) "GND", 0);
+  frame[n++] = 0x03;
+  frame[n++] = 0xF0;
+  memcpy (frame + n, info, len);
+  n += len;
+  wire[o++] = KISS_FEND;
+  o += kiss_escape (wire + o, frame, n);
+  wire[o++] = KISS_FEND;
+  pipe_write (NULL, wire, o);
+}
+
+static int
+adapter (void)
+{
+  static kiss_t k;
+  const bridge_port_t port = { pipe_read, pipe_write, NULL };
+  static const uint8_t cmd[] = { 0x68, 0x01, KISS_FEND, KISS_FESC, 0x55 };
+  static const uint8_t junk[] = { 0x12, 0x34, KISS_FEND, 0x01, 0x20,
+      KISS_FEND };
+  uint8_t rec[1 + sizeof(cmd)];
+  uint8_t got[64];
+  kiss_dec_t d;
+  size_t n, used;
+  int32_t len;
+  int err = 0;
+
+  kiss_init (&k, &port);
+  /* Noise, a TXDELAY command, a frame for someone else, then ours */
+  pipe_write (NULL, junk, sizeof(junk));
+  ground_send ("OTHER", cmd, sizeof(cmd));
+  ground_send (__UPSAT_CALLSIGN, cmd, sizeof(cmd));
+  n = kiss_read (&k, got, sizeof(got));
+  if (n != 1 + sizeof(cmd) || got[0] != sizeof(cmd)
+      || memcmp (got + 1, cmd, sizeof(cmd)) || k.other_cmds != 1
+      || k.bad_frames != 1) {
+    printf ("adapter uplink FAIL\n");
+    err = 1;
+  }
+
+  /* The bridge echoes the packet, which goes out as a UI frame */
+  pipe_len = pipe_off = 0;
+  rec[0] = sizeof(cmd);
+  memcpy (rec + 1, cmd, sizeof(cmd));
+  kiss_write (&k, rec, sizeof(rec));
+  kiss_dec_init (&d);
+  len = kiss_decode (&d, pipe_mem, pipe_len, &used);
+  if (len != 1 + AX25_MIN_ADDR_LEN + 2 + (int32_t) sizeof(cmd)
+      || !ax25_check_dest_callsign (d.buf + 1, len - 1,
+				    __UPSAT_DEST_CALLSIGN)
+      || memcmp (d.buf + 1 + AX25_MIN_ADDR_LEN + 2, cmd, sizeof(cmd))) {
+    printf ("adapter downlink FAIL\n");
+    err = 1;
+  }
+  printf ("adapter: %s\n", err ? "FAIL" : "ok");
+  return err;
+}
+
+static int
+run_file (const char *path)
+{
+  FILE *f = fopen (path, "rb");
+  uint8_t *in;
+  long len;
+  int err;
+
+  if (!f) {
+    perror (path);
+    return 1;
+  }
+  fseek (f, 0, SEEK_END);
+  len = ftell (f);
+  fseek (f, 0, SEEK_SET);
+  in = malloc (len + 1);
+  if (!in || fread (in, 1, len, f) != (size_t) len) {
+    fclose (f);
+    return 1;
+  }
+  fclose (f);
+  err = run (path, in, len);
+  free (in);
+  return err;
+}
+
+int
+main (int argc, char **argv)
+{
+  static uint8_t in[RANDOM_LEN];
+  size_t i;
+  int err = 0;
+
+  err |= adapter ();
+  if (argc > 1) {
+    for (i = 1; i < (size_t) argc; i++) {
+      err |= run_file (argv[i]);
+    }
+    return err;
+  }
+
+  srand (1);
+  for (i = 0; i < sizeof(in); i++) {
+    in[i] = rand ();
+  }
+  err |= run ("random", in, sizeof(in));
+  err |= run_file ("../ground_station/rom.txt");
+  memset (in, KISS_FEND, sizeof(in));
+  err |= run ("all FEND", in, sizeof(in));
+  return err;
+}
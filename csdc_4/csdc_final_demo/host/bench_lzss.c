@@ -0,0 +1,151 @@
+/*
+ * bench_lzss.c
+ *	Description: Host benchmark of the comms LZSS compressor. Each file is
+ *		     compressed and decompressed in the small pieces the
+ *		     downlink pipeline uses, the round trip is checked, and
+ *		     the compression ratio and throughput are reported.
+ *
+ *	usage: bench_lzss [file ...]
+ *	Without arguments the ground station sample data is used.
+ */
+
+#include "bench.h"
+#include "lzss.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* The same sizes as send_mem() in the comms firmware */
+#define SRC_CHUNK 128
+#define PKT_LEN 256
+#define RUNS 64
+
+static lzss_enc_t enc;
+static lzss_dec_t dec;
+
+static size_t
+compress (const uint8_t *in, size_t len, uint8_t *out)
+{
+  size_t n = 0;
+  size_t off = 0;
+  size_t got;
+  lzss_status_t st;
+
+  lzss_enc_init (&enc);
+  for (;;) {
+    st = lzss_enc_poll (&enc, out + n, PKT_LEN, &got);
+    n += got;
+    if (st == LZSS_DONE || st == LZSS_ERROR) {
+      break;
+    }
+    if (st == LZSS_MORE_INPUT) {
+      if (off == len) {
+	lzss_enc_finish (&enc);
+      }
+      else {
+	off += lzss_enc_sink (&enc, in + off,
+			      len - off < SRC_CHUNK ? len - off : SRC_CHUNK);
+      }
+    }
+  }
+  return n;
+}
+
+static size_t
+decompress (const uint8_t *in, size_t len, uint8_t *out, size_t cap)
+{
+  size_t n = 0;
+  size_t off = 0;
+  size_t got;
+  size_t used;
+  size_t piece;
+  lzss_status_t st;
+
+  lzss_dec_init (&dec);
+  while (off < len) {
+    piece = len - off < PKT_LEN ? len - off : PKT_LEN;
+    st = lzss_decode (&dec, out + n, cap - n, &got, in + off, piece, &used);
+    n += got;
+    off += used;
+    if (st == LZSS_ERROR || (st == LZSS_OK && n == cap && used < piece)) {
+      break;
+    }
+  }
+  return n;
+}
+
+static int
+run (const char *path)
+{
+  FILE *f = fopen (path, "rb");
+  uint8_t *in, *comp, *back;
+  size_t len, clen, dlen;
+  bench_timer_t t;
+  char name[256];
+  int r;
+
+  if (!f) {
+    perror (path);
+    return 1;
+  }
+  fseek (f, 0, SEEK_END);
+  len = (size_t) ftell (f);
+  fseek (f, 0, SEEK_SET);
+  in = malloc (len + 1);
+  comp = malloc (LZSS_MAX_OUTPUT(len) + PKT_LEN);
+  back = malloc (len + 1);
+  if (!in || !comp || !back || fread (in, 1, len, f) != len) {
+    fclose (f);
+    return 1;
+  }
+  fclose (f);
+
+  clen = compress (in, len, comp);
+  dlen = decompress (comp, clen, back, len + 1);
+  if (dlen != len || memcmp (in, back, len) != 0) {
+    printf ("%s: round trip FAIL\n", path);
+    return 1;
+  }
+  printf ("%s: %zu -> %zu bytes, ratio %.3f\n", path, len, clen,
+	  len ? (double) clen / len : 0.0);
+
+  snprintf (name, sizeof(name), "  compress");
+  bench_start (&t);
+  for (r = 0; r < RUNS; r++) {
+    compress (in, len, comp);
+  }
+  bench_stop (&t, name, (uint64_t) RUNS * len);
+
+  snprintf (name, sizeof(name), "  decompress");
+  bench_start (&t);
+  for (r = 0; r < RUNS; r++) {
+    decompress (comp, clen, back, len + 1);
+  }
+  bench_stop (&t, name, (uint64_t) RUNS * len);
+
+  free (in);
+  free (comp);
+  free (back);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  static const char *defaults[] = { "../ground_station/rom.txt",
+      "../ground_station/serout.txt" };
+  int err = 0;
+  int i;
+
+  printf ("LZSS window %d, max match %d, encoder %zu B, decoder %zu B\n",
+	  LZSS_WINDOW_LEN, LZSS_MAX_MATCH, sizeof(lzss_enc_t),
+	  sizeof(lzss_dec_t));
+  if (argc < 2) {
+    for (i = 0; i < 2; i++) {
+      err |= run (defaults[i]);
+    }
+  }
+  for (i = 1; i < argc; i++) {
+    err |= run (argv[i]);
+  }
+  return err;
+}
@@ -0,0 +1,409 @@
+/*
+ * bench_memdl.c
+ *	Description: Downlink of the emulated memory (send_mem()) over a
+ *		     simulated 115200 baud line to the memory emulator, in
+ *		     virtual time.
+ *
+ *	The new downlink is the firmware memdl.c itself, with a 1024 byte
+ *	send queue and a 512 byte receive buffer like the DMA UART. Read
+ *	requests and downlink packets share the line to the PC, as they share
+ *	USART2 on the board: the tagged requests of memreq.c and the
+ *	DBG_MEMDL packets of send_mem() in the frames of dbg_frame.c, byte for
+ *	byte. The PC side reads the line with one frame decoder, as PC.py
+ *	does. The emulator answers every request in order once it has received
+ *	it and a turnaround time has passed (Python, the USB serial latency).
+ *
+ *	The old downlink is a model of the blocking send_mem(): request
+ *	128 bytes, wait for them, send the packet, HAL_Delay(100).
+ *
+ *	Every download is unpacked on the ground side and compared with the
+ *	memory. The last runs resume a download in the middle and restart the
+ *	emulator while requests are in flight, or damage an answer on the
+ *	line.
+ *
+ *	usage: bench_memdl [turnaround ms]
+ */
+
+#include "memdl.h"
+#include "memreq.h"
+#include "dbg_frame.h"
+#include "lzss.h"
+#include "ringbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* 10 bits per byte on the line */
+#define BYTE_US (10 * 1e6 / 115200)
+#define TICKS_TO_MS(t) ((uint32_t) ((t) * BYTE_US / 1000))
+#define MS_TO_TICKS(ms) ((uint64_t) ((ms) * 1000 / BYTE_US))
+
+#define MEM_SIZE 32000
+#define OLD_CHUNK_LEN 128
+#define OLD_DELAY_MS 100
+#define MAX_ANSWERS 64
+
+/* The answer to a request received by the emulator, framed */
+typedef struct
+{
+  uint8_t frame[DBG_FRAME_LEN(1 + MEMREQ_MAX_LEN)];
+  size_t len;
+  uint64_t ready;		/* tick the answer starts */
+} answer_t;
+
+static uint8_t mem[MEM_SIZE];
+static uint64_t now;
+
+/* comms -> PC */
+static ringbuf_t tx;
+static uint8_t tx_mem[1024];
+
+/* PC -> comms */
+static ringbuf_t rx;
+static uint8_t rx_mem[512];
+static uint64_t rx_lost;
+
+/* the emulator */
+static answer_t answers[MAX_ANSWERS];
+static size_t ans_head, ans_tail, ans_sent;
+static uint64_t turnaround;
+static uint64_t deaf_until;
+static uint64_t damage_at;
+static dbg_frame_rx_t pc_rx;
+static uint16_t pc_seq;
+
+/* the comms board */
+static memreq_t emu;
+static uint16_t seq;
+
+/* the ground side */
+static uint8_t *ground;
+static size_t ground_len;
+static uint32_t bad_counters;
+static uint8_t next_txcnt;
+
+/* A record of the debug channel, as dbg_write() queues it; memreq's port */
+static int32_t
+emu_send (void *priv, uint8_t type, const uint8_t *head, size_t head_len,
+	  const uint8_t *data, size_t len)
+{
+  (void) priv;
+  seq++;
+  if (ringbuf_room (&tx) < DBG_FRAME_LEN(head_len + len)) {
+    return -1;
+  }
+  ringbuf_commit (&tx, dbg_frame_put (&tx, type, seq, head, head_len, data,
+				      len));
+  return 0;
+}
+
+static size_t
+emu_read (void *priv, uint8_t *buf, size_t len)
+{
+  (void) priv;
+  return ringbuf_read (&rx, buf, len);
+}
+
+static int32_t
+port_request (void *priv, uint32_t addr, size_t len)
+{
+  return memreq_request ((memreq_t *) priv, addr, len);
+}
+
+static size_t
+port_read (void *priv, uint32_t addr, uint8_t *buf, size_t len)
+{
+  return memreq_read ((memreq_t *) priv, addr, buf, len);
+}
+
+/* mem_send() of main.c */
+static int32_t
+port_send (void *priv, const uint8_t *pkt, size_t len)
+{
+  if (len < 2 || ringbuf_room (&tx) < DBG_FRAME_LEN(len)) {
+    return -1;
+  }
+  return emu_send (priv, DBG_MEMDL, pkt, 2, pkt + 2, len - 2);
+}
+
+/* The answer of the emulator, as PC.py frames it */
+static void
+pc_answer (uint8_t tag, uint32_t addr, size_t len)
+{
+  static uint8_t ring_mem[2048];
+  uint8_t data[MEMREQ_MAX_LEN];
+  ringbuf_t ring;
+  answer_t *a;
+  size_t i;
+
+  if (ans_head - ans_tail == MAX_ANSWERS) {
+    return;
+  }
+  for (i = 0; i < len; i++) {
+    data[i] = addr + i < MEM_SIZE ? mem[addr + i] : 0;
+  }
+  ringbuf_init (&ring, ring_mem, sizeof(ring_mem));
+  a = &answers[ans_head++ % MAX_ANSWERS];
+  a->len = dbg_frame_put (&ring, DBG_MEM_DATA, ++pc_seq, &tag, 1, data, len);
+  ringbuf_commit (&ring, a->len);
+  ringbuf_read (&ring, a->frame, a->len);
+  a->ready = now + turnaround;
+}
+
+/* A whole record reached the PC: a downlink packet goes to the ground
+ * side (dbg_link.Downlink), a read request to the emulator */
+static void
+pc_receive (const dbg_frame_rx_t *r)
+{
+  const uint8_t *p = r->payload;
+
+  if (r->type == DBG_MEMDL && r->payload_len >= 2) {
+    if (p[0] != next_txcnt || p[1] != ((next_txcnt + 1) & 0x07)) {
+      bad_counters++;
+    }
+    next_txcnt = (p[0] + 1) & 0x07;
+    memcpy (ground + ground_len, p + 2, r->payload_len - 2);
+    ground_len += r->payload_len - 2;
+  }
+  else if (r->type == DBG_MEM_READ && r->payload_len == 5
+	   && now >= deaf_until) {
+    pc_answer (p[0], ((uint32_t) p[1] << 8) | p[2],
+	       ((size_t) p[3] << 8) | p[4]);
+  }
+}
+
+/* One byte time on both directions of the line */
+static void
+line_tick (void)
+{
+  uint8_t byte;
+  answer_t *a;
+
+  if (ringbuf_read (&tx, &byte, 1) && dbg_frame_feed (&pc_rx, byte)) {
+    pc_receive (&pc_rx);
+  }
+  if (ans_head != ans_tail) {
+    a = &answers[ans_tail % MAX_ANSWERS];
+    if (now >= a->ready) {
+      byte = a->frame[ans_sent];
+      /* One bit error in the middle of the frame */
+      if (damage_at && now >= damage_at && ans_sent == a->len / 2) {
+	byte ^= 0x10;
+	damage_at = 0;
+      }
+      if (!ringbuf_write (&rx, &byte, 1)) {
+	rx_lost++;
+      }
+      if (++ans_sent == a->len) {
+	ans_tail++;
+	ans_sent = 0;
+      }
+    }
+  }
+  now++;
+}
+
+static void
+sim_reset (void)
+{
+  ringbuf_init (&tx, tx_mem, sizeof(tx_mem));
+  ringbuf_init (&rx, rx_mem, sizeof(rx_mem));
+  ans_head = ans_tail = ans_sent = 0;
+  rx_lost = 0;
+  deaf_until = 0;
+  damage_at = 0;
+  dbg_frame_rx_init (&pc_rx);
+  ground_len = 0;
+  bad_counters = 0;
+  next_txcnt = 0;
+}
+
+/* Unpacks what reached the ground, returns 0 if it matches the memory */
+static int
+check (uint32_t start, int compressed)
+{
+  static uint8_t back[MEM_SIZE];
+  lzss_dec_t dec;
+  lzss_status_t st;
+  size_t off = 0, n = 0, got, used;
+  size_t want = MEM_SIZE - start;
+
+  if (!compressed) {
+    return ground_len != want || memcmp (ground, mem + start, want);
+  }
+  lzss_dec_init (&dec);
+  while (off < ground_len && n < want) {
+    st = lzss_decode (&dec, back + n, want - n, &got, ground + off,
+		      ground_len - off, &used);
+    n += got;
+    off += used;
+    if (st == LZSS_ERROR || (!got && !used)) {
+      break;
+    }
+  }
+  return n != want || memcmp (back, mem + start, want);
+}
+
+typedef struct
+{
+  uint32_t rate;
+  uint32_t packets;
+  uint32_t retries;
+  int ok;
+} result_t;
+
+/*
+ * Runs memdl from start to the end of the memory. restart_at_ms restarts
+ * the emulator at that time: it forgets the requests it has and ignores
+ * the line for 1.5 s. damage_at_ms flips a bit of the next answer sent
+ * from that time on.
+ */
+static result_t
+run_memdl (uint8_t depth, int compressed, uint32_t start,
+	   uint32_t restart_at_ms, uint32_t damage_at_ms)
+{
+  static lzss_enc_t enc;
+  const memreq_port_t emu_port = { emu_send, emu_read, NULL };
+  const memdl_port_t port = { port_request, port_read, port_send, &emu };
+  memdl_t m;
+  result_t res;
+
+  sim_reset ();
+  memreq_init (&emu, &emu_port);
+  seq = 0;
+  now = MS_TO_TICKS(1000);
+  if (damage_at_ms) {
+    damage_at = MS_TO_TICKS(damage_at_ms);
+  }
+  memdl_start (&m, &port, compressed ? &enc : NULL, depth, start, MEM_SIZE,
+	       TICKS_TO_MS(now));
+  while (m.state != MEMDL_DONE || ringbuf_used (&tx)) {
+    if (restart_at_ms && TICKS_TO_MS(now) == restart_at_ms && !deaf_until) {
+      ans_head = ans_tail;
+      ans_sent = 0;
+      deaf_until = now + MS_TO_TICKS(1500);
+    }
+    memdl_poll (&m, TICKS_TO_MS(now));
+    line_tick ();
+    if (now > MS_TO_TICKS(600 * 1000)) {
+      break;
+    }
+  }
+  res.rate = memdl_rate (&m, TICKS_TO_MS(now));
+  res.packets = m.packets;
+  res.retries = m.retries;
+  res.ok = m.state == MEMDL_DONE && !rx_lost && !bad_counters && !pc_rx.bad
+      && !check (start, compressed);
+  return res;
+}
+
+/* The old blocking loop, in closed form */
+static uint32_t
+run_old (int compressed)
+{
+  static lzss_enc_t enc;
+  static uint8_t comp[LZSS_MAX_OUTPUT(MEM_SIZE) + MEMDL_PAYLOAD_LEN];
+  size_t chunks = (MEM_SIZE + OLD_CHUNK_LEN - 1) / OLD_CHUNK_LEN;
+  size_t sent, clen = 0, n, off = 0;
+  uint32_t packets;
+  double us;
+  lzss_status_t st;
+
+  if (compressed) {
+    lzss_enc_init (&enc);
+    for (;;) {
+      st = lzss_enc_poll (&enc, comp + clen, MEMDL_PAYLOAD_LEN, &n);
+      clen += n;
+      if (st == LZSS_DONE || st == LZSS_ERROR) {
+	break;
+      }
+      if (st == LZSS_MORE_INPUT) {
+	if (off == MEM_SIZE) {
+	  lzss_enc_finish (&enc);
+	}
+	else {
+	  off += lzss_enc_sink (&enc, mem + off, MEM_SIZE - off);
+	}
+      }
+    }
+    sent = clen;
+  }
+  else {
+    sent = MEM_SIZE;
+  }
+  packets = compressed ? (clen + MEMDL_PAYLOAD_LEN - 1) / MEMDL_PAYLOAD_LEN
+      : chunks;
+  us = chunks * ((4 + OLD_CHUNK_LEN) * BYTE_US + turnaround * BYTE_US)
+      + packets * (2 * BYTE_US + OLD_DELAY_MS * 1000.0) + sent * BYTE_US;
+  return (uint32_t) (MEM_SIZE / (us / 1e6));
+}
+
+static int
+load (const char *path)
+{
+  FILE *f = fopen (path, "rb");
+  size_t n = 0;
+  size_t i;
+
+  if (f) {
+    n = fread (mem, 1, MEM_SIZE, f);
+    fclose (f);
+  }
+  /* Pad or replace with text like data */
+  for (i = n; i < MEM_SIZE; i++) {
+    mem[i] = "0123456789ABCDEF \n"[(i * 7 + i / 61) % 18];
+  }
+  return n == MEM_SIZE;
+}
+
+int
+main (int argc, char **argv)
+{
+  static const char *modes[] = { "raw", "lzss" };
+  uint32_t turnaround_ms = argc > 1 ? (uint32_t) atoi (argv[1]) : 10;
+  result_t r;
+  uint8_t depth;
+  int c;
+  int err = 0;
+
+  ground = malloc (2 * MEM_SIZE);
+  if (!ground) {
+    return 1;
+  }
+  printf ("memory: %s, %d bytes, emulator turnaround %u ms\n",
+	  load ("../ground_station/rom.txt") ? "rom.txt" : "synthetic",
+	  MEM_SIZE, turnaround_ms);
+  turnaround = MS_TO_TICKS(turnaround_ms);
+  printf ("line limit %u B/s\n\n", (uint32_t) (1e6 / BYTE_US));
+
+  for (c = 0; c < 2; c++) {
+    printf ("%s:\n", modes[c]);
+    printf ("  old blocking   %6u B/s\n", run_old (c));
+    for (depth = 1; depth <= MEMDL_DEPTH; depth++) {
+      r = run_memdl (depth, c, 0, 0, 0);
+      printf ("  memdl depth %u  %6u B/s  %4u packets  %s\n", depth, r.rate,
+	      r.packets, r.ok ? "ok" : "FAIL");
+      err |= !r.ok;
+    }
+  }
+
+  printf ("\nresume at 12345, emulator restart at 1.5 s:\n");
+  for (c = 0; c < 2; c++) {
+    r = run_memdl (MEMDL_DEPTH, c, 12345, 1500, 0);
+    printf ("  %-4s           %6u B/s  %4u packets  %u retries  %s\n",
+	    modes[c], r.rate, r.packets, r.retries,
+	    r.ok && r.retries ? "ok" : "FAIL");
+    err |= !r.ok || !r.retries;
+  }
+
+  printf ("\none answer damaged on the line at 2 s:\n");
+  for (c = 0; c < 2; c++) {
+    r = run_memdl (MEMDL_DEPTH, c, 0, 0, 2000);
+    printf ("  %-4s           %6u B/s  %4u packets  %u retries  %s\n",
+	    modes[c], r.rate, r.packets, r.retries,
+	    r.ok && r.retries ? "ok" : "FAIL");
+    err |= !r.ok || !r.retries;
+  }
+  free (ground);
+  return err;
+}
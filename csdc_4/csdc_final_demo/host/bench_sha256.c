@@ -0,0 +1,281 @@
+/*
+ * bench_sha256.c
+ *	Description: Host benchmark of the comms SHA-256 / HMAC-SHA-256.
+ *		     Checks the FIPS 180-4 and RFC 4231 vectors, streamed
+ *		     against one-shot digests and the command tags of
+ *		     cmd_auth.c first, then reports the cost per byte for bulk
+ *		     hashing and for the small pieces the UART delivers.
+ */
+
+#include "bench.h"
+#include "sha256.h"
+#include "cmd_auth.h"
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BULK_LEN (4 * 1024 * 1024)
+#define RUNS 16
+
+static int
+check (const char *name, const uint8_t *got, const char *hex)
+{
+  char buf[2 * SHA256_DIGEST_LEN + 1];
+  size_t i;
+
+  for (i = 0; i < SHA256_DIGEST_LEN; i++) {
+    sprintf (buf + 2 * i, "%02x", got[i]);
+  }
+  if (strcmp (buf, hex) != 0) {
+    printf ("%s: FAIL\n  got      %s\n  expected %s\n", name, buf, hex);
+    return 1;
+  }
+  return 0;
+}
+
+static int
+self_test (void)
+{
+  uint8_t d[SHA256_DIGEST_LEN];
+  uint8_t key[131];
+  hmac_sha256_key_t k;
+  hmac_sha256_ctx_t h;
+  int err = 0;
+
+  sha256 (d, (const uint8_t *) "abc", 3);
+  err |= check ("sha256(abc)", d,
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+  sha256 (d, (const uint8_t *)
+	  "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56);
+  err |= check ("sha256(448 bits)", d,
+      "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+
+  /* RFC 4231 test case 2 */
+  hmac_sha256_set_key (&k, (const uint8_t *) "Jefe", 4);
+  hmac_sha256_init (&h, &k);
+  hmac_sha256_update (&h, (const uint8_t *) "what do ya want ", 16);
+  hmac_sha256_update (&h, (const uint8_t *) "for nothing?", 12);
+  hmac_sha256_final (&h, d);
+  err |= check ("hmac-sha256(rfc4231 #2)", d,
+      "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+  /* RFC 4231 test cases 6 and 7, keys longer than a block are hashed */
+  memset (key, 0xaa, 131);
+  hmac_sha256_set_key (&k, key, 131);
+  hmac_sha256_init (&h, &k);
+  hmac_sha256_update (&h, (const uint8_t *)
+      "Test Using Larger Than Block-Size Key - Hash Key First", 54);
+  hmac_sha256_final (&h, d);
+  err |= check ("hmac-sha256(rfc4231 #6)", d,
+      "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54");
+  hmac_sha256_init (&h, &k);
+  hmac_sha256_update (&h, (const uint8_t *)
+      "This is a test using a larger than block-size key and a larger than "
+      "block-size data. The key needs to be hashed before being used by the "
+      "HMAC algorithm.", 152);
+  hmac_sha256_final (&h, d);
+  err |= check ("hmac-sha256(rfc4231 #7)", d,
+      "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2");
+  return err;
+}
+
+/**
+ * HMAC-SHA-256 by its definition on one-shot digests
+ */
+static void
+hmac_ref (uint8_t *mac, const uint8_t *key, size_t key_len,
+	  const uint8_t *msg, size_t len)
+{
+  static uint8_t buf[SHA256_BLOCK_LEN + 4096];
+  uint8_t k[SHA256_BLOCK_LEN] = { 0 };
+  size_t i;
+
+  if (key_len > SHA256_BLOCK_LEN) {
+    sha256 (k, key, key_len);
+  }
+  else {
+    memcpy (k, key, key_len);
+  }
+  for (i = 0; i < SHA256_BLOCK_LEN; i++) {
+    buf[i] = k[i] ^ 0x36;
+  }
+  memcpy (buf + SHA256_BLOCK_LEN, msg, len);
+  sha256 (mac, buf, SHA256_BLOCK_LEN + len);
+  for (i = 0; i < SHA256_BLOCK_LEN; i++) {
+    buf[i] = k[i] ^ 0x5c;
+  }
+  memcpy (buf + SHA256_BLOCK_LEN, mac, SHA256_DIGEST_LEN);
+  sha256 (mac, buf, SHA256_BLOCK_LEN + SHA256_DIGEST_LEN);
+}
+
+/**
+ * Digests and MACs fed in random pieces against the one-shot ones, over
+ * every length across a few blocks and keys around the block size
+ */
+static int
+stream_test (void)
+{
+  static const size_t key_lens[] = { 1, 32, 63, 64, 65, 131, 200 };
+  uint8_t msg[300], key[200];
+  uint8_t d1[SHA256_DIGEST_LEN], d2[SHA256_DIGEST_LEN];
+  hmac_sha256_key_t k;
+  hmac_sha256_ctx_t h;
+  sha256_ctx_t ctx;
+  size_t len, i, n, kl;
+  int err = 0;
+
+  srand (1);
+  for (i = 0; i < sizeof(msg); i++) {
+    msg[i] = (uint8_t) rand ();
+  }
+  for (i = 0; i < sizeof(key); i++) {
+    key[i] = (uint8_t) rand ();
+  }
+  for (len = 0; len <= sizeof(msg); len++) {
+    sha256 (d1, msg, len);
+    sha256_init (&ctx);
+    for (i = 0; i < len; i += n) {
+      n = 1 + rand () % 70;
+      n = n > len - i ? len - i : n;
+      sha256_update (&ctx, msg + i, n);
+    }
+    sha256_final (&ctx, d2);
+    err |= memcmp (d1, d2, SHA256_DIGEST_LEN) != 0;
+
+    kl = key_lens[len % (sizeof(key_lens) / sizeof(key_lens[0]))];
+    hmac_ref (d1, key, kl, msg, len);
+    hmac_sha256_set_key (&k, key, kl);
+    hmac_sha256_init (&h, &k);
+    for (i = 0; i < len; i += n) {
+      n = 1 + rand () % 70;
+      n = n > len - i ? len - i : n;
+      hmac_sha256_update (&h, msg + i, n);
+    }
+    hmac_sha256_final (&h, d2);
+    err |= memcmp (d1, d2, SHA256_DIGEST_LEN) != 0;
+  }
+  printf ("streamed against one-shot, 0 to %u bytes: %s\n",
+	  (unsigned) sizeof(msg), err ? "FAIL" : "OK");
+  return err;
+}
+
+static router_pkt_t
+parse (const uint8_t *buf, size_t len)
+{
+  router_pkt_t p;
+
+  p.addr = router_head_addr (buf[0]);
+  p.flag = router_head_flag (buf[0]);
+  p.len_cmd = buf[1];
+  p.data = buf + 2;
+  p.len = p.flag ? buf[1] : len - 2;
+  return p;
+}
+
+/**
+ * The command tags against uplink.py sign(), and damaged ones
+ */
+static int
+auth_test (void)
+{
+  /* SET_PROFILE 1 and a data packet, from python uplink.py sign */
+  static const uint8_t cmd[] = { 0x68, 0x01, 0x01, 0xc7, 0xac, 0xe1, 0x1a,
+      0x27, 0xa6, 0xd9, 0xe9 };
+  static const uint8_t data[] = { 0x69, 0x0c, 0x01, 0x02, 0x03, 0xff, 0x92,
+      0xc6, 0x7a, 0xe4, 0x22, 0x53, 0x97, 0xef };
+  uint8_t buf[3 + SHA256_DIGEST_LEN], key[100], mac[SHA256_DIGEST_LEN];
+  router_pkt_t p;
+  size_t i;
+  int err = 0;
+
+  /* No key, no command */
+  p = parse (cmd, sizeof(cmd));
+  err |= cmd_auth_verify (&p, 8) != 0 || cmd_auth_init (NULL, 0) != -1;
+  cmd_auth_init (__COMMS_CMD_KEY, sizeof(__COMMS_CMD_KEY));
+  err |= cmd_auth_verify (&p, 8) != 1;
+  p = parse (data, sizeof(data));
+  err |= cmd_auth_verify (&p, 8) != 1;
+  /* Any bit flipped, header included, and too short a tag fail */
+  for (i = 0; i < 8 * sizeof(data); i++) {
+    memcpy (buf, data, sizeof(data));
+    buf[i / 8] ^= 1 << (i % 8);
+    p = parse (buf, sizeof(data));
+    err |= p.len <= sizeof(data) - 2 && router_head_valid (buf[0])
+	&& cmd_auth_verify (&p, 8) != 0;
+  }
+  p = parse (cmd, sizeof(cmd) - 1);
+  err |= cmd_auth_verify (&p, 7) != 0;
+
+  /* A key longer than a block */
+  for (i = 0; i < sizeof(key); i++) {
+    key[i] = (uint8_t) (i * 7);
+  }
+  cmd_auth_init (key, sizeof(key));
+  memcpy (buf, cmd, 3);
+  hmac_ref (mac, key, sizeof(key), buf, 3);
+  memcpy (buf + 3, mac, 16);
+  p = parse (buf, 19);
+  err |= cmd_auth_verify (&p, 16) != 1 || cmd_auth_verify (&p, 8) != 0;
+  printf ("command tags: %s\n", err ? "FAIL" : "OK");
+  return err;
+}
+
+int
+main (void)
+{
+  uint8_t *buf = malloc (BULK_LEN);
+  uint8_t d[SHA256_DIGEST_LEN];
+  hmac_sha256_key_t k;
+  hmac_sha256_ctx_t h;
+  sha256_ctx_t ctx;
+  bench_timer_t t;
+  size_t i;
+  int r;
+
+  if (!buf || self_test () | stream_test () | auth_test ()) {
+    return 1;
+  }
+  for (i = 0; i < BULK_LEN; i++) {
+    buf[i] = (uint8_t) (i * 31 + 7);
+  }
+
+  bench_start (&t);
+  for (r = 0; r < RUNS; r++) {
+    sha256 (d, buf, BULK_LEN);
+  }
+  bench_stop (&t, "sha256 bulk", (uint64_t) RUNS * BULK_LEN);
+
+  /* Same data in 37 byte pieces, as it arrives from the UART */
+  bench_start (&t);
+  for (r = 0; r < RUNS; r++) {
+    sha256_init (&ctx);
+    for (i = 0; i + 37 <= BULK_LEN; i += 37) {
+      sha256_update (&ctx, buf + i, 37);
+    }
+    sha256_update (&ctx, buf + i, BULK_LEN - i);
+    sha256_final (&ctx, d);
+  }
+  bench_stop (&t, "sha256 streamed (37 B)", (uint64_t) RUNS * BULK_LEN);
+
+  hmac_sha256_set_key (&k, buf, 32);
+  bench_start (&t);
+  for (r = 0; r < RUNS; r++) {
+    hmac_sha256_init (&h, &k);
+    hmac_sha256_update (&h, buf, BULK_LEN);
+    hmac_sha256_final (&h, d);
+  }
+  bench_stop (&t, "hmac-sha256 bulk", (uint64_t) RUNS * BULK_LEN);
+
+  /* Short commands: the fixed cost dominates */
+  bench_start (&t);
+  for (r = 0; r < 1000000; r++) {
+    hmac_sha256_init (&h, &k);
+    hmac_sha256_update (&h, buf + (r & 1023), 32);
+    hmac_sha256_final (&h, d);
+  }
+  bench_stop (&t, "hmac-sha256 32 B commands", 32ULL * 1000000);
+
+  free (buf);
+  return 0;
+}
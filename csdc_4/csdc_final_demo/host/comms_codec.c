@@ -0,0 +1,138 @@
+/*
+ * comms_codec.c
+ *	Description: Host entry points of the comms AX.25 / G3RUH codec.
+ *		     Sizes are checked here because the firmware functions
+ *		     trust their callers.
+ */
+
+#include "comms_codec.h"
+
+/**
+ * @return the size of a codec_rx_t, so the binding can allocate one
+ */
+size_t
+codec_rx_size (void)
+{
+  return sizeof(codec_rx_t);
+}
+
+/**
+ * Prepares a receiver for a new stream
+ * @param rx the receiver
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+codec_rx_init (codec_rx_t *rx)
+{
+  if (!rx) {
+    return -1;
+  }
+  rx->frames = 0;
+  rx->crc_errors = 0;
+  return ax25_rx_init (&rx->h);
+}
+
+/**
+ * Runs received (scrambled, NRZI) bytes through the decoder until the next
+ * frame. The firmware decoder stops in the middle of its input when a
+ * frame completes, so the stream is fed one byte at a time.
+ * @param rx the receiver
+ * @param in the received bytes
+ * @param len the number of received bytes
+ * @param consumed the number of bytes used from \p in
+ * @param out a buffer of at least AX25_MAX_FRAME_LEN bytes for the frame,
+ * address field included and FCS removed
+ * @return the frame length, 0 if \p in ran out first, or a negative number
+ * in case of error
+ */
+int32_t
+codec_rx_feed (codec_rx_t *rx, const uint8_t *in, size_t len,
+	       size_t *consumed, uint8_t *out)
+{
+  size_t frame_len;
+  size_t i;
+  int32_t ret;
+
+  if (!rx || (!in && len) || !consumed || !out) {
+    return -1;
+  }
+  for (i = 0; i < len; i++) {
+    ret = ax25_recv_nrzi (&rx->h, rx->frame, &frame_len, in + i, 1);
+    if (ret == AX25_DEC_OK) {
+      if (frame_len > AX25_MAX_FRAME_LEN) {
+	continue;
+      }
+      memcpy (out, rx->frame, frame_len);
+      rx->frames++;
+      *consumed = i + 1;
+      return (int32_t) frame_len;
+    }
+    if (ret == AX25_DEC_CRC_FAIL) {
+      rx->crc_errors++;
+    }
+  }
+  *consumed = len;
+  return 0;
+}
+
+/**
+ * Encodes a payload into the over the air bit stream, exactly as
+ * ax25_send() does on the satellite
+ * @param out the output buffer
+ * @param out_cap the size of \p out, at least AX25_MAX_ENCODED_LEN
+ * @param in the payload
+ * @param len the payload size, up to AX25_MAX_FRAME_LEN
+ * @param is_wod 1 to use the WOD destination SSID
+ * @return the encoded length or -1 in case of error
+ */
+int32_t
+codec_encode (uint8_t *out, size_t out_cap, const uint8_t *in, size_t len,
+	      uint8_t is_wod)
+{
+  if (!out || (!in && len) || out_cap < AX25_MAX_ENCODED_LEN
+      || len > AX25_MAX_FRAME_LEN) {
+    return -1;
+  }
+  return ax25_send (out, in, len, is_wod);
+}
+
+/**
+ * Extracts the payload of a frame returned by codec_rx_feed()
+ * @param out a buffer of at least \p frame_len bytes
+ * @param frame the frame
+ * @param frame_len the frame length
+ * @return the payload size or a negative number in case of error
+ */
+int32_t
+codec_payload (uint8_t *out, const uint8_t *frame, size_t frame_len)
+{
+  return ax25_extract_payload (out, frame, frame_len, AX25_MIN_ADDR_LEN,
+			       AX25_MIN_CTRL_LEN);
+}
+
+/**
+ * G3RUH scrambling with NRZI, from a fresh scrambler state
+ */
+int32_t
+codec_scramble (uint8_t *out, const uint8_t *in, size_t len)
+{
+  scrambler_handle_t h;
+
+  scrambler_init (&h, __SCRAMBLER_POLY, __SCRAMBLER_SEED, __SCRAMBLER_ORDER);
+  scrambler_reset (&h);
+  return scramble_data_nrzi (&h, out, in, len);
+}
+
+/**
+ * G3RUH descrambling with NRZI, from a fresh descrambler state
+ */
+int32_t
+codec_descramble (uint8_t *out, const uint8_t *in, size_t len)
+{
+  scrambler_handle_t h;
+
+  descrambler_init (&h, __SCRAMBLER_POLY, __SCRAMBLER_SEED,
+		    __SCRAMBLER_ORDER);
+  descrambler_reset (&h);
+  return descramble_data_nrzi (&h, out, in, len);
+}
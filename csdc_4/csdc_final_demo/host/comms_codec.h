@@ -0,0 +1,49 @@
+/*
+ * comms_codec.h
+ *	Description: Host entry points of the comms AX.25 / G3RUH codec,
+ *		     built as libcomms_codec.so for the ground station
+ *		     (ground_station/comms_codec.py). The codec itself is the
+ *		     firmware source, compiled unchanged.
+ */
+
+#ifndef COMMS_CODEC_H_
+#define COMMS_CODEC_H_
+
+#include "ax25.h"
+
+/**
+ * Receiver for a captured stream: the AX.25 decoder and the frame it is
+ * filling in
+ */
+typedef struct
+{
+  ax25_handle_t h;
+  uint8_t frame[AX25_MAX_FRAME_LEN + 2];
+  uint32_t frames;
+  uint32_t crc_errors;
+} codec_rx_t;
+
+size_t
+codec_rx_size (void);
+
+int32_t
+codec_rx_init (codec_rx_t *rx);
+
+int32_t
+codec_rx_feed (codec_rx_t *rx, const uint8_t *in, size_t len,
+	       size_t *consumed, uint8_t *out);
+
+int32_t
+codec_encode (uint8_t *out, size_t out_cap, const uint8_t *in, size_t len,
+	      uint8_t is_wod);
+
+int32_t
+codec_payload (uint8_t *out, const uint8_t *frame, size_t frame_len);
+
+int32_t
+codec_scramble (uint8_t *out, const uint8_t *in, size_t len);
+
+int32_t
+codec_descramble (uint8_t *out, const uint8_t *in, size_t len);
+
+#endif /* COMMS_CODEC_H_ */
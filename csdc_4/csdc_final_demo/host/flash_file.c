@@ -0,0 +1,108 @@
+/*
+ * flash_file.c
+ *	Description: File backed model of the STM32F401RE internal flash.
+ *		     The file is mapped, so the flash contents survive between
+ *		     runs like the real thing does across resets.
+ */
+
+#include "flash_file.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int32_t
+flash_file_read (const flash_dev_t *dev, uint32_t addr, uint8_t *buf,
+		 size_t len)
+{
+  const flash_file_t *f = dev->priv;
+
+  if (addr < FLASH_DEV_BASE || addr - FLASH_DEV_BASE + len > FLASH_DEV_LEN) {
+    return -1;
+  }
+  memcpy (buf, f->mem + (addr - FLASH_DEV_BASE), len);
+  return 0;
+}
+
+static int32_t
+flash_file_program (const flash_dev_t *dev, uint32_t addr, const uint8_t *buf,
+		    size_t len)
+{
+  flash_file_t *f = dev->priv;
+  uint8_t *p;
+  size_t i;
+
+  if (addr < FLASH_DEV_BASE || addr - FLASH_DEV_BASE + len > FLASH_DEV_LEN) {
+    return -1;
+  }
+  p = f->mem + (addr - FLASH_DEV_BASE);
+  for (i = 0; i < len; i++) {
+    if ((p[i] & buf[i]) != buf[i]) {
+      return -1;
+    }
+    p[i] = buf[i];
+  }
+  f->programmed += len;
+  return 0;
+}
+
+static int32_t
+flash_file_erase_sector (const flash_dev_t *dev, uint8_t sector)
+{
+  flash_file_t *f = dev->priv;
+
+  if (sector >= FLASH_DEV_SECTORS) {
+    return -1;
+  }
+  memset (f->mem + (flash_sectors[sector].addr - FLASH_DEV_BASE), 0xFF,
+	  flash_sectors[sector].len);
+  f->erases++;
+  return 0;
+}
+
+/**
+ * Opens a flash model. A new file starts fully erased.
+ * @param f the model
+ * @param path the backing file
+ * @return 0 on success or a negative number in case of error
+ */
+int32_t
+flash_file_open (flash_file_t *f, const char *path)
+{
+  struct stat st;
+  int fresh;
+
+  memset (f, 0, sizeof(flash_file_t));
+  f->fd = open (path, O_RDWR | O_CREAT, 0644);
+  if (f->fd < 0 || fstat (f->fd, &st)) {
+    return -1;
+  }
+  fresh = st.st_size == 0;
+  if (st.st_size != FLASH_DEV_LEN && ftruncate (f->fd, FLASH_DEV_LEN)) {
+    close (f->fd);
+    return -1;
+  }
+  f->mem = mmap (NULL, FLASH_DEV_LEN, PROT_READ | PROT_WRITE, MAP_SHARED,
+		 f->fd, 0);
+  if (f->mem == MAP_FAILED) {
+    close (f->fd);
+    return -1;
+  }
+  if (fresh) {
+    memset (f->mem, 0xFF, FLASH_DEV_LEN);
+  }
+  f->dev.read = flash_file_read;
+  f->dev.program = flash_file_program;
+  f->dev.erase_sector = flash_file_erase_sector;
+  f->dev.priv = f;
+  return 0;
+}
+
+void
+flash_file_close (flash_file_t *f)
+{
+  msync (f->mem, FLASH_DEV_LEN, MS_SYNC);
+  munmap (f->mem, FLASH_DEV_LEN);
+  close (f->fd);
+}
@@ -0,0 +1,30 @@
+/*
+ * flash_file.h
+ *	Description: File backed model of the STM32F401RE internal flash, a
+ *		     flash_dev_t for running the firmware update and the
+ *		     configuration store on the host. Enforces the NOR rules:
+ *		     programming a 0 bit back to 1 fails.
+ */
+
+#ifndef FLASH_FILE_H_
+#define FLASH_FILE_H_
+
+#include "flash_dev.h"
+
+typedef struct
+{
+  flash_dev_t dev;
+  uint8_t *mem;
+  int fd;
+  /* Counters for the benchmarks */
+  uint32_t erases;
+  uint32_t programmed;
+} flash_file_t;
+
+int32_t
+flash_file_open (flash_file_t *f, const char *path);
+
+void
+flash_file_close (flash_file_t *f);
+
+#endif /* FLASH_FILE_H_ */
@@ -0,0 +1,304 @@
+/*
+ * fwdiff.c
+ *	Description: Makes binary delta patches for the firmware update
+ *		     (fwpatch.h). The matching follows bsdiff: exact matches
+ *		     between the images are extended into approximate ones,
+ *		     so code that only moved, or whose addresses shifted,
+ *		     becomes runs of small differences that compress well.
+ *		     Matches are found through hash chains over the old image
+ *		     instead of a suffix array.
+ *
+ *	usage: fwdiff old.bin new.bin patch.bin
+ */
+
+#include "fwpatch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define HASH_BITS 16
+#define HASH_MIN 4
+#define MAX_CHAIN 64
+
+typedef struct
+{
+  uint8_t *buf;
+  size_t len;
+  size_t cap;
+} bytes_t;
+
+static const uint8_t *old_img;
+static size_t old_len;
+static int32_t *head;
+static int32_t *prev;
+
+static void
+put (bytes_t *b, const void *data, size_t len)
+{
+  if (b->len + len > b->cap) {
+    b->cap = (b->len + len) * 2;
+    b->buf = realloc (b->buf, b->cap);
+    if (!b->buf) {
+      perror ("realloc");
+      exit (1);
+    }
+  }
+  memcpy (b->buf + b->len, data, len);
+  b->len += len;
+}
+
+static void
+put_le32 (bytes_t *b, uint32_t v)
+{
+  uint8_t le[4] =
+    { (uint8_t) v, (uint8_t) (v >> 8), (uint8_t) (v >> 16), (uint8_t) (v
+	>> 24) };
+  put (b, le, 4);
+}
+
+static inline uint32_t
+hash4 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, 4);
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void
+index_old (void)
+{
+  size_t i;
+  uint32_t k;
+
+  head = malloc (sizeof(int32_t) << HASH_BITS);
+  prev = malloc (sizeof(int32_t) * (old_len + 1));
+  memset (head, 0xFF, sizeof(int32_t) << HASH_BITS);
+  for (i = 0; i + HASH_MIN <= old_len; i++) {
+    k = hash4 (old_img + i);
+    prev[i] = head[k];
+    head[k] = (int32_t) i;
+  }
+}
+
+/**
+ * Finds the longest exact match of \p p in the old image
+ */
+static size_t
+search (const uint8_t *p, size_t len, size_t *pos)
+{
+  int32_t cand;
+  size_t best = 0;
+  size_t n;
+  size_t max;
+  int chain = MAX_CHAIN;
+
+  if (len < HASH_MIN) {
+    return 0;
+  }
+  for (cand = head[hash4 (p)]; cand >= 0 && chain--; cand = prev[cand]) {
+    max = old_len - cand < len ? old_len - cand : len;
+    if (max <= best || old_img[cand + best] != p[best]) {
+      continue;
+    }
+    for (n = 0; n < max && old_img[cand + n] == p[n]; n++)
+      ;
+    if (n > best) {
+      best = n;
+      *pos = cand;
+    }
+  }
+  return best;
+}
+
+/**
+ * The bsdiff pass: splits the new image into records of approximate
+ * matches (diff) and unmatched bytes (extra)
+ */
+static void
+diff (const uint8_t *new_img, size_t new_len, bytes_t *body)
+{
+  ssize_t scan = 0, len = 0, pos = 0;
+  ssize_t lastscan = 0, lastpos = 0, lastoffset = 0;
+  ssize_t oldscore, scsc;
+  ssize_t s, sf, lenf, sb, lenb, overlap, ss, lens, i;
+  ssize_t nlen = (ssize_t) new_len, olen = (ssize_t) old_len;
+  int32_t seek = 0;
+  size_t p = 0;
+
+  while (scan < nlen) {
+    oldscore = 0;
+    for (scsc = scan += len; scan < nlen; scan++) {
+      len = (ssize_t) search (new_img + scan, new_len - scan, &p);
+      if (len) {
+	pos = (ssize_t) p;
+      }
+      for (; scsc < scan + len; scsc++) {
+	if (scsc + lastoffset < olen
+	    && old_img[scsc + lastoffset] == new_img[scsc]) {
+	  oldscore++;
+	}
+      }
+      if ((len == oldscore && len != 0) || len > oldscore + 8) {
+	break;
+      }
+      if (scan + lastoffset < olen
+	  && old_img[scan + lastoffset] == new_img[scan]) {
+	oldscore--;
+      }
+    }
+
+    if (len == oldscore && scan != nlen) {
+      continue;
+    }
+
+    /* Extend the last match forward and the new one backward while at
+     * least half of the bytes agree */
+    s = 0, sf = 0, lenf = 0;
+    for (i = 0; lastscan + i < scan && lastpos + i < olen;) {
+      if (old_img[lastpos + i] == new_img[lastscan + i]) {
+	s++;
+      }
+      i++;
+      if (s * 2 - i > sf * 2 - lenf) {
+	sf = s;
+	lenf = i;
+      }
+    }
+    lenb = 0;
+    if (scan < nlen) {
+      s = 0, sb = 0;
+      for (i = 1; scan >= lastscan + i && pos >= i; i++) {
+	if (old_img[pos - i] == new_img[scan - i]) {
+	  s++;
+	}
+	if (s * 2 - i > sb * 2 - lenb) {
+	  sb = s;
+	  lenb = i;
+	}
+      }
+    }
+    if (lastscan + lenf > scan - lenb) {
+      overlap = (lastscan + lenf) - (scan - lenb);
+      s = 0, ss = 0, lens = 0;
+      for (i = 0; i < overlap; i++) {
+	if (new_img[lastscan + lenf - overlap + i]
+	    == old_img[lastpos + lenf - overlap + i]) {
+	  s++;
+	}
+	if (new_img[scan - lenb + i] == old_img[pos - lenb + i]) {
+	  s--;
+	}
+	if (s > ss) {
+	  ss = s;
+	  lens = i + 1;
+	}
+      }
+      lenf += lens - overlap;
+      lenb -= lens;
+    }
+
+    /* fwpatch records seek before the diff, bsdiff after it */
+    put_le32 (body, (uint32_t) seek);
+    put_le32 (body, (uint32_t) lenf);
+    put_le32 (body, (uint32_t) ((scan - lenb) - (lastscan + lenf)));
+    for (i = 0; i < lenf; i++) {
+      uint8_t d = new_img[lastscan + i] - old_img[lastpos + i];
+      put (body, &d, 1);
+    }
+    put (body, new_img + lastscan + lenf, (scan - lenb) - (lastscan + lenf));
+    seek = (int32_t) ((pos - lenb) - (lastpos + lenf));
+
+    lastscan = scan - lenb;
+    lastpos = pos - lenb;
+    lastoffset = pos - scan;
+  }
+}
+
+static void
+compress (const bytes_t *body, bytes_t *out)
+{
+  static lzss_enc_t enc;
+  uint8_t buf[256];
+  size_t off = 0;
+  size_t n;
+  lzss_status_t st;
+
+  lzss_enc_init (&enc);
+  do {
+    st = lzss_enc_poll (&enc, buf, sizeof(buf), &n);
+    put (out, buf, n);
+    if (st == LZSS_MORE_INPUT) {
+      if (off == body->len) {
+	lzss_enc_finish (&enc);
+      }
+      else {
+	off += lzss_enc_sink (&enc, body->buf + off, body->len - off);
+      }
+    }
+  }
+  while (st != LZSS_DONE && st != LZSS_ERROR);
+}
+
+static uint8_t *
+load (const char *path, size_t *len)
+{
+  FILE *f = fopen (path, "rb");
+  uint8_t *buf;
+
+  if (!f) {
+    perror (path);
+    exit (1);
+  }
+  fseek (f, 0, SEEK_END);
+  *len = (size_t) ftell (f);
+  fseek (f, 0, SEEK_SET);
+  buf = malloc (*len + 1);
+  if (!buf || fread (buf, 1, *len, f) != *len) {
+    perror (path);
+    exit (1);
+  }
+  fclose (f);
+  return buf;
+}
+
+int
+main (int argc, char **argv)
+{
+  uint8_t digest[SHA256_DIGEST_LEN];
+  bytes_t body = { 0 };
+  bytes_t out = { 0 };
+  uint8_t *new_img;
+  size_t new_len;
+  FILE *f;
+
+  if (argc != 4) {
+    fprintf (stderr, "usage: fwdiff old.bin new.bin patch.bin\n");
+    return 1;
+  }
+  old_img = load (argv[1], &old_len);
+  new_img = load (argv[2], &new_len);
+
+  put (&out, FWPATCH_MAGIC, 4);
+  put_le32 (&out, (uint32_t) old_len);
+  put_le32 (&out, (uint32_t) new_len);
+  sha256 (digest, old_img, old_len);
+  put (&out, digest, SHA256_DIGEST_LEN);
+  sha256 (digest, new_img, new_len);
+  put (&out, digest, SHA256_DIGEST_LEN);
+
+  index_old ();
+  diff (new_img, new_len, &body);
+  compress (&body, &out);
+
+  f = fopen (argv[3], "wb");
+  if (!f || fwrite (out.buf, 1, out.len, f) != out.len) {
+    perror (argv[3]);
+    return 1;
+  }
+  fclose (f);
+  printf ("old %zu B, new %zu B, records %zu B, patch %zu B (%.1f%%)\n",
+	  old_len, new_len, body.len, out.len,
+	  new_len ? 100.0 * out.len / new_len : 0.0);
+  return 0;
+}
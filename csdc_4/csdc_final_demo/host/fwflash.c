@@ -0,0 +1,191 @@
+/*
+ * fwflash.c
+ *	Description: Runs the comms firmware update on the file backed flash
+ *		     model, the same code path the satellite uses, with the
+ *		     patch cut into uplink sized packets.
+ *
+ *	usage: fwflash flash.img install ADDR image.bin
+ *	       fwflash flash.img update RUN_ADDR patch.bin [packet_len [copies]]
+ *	       fwflash flash.img boot
+ *	       fwflash flash.img confirm RUN_ADDR
+ *	       fwflash flash.img dump ADDR LEN out.bin
+ *
+ *	install writes an image straight to a slot (or the factory area) and
+ *	records it as confirmed. boot runs the boot selector and prints the
+ *	address it would jump to; every boot of an unconfirmed image uses up
+ *	one of its tries. update sends every packet copies times, as the
+ *	ground does when it misses the replies.
+ */
+
+#include "flash_file.h"
+#include "fwupdate.h"
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint8_t *
+load (const char *path, size_t *len)
+{
+  FILE *f = fopen (path, "rb");
+  uint8_t *buf;
+
+  if (!f) {
+    perror (path);
+    exit (1);
+  }
+  fseek (f, 0, SEEK_END);
+  *len = (size_t) ftell (f);
+  fseek (f, 0, SEEK_SET);
+  buf = malloc (*len + 1);
+  if (!buf || fread (buf, 1, *len, f) != *len) {
+    perror (path);
+    exit (1);
+  }
+  fclose (f);
+  return buf;
+}
+
+static int
+install (const flash_dev_t *dev, uint32_t addr, const char *path)
+{
+  uint8_t digest[SHA256_DIGEST_LEN];
+  uint32_t cap = addr == FW_FACTORY_ADDR ? FW_FACTORY_LEN : FW_SLOT_LEN;
+  size_t len;
+  uint8_t *img = load (path, &len);
+
+  if (len > cap || flash_dev_erase (dev, addr, len)
+      || flash_dev_program (dev, addr, img, len)) {
+    fprintf (stderr, "install failed\n");
+    return 1;
+  }
+  if (addr != FW_FACTORY_ADDR) {
+    sha256 (digest, img, len);
+    if (fwboot_append (dev, addr, (uint32_t) len, digest, 1)) {
+      fprintf (stderr, "boot record failed\n");
+      return 1;
+    }
+  }
+  printf ("installed %zu B at 0x%08x\n", len, addr);
+  return 0;
+}
+
+/**
+ * Hands a packet to the update session \p copies times
+ * @return 0 if every copy was taken, as fwupdate_uplink() otherwise
+ */
+static int32_t
+send (fwupdate_t *u, const flash_dev_t *dev, uint32_t run_addr,
+      const uint8_t *pkt, size_t len, size_t copies)
+{
+  int32_t ret = 0;
+
+  while (copies-- && !ret) {
+    ret = fwupdate_uplink (u, dev, run_addr, pkt, len);
+  }
+  return ret;
+}
+
+static int
+update (const flash_dev_t *dev, uint32_t run_addr, const char *path,
+	size_t pkt_len, size_t copies)
+{
+  static fwupdate_t u;
+  uint8_t pkt[5 + 1024];
+  uint8_t cmd;
+  size_t len;
+  size_t off;
+  size_t n;
+  uint8_t *patch = load (path, &len);
+  bench_timer_t t;
+
+  if (pkt_len == 0 || pkt_len > 1024) {
+    pkt_len = 200;
+  }
+  if (copies == 0) {
+    copies = 1;
+  }
+  bench_start (&t);
+  cmd = FWUPDATE_CMD_BEGIN;
+  if (send (&u, dev, run_addr, &cmd, 1, copies)) {
+    fprintf (stderr, "begin failed\n");
+    return 1;
+  }
+  for (off = 0; off < len; off += n) {
+    n = len - off < pkt_len ? len - off : pkt_len;
+    pkt[0] = FWUPDATE_CMD_DATA;
+    pkt[1] = (uint8_t) off;
+    pkt[2] = (uint8_t) (off >> 8);
+    pkt[3] = (uint8_t) (off >> 16);
+    pkt[4] = (uint8_t) (off >> 24);
+    memcpy (pkt + 5, patch + off, n);
+    if (send (&u, dev, run_addr, pkt, n + 5, copies)) {
+      fprintf (stderr, "patch rejected at offset %zu\n", off);
+      return 1;
+    }
+  }
+  cmd = FWUPDATE_CMD_FINISH;
+  if (send (&u, dev, run_addr, &cmd, 1, copies)) {
+    fprintf (stderr, "verification failed\n");
+    return 1;
+  }
+  cmd = FWUPDATE_CMD_ACTIVATE;
+  if (send (&u, dev, run_addr, &cmd, 1, copies)) {
+    fprintf (stderr, "activation failed\n");
+    return 1;
+  }
+  bench_stop (&t, "apply", u.patch.new_len);
+  printf ("new image %u B at 0x%08x from a %zu B patch in %zu packets\n",
+	  u.patch.new_len, u.slot_addr, len, (len + pkt_len - 1) / pkt_len);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  flash_file_t f;
+  const flash_dev_t *dev = &f.dev;
+  uint8_t *buf;
+  FILE *out;
+  uint32_t addr;
+  uint32_t len;
+  int ret = 1;
+
+  if (argc < 3 || flash_file_open (&f, argv[1])) {
+    fprintf (stderr, "usage: see fwflash.c\n");
+    return 1;
+  }
+  if (!strcmp (argv[2], "install") && argc == 5) {
+    ret = install (dev, strtoul (argv[3], NULL, 0), argv[4]);
+  }
+  else if (!strcmp (argv[2], "update") && argc >= 5) {
+    ret = update (dev, strtoul (argv[3], NULL, 0), argv[4],
+		  argc > 5 ? strtoul (argv[5], NULL, 0) : 0,
+		  argc > 6 ? strtoul (argv[6], NULL, 0) : 0);
+  }
+  else if (!strcmp (argv[2], "boot") && argc == 3) {
+    printf ("0x%08x\n", fwboot_select (dev));
+    ret = 0;
+  }
+  else if (!strcmp (argv[2], "confirm") && argc == 4) {
+    ret = fwupdate_confirm (dev, strtoul (argv[3], NULL, 0)) ? 1 : 0;
+  }
+  else if (!strcmp (argv[2], "dump") && argc == 6) {
+    addr = strtoul (argv[3], NULL, 0);
+    len = strtoul (argv[4], NULL, 0);
+    buf = malloc (len);
+    out = fopen (argv[5], "wb");
+    if (buf && out && !flash_dev_read (dev, addr, buf, len)
+	&& fwrite (buf, 1, len, out) == len) {
+      ret = 0;
+    }
+    if (out) {
+      fclose (out);
+    }
+  }
+  else {
+    fprintf (stderr, "usage: see fwflash.c\n");
+  }
+  flash_file_close (&f);
+  return ret;
+}
@@ -0,0 +1,182 @@
+/*
+ * hal_shim.c
+ *	Description: Host stand-in for the STM32 HAL and the internal flash,
+ *		     see hal_shim/stm32f4xx_hal.h.
+ */
+
+#include "stm32f4xx_hal.h"
+#include "flash_dev.h"
+#include <setjmp.h>
+#include <string.h>
+
+uint32_t hal_shim_ms;
+SCB_Type hal_shim_scb = { FLASH_DEV_BASE };
+GPIO_TypeDef hal_shim_gpioa;
+
+static jmp_buf stall;
+static uint8_t in_call;
+
+uint32_t
+HAL_GetTick (void)
+{
+  return hal_shim_ms;
+}
+
+void
+HAL_Delay (uint32_t ms)
+{
+  hal_shim_ms += ms;
+}
+
+void
+HAL_GPIO_WritePin (GPIO_TypeDef *port, uint16_t pin, uint8_t state)
+{
+  if (state) {
+    port->ODR |= pin;
+  }
+  else {
+    port->ODR &= ~(uint32_t) pin;
+  }
+}
+
+void
+HAL_GPIO_TogglePin (GPIO_TypeDef *port, uint16_t pin)
+{
+  port->ODR ^= pin;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Receive (UART_HandleTypeDef *huart, uint8_t *data, uint16_t size,
+		  uint32_t timeout)
+{
+  if (huart->rx_len - huart->rx_used < size) {
+    hal_shim_ms += timeout;
+    if (in_call) {
+      longjmp (stall, 1);
+    }
+    return HAL_TIMEOUT;
+  }
+  memcpy (data, huart->rx + huart->rx_used, size);
+  huart->rx_used += size;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Transmit (UART_HandleTypeDef *huart, uint8_t *data, uint16_t size,
+		   uint32_t timeout)
+{
+  size_t n = huart->tx_size - huart->tx_len;
+
+  (void) timeout;
+  if (n > size) {
+    n = size;
+  }
+  if (huart->tx) {
+    memcpy (huart->tx + huart->tx_len, data, n);
+  }
+  huart->tx_len += n;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef
+HAL_UART_Receive_IT (UART_HandleTypeDef *huart, uint8_t *data, uint16_t size)
+{
+  if (!size) {
+    return HAL_ERROR;
+  }
+  huart->it_buf = data;
+  huart->it_size = size;
+  huart->it_got = 0;
+  return HAL_OK;
+}
+
+int32_t
+hal_shim_uart_rx (UART_HandleTypeDef *huart, uint8_t b)
+{
+  uint8_t *buf = huart->it_buf;
+
+  if (!buf) {
+    return -1;
+  }
+  buf[huart->it_got++] = b;
+  if (huart->it_got == huart->it_size) {
+    /* The callback may start the next reception */
+    huart->it_buf = NULL;
+    HAL_UART_RxCpltCallback (huart);
+  }
+  return 0;
+}
+
+int32_t
+hal_shim_call (void (*fn) (void *arg), void *arg)
+{
+  if (setjmp (stall)) {
+    in_call = 0;
+    return -1;
+  }
+  in_call = 1;
+  fn (arg);
+  in_call = 0;
+  return 0;
+}
+
+/* --- The internal flash, erased at start ------------------------------ */
+
+static uint8_t flash_mem[FLASH_DEV_LEN];
+static uint8_t flash_erased;
+
+static int32_t
+flash_ram_check (uint32_t addr, size_t len)
+{
+  if (!flash_erased) {
+    memset (flash_mem, 0xFF, sizeof(flash_mem));
+    flash_erased = 1;
+  }
+  if (addr < FLASH_DEV_BASE || addr - FLASH_DEV_BASE + len > FLASH_DEV_LEN) {
+    return -1;
+  }
+  return 0;
+}
+
+static int32_t
+flash_ram_read (const flash_dev_t *dev, uint32_t addr, uint8_t *buf,
+		size_t len)
+{
+  (void) dev;
+  if (flash_ram_check (addr, len)) {
+    return -1;
+  }
+  memcpy (buf, flash_mem + addr - FLASH_DEV_BASE, len);
+  return 0;
+}
+
+static int32_t
+flash_ram_program (const flash_dev_t *dev, uint32_t addr, const uint8_t *buf,
+		   size_t len)
+{
+  size_t i;
+
+  (void) dev;
+  if (flash_ram_check (addr, len)) {
+    return -1;
+  }
+  for (i = 0; i < len; i++) {
+    flash_mem[addr - FLASH_DEV_BASE + i] &= buf[i];
+  }
+  return 0;
+}
+
+static int32_t
+flash_ram_erase (const flash_dev_t *dev, uint8_t sector)
+{
+  (void) dev;
+  if (sector >= FLASH_DEV_SECTORS || flash_ram_check (FLASH_DEV_BASE, 0)) {
+    return -1;
+  }
+  memset (flash_mem + flash_sectors[sector].addr - FLASH_DEV_BASE, 0xFF,
+	  flash_sectors[sector].len);
+  return 0;
+}
+
+const flash_dev_t flash_internal =
+  { flash_ram_read, flash_ram_program, flash_ram_erase, NULL };
@@ -0,0 +1,120 @@
+/*
+ * stm32f4xx_hal.h
+ *	Description: Host stand-in for the STM32 HAL, just enough of it for
+ *		     the firmware sources that the replay harness (replay.c)
+ *		     runs: virtual milliseconds and UARTs that read from
+ *		     memory. Implemented in hal_shim.c. The LED pin and
+ *		     __WFI() are there for the sources that are only
+ *		     compiled on the host (pymem_kiss.o in the Makefile).
+ *
+ *	HAL_UART_Receive() never waits. When fewer bytes are buffered than
+ *	asked for, the code on the board would block on the line, so the
+ *	call returns to the hal_shim_call() that ran the firmware code, which
+ *	then reports a stall. An interrupt reception (HAL_UART_Receive_IT())
+ *	is completed by the harness, byte by byte with hal_shim_uart_rx().
+ */
+
+#ifndef HAL_SHIM_STM32F4XX_HAL_H_
+#define HAL_SHIM_STM32F4XX_HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum
+{
+  HAL_OK = 0x00,
+  HAL_ERROR = 0x01,
+  HAL_BUSY = 0x02,
+  HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+typedef struct
+{
+  /* What the firmware reads, set by the harness */
+  const uint8_t *rx;
+  size_t rx_len;
+  size_t rx_used;
+  /* What the firmware sent */
+  uint8_t *tx;
+  size_t tx_size;
+  size_t tx_len;
+  /* The interrupt reception in progress */
+  uint8_t *it_buf;
+  uint16_t it_size;
+  uint16_t it_got;
+} UART_HandleTypeDef;
+
+typedef struct
+{
+  uint32_t ODR;
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef hal_shim_gpioa;
+#define GPIOA (&hal_shim_gpioa)
+#define GPIO_PIN_5 ((uint16_t) 0x0020)
+
+typedef struct
+{
+  uint32_t VTOR;
+} SCB_Type;
+
+extern SCB_Type hal_shim_scb;
+#define SCB (&hal_shim_scb)
+
+uint32_t
+HAL_GetTick (void);
+
+void
+HAL_Delay (uint32_t ms);
+
+void
+HAL_GPIO_WritePin (GPIO_TypeDef *port, uint16_t pin, uint8_t state);
+
+void
+HAL_GPIO_TogglePin (GPIO_TypeDef *port, uint16_t pin);
+
+/* Nothing to wait for on the host, one thread */
+#define __WFI() ((void) 0)
+#define __DMB() ((void) 0)
+
+HAL_StatusTypeDef
+HAL_UART_Receive (UART_HandleTypeDef *huart, uint8_t *data, uint16_t size,
+		  uint32_t timeout);
+
+HAL_StatusTypeDef
+HAL_UART_Transmit (UART_HandleTypeDef *huart, uint8_t *data, uint16_t size,
+		   uint32_t timeout);
+
+HAL_StatusTypeDef
+HAL_UART_Receive_IT (UART_HandleTypeDef *huart, uint8_t *data, uint16_t size);
+
+/* Defined by the firmware */
+void
+HAL_UART_RxCpltCallback (UART_HandleTypeDef *huart);
+
+void
+HAL_UART_ErrorCallback (UART_HandleTypeDef *huart);
+
+/* --- The harness side ------------------------------------------------- */
+
+/**
+ * The virtual time, in ms
+ */
+extern uint32_t hal_shim_ms;
+
+/**
+ * Runs \p fn on \p arg
+ * @return 0 if it returned, -1 if it stalled in HAL_UART_Receive()
+ */
+int32_t
+hal_shim_call (void (*fn) (void *arg), void *arg);
+
+/**
+ * A byte arrives on \p huart: completes its interrupt reception, if there
+ * is one, as the UART interrupt would
+ * @return 0 if the firmware was receiving, -1 if the byte was lost
+ */
+int32_t
+hal_shim_uart_rx (UART_HandleTypeDef *huart, uint8_t b);
+
+#endif /* HAL_SHIM_STM32F4XX_HAL_H_ */
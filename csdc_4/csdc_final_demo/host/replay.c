@@ -0,0 +1,730 @@
+/*
+ * replay.c
+ *	Description: Replays a captured ground pass through the firmware:
+ *		     the comms bridge as csdcdemo() sets it up (bridge.c,
+ *		     router.c, comms_cmd.c, tx_sched.c, dedup.c) and the
+ *		     packet parser of the CDH (cdh_firmware comms.c), on
+ *		     simulated 115200 baud lines in virtual time, with the HAL
+ *		     replaced by hal_shim.c.
+ *
+ *	The capture is what the ground uplink client recorded
+ *	(ground_station/uplink.py, record=): the bytes it sent ('U') and
+ *	the bytes it received ('G'), with their times. The uplink bytes are
+ *	sent again at their recorded times. The frames the ground received
+ *	are sorted into
+ *	  echo	  the same bytes as a packet the ground sent
+ *	  telem	  comms telemetry, beacons and status replies, which depend on
+ *		  the time and are only counted
+ *	  local	  the other replies of the comms MCU, ROUTER_ADDR_COMMS and
+ *		  ROUTER_ADDR_DIAG
+ *	  CDH	  everything else, data of the CDH
+ *	The CDH frames are fed to the comms MCU from the CDH side at their
+ *	recorded times less their line time, as the CDH sent them. What the
+ *	replayed firmware sends to the ground must then match the recording
+ *	class by class, in order; every frame that only one side has is
+ *	reported as a difference, and the exit status is 1 if there is any.
+ *
+ *	The CDH end feeds what the bridge passes on into the receive ring of
+ *	the CDH byte by byte, as its USART1 interrupt does, and runs
+ *	poll_packet() and parse_packet() on it. A command whose length the
+ *	CDH does not know, a packet that does not start with a header, a
+ *	parse that does not end on a packet boundary, bytes the CDH skips to
+ *	find the next head or loses are differences too: the CDH loses its
+ *	place in the stream there. The
+ *	replay stops at the parser; the CDH main loop, which acts on the
+ *	commands and sends the data, is not run, so what the CDH sends is
+ *	taken from the recording.
+ *
+ *	Time only runs byte by byte while something is on a line; idle
+ *	stretches between packets are skipped in 10 ms steps, so an hour of
+ *	pass replays in seconds.
+ *
+ *	usage: replay capture.cap
+ */
+
+#include "bridge.h"
+#include "router.h"
+#include "comms_cmd.h"
+#include "comms_stats.h"
+#include "tx_sched.h"
+#include "ringbuf.h"
+#include "uart_dma.h"
+#include "stm32f4xx_hal.h"
+#include "comms.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* 10 bits per byte on the line */
+#define BYTE_US (10 * 1e6 / 115200)
+#define MS_TO_TICKS(ms) ((uint64_t) ((ms) * 1000 / BYTE_US))
+#define TICKS_TO_MS(t) ((t) * BYTE_US / 1000)
+#define IDLE_STEP MS_TO_TICKS (10)
+#define DRAIN_MS 3000
+#define RESYNC_MS 100
+#define HASH_LEN 4096
+#define MAX_DIFFS_SHOWN 20
+
+typedef enum
+{
+  CLS_ECHO = 0,
+  CLS_TELEM,
+  CLS_LOCAL,
+  CLS_CDH,
+  CLS_NUM
+} frame_cls_t;
+
+static const char *cls_name[CLS_NUM] = { "echo", "telem", "local", "CDH" };
+
+/* A packet or frame with its size byte, [size][size bytes]; what the
+ * ground sends is [size][seq][packet] (bridge.h) */
+typedef struct
+{
+  uint64_t tick;
+  const uint8_t *data;
+  size_t len;
+  uint32_t hash;
+  int next;			/* the next one with the same hash */
+  uint32_t cdh_hash;		/* of the packet alone, as the CDH gets it */
+  int cdh_next;
+  uint8_t echoed;		/* in the recording */
+  uint8_t replay_echoed;
+  uint8_t at_cdh;
+} pkt_t;
+
+typedef struct
+{
+  pkt_t *p;
+  size_t n;
+  size_t size;
+} pkt_list_t;
+
+/* One direction of a serial line, as in bench_bridge.c */
+typedef struct
+{
+  ringbuf_t tx;
+  uint8_t tx_mem[4096];
+  ringbuf_t rx;
+  uint8_t rx_mem[512];
+  uint64_t lost;
+  uint64_t bytes;
+} line_t;
+
+typedef struct
+{
+  line_t *from;
+  line_t *to;
+} port_t;
+
+/* Latency and volume of one stage */
+typedef struct
+{
+  uint32_t count;
+  uint64_t bytes;
+  double lat_sum;
+  double lat_max;
+} stage_t;
+
+static pkt_list_t up;		/* sent by the ground */
+static pkt_list_t rec[CLS_NUM];	/* received by the ground, recorded */
+static size_t rec_next[CLS_NUM];
+static int hash_head[HASH_LEN];
+static int cdh_hash_head[HASH_LEN];
+static line_t gnd_up, gnd_down, cdh_up, cdh_down;
+static uint64_t now;
+static uint32_t diffs[CLS_NUM];
+static uint32_t diffs_shown;
+static uint32_t replay_count[CLS_NUM];
+static stage_t st_echo, st_echo_rec, st_cdh, st_down;
+static uint32_t cdh_parsed, cdh_bad_start, cdh_unsized, cdh_misaligned,
+    cdh_stalls, cdh_not_receiving;
+
+extern UART_HandleTypeDef huart1;
+
+/* The lines stand in for the DMA ports; only their error counts are read */
+uart_dma_t uart_cdh, uart_gnd;
+
+static uint32_t
+fnv1a (const uint8_t *p, size_t len)
+{
+  uint32_t h = 2166136261u;
+  while (len--) {
+    h = (h ^ *p++) * 16777619u;
+  }
+  return h;
+}
+
+static pkt_t *
+pkt_add (pkt_list_t *l, uint64_t tick, const uint8_t *data, size_t len)
+{
+  pkt_t *p;
+
+  if (l->n == l->size) {
+    l->size = l->size ? 2 * l->size : 256;
+    l->p = realloc (l->p, l->size * sizeof(pkt_t));
+    if (!l->p) {
+      fprintf (stderr, "out of memory\n");
+      exit (2);
+    }
+  }
+  p = &l->p[l->n++];
+  memset (p, 0, sizeof(pkt_t));
+  p->tick = tick;
+  p->data = data;
+  p->len = len;
+  p->hash = fnv1a (data, len);
+  p->next = -1;
+  return p;
+}
+
+/**
+ * The first sent packet with the same bytes whose flag at \p off is clear,
+ * NULL if there is none
+ */
+static pkt_t *
+up_find (const uint8_t *data, size_t len, size_t off)
+{
+  uint32_t h = fnv1a (data, len);
+  int i;
+
+  for (i = hash_head[h % HASH_LEN]; i >= 0; i = up.p[i].next) {
+    pkt_t *p = &up.p[i];
+    if (p->hash == h && p->len == len && !memcmp (p->data, data, len)
+	&& !((uint8_t *) p)[off]) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * The first sent packet not yet seen by the CDH whose packet, without the
+ * size and sequence bytes, is \p data; NULL if there is none
+ */
+static pkt_t *
+up_find_cdh (const uint8_t *data, size_t len)
+{
+  uint32_t h = fnv1a (data, len);
+  int i;
+
+  for (i = cdh_hash_head[h % HASH_LEN]; i >= 0; i = up.p[i].cdh_next) {
+    pkt_t *p = &up.p[i];
+    if (p->cdh_hash == h && p->len == len + 2
+	&& !memcmp (p->data + 2, data, len) && !p->at_cdh) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+/* Appends the last sent packet to a hash chain, in time order */
+static void
+up_chain (int *heads, uint32_t h, size_t next_off)
+{
+  int *link = &heads[h % HASH_LEN];
+
+  while (*link >= 0) {
+    link = (int *) ((uint8_t *) &up.p[*link] + next_off);
+  }
+  *link = (int) (up.n - 1);
+}
+
+static void
+stage_add (stage_t *s, size_t bytes, double lat_ms)
+{
+  s->count++;
+  s->bytes += bytes;
+  s->lat_sum += lat_ms;
+  if (lat_ms > s->lat_max) {
+    s->lat_max = lat_ms;
+  }
+}
+
+static frame_cls_t
+classify (const uint8_t *f, size_t len, size_t echo_flag)
+{
+  uint8_t head, addr;
+
+  if (up_find (f, len, echo_flag)) {
+    return CLS_ECHO;
+  }
+  head = f[1];
+  addr = router_head_addr (head);
+  if (!router_head_valid (head) || len < 3
+      || (addr != ROUTER_ADDR_COMMS && addr != ROUTER_ADDR_DIAG)) {
+    return CLS_CDH;
+  }
+  if (addr == ROUTER_ADDR_COMMS && router_head_flag (head) && len >= 4
+      && (f[3] == COMMS_CMD_STATUS || f[3] == COMMS_CMD_TELEMETRY
+	  || f[3] == COMMS_CMD_BEACON)) {
+    return CLS_TELEM;
+  }
+  return CLS_LOCAL;
+}
+
+/* --- The capture ------------------------------------------------------ */
+
+/**
+ * Cuts a byte stream into [size][size bytes] frames. Bytes further apart
+ * than RESYNC_MS do not belong to one frame.
+ */
+typedef struct
+{
+  uint8_t buf[257];
+  size_t got;
+  uint64_t last;
+} framer_t;
+
+static size_t
+framer_feed (framer_t *f, uint8_t b, uint64_t tick)
+{
+  size_t need;
+
+  if (f->got && tick - f->last > MS_TO_TICKS (RESYNC_MS)) {
+    f->got = 0;
+  }
+  f->last = tick;
+  f->buf[f->got++] = b;
+  need = 1 + (f->buf[0] ? f->buf[0] : 256);
+  if (f->got < need) {
+    return 0;
+  }
+  f->got = 0;
+  return need;
+}
+
+static uint8_t *
+copy (const uint8_t *data, size_t len)
+{
+  uint8_t *p = malloc (len);
+  if (!p) {
+    fprintf (stderr, "out of memory\n");
+    exit (2);
+  }
+  memcpy (p, data, len);
+  return p;
+}
+
+static uint64_t
+load (const char *path)
+{
+  FILE *f = fopen (path, "rb");
+  uint8_t head[11];
+  uint8_t data[65536];
+  framer_t fu, fg;
+  double t, t0 = -1;
+  uint64_t tick = 0;
+  size_t len, i, n;
+  pkt_t *p;
+
+  if (!f) {
+    perror (path);
+    exit (2);
+  }
+  memset (&fu, 0, sizeof(fu));
+  memset (&fg, 0, sizeof(fg));
+  for (i = 0; i < HASH_LEN; i++) {
+    hash_head[i] = -1;
+    cdh_hash_head[i] = -1;
+  }
+  while (fread (head, 1, sizeof(head), f) == sizeof(head)) {
+    memcpy (&t, head, 8);
+    len = head[9] | (head[10] << 8);
+    if (fread (data, 1, len, f) != len) {
+      break;
+    }
+    if (t0 < 0) {
+      t0 = t;
+    }
+    /* a second of slack for the CDH frames fed before their time */
+    tick = MS_TO_TICKS ((t - t0) * 1000 + 1000);
+    for (i = 0; i < len; i++) {
+      if (head[8] == 'U' && (n = framer_feed (&fu, data[i], tick))) {
+	p = pkt_add (&up, tick, copy (fu.buf, n), n);
+	p->cdh_hash = n >= 2 ? fnv1a (p->data + 2, n - 2) : 0;
+	p->cdh_next = -1;
+	up_chain (hash_head, p->hash, offsetof(pkt_t, next));
+	up_chain (cdh_hash_head, p->cdh_hash, offsetof(pkt_t, cdh_next));
+      }
+      else if (head[8] == 'G' && (n = framer_feed (&fg, data[i], tick))) {
+	frame_cls_t c = classify (fg.buf, n, offsetof(pkt_t, echoed));
+	if (c == CLS_ECHO) {
+	  p = up_find (fg.buf, n, offsetof(pkt_t, echoed));
+	  p->echoed = 1;
+	  stage_add (&st_echo_rec, n, TICKS_TO_MS (tick - p->tick));
+	}
+	pkt_add (&rec[c], tick, copy (fg.buf, n), n);
+      }
+    }
+  }
+  fclose (f);
+  return tick;
+}
+
+/* --- The lines and the end points ------------------------------------- */
+
+static void
+line_init (line_t *l)
+{
+  memset (l, 0, sizeof(line_t));
+  ringbuf_init (&l->tx, l->tx_mem, sizeof(l->tx_mem));
+  ringbuf_init (&l->rx, l->rx_mem, sizeof(l->rx_mem));
+}
+
+/**
+ * Moves one byte along the wire
+ * @return the byte plus 1, or 0 if the line was idle
+ */
+static int
+line_tick (line_t *l)
+{
+  uint8_t b;
+
+  if (!ringbuf_read (&l->tx, &b, 1)) {
+    return 0;
+  }
+  l->bytes++;
+  if (!ringbuf_write (&l->rx, &b, 1)) {
+    l->lost++;
+  }
+  return b + 1;
+}
+
+static size_t
+port_read (void *priv, uint8_t *buf, size_t len)
+{
+  return ringbuf_read (&((port_t *) priv)->from->rx, buf, len);
+}
+
+static int32_t
+port_write (void *priv, const uint8_t *data, size_t len)
+{
+  ringbuf_t *tx = &((port_t *) priv)->to->tx;
+  if (ringbuf_room (tx) < len) {
+    return -1;
+  }
+  ringbuf_write (tx, data, len);
+  return 0;
+}
+
+static size_t
+port_pending (void *priv)
+{
+  return ringbuf_used (&((port_t *) priv)->to->tx);
+}
+
+static void
+diff (frame_cls_t c, const char *what, const pkt_t *p)
+{
+  size_t i;
+
+  diffs[c]++;
+  if (diffs_shown++ >= MAX_DIFFS_SHOWN) {
+    return;
+  }
+  printf ("  %10.3f s  %-5s %-13s", TICKS_TO_MS (p->tick) / 1000 - 1,
+	  cls_name[c], what);
+  for (i = 0; i < p->len && i < 16; i++) {
+    printf (" %02x", p->data[i]);
+  }
+  printf ("%s\n", p->len > 16 ? " ..." : "");
+}
+
+/**
+ * A frame the replayed firmware sent to the ground, checked against the
+ * next recorded one of its class. A recorded frame that turns up a few
+ * frames later means the ones before it were not replayed.
+ */
+static void
+gnd_frame (const uint8_t *f, size_t len)
+{
+  frame_cls_t c = classify (f, len, offsetof(pkt_t, replay_echoed));
+  pkt_list_t *l = &rec[c];
+  pkt_t got = { now, f, len, 0, -1, 0, 0, 0 };
+  pkt_t *p;
+  size_t k;
+
+  replay_count[c]++;
+  if (c == CLS_ECHO) {
+    p = up_find (f, len, offsetof(pkt_t, replay_echoed));
+    p->replay_echoed = 1;
+    stage_add (&st_echo, len, TICKS_TO_MS (now - p->tick));
+  }
+  else if (c == CLS_CDH) {
+    stage_add (&st_down, len, 0);
+  }
+  if (c == CLS_TELEM) {
+    return;
+  }
+  for (k = rec_next[c]; k < l->n && k < rec_next[c] + 8; k++) {
+    if (l->p[k].len == len && !memcmp (l->p[k].data, f, len)) {
+      break;
+    }
+  }
+  if (k == l->n || k == rec_next[c] + 8) {
+    diff (c, "replay only", &got);
+    return;
+  }
+  if (c == CLS_CDH) {
+    st_down.lat_sum += TICKS_TO_MS (now - l->p[k].tick);
+    if (TICKS_TO_MS (now - l->p[k].tick) > st_down.lat_max) {
+      st_down.lat_max = TICKS_TO_MS (now - l->p[k].tick);
+    }
+  }
+  for (; rec_next[c] < k; rec_next[c]++) {
+    diff (c, "recorded only", &l->p[rec_next[c]]);
+  }
+  rec_next[c] = k + 1;
+}
+
+static void
+gnd_byte (uint8_t b)
+{
+  static framer_t fr;
+  size_t n = framer_feed (&fr, b, now);
+
+  if (n) {
+    gnd_frame (fr.buf, n);
+  }
+}
+
+/* The CDH end: the receive ring, poll_packet() and parse_packet() of
+ * cdh_firmware, fed byte by byte as the USART1 interrupt does */
+
+static void
+cdh_receive (void *arg)
+{
+  static const uint8_t cmd_len[2][4] = { { 0, 0, 0, 0 }, { 8, 1, 2, 4 } };
+  uint8_t pkt[PACKET_SIZE];
+  uint8_t data[PACKET_SIZE];
+  uint8_t adr, flg, len_cmd;
+  size_t need;
+  pkt_t *p;
+
+  (void) arg;
+  while (poll_packet (pkt, 0)) {
+    cdh_parsed++;
+    if (!parse_packet (pkt, &adr, &flg, &len_cmd, data)) {
+      cdh_bad_start++;
+    }
+    /* The lengths poll_packet() knows */
+    if (router_head_flag (pkt[0])) {
+      need = 2 + pkt[1];
+    }
+    else if (router_head_addr (pkt[0]) <= 1 && pkt[1] <= 3) {
+      need = 2 + cmd_len[router_head_addr (pkt[0])][pkt[1]];
+    }
+    else {
+      /* Not in its table: the CDH takes the two bytes alone */
+      cdh_unsized++;
+      need = 2;
+    }
+    /* Was it one whole packet of the ground? */
+    p = up_find_cdh (pkt, need);
+    if (p) {
+      p->at_cdh = 1;
+      stage_add (&st_cdh, need, TICKS_TO_MS (now - p->tick));
+    }
+    else {
+      cdh_misaligned++;
+    }
+  }
+}
+
+static void
+cdh_byte (uint8_t b)
+{
+  if (hal_shim_uart_rx (&huart1, b)) {
+    cdh_not_receiving++;
+  }
+}
+
+static void
+cdh_poll (void)
+{
+  if (hal_shim_call (cdh_receive, NULL)) {
+    cdh_stalls++;
+  }
+}
+
+/* --------------------------------------------------------------------- */
+
+static void
+print_stage (const char *name, const stage_t *s, double seconds)
+{
+  printf ("  %-22s %6u frames %9.1f B/s  latency avg %7.1f ms max %7.1f ms\n",
+	  name, s->count, s->bytes / seconds,
+	  s->count ? s->lat_sum / s->count : 0, s->lat_max);
+}
+
+static void
+print_hist (const char *name, comms_lat_t lat, const comms_counters_t *c)
+{
+  int b;
+
+  printf ("  %-9s", name);
+  for (b = 0; b < COMMS_STATS_HIST_BUCKETS; b++) {
+    if (c->lat[lat][b]) {
+      printf (" <%ums %u", 1u << b, c->lat[lat][b]);
+    }
+  }
+  printf ("\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  static bridge_t b;
+  static router_t router;
+  static tx_sched_t sched;
+  static port_t gnd_port = { &gnd_up, &gnd_down };
+  static port_t cdh_port = { &cdh_up, &cdh_down };
+  static comms_counters_t total;
+  const bridge_port_t gnd = { port_read, port_write, &gnd_port };
+  const bridge_port_t cdh = { port_read, port_write, &cdh_port };
+  const tx_sink_t sink = { port_write, port_pending, comms_cmd_beacon,
+			   &gnd_port };
+  size_t next_up = 0, next_cdh = 0, i;
+  uint64_t end, busy;
+  uint32_t d = 0, cdh_lost;
+  clock_t wall;
+  double seconds;
+  int v, c, l;
+
+  if (argc != 2) {
+    fprintf (stderr, "usage: replay capture.cap\n");
+    return 2;
+  }
+  end = load (argv[1]) + MS_TO_TICKS (DRAIN_MS);
+  printf ("%s: %zu packets sent, %zu echoes, %zu telemetry, %zu local "
+	  "replies and %zu CDH frames received\n", argv[1], up.n,
+	  rec[CLS_ECHO].n, rec[CLS_TELEM].n, rec[CLS_LOCAL].n, rec[CLS_CDH].n);
+
+  line_init (&gnd_up);
+  line_init (&gnd_down);
+  line_init (&cdh_up);
+  line_init (&cdh_down);
+  hal_shim_ms = 0;
+  router_init (&router, comms_routes);
+  comms_cmd_init (&router);
+  tx_sched_init (&sched, &sink, COMMS_LINK_GND, 0);
+  bridge_init (&b, &gnd, &cdh, &router, &sched);
+  comms_rx_start ();
+
+  printf ("differences:\n");
+  wall = clock ();
+  for (now = 0; now < end;) {
+    /* The recorded ground and the CDH send at their times */
+    while (next_up < up.n && up.p[next_up].tick <= now
+	   && port_write (&(port_t) { NULL, &gnd_up }, up.p[next_up].data,
+			  up.p[next_up].len) == 0) {
+      up.p[next_up++].tick = now;
+    }
+    while (next_cdh < rec[CLS_CDH].n
+	   && rec[CLS_CDH].p[next_cdh].tick
+	       <= now + rec[CLS_CDH].p[next_cdh].len
+	   && port_write (&(port_t) { NULL, &cdh_up },
+			  rec[CLS_CDH].p[next_cdh].data + 1,
+			  rec[CLS_CDH].p[next_cdh].len - 1) == 0) {
+      next_cdh++;
+    }
+
+    hal_shim_ms = (uint32_t) TICKS_TO_MS (now);
+    busy = bridge_poll (&b, hal_shim_ms);
+    comms_cmd_poll (&b, hal_shim_ms);
+
+    busy |= line_tick (&gnd_up) | line_tick (&cdh_up);
+    if ((v = line_tick (&gnd_down))) {
+      gnd_byte (v - 1);
+      ringbuf_skip (&gnd_down.rx, 1);
+      busy = 1;
+    }
+    if ((v = line_tick (&cdh_down))) {
+      cdh_byte (v - 1);
+      ringbuf_skip (&cdh_down.rx, 1);
+      busy = 1;
+    }
+    cdh_poll ();
+    if (busy || ringbuf_used (&gnd_up.rx) || ringbuf_used (&cdh_up.rx)) {
+      now++;
+    }
+    else {
+      /* Idle: on to the next packet, polling now and then */
+      uint64_t next = now + IDLE_STEP;
+      if (next_up < up.n && up.p[next_up].tick < next) {
+	next = up.p[next_up].tick > now ? up.p[next_up].tick : now + 1;
+      }
+      now = next;
+    }
+  }
+  seconds = TICKS_TO_MS (now) / 1000;
+  wall = clock () - wall;
+
+  /* What the ground recorded and the firmware did not send */
+  for (c = 0; c < CLS_NUM; c++) {
+    if (c == CLS_TELEM) {
+      continue;
+    }
+    for (i = rec_next[c]; i < rec[c].n; i++) {
+      diff (c, "recorded only", &rec[c].p[i]);
+    }
+  }
+  if (diffs_shown > MAX_DIFFS_SHOWN) {
+    printf ("  ... %u more\n", diffs_shown - MAX_DIFFS_SHOWN);
+  }
+  for (c = 0; c < CLS_NUM; c++) {
+    d += diffs[c];
+  }
+  /* Where the CDH lost its place in the uplink */
+  cdh_lost = cdh_bad_start + cdh_unsized + cdh_misaligned + cdh_stalls
+      + cdh_not_receiving + commsRxSkipped + commsRxOverruns;
+  d += cdh_lost;
+  if (!d) {
+    printf ("  none\n");
+  }
+  else if (cdh_lost) {
+    printf ("  the CDH parser lost its place in the uplink, see below\n");
+  }
+  printf ("frames by class, recorded / replayed / differences:\n ");
+  for (c = 0; c < CLS_NUM; c++) {
+    printf (" %s %zu / %u / %u%s", cls_name[c], rec[c].n, replay_count[c],
+	    diffs[c], c == CLS_TELEM ? " (not compared)" : "");
+  }
+  printf ("\n");
+
+  printf ("%.1f s of pass replayed in %.2f s, %.0fx real time\n", seconds,
+	  (double) wall / CLOCKS_PER_SEC,
+	  seconds / ((double) wall / CLOCKS_PER_SEC + 1e-9));
+  printf ("stages:\n");
+  print_stage ("ground -> echo (pass)", &st_echo_rec, seconds);
+  print_stage ("ground -> echo", &st_echo, seconds);
+  print_stage ("ground -> CDH parsed", &st_cdh, seconds);
+  print_stage ("CDH -> ground", &st_down, seconds);
+  printf ("  lines: ground up %.1f%%, down %.1f%%, CDH up %.1f%%, down "
+	  "%.1f%% busy; bytes lost %lu\n",
+	  100.0 * gnd_up.bytes / now, 100.0 * gnd_down.bytes / now,
+	  100.0 * cdh_up.bytes / now, 100.0 * cdh_down.bytes / now,
+	  (unsigned long) (gnd_up.lost + gnd_down.lost + cdh_up.lost
+	      + cdh_down.lost));
+  printf ("CDH parser: %u packets, %u bad start, %u of unknown length, %u "
+	  "not on a packet boundary, %u stalls; bytes skipped %lu, lost %lu\n",
+	  cdh_parsed, cdh_bad_start, cdh_unsized, cdh_misaligned, cdh_stalls,
+	  (unsigned long) commsRxSkipped,
+	  (unsigned long) (commsRxOverruns + cdh_not_receiving));
+
+  /* The firmware latency histograms, all periods together */
+  total = comms_stats.now;
+  for (l = 0; l < COMMS_LAT_NUM; l++) {
+    for (v = 0; v < COMMS_STATS_HIST_BUCKETS; v++) {
+      total.lat[l][v] += comms_stats.sent.lat[l][v];
+    }
+  }
+  printf ("comms latency histograms (comms_stats.h, since the last "
+	  "telemetry frame):\n");
+  print_hist ("uplink", COMMS_LAT_UPLINK, &comms_stats.now);
+  print_hist ("downlink", COMMS_LAT_DOWNLINK, &comms_stats.now);
+  print_hist ("local", COMMS_LAT_LOCAL, &comms_stats.now);
+  return d ? 1 : 0;
+}